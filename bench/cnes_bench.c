@@ -0,0 +1,322 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "cNES/bus.h"
+#include "cNES/cpu.h"
+#include "cNES/nes.h"
+#include "cNES/ppu.h"
+
+// Throughput of the emulator's parts, for tracking performance from commit to
+// commit. Every benchmark is repeated and reported as min/median/p99 of the
+// per-repetition samples, as JSON on stdout:
+//
+//   { "build_type": "Release", "cpu_core": "interpreter", "reps": 5, "frames": 300, "benchmarks": [
+//     { "name": "...", "unit": "...", "samples": 5, "min": ..., "median": ..., "p99": ... }, ... ] }
+//
+// usage: cnes_bench [--reps n] [--frames n] [--tests dir] [--recompiler]
+//
+// The ROMs and 6502_functional_test.bin are read from the tests directory.
+// --recompiler runs the ROMs through CPU_SetRecompiler's translated blocks. The
+// functional test runs from RAM, which is always interpreted.
+
+#define BENCH_DEFAULT_REPS   5
+#define BENCH_DEFAULT_FRAMES 300
+#define BENCH_COST_BATCH     100 // Operations timed together for one cost sample
+#define BENCH_COST_SAMPLES   100 // Cost samples per repetition
+
+#define BENCH_FUNCTIONAL_START   0x0400 // Entry point of 6502_functional_test.bin
+#define BENCH_FUNCTIONAL_TRAP    0x3477 // Decimal ADC check, the first test a 2A03 fails
+
+#define BENCH_DOTS_PER_FRAME (341 * 262)
+
+static const char *bench_roms[] = {
+    "nestest.nes",
+    "color_test.nes",
+    "blargg_ppu_tests/palette_ram.nes",
+    "blargg_ppu_tests/power_up_palette.nes",
+    "blargg_ppu_tests/sprite_ram.nes",
+    "blargg_ppu_tests/vbl_clear_time.nes",
+    "blargg_ppu_tests/vram_access.nes",
+};
+
+static int bench_reported = 0;
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static int compare_doubles(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+// Prints one benchmark, samples are sorted in place
+static void report(const char *name, const char *unit, double *samples, int count)
+{
+    if (count <= 0)
+        return;
+
+    qsort(samples, (size_t)count, sizeof(double), compare_doubles);
+    double median = (count & 1) ? samples[count / 2] : (samples[count / 2 - 1] + samples[count / 2]) / 2;
+    int p99 = (count * 99 + 99) / 100 - 1; // Nearest rank
+
+    printf("%s\n    { \"name\": \"%s\", \"unit\": \"%s\", \"samples\": %d, \"min\": %.6g, \"median\": %.6g, \"p99\": %.6g }",
+           bench_reported++ ? "," : "", name, unit, count, samples[0], median, samples[p99]);
+}
+
+static uint8_t *read_file(const char *path, size_t *size)
+{
+    FILE *file = fopen(path, "rb");
+    if (!file)
+        return NULL;
+
+    uint8_t *data = NULL;
+    long length = -1;
+    if (fseek(file, 0, SEEK_END) == 0)
+        length = ftell(file);
+    if (length > 0 && fseek(file, 0, SEEK_SET) == 0 && (data = malloc((size_t)length)))
+    {
+        if (fread(data, 1, (size_t)length, file) != (size_t)length)
+        {
+            free(data);
+            data = NULL;
+        }
+    }
+
+    fclose(file);
+    *size = (size_t)length;
+    return data;
+}
+
+static bool bench_recompiler;
+
+static NES *load_rom(const char *dir, const char *name)
+{
+    char path[1024];
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+
+    NES *nes = NES_Create();
+    if (nes && (NES_Load(path, nes) || (bench_recompiler && CPU_SetRecompiler(nes->cpu, true))))
+    {
+        NES_Destroy(nes);
+        return NULL;
+    }
+    return nes;
+}
+
+// CPU alone: the functional test runs from RAM with all 64KB mapped flat. The
+// stack goes straight to bus->ram, so that backs the first 2KB of the flat RAM.
+// The workload is everything up to the first trap. The 2A03 has no decimal mode,
+// so the run ends in the decimal checks just before the success trap.
+static void bench_cpu(const char *dir, int reps)
+{
+    char path[1024];
+    size_t size = 0;
+    snprintf(path, sizeof(path), "%s/6502_functional_test.bin", dir);
+    uint8_t *image = read_file(path, &size);
+    NES *nes = NES_Create();
+    uint8_t *flat = malloc(0x10000);
+    double *samples = calloc((size_t)reps, sizeof(double));
+    if (!image || size != 0x10000 || !nes || !flat || !samples)
+    {
+        fprintf(stderr, "cpu: could not set up %s\n", path);
+        goto cleanup;
+    }
+
+    BUS_MapPages(nes->bus, 0x00, 0x08, nes->bus->ram, nes->bus->ram);
+    BUS_MapPages(nes->bus, 0x08, BUS_PAGE_COUNT - 0x08, flat + 0x800, flat + 0x800);
+    CPU *cpu = nes->cpu;
+
+    uint64_t instructions = 0;
+    for (int rep = 0; rep < reps; rep++)
+    {
+        memcpy(nes->bus->ram, image, sizeof(nes->bus->ram));
+        memcpy(flat, image, 0x10000);
+        CPU_Reset(cpu);
+        cpu->pc = BENCH_FUNCTIONAL_START;
+
+        // Runs until the test traps itself in a jump or branch to its own address
+        uint16_t pc;
+        instructions = 0;
+        double start = now();
+        do
+        {
+            pc = cpu->pc;
+            if (CPU_Step(cpu) < 0)
+                break;
+            instructions++;
+        } while (cpu->pc != pc);
+        samples[rep] = (double)instructions / (now() - start);
+    }
+
+    if (cpu->pc != BENCH_FUNCTIONAL_TRAP)
+        fprintf(stderr, "cpu: functional test stopped at $%04X after %llu instructions\n", cpu->pc, (unsigned long long)instructions);
+    report("cpu_functional_test", "instructions/s", samples, reps);
+
+cleanup:
+    free(samples);
+    free(flat);
+    NES_Destroy(nes);
+    free(image);
+}
+
+// PPU alone over a frame of nestest's screen, with PPUMASK forcing rendering on or off
+static void bench_ppu(const char *dir, int reps, int frames)
+{
+    NES *nes = load_rom(dir, "nestest.nes");
+    double *samples = calloc((size_t)reps, sizeof(double));
+    if (!nes || !samples)
+    {
+        fprintf(stderr, "ppu: could not load nestest.nes\n");
+        goto cleanup;
+    }
+
+    for (int frame = 0; frame < 60; frame++)
+        NES_StepFrame(nes);
+
+    for (int rendering = 1; rendering >= 0; rendering--)
+    {
+        PPU_WriteRegister(nes->ppu, 0x2000, 0x00); // No NMI, the CPU isn't running
+        PPU_WriteRegister(nes->ppu, 0x2001, rendering ? 0x1E : 0x00);
+
+        for (int rep = 0; rep < reps; rep++)
+        {
+            uint64_t dots = (uint64_t)frames * BENCH_DOTS_PER_FRAME;
+            double start = now();
+            PPU_CatchUp(nes->ppu, nes->ppu->clock + dots);
+            samples[rep] = (double)dots / (now() - start);
+        }
+
+        report(rendering ? "ppu_rendering_on" : "ppu_rendering_off", "dots/s", samples, reps);
+    }
+
+cleanup:
+    free(samples);
+    NES_Destroy(nes);
+}
+
+// Whole system from power on
+static void bench_system(const char *dir, int reps, int frames)
+{
+    double *samples = calloc((size_t)reps, sizeof(double));
+    if (!samples)
+        return;
+
+    for (size_t i = 0; i < sizeof(bench_roms) / sizeof(bench_roms[0]); i++)
+    {
+        int count = 0;
+        for (int rep = 0; rep < reps; rep++)
+        {
+            NES *nes = load_rom(dir, bench_roms[i]);
+            if (!nes)
+            {
+                fprintf(stderr, "system: could not load %s\n", bench_roms[i]);
+                break;
+            }
+
+            double start = now();
+            for (int frame = 0; frame < frames; frame++)
+                NES_StepFrame(nes);
+            samples[count++] = frames / (now() - start);
+
+            NES_Destroy(nes);
+        }
+
+        char name[256];
+        snprintf(name, sizeof(name), "system_%s", bench_roms[i]);
+        report(name, "frames/s", samples, count);
+    }
+
+    free(samples);
+}
+
+// Per call costs of save states and the frame hash, on nestest after a second of play
+static void bench_costs(const char *dir, int reps)
+{
+    int count = reps * BENCH_COST_SAMPLES;
+    NES *nes = load_rom(dir, "nestest.nes");
+    double *samples = calloc((size_t)count, sizeof(double));
+    size_t state_size = nes ? NES_GetStateSize(nes) : 0;
+    uint8_t *state = nes ? malloc(state_size) : NULL;
+    if (!nes || !samples || !state)
+    {
+        fprintf(stderr, "costs: could not load nestest.nes\n");
+        goto cleanup;
+    }
+
+    for (int frame = 0; frame < 60; frame++)
+        NES_StepFrame(nes);
+
+    volatile uint64_t sink = 0; // Keeps the hashes from being optimised out
+    for (int bench = 0; bench < 3; bench++)
+    {
+        for (int sample = 0; sample < count; sample++)
+        {
+            double start = now();
+            for (int i = 0; i < BENCH_COST_BATCH; i++)
+            {
+                if (bench == 0)
+                    NES_SaveState(nes, state, state_size);
+                else if (bench == 1)
+                    NES_LoadState(nes, state, state_size);
+                else
+                    sink ^= NES_HashFrame(nes);
+            }
+            samples[sample] = (now() - start) * 1e9 / BENCH_COST_BATCH;
+        }
+
+        static const char *names[] = { "save_state", "load_state", "frame_hash" };
+        report(names[bench], "ns", samples, count);
+    }
+    (void)sink;
+
+cleanup:
+    free(state);
+    free(samples);
+    NES_Destroy(nes);
+}
+
+int main(int argc, char **argv)
+{
+    int reps = BENCH_DEFAULT_REPS;
+    int frames = BENCH_DEFAULT_FRAMES;
+    const char *dir = "tests";
+
+    for (int i = 1; i < argc; i++)
+    {
+        const char *value = (i + 1 < argc) ? argv[i + 1] : NULL;
+        if (!strcmp(argv[i], "--reps") && value)
+            reps = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--frames") && value)
+            frames = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--tests") && value)
+            dir = argv[++i];
+        else if (!strcmp(argv[i], "--recompiler"))
+            bench_recompiler = true;
+        else
+            reps = 0;
+    }
+    if (reps <= 0 || frames <= 0)
+    {
+        fprintf(stderr, "usage: %s [--reps n] [--frames n] [--tests dir] [--recompiler]\n", argv[0]);
+        return 2;
+    }
+
+    // Numbers from different build types can't be compared, so the type goes with them
+    printf("{\n  \"build_type\": \"%s\",\n  \"cpu_core\": \"%s\",\n  \"reps\": %d,\n  \"frames\": %d,\n  \"benchmarks\": [",
+           CNES_BENCH_BUILD_TYPE, bench_recompiler ? "recompiler" : "interpreter", reps, frames);
+    bench_cpu(dir, reps);
+    bench_ppu(dir, reps, frames);
+    bench_system(dir, reps, frames);
+    bench_costs(dir, reps);
+    printf("\n  ]\n}\n");
+
+    return bench_reported ? 0 : 1;
+}
@@ -0,0 +1,136 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "cNES/rom.h"
+#include "cNES/runner.h"
+
+// Runs the same batch of jobs with 1, 2, 4... threads up to the CPU count and
+// reports throughput and speedup. Every job gets its own input stream, results
+// must not change with the thread count.
+//
+// usage: runner_bench <rom.nes> [jobs] [frames] [max threads]
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "usage: %s <rom.nes> [jobs] [frames] [max threads]\n", argv[0]);
+        return 2;
+    }
+
+    int job_count = argc > 2 ? atoi(argv[2]) : 64;
+    int frames = argc > 3 ? atoi(argv[3]) : 300;
+    int max_threads = argc > 4 ? atoi(argv[4]) : 0;
+    if (job_count <= 0 || frames <= 0)
+    {
+        fprintf(stderr, "jobs and frames must be positive\n");
+        return 2;
+    }
+
+    // Loaded once, every job's NES attaches the same image
+    ROM *rom = ROM_Load(argv[1]);
+    if (!rom)
+    {
+        fprintf(stderr, "could not load %s\n", argv[1]);
+        return 1;
+    }
+
+    // Random button presses, one stream per job
+    uint8_t *input = malloc((size_t)job_count * (size_t)frames * 2);
+    RUNNER_Job *jobs = calloc((size_t)job_count, sizeof(RUNNER_Job));
+    uint64_t *expected = calloc((size_t)job_count, sizeof(uint64_t));
+    if (!input || !jobs || !expected)
+        return 1;
+
+    uint32_t seed = 0x2545F491;
+    for (size_t i = 0; i < (size_t)job_count * (size_t)frames * 2; i++)
+    {
+        seed ^= seed << 13;
+        seed ^= seed >> 17;
+        seed ^= seed << 5;
+        input[i] = (i & 1) ? 0 : (uint8_t)seed;
+    }
+
+    if (max_threads <= 0)
+    {
+        RUNNER *probe = RUNNER_Create(0);
+        if (!probe)
+            return 1;
+        max_threads = RUNNER_GetThreadCount(probe);
+        RUNNER_Destroy(probe);
+    }
+
+    printf("%d jobs x %d frames\n", job_count, frames);
+    printf("%8s %10s %12s %12s %8s\n", "threads", "seconds", "jobs/s", "frames/s", "speedup");
+
+    double base_seconds = 0;
+    int result = 0;
+    for (int threads = 1; ; threads *= 2)
+    {
+        if (threads > max_threads)
+            threads = max_threads;
+
+        RUNNER *runner = RUNNER_Create(threads);
+        if (!runner)
+            return 1;
+
+        for (int i = 0; i < job_count; i++)
+        {
+            jobs[i] = (RUNNER_Job){
+                .rom = rom,
+                .input = &input[(size_t)i * (size_t)frames * 2],
+                .input_frames = (size_t)frames,
+                .frames = frames,
+            };
+        }
+
+        double start = now();
+        int failed = RUNNER_Run(runner, jobs, (size_t)job_count);
+        double seconds = now() - start;
+        RUNNER_Destroy(runner);
+
+        if (failed)
+        {
+            fprintf(stderr, "%d jobs failed\n", failed);
+            return 1;
+        }
+
+        int mismatches = 0;
+        for (int i = 0; i < job_count; i++)
+        {
+            uint64_t hash = jobs[i].frame_hash ^ jobs[i].ram_hash ^ jobs[i].cycles;
+            if (threads == 1)
+                expected[i] = hash;
+            else if (expected[i] != hash)
+                mismatches++;
+        }
+        if (mismatches)
+        {
+            fprintf(stderr, "%d jobs gave different results with %d threads\n", mismatches, threads);
+            result = 1;
+        }
+
+        if (threads == 1)
+            base_seconds = seconds;
+        printf("%8d %10.3f %12.1f %12.0f %7.2fx\n", threads, seconds, job_count / seconds,
+               (double)job_count * frames / seconds, base_seconds / seconds);
+
+        if (threads == max_threads)
+            break;
+    }
+
+    free(expected);
+    free(jobs);
+    free(input);
+    ROM_Release(rom);
+    return result;
+}
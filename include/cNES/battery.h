@@ -0,0 +1,24 @@
+#ifndef BATTERY_H
+#define BATTERY_H
+
+typedef struct NES NES;
+typedef struct BATTERY BATTERY;
+
+// Battery backed PRG RAM kept in a .sav file that is mapped into memory. The
+// game runs on the PRG RAM in the BUS as usual, writes to $6000-$7FFF go through
+// a handler that marks their 4KB page dirty. BATTERY_Flush copies the dirty pages
+// that actually changed into the mapping and has the OS write just those back,
+// so there is no syscall per write and the file is never rewritten whole.
+#define BATTERY_PAGE_SIZE 0x1000
+
+BATTERY *BATTERY_Open(NES *nes, const char *path); // Loads the file into PRG RAM, a new file starts zeroed. NULL if it can't be mapped
+void BATTERY_Flush(BATTERY *battery); // Cheap when nothing was written, NES_StepFrame calls it every frame
+void BATTERY_Close(BATTERY *battery);
+
+// A movie starts from its own PRG RAM and must not leave it in the save. Suspend
+// writes back what is pending and stops writing back, Resume loads the save into
+// PRG RAM again. Movies call these themselves, NULL is ignored
+void BATTERY_Suspend(BATTERY *battery);
+void BATTERY_Resume(BATTERY *battery); // Copies the save back over what the movie wrote, clears the dirty pages and remaps $6000-$7FFF through BATTERY_Write
+
+#endif // BATTERY_H
@@ -3,21 +3,61 @@
 
 #include <stdint.h>
 #include <stddef.h>
+#include <stdatomic.h>
+
+#include "cNES/mapper.h"
 
 typedef struct NES NES;
 
+#define BUS_PAGE_COUNT 0x100 // 256 byte pages in the CPU address space
+#define BUS_CHR_SLOT_SIZE 0x400 // PPU pattern tables are mapped in 1KB slots
+#define BUS_CHR_SLOT_COUNT 8
+
+// Handlers for pages that can't be read or written as plain memory (PPU and APU/IO registers)
+typedef uint8_t (*BUS_ReadHandler)(NES* nes, uint16_t address);
+typedef void (*BUS_WriteHandler)(NES* nes, uint16_t address, uint8_t value);
+
 typedef struct BUS {
-    uint8_t memory[0x10000]; // 64KB address map
-    uint8_t prgRom[0x8000];  // 32KB PRG ROM
-    uint8_t chrRom[0x2000];  // 8KB CHR ROM
-    uint8_t vram[0x1000];    // 4KB VRAM for nametables (mirrored)
-    uint8_t palette[0x20];   // 32 bytes palette RAM
+    // CPU memory map, one entry per page. A page either points at host memory
+    // or is NULL and goes through the handler for that page.
+    uint8_t *read_pages[BUS_PAGE_COUNT];
+    uint8_t *write_pages[BUS_PAGE_COUNT];
+    uint8_t ram[0x800];      // 2KB internal RAM, mirrored up to $1FFF
+    BUS_ReadHandler read_handlers[BUS_PAGE_COUNT];
+    BUS_WriteHandler write_handlers[BUS_PAGE_COUNT];
+
+    // Where the decoded instructions of each page at $8000-$FFFF are in the ROM's
+    // decode_banks, so the CPU finds them without working out the ROM offset. NULL
+    // until code runs on the page, remapping its reads clears it again
+    _Atomic(uint32_t) *decode_pages[BUS_PAGE_COUNT / 2];
+
+    // Cartridge memory at the sizes the iNES header gives, mappers point
+    // read_pages at $8000-$FFFF and chr_pages into these to switch banks
+    uint8_t *chr_pages[BUS_CHR_SLOT_COUNT];    // PPU $0000-$1FFF
+    uint8_t *prg_rom;                          // Inside the shared ROM, read only
+    size_t prg_rom_size;
+    uint8_t *chr;                              // CHR ROM inside the shared ROM, or chr_ram
+    size_t chr_size;
+    MAPPER_State mapper_state;
+    BUS_WriteHandler prg_ram_write; // Takes writes to PRG RAM the mapper allows, NULL writes it as plain memory
+
     uint8_t mapper;          // Mapper type
-    uint8_t mirroring;       // Mirroring type
+    uint8_t mirroring;       // Mirroring type from the header (0: horizontal, 1: vertical)
     uint8_t prgRomSize;      // PRG ROM size in 16KB units
     uint8_t chrRomSize;      // CHR ROM size in 8KB units
+    uint8_t prg_ram_dirty;   // PRG RAM pages written since the battery file last saw them, one bit per 4KB
+
+    uint8_t prg_ram[0x2000]; // 8KB PRG RAM at $6000-$7FFF
+    uint8_t chr_ram[0x2000]; // 8KB CHR RAM, only mapped when the cart has no CHR ROM
+    uint8_t open_bus[0x100]; // Backs unmapped reads
+    uint8_t discard[0x100];  // Backs writes that go nowhere (ROM, unmapped)
 } BUS;
 
+// Memory map setup
+void BUS_Init(BUS* bus); // Maps internal RAM, registers and PRG RAM, $8000-$FFFF stays unmapped until a mapper takes it
+void BUS_MapPages(BUS* bus, uint8_t first_page, int count, uint8_t *read, uint8_t *write); // NULL leaves that side as it is
+void BUS_MapHandlers(BUS* bus, uint8_t first_page, int count, BUS_ReadHandler read, BUS_WriteHandler write);
+
 // IO functions
 uint8_t BUS_Read(NES* nes, uint16_t address);
 void BUS_Write(NES* nes, uint16_t address, uint8_t value);
@@ -28,10 +68,6 @@ void BUS_Write16(NES* nes, uint16_t address, uint16_t value);
 uint8_t BUS_PPU_ReadCHR(struct BUS* bus, uint16_t address);
 void BUS_PPU_WriteCHR(struct BUS* bus, uint16_t address, uint8_t value);
 
-// PPU bus mapping for PPU address space
-uint8_t BUS_PPU_Read(struct BUS* bus, uint16_t address);
-void BUS_PPU_Write(struct BUS* bus, uint16_t address, uint8_t value);
-
 // Peak methods (no PC increment)
 uint8_t BUS_Peek(NES* nes, uint16_t address);
 uint16_t BUS_Peek16(NES* nes, uint16_t address);
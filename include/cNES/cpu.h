@@ -1,8 +1,10 @@
 #ifndef CPU_H
 #define CPU_H
 
+#include <stdbool.h>
 #include <stdint.h>
 #include <stddef.h>
+#include <stdatomic.h>
 
 typedef struct NES NES;
 
@@ -37,6 +39,13 @@ typedef struct CPU_Opcode {
     uint8_t cycles;
 } CPU_Opcode;
 
+typedef struct CPU CPU;
+typedef struct CPU_Recompiler CPU_Recompiler;
+
+// Instruction handler: runs one instruction on its already fetched operand and
+// returns the cycles it took, or -1 if the CPU must halt
+typedef int (*CPU_Handler)(CPU *cpu, uint16_t operand);
+
 typedef struct CPU {
     // Registers
     uint8_t a;  // Accumulator
@@ -47,18 +56,27 @@ typedef struct CPU {
     uint8_t status; // Processor Status
 
     uint64_t total_cycles;
+    uint64_t run_until; // CPU_Run returns once total_cycles reaches this, lowering it ends the burst early
 
     NES* nes; // Pointer to the NES instance
+    _Atomic(uint32_t) **decode_pages; // The bus's decode_pages, saves going through the NES for every instruction
+    CPU_Recompiler *recompiler; // Translated blocks CPU_Run goes through, NULL runs the interpreter
 } CPU;
 
 extern CPU_Opcode cpu_opcodes[256];
 
-CPU *CPU_Create(NES *nes);
+// The CPU lives inside the NES, code running from PRG ROM is decoded into the ROM's decode_banks
+void CPU_Init(CPU *cpu, NES *nes);
 void CPU_Reset(CPU* cpu);
 int CPU_Step(CPU* cpu);
+int CPU_Run(CPU* cpu, uint64_t until); // Runs instructions until total_cycles >= until, -1 if the CPU halted
+// Runs PRG ROM code in CPU_Run through translated x86-64 blocks instead of the interpreter,
+// with the same results and cycle counts. Off by default, -1 where it isn't available
+int CPU_SetRecompiler(CPU* cpu, bool enabled);
 
 void CPU_Interupt(CPU* cpu);
 void CPU_NMI(CPU* cpu);
+void CPU_IRQ(CPU* cpu); // Does nothing while the I flag is set
 
 void CPU_SetFlag(CPU* cpu, uint8_t flag, int value);
 uint8_t CPU_GetFlag(CPU* cpu, uint8_t flag);
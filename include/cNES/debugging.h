@@ -1 +1,5 @@
-uint16_t disassemble(NES *nes, uint16_t address, char *buffer, size_t buffer_size);
\ No newline at end of file
+uint16_t disassemble(NES *nes, uint16_t address, char *buffer, size_t buffer_size);
+
+// Same, reading the instruction through read(memory, address) instead of the live bus
+typedef uint8_t (*disassemble_read_func)(const void *memory, uint16_t address);
+uint16_t disassemble_memory(disassemble_read_func read, const void *memory, uint16_t address, char *buffer, size_t buffer_size);
@@ -0,0 +1,75 @@
+#ifndef EMUTHREAD_H
+#define EMUTHREAD_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "cNES/cpu.h"
+#include "cNES/ppu.h"
+
+typedef struct NES NES;
+typedef struct EMUTHREAD EMUTHREAD;
+
+#define EMUTHREAD_NTSC_FPS 60.0988 // 1789773 / 29780.5 CPU cycles per frame
+#define EMUTHREAD_MAX_TIMINGS 8    // Timings a frame function can report per frame
+
+// Time spent in a part of the frame function, see EMUTHREAD_AddTiming
+typedef struct EMUTHREAD_Timing {
+    const char *name; // Must outlive the frame, a string literal
+    uint64_t ns;
+} EMUTHREAD_Timing;
+
+// Everything the UI shows of a finished frame, copied out of the NES when it completes
+typedef struct EMUTHREAD_Frame {
+    uint8_t framebuffer[PPU_FRAMEBUFFER_WIDTH * PPU_FRAMEBUFFER_HEIGHT];
+    PPU ppu;            // Copy of the PPU, its framebuffer points at the one above so PPU_ConvertFramebuffer works on it
+    CPU cpu;            // Registers and cycle count, the pointers in it still lead to the live NES
+    uint8_t ram[0x800]; // Internal RAM
+    uint8_t cart[0xA000]; // $6000-$FFFF as the CPU reads it, PRG RAM and the PRG ROM banks mapped
+    bool movie;           // A movie is recording or playing
+    bool movie_recording;
+    uint64_t movie_frame;  // MOVIE_GetFrame
+    uint64_t movie_length; // MOVIE_GetLength
+    uint64_t frame;     // Frames the thread had run when this was published
+    EMUTHREAD_Timing timings[EMUTHREAD_MAX_TIMINGS]; // Reported by the frame function while running this frame
+    int timing_count;
+} EMUTHREAD_Frame;
+
+// CPU bus as of a frame, for debuggers. PPU, APU and I/O registers read 0
+uint8_t EMUTHREAD_PeekFrame(const EMUTHREAD_Frame *frame, uint16_t address);
+
+// Runs one frame on the emulation thread, NULL means NES_StepFrame
+typedef void (*EMUTHREAD_FrameFunc)(NES *nes, void *userdata);
+
+// Runs an NES on its own thread, paced at the NTSC frame rate. Finished frames are
+// handed to one consumer thread through a triple buffer and controller input goes
+// the other way through a single producer, single consumer queue, neither takes a
+// lock. The consumer reads everything it shows from the published frame, anything
+// that changes the NES from outside has to hold EMUTHREAD_Lock.
+EMUTHREAD *EMUTHREAD_Create(NES *nes, EMUTHREAD_FrameFunc run_frame, void *userdata);
+void EMUTHREAD_Destroy(EMUTHREAD *thread); // Stops the thread after the frame it is running
+
+// Consumer side, call from one thread only
+const EMUTHREAD_Frame *EMUTHREAD_AcquireFrame(EMUTHREAD *thread); // Newest frame, valid until the next call
+int EMUTHREAD_PushInput(EMUTHREAD *thread, uint8_t controller1, uint8_t controller2); // -1 if the queue is full
+
+// Exclusive access to the NES between frames, for loading ROMs and states, resets, movies
+// and settings the frame function reads. It waits for the frame in progress, so take it
+// for one-off changes only, never every frame. A snapshot is republished when the lock
+// is released, so changes made while paused still show up. Both accept NULL and do nothing.
+void EMUTHREAD_Lock(EMUTHREAD *thread);
+void EMUTHREAD_Unlock(EMUTHREAD *thread);
+
+void EMUTHREAD_SetPaused(EMUTHREAD *thread, bool paused);
+bool EMUTHREAD_IsPaused(EMUTHREAD *thread);
+void EMUTHREAD_StepFrame(EMUTHREAD *thread);       // Runs one frame while paused
+void EMUTHREAD_StepInstruction(EMUTHREAD *thread); // Runs one CPU instruction while paused
+
+uint64_t EMUTHREAD_GetFrameCount(EMUTHREAD *thread);
+
+// Called by the frame function, publishes the time a part of it took with the frame
+// so a profiler on the consumer thread can show it. -1 when not called from an
+// emulation thread's frame function or the frame has no room left
+int EMUTHREAD_AddTiming(const char *name, uint64_t ns);
+
+#endif // EMUTHREAD_H
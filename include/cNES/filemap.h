@@ -0,0 +1,15 @@
+#ifndef FILEMAP_H
+#define FILEMAP_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+// File mappings. Pages come straight from the OS file cache, so every process
+// and NES instance mapping the same file shares one physical copy. Writing
+// through a read-only mapping faults.
+void *FILEMAP_OpenReadOnly(const char *path, size_t *size); // NULL if the file can't be mapped (missing, empty, not a regular file)
+void *FILEMAP_OpenReadWrite(const char *path, size_t size); // Shared mapping of the first size bytes, the file is created or grown with zeros
+int FILEMAP_Flush(void *data, size_t offset, size_t size, bool wait); // Starts writing a range back to the file, wait blocks until it is on disk
+void FILEMAP_Close(void *data, size_t size);
+
+#endif // FILEMAP_H
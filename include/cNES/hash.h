@@ -0,0 +1,13 @@
+#ifndef HASH_H
+#define HASH_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// 64-bit xxHash (XXH64). Input is consumed as four independent 64-bit lanes,
+// which keeps the multipliers pipelined and lets compilers vectorise the loop.
+// Chain several buffers by passing the previous hash as the next seed.
+// Values are only stable across little endian hosts.
+uint64_t HASH_Bytes(const void *data, size_t size, uint64_t seed);
+
+#endif // HASH_H
@@ -0,0 +1,48 @@
+#ifndef MAPPER_H
+#define MAPPER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef struct NES NES;
+
+// Access to the PRG RAM at $6000-$7FFF, boards without a protect register leave it 0
+#define MAPPER_PRG_RAM_DISABLED  0x01 // Reads see open bus, writes go nowhere
+#define MAPPER_PRG_RAM_READ_ONLY 0x02 // Writes go nowhere
+
+// Registers of every supported mapper. Lives in the BUS and is saved in states as
+// it is, the bank pointers are rebuilt from it with MAPPER_Sync after a load.
+typedef struct MAPPER_State {
+    uint8_t banks[8];    // Bank registers: MMC3 R0-R7, MMC1 CHR0/CHR1/PRG in 0-2, the others use 0
+    uint8_t control;     // MMC1 control, MMC3 bank select
+    uint8_t shift;       // MMC1 serial port, bits arrive LSB first
+    uint8_t shift_count; // MMC1 bits in shift so far
+    uint8_t mirroring;   // MMC3 $A000, 0 vertical 1 horizontal
+    uint8_t prg_ram_protect; // MAPPER_PRG_RAM_* bits, MMC3 sets them with $A001
+    uint8_t irq_latch;   // MMC3 scanline counter reload value
+    uint8_t irq_counter; // MMC3 scanline counter
+    bool irq_reload;     // MMC3 counter reloads on its next clock
+    bool irq_enabled;    // Counter reaching 0 raises the IRQ line
+    bool irq_line;       // IRQ asserted to the CPU, level triggered
+    uint64_t write_cycle; // MMC1 CPU cycle of the last register write plus one, 0 before the first
+} MAPPER_State;
+
+// Banks are switched by pointing CPU pages and CHR slots into the cartridge memory,
+// nothing is copied. Register writes catch the PPU up first, so a CHR or mirroring
+// change mid-frame only affects what is drawn after it.
+typedef struct MAPPER {
+    uint8_t number;    // iNES mapper number
+    const char *name;
+    void (*reset)(NES *nes);                                  // Power on register values, NULL leaves them zeroed
+    void (*write)(NES *nes, uint16_t address, uint8_t value); // Writes to $8000-$FFFF, NULL ignores them
+    void (*sync)(NES *nes);                                   // Maps banks and mirroring from the registers
+    void (*scanline)(NES *nes);                               // Clocked at dot 260 of rendered lines, NULL if unused
+} MAPPER;
+
+const MAPPER *MAPPER_Get(uint8_t number); // NULL if the mapper isn't supported
+
+void MAPPER_Reset(NES *nes); // Power on state of nes->mapper, maps its banks
+void MAPPER_Sync(NES *nes);  // Remaps banks and mirroring from bus->mapper_state
+void MAPPER_MapPRGRAM(NES *nes); // Maps $6000-$7FFF for prg_ram_protect, writes go through bus->prg_ram_write if set
+
+#endif // MAPPER_H
@@ -0,0 +1,43 @@
+#ifndef MOVIE_H
+#define MOVIE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef struct NES NES;
+typedef struct MOVIE MOVIE;
+
+// Input movies, the controller state of every frame from a fixed starting point.
+// Replaying one on the same ROM gives the same frames bit for bit.
+//
+// File layout, all values little endian:
+//   "CNMV", u16 version, u8 anchor, u8 controller count
+//   u64 ROM hash (NES rom_hash of the image it was recorded on)
+//   u64 frame count, u32 anchor state size, then the save state for MOVIE_ANCHOR_STATE
+//   runs of identical input until the end of the file: LEB128 frame count, one byte per controller
+//
+// Files are read and written as they play, a movie is never held in memory.
+
+typedef enum MOVIE_Anchor {
+    MOVIE_ANCHOR_POWER_ON, // Starts from a reset with cleared memories
+    MOVIE_ANCHOR_STATE,    // Starts from a save state stored in the movie
+} MOVIE_Anchor;
+
+// Both attach the movie to the NES, NES_StepFrame then records or plays one frame of
+// input every time it runs. Power-on movies reset the NES, state movies load their state.
+MOVIE *MOVIE_Record(NES *nes, const char *path, MOVIE_Anchor anchor);
+MOVIE *MOVIE_Play(NES *nes, const char *path); // NULL if the file is damaged or was recorded on another ROM
+
+// Detaches the movie and finishes the file when recording. -1 if it couldn't be written completely
+int MOVIE_Close(MOVIE *movie);
+
+// Frame hook called by NES_StepFrame. Recording stores the controllers the frame runs
+// with, playback sets them. Input stays on the last frame once a movie has played out.
+void MOVIE_Frame(MOVIE *movie);
+
+bool MOVIE_IsRecording(const MOVIE *movie);
+bool MOVIE_IsFinished(const MOVIE *movie); // Playback has run out of input
+uint64_t MOVIE_GetFrame(const MOVIE *movie);  // Frames recorded or played so far
+uint64_t MOVIE_GetLength(const MOVIE *movie); // Frames in the movie, the frames so far while recording
+
+#endif // MOVIE_H
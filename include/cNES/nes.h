@@ -3,34 +3,104 @@
 
 #include <stdint.h>
 #include <stddef.h>
+#include <stdbool.h>
 
 typedef struct CPU CPU;
 typedef struct PPU PPU;
 typedef struct BUS BUS;
 typedef struct ROM ROM;
+typedef struct MOVIE MOVIE;
+typedef struct BATTERY BATTERY;
+typedef struct MAPPER MAPPER;
 //typedef struct Profiler Profiler;
 
+// Timed events the CPU runs up to without interruption
+typedef enum NES_Event {
+    NES_EVENT_NMI,       // PPU reaches vblank (241, 1) or NMI gets enabled during vblank
+    NES_EVENT_FRAME_END, // PPU wraps around to the next frame
+    NES_EVENT_IRQ,       // Mapper scanline counter clocks with its IRQ enabled, or a raised IRQ waits on the I flag
+    NES_EVENT_COUNT
+} NES_Event;
+
+#define NES_EVENT_NEVER UINT64_MAX
+
+typedef struct NES_Scheduler {
+    uint64_t deadlines[NES_EVENT_COUNT]; // CPU cycle each event is due on, NES_EVENT_NEVER if not pending
+} NES_Scheduler;
+
 typedef struct NES {
+    // All three live in the same allocation as the NES, see NES_Arena in nes.c
     CPU* cpu; // Pointer to the CPU
     PPU* ppu; // Pointer to the PPU
     BUS* bus; // Pointer to the BUS
-    ROM* rom; // Pointer to the ROM
+    ROM* rom; // Cartridge image, shared with every other NES running it
+    const MAPPER *mapper; // Cartridge mapper, NULL until a ROM is loaded
 
     uint8_t controllers[2]; // Two NES controllers
     uint8_t controller_strobe; // Strobe flag for controllers
     uint8_t controller_shift[2]; // Shift registers for controllers
 
+    NES_Scheduler scheduler;
+
+    // Run-ahead scratch, not part of save states
+    uint8_t *runahead_state;
+    size_t runahead_state_size;
+
+    uint64_t rom_hash; // FNV-1a of the loaded iNES image, identifies the ROM movies belong to
+    MOVIE *movie;      // Movie recording or playing back, see movie.h
+    BATTERY *battery;  // Save file behind PRG RAM, see battery.h. Not written to while a movie runs
+
+    bool hash_frames;    // Hash every frame at the end of NES_StepFrame
+    uint64_t frame_hash; // Hash of the last frame run with hash_frames set, the shown one under run-ahead
+
     //Profiler *profiler;
 } NES;
 
 NES *NES_Create();
-int NES_Load(const char* path, NES* nes);
-void NES_Destroy(NES* nes);
+int NES_Load(const char* path, NES* nes); // ROM for this NES alone, share one with ROM_Load and NES_AttachROM
+int NES_LoadMemory(NES *nes, const uint8_t *data, size_t size); // iNES image, copied once, data is not kept after the call
+int NES_AttachROM(NES *nes, ROM *rom); // Takes a reference to rom, see rom.h. Resets the NES
+void NES_Destroy(NES* nes); // Also closes a movie and writes back a save file that are still attached
+NES *NES_Clone(const NES *nes); // Copy of the whole machine sharing its ROM, without the movie, save file or run-ahead scratch
+int NES_SetBatteryFile(NES *nes, const char *path); // Keeps PRG RAM in path, NULL detaches. NES_Load does this for battery carts
 
 void NES_StepFrame(NES *nes);
+// Runs one frame, then shows the frame that comes `frames` later with the same input and
+// returns to the real one. Hides the game's own input lag at the cost of frames + 1 frames of work.
+int NES_RunAhead(NES *nes, int frames);
+// Runs `frames` frames and draws only the last, for fast-forward. Movies see every frame.
+void NES_FastForward(NES *nes, int frames);
 void NES_Step(NES *nes);
 void NES_Reset(NES *nes);
 
+// Framebuffer as palette indices, complete after NES_StepFrame. PPU_ConvertFramebuffer turns it into colours
+const uint8_t* NES_GetFramebuffer(NES *nes);
+
+// Regression hashing. When enabled every NES_StepFrame ends by hashing the framebuffer,
+// its emphasis slots, the CPU registers and cycle count and the internal RAM.
+// After NES_RunAhead it is the hash of the shown frame ahead, not of the restored machine
+void NES_SetFrameHashing(NES *nes, bool enabled);
+uint64_t NES_GetFrameHash(NES *nes);
+uint64_t NES_HashFrame(NES *nes); // The same hash of the machine as it is right now
+
+// blargg's test ROMs report through PRG RAM: DE B0 61 at $6001 marks a report,
+// $6000 holds the status and a zero terminated message starts at $6004.
+// Statuses below NES_TEST_RUNNING are results, 0 means every test passed.
+#define NES_TEST_RUNNING     0x80
+#define NES_TEST_NEEDS_RESET 0x81 // Press reset (after 100ms or more) to continue
+int NES_GetTestStatus(NES *nes, const char **message); // -1 while no test ROM reports, message may be NULL
+
+// Save states, a flat copy of the machine state that can be restored into an NES running the same ROM
+size_t NES_GetStateSize(NES *nes);
+size_t NES_SaveState(NES *nes, void *buffer, size_t size);   // Bytes written, 0 if the buffer is too small
+int NES_LoadState(NES *nes, const void *buffer, size_t size); // -1 if the state doesn't fit this ROM or build, the NES is left untouched
+int NES_SaveStateFile(NES *nes, const char *path);
+int NES_LoadStateFile(NES *nes, const char *path);
+
+// Scheduler
+void NES_Schedule(NES *nes, NES_Event event, uint64_t cycle); // Ends the current CPU burst early if cycle is sooner
+void NES_SyncPPU(NES *nes); // Runs the PPU up to the CPU's current cycle
+
 // Poll controller state (UI or platform layer should implement this and NES core should call it)
 uint8_t NES_PollController(NES* nes, int controller);
 
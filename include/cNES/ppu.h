@@ -16,6 +16,7 @@ typedef struct NES NES;
 // Define framebuffer dimensions
 #define PPU_FRAMEBUFFER_WIDTH 256
 #define PPU_FRAMEBUFFER_HEIGHT 240
+#define PPU_EMPHASIS_SLOTS 4 // Emphasis changes tracked per scanline
 
 // --- PPU Register Bit Definitions ---
 
@@ -65,15 +66,11 @@ typedef struct {
 } SpriteShifter;
 
 // PPU State Structure
+// Laid out for the emulation loop: registers, timing and the rendering pipeline
+// touched every dot come first, then the memories, then everything outside the
+// machine state, with the output palettes only PPU_ConvertFramebuffer reads last.
+// Save states copy everything up to `nes` in one piece.
 typedef struct PPU {
-    NES *nes; // Pointer to the main NES structure for bus access, callbacks, etc.
-
-    // Memory
-    uint8_t vram[PPU_VRAM_SIZE];           // Nametable RAM (2KB for 2 nametables)
-    uint8_t palette[PPU_PALETTE_RAM_SIZE]; // Palette RAM (32 bytes) - Renamed from 'palette' to avoid conflict with nes_palette array
-    uint8_t oam[PPU_OAM_SIZE];             // Primary OAM (Object Attribute Memory - 256 bytes)
-    uint8_t secondary_oam[PPU_SECONDARY_OAM_SIZE]; // Secondary OAM (for sprites on current scanline - 32 bytes)
-
     // Registers
     uint8_t ctrl;        // $2000 PPUCTRL
     uint8_t mask;        // $2001 PPUMASK
@@ -91,6 +88,7 @@ typedef struct PPU {
     int   scanline;      // Current scanline being processed (-1/261 for pre-render, 0-239 visible, 240 post, 241-260 VBlank)
     int   cycle;         // Current PPU clock cycle on the scanline (0-340)
     bool  frame_odd;     // True if the current frame is odd (for cycle skip on pre-render line)
+    uint64_t clock;      // Dots run since reset, the PPU only runs when something needs it to catch up
 
     // NMI (Non-Maskable Interrupt) State
     bool nmi_occured;         // Flag: VBlank period has started (set at SL241, C1; cleared at PreRender SL, C1)
@@ -120,18 +118,47 @@ typedef struct PPU {
     // Cartridge and System Configuration
     MirrorMode mirror_mode; // Nametable mirroring mode set by cartridge
 
-    // Output
-    //uint32_t framebuffer[PPU_FRAMEBUFFER_WIDTH * PPU_FRAMEBUFFER_HEIGHT];
-    uint32_t *framebuffer;
+    uint8_t pixel_tag; // Emphasis slot bits for pixels drawn now, see line_emphasis
+
+    // Memory
+    uint8_t palette[PPU_PALETTE_RAM_SIZE]; // Palette RAM (32 bytes) - Renamed from 'palette' to avoid conflict with nes_palette array
+    uint8_t secondary_oam[PPU_SECONDARY_OAM_SIZE]; // Secondary OAM (for sprites on current scanline - 32 bytes)
+    uint8_t oam[PPU_OAM_SIZE];             // Primary OAM (Object Attribute Memory - 256 bytes)
+    uint8_t vram[PPU_VRAM_SIZE];           // Nametable RAM (2KB for 2 nametables)
+
+    // Output, save states only keep the line being drawn
+    // The framebuffer holds one byte per pixel: the palette index in bits 0-5 and,
+    // in bits 6-7, which of its scanline's emphasis slots applies. A line starts
+    // with one slot, every mid-line PPUMASK emphasis change opens another (up to 4).
+    // PPU_ConvertFramebuffer turns it into colours when something needs them.
+    uint8_t line_emphasis[PPU_FRAMEBUFFER_HEIGHT][PPU_EMPHASIS_SLOTS]; // PPUMASK emphasis bits (mask >> 5) per slot
+    uint8_t line_emphasis_count[PPU_FRAMEBUFFER_HEIGHT];              // Slots used by each scanline
+
+    // Not part of save states
+    NES *nes; // Pointer to the main NES structure for bus access, callbacks, etc.
+    uint8_t *framebuffer; // Lives in the NES arena, see nes.c
+    bool suppress_output; // Skips writing pixels, status flags and sprite 0 hit behave as usual
+
+    // Output colours, 0xRRGGBBAA
+    uint32_t master_palette[64];            // Palette the emphasis palettes are baked from
+    uint32_t emphasis_palettes[8][64];      // master_palette under each PPUMASK emphasis combination
 } PPU;
 
+// Output formats for PPU_ConvertFramebuffer
+typedef enum PPU_PixelFormat {
+    PPU_PIXEL_FORMAT_RRGGBBAA, // uint32_t 0xRRGGBBAA, the palette format
+    PPU_PIXEL_FORMAT_AABBGGRR, // uint32_t 0xAABBGGRR, R,G,B,A byte order on little endian hosts
+    PPU_PIXEL_FORMAT_AARRGGBB, // uint32_t 0xAARRGGBB, B,G,R,A byte order on little endian hosts
+    PPU_PIXEL_FORMAT_RGB565,   // uint16_t
+} PPU_PixelFormat;
+
 // --- PPU Lifecycle Functions ---
-PPU* PPU_Create(NES *nes);
-void PPU_Destroy(PPU *ppu);
+void PPU_Init(PPU *ppu, NES *nes, uint8_t *framebuffer); // ppu must be zeroed, framebuffer holds PPU_FRAMEBUFFER_WIDTH * PPU_FRAMEBUFFER_HEIGHT bytes
 void PPU_Reset(PPU *ppu);
 
 // --- PPU Execution Function ---
 void PPU_Step(PPU *ppu); // Advances PPU by one clock cycle
+void PPU_CatchUp(PPU *ppu, uint64_t clock); // Runs the PPU until its clock reaches the given dot
 
 // --- PPU Register Access Functions (CPU interface) ---
 uint8_t PPU_ReadRegister(PPU *ppu, uint16_t addr);
@@ -151,8 +178,10 @@ void PPU_TriggerNMI(PPU *ppu); // Triggers NMI if enabled (not usually called di
 // NMI line state is managed by PPU_Step and PPU_WriteRegister(PPUCTRL).
 
 // --- UI and Debugging Helper Functions ---
-const uint32_t* PPU_GetFramebuffer(PPU* ppu);
+const uint8_t* PPU_GetFramebuffer(PPU* ppu); // Palette indices, see PPU_ConvertFramebuffer
+void PPU_ConvertFramebuffer(const PPU* ppu, void* pixels, size_t pitch, PPU_PixelFormat format); // pitch in bytes
 const uint32_t* PPU_GetPalette(void); // Returns pointer to the static master NES palette
+void PPU_SetPalette(PPU *ppu, const uint32_t *palette); // Swaps in a 64 colour 0xRRGGBBAA master palette, NULL restores the default
 const uint8_t* PPU_GetPaletteRAM(PPU* ppu); // Returns pointer to PPU's internal palette RAM
 const uint8_t* PPU_GetOAM(PPU* ppu);
 const uint8_t* PPU_GetNametable(PPU* ppu, int index); // Gets a pointer to a nametable based on mirroring
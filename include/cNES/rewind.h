@@ -0,0 +1,36 @@
+#ifndef REWIND_H
+#define REWIND_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+typedef struct NES NES;
+typedef struct REWIND REWIND;
+
+#define REWIND_DEFAULT_BUDGET   (4 * 1024 * 1024) // Bytes of history
+#define REWIND_DEFAULT_INTERVAL 4                 // Frames between snapshots
+#define REWIND_DEFAULT_KEYFRAME 32                // Snapshots per keyframe
+
+// History of an NES as a fixed size ring of snapshots. Every interval frames a
+// save state is captured, stored as a zero run-length encoded XOR against the
+// last keyframe (keyframes against nothing). The inputs of the frames between
+// snapshots are kept as well, so any frame in the history can be rebuilt by
+// loading the snapshot before it and replaying with NES_StepFrame. The oldest
+// entries are dropped once the budget is used up.
+REWIND *REWIND_Create(NES *nes, size_t budget, int interval, int keyframe_interval);
+void REWIND_Destroy(REWIND *rewind);
+void REWIND_Clear(REWIND *rewind); // Forgets all history, call after loading a ROM or a save state
+
+// Call after every NES_StepFrame, records the controller state the frame ran with
+// and captures a snapshot when one is due. -1 if the snapshot didn't fit the budget.
+int REWIND_Capture(REWIND *rewind);
+
+// Takes the NES back one frame, the framebuffer shows that frame again.
+// -1 if there is no history left.
+int REWIND_StepBack(REWIND *rewind);
+
+// Statistics
+size_t REWIND_GetFrameCount(const REWIND *rewind); // Frames that can be stepped back
+size_t REWIND_GetMemoryUsed(const REWIND *rewind); // Bytes of the budget holding snapshots
+
+#endif // REWIND_H
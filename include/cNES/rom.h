@@ -0,0 +1,51 @@
+#ifndef ROM_H
+#define ROM_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+
+typedef struct MAPPER MAPPER;
+
+#define ROM_DECODE_BANK_SIZE 0x2000 // PRG ROM bytes covered by one table of decoded instructions
+
+// A parsed iNES image, loaded once and attached to any number of NES instances.
+// Everything in it is read only after loading, so instances on different threads
+// can share it. Each NES keeps a reference until it loads another ROM or is
+// destroyed, so the loader can release its own reference right after attaching.
+typedef struct ROM {
+    atomic_int references;
+
+    uint8_t *image;      // Whole iNES file, a read-only file mapping or a heap copy
+    size_t image_size;
+    bool image_mapped;
+
+    uint8_t *prg;        // PRG ROM inside image, read only
+    size_t prg_size;
+    uint8_t *chr;        // CHR ROM inside image, read only. NULL when the cart has CHR RAM
+    size_t chr_size;
+
+    const MAPPER *mapper;
+    uint8_t mapper_number;
+    uint8_t mirroring;   // Mirroring from the header (0: horizontal, 1: vertical)
+    uint8_t prg_banks;   // PRG ROM size in 16KB units
+    uint8_t chr_banks;   // CHR ROM size in 8KB units, 0 means CHR RAM
+    bool has_battery;    // PRG RAM is battery backed and kept in a save file
+
+    uint64_t hash;       // 64-bit FNV-1a of the image, identifies the ROM movies belong to
+
+    // The CPU's decoded instructions, one 32-bit entry per PRG ROM byte (see CPU_Step).
+    // An entry only depends on the ROM bytes it decodes, so instances racing to fill
+    // the same one store the same value. One table per 8KB bank, allocated the first
+    // time any instance runs code in it and freed with the ROM
+    _Atomic(_Atomic(uint32_t) *) *decode_banks;
+    size_t decode_bank_count;
+} ROM;
+
+ROM *ROM_Load(const char *path); // Maps the file read only when it can. NULL if it isn't a ROM cNES can run
+ROM *ROM_LoadMemory(const uint8_t *data, size_t size); // Copies the image once, data is not kept after the call
+ROM *ROM_Retain(ROM *rom); // Returns rom
+void ROM_Release(ROM *rom); // Frees the ROM with its last reference, NULL is ignored
+
+#endif // ROM_H
@@ -0,0 +1,35 @@
+#ifndef RUNNER_H
+#define RUNNER_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+typedef struct RUNNER RUNNER;
+typedef struct ROM ROM;
+
+// One independent emulation: a ROM, an input stream and a frame count in,
+// hashes of where it ended up out. Jobs never share an NES instance.
+typedef struct RUNNER_Job {
+    // Inputs, only read by the runner
+    ROM *rom;             // May be shared by any number of jobs, each NES holds a reference while it runs
+    const uint8_t *input; // 2 bytes per frame (controller 1, controller 2), the last frame is held
+    size_t input_frames;
+    int frames;           // Frames to run
+
+    // Results
+    int status;           // 0 on success, -1 if the NES could not be created or the ROM did not load
+    uint64_t frame_hash;  // Final frame as RRGGBBAA, same hash cnes-headless prints
+    uint64_t ram_hash;    // 2KB internal RAM
+    uint64_t cycles;      // CPU cycles run
+} RUNNER_Job;
+
+RUNNER *RUNNER_Create(int thread_count); // 0 or less uses one thread per online CPU
+void RUNNER_Destroy(RUNNER *runner);
+int RUNNER_GetThreadCount(const RUNNER *runner);
+
+// Runs every job and returns once all of them are done. Jobs are split evenly
+// between the threads up front, a thread that runs out steals from the others.
+// Returns the number of jobs that failed.
+int RUNNER_Run(RUNNER *runner, RUNNER_Job *jobs, size_t count);
+
+#endif // RUNNER_H
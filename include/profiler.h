@@ -61,6 +61,7 @@ void Profiler_BeginFrame(void);
 void Profiler_EndFrame(void);
 int Profiler_BeginSection(const char* name);
 void Profiler_EndSection(int section_id);
+void Profiler_RecordSection(const char* name, double time_ms); // A section timed elsewhere (another thread), ending now
 
 // Data Access
 float Profiler_GetFPS(void);
@@ -0,0 +1,113 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "debug.h"
+
+#include "cNES/nes.h"
+#include "cNES/bus.h"
+#include "cNES/mapper.h"
+#include "cNES/battery.h"
+#include "cNES/filemap.h"
+
+struct BATTERY {
+    NES *nes;
+    uint8_t *data; // File mapping, the size of the PRG RAM
+    bool suspended; // PRG RAM belongs to a movie, nothing is written back
+};
+
+// $6000-$7FFF writes while a battery is attached, reads stay plain memory
+static void BATTERY_Write(NES *nes, uint16_t address, uint8_t value)
+{
+    uint16_t offset = address & 0x1FFF;
+    nes->bus->prg_ram[offset] = value;
+    nes->bus->prg_ram_dirty |= (uint8_t)(1u << (offset / BATTERY_PAGE_SIZE));
+}
+
+BATTERY *BATTERY_Open(NES *nes, const char *path)
+{
+    BUS *bus = nes->bus;
+    BATTERY *battery = calloc(1, sizeof(BATTERY));
+    if (!battery)
+    {
+        DEBUG_ERROR("Could not allocate battery");
+        return NULL;
+    }
+    battery->nes = nes;
+
+    battery->data = FILEMAP_OpenReadWrite(path, sizeof(bus->prg_ram));
+    if (!battery->data)
+    {
+        DEBUG_ERROR("Could not open save file %s", path);
+        free(battery);
+        return NULL;
+    }
+
+    memcpy(bus->prg_ram, battery->data, sizeof(bus->prg_ram));
+    bus->prg_ram_dirty = 0;
+    bus->prg_ram_write = BATTERY_Write;
+    MAPPER_MapPRGRAM(nes);
+
+    return battery;
+}
+
+void BATTERY_Flush(BATTERY *battery)
+{
+    BUS *bus = battery->nes->bus;
+    uint8_t dirty = bus->prg_ram_dirty;
+    if (!dirty || battery->suspended)
+        return;
+    bus->prg_ram_dirty = 0;
+
+    // Games rewrite the same values a lot, pages that end up unchanged cost no I/O
+    for (size_t page = 0; page < sizeof(bus->prg_ram) / BATTERY_PAGE_SIZE; page++)
+    {
+        size_t offset = page * BATTERY_PAGE_SIZE;
+        if (!(dirty & (1u << page)) || !memcmp(battery->data + offset, bus->prg_ram + offset, BATTERY_PAGE_SIZE))
+            continue;
+
+        memcpy(battery->data + offset, bus->prg_ram + offset, BATTERY_PAGE_SIZE);
+        if (FILEMAP_Flush(battery->data, offset, BATTERY_PAGE_SIZE, false))
+            DEBUG_WARN("Could not write back save page %zu", page);
+    }
+}
+
+void BATTERY_Suspend(BATTERY *battery)
+{
+    if (!battery || battery->suspended)
+        return;
+
+    BATTERY_Flush(battery);
+    battery->suspended = true;
+    battery->nes->bus->prg_ram_write = NULL;
+    MAPPER_MapPRGRAM(battery->nes);
+}
+
+void BATTERY_Resume(BATTERY *battery)
+{
+    if (!battery || !battery->suspended)
+        return;
+
+    // Whatever the movie left in PRG RAM is thrown away, the game sees its save again
+    BUS *bus = battery->nes->bus;
+    memcpy(bus->prg_ram, battery->data, sizeof(bus->prg_ram));
+    bus->prg_ram_dirty = 0;
+    battery->suspended = false;
+    bus->prg_ram_write = BATTERY_Write;
+    MAPPER_MapPRGRAM(battery->nes);
+}
+
+void BATTERY_Close(BATTERY *battery)
+{
+    if (!battery)
+        return;
+
+    BUS *bus = battery->nes->bus;
+    BATTERY_Flush(battery);
+    if (FILEMAP_Flush(battery->data, 0, sizeof(bus->prg_ram), true))
+        DEBUG_WARN("Could not write back the save file");
+
+    bus->prg_ram_write = NULL;
+    MAPPER_MapPRGRAM(battery->nes);
+    FILEMAP_Close(battery->data, sizeof(bus->prg_ram));
+    free(battery);
+}
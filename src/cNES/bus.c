@@ -1,16 +1,60 @@
+#include <string.h>
+
 #include "cNES/nes.h"
 #include "cNES/bus.h"
 #include "cNES/ppu.h"
 #include "cNES/cpu.h" // For OAM DMA CPU stalls (if implemented, currently not in this file)
 
-uint8_t BUS_Read(NES* nes, uint16_t address) {
-    // Handle CPU memory map (0x0000 - 0xFFFF)
-    if (address < 0x2000) { // Internal RAM
-        return nes->bus->memory[address & 0x07FF]; // 2KB RAM, mirrored every 0x0800 bytes
-    } else if (address >= 0x2000 && address < 0x4000) { // PPU Registers
-        // PPU registers ($2000-$2007), mirrored every 8 bytes up to $3FFF
-        return PPU_ReadRegister(nes->ppu, 0x2000 + (address & 0x0007));
-    } else if (address == 0x4016) { // Controller 1 Read
+// Pattern tables read as 0 until a cartridge is loaded
+static uint8_t bus_no_chr[BUS_CHR_SLOT_SIZE];
+
+// --- Memory map ---
+
+// Decoded instructions found for the old page don't belong to the new one
+static void BUS_SetReadPage(BUS* bus, int page, uint8_t *read) {
+    bus->read_pages[page] = read;
+    if (page >= BUS_PAGE_COUNT / 2) bus->decode_pages[page - BUS_PAGE_COUNT / 2] = NULL;
+}
+
+void BUS_MapPages(BUS* bus, uint8_t first_page, int count, uint8_t *read, uint8_t *write) {
+    for (int i = 0; i < count && first_page + i < BUS_PAGE_COUNT; ++i) {
+        if (read) BUS_SetReadPage(bus, first_page + i, read + i * 0x100);
+        if (write) bus->write_pages[first_page + i] = write + i * 0x100;
+    }
+}
+
+void BUS_MapHandlers(BUS* bus, uint8_t first_page, int count, BUS_ReadHandler read, BUS_WriteHandler write) {
+    for (int i = 0; i < count && first_page + i < BUS_PAGE_COUNT; ++i) {
+        if (read) {
+            BUS_SetReadPage(bus, first_page + i, NULL);
+            bus->read_handlers[first_page + i] = read;
+        }
+        if (write) {
+            bus->write_pages[first_page + i] = NULL;
+            bus->write_handlers[first_page + i] = write;
+        }
+    }
+}
+
+// PPU registers ($2000-$2007), mirrored every 8 bytes up to $3FFF
+// The PPU is caught up to the cycle the accessing instruction started on first
+static uint8_t BUS_ReadPPU(NES* nes, uint16_t address) {
+    NES_SyncPPU(nes);
+    return PPU_ReadRegister(nes->ppu, 0x2000 + (address & 0x0007));
+}
+
+static void BUS_WritePPU(NES* nes, uint16_t address, uint8_t value) {
+    NES_SyncPPU(nes);
+    PPU_WriteRegister(nes->ppu, 0x2000 + (address & 0x0007), value);
+    if (nes->ppu->nmi_interrupt_line) {
+        // Enabling NMI during vblank raises it straight away
+        NES_Schedule(nes, NES_EVENT_NMI, nes->cpu->total_cycles);
+    }
+}
+
+// APU and I/O registers ($4000-$401F), the rest of the page is unmapped
+static uint8_t BUS_ReadIO(NES* nes, uint16_t address) {
+    if (address == 0x4016) { // Controller 1 Read
         uint8_t result = nes->controller_shift[0] & 0x01;
         if (nes->controller_strobe) {
             result = nes->controllers[0] & 0x01; // Only bit 0 is returned if strobe is active
@@ -22,7 +66,6 @@ uint8_t BUS_Read(NES* nes, uint16_t address) {
         }
         // Bits 1-7 are typically open bus, returning a mix of values.
         // Returning just bit 0 is a common simplification.
-        // For more accuracy, one might return (result | (BUS_Peek(nes, address) & 0xFE)) or similar.
         return result; // Only bit 0 is significant
     } else if (address == 0x4017) { // Controller 2 Read
         uint8_t result = nes->controller_shift[1] & 0x01;
@@ -31,92 +74,29 @@ uint8_t BUS_Read(NES* nes, uint16_t address) {
         } else {
             nes->controller_shift[1] >>= 1;
         }
-        // Similar to 0x4016, only bit 0 is significant.
-        // Some emulators might return fixed values (e.g. from an expansion device) on other bits.
         return result;
-    } else if (address >= 0x4000 && address < 0x4020) { // APU and I/O Registers
-        // APU registers are mostly write-only or have specific read behavior (e.g., status reads)
-        // Not fully implemented here, typically returns open bus or last written value.
-        // $4015: APU Status Read
-        // For now, returning 0 for unhandled IO reads in this range besides controllers.
-        return 0; // Placeholder for APU/IO reads
-    } else if (address >= 0x6000 && address < 0x8000) { // PRG RAM (WRAM)
-        // PRG RAM (if present, typically battery-backed save RAM)
-        // This example doesn't explicitly model a separate PRG RAM in nes->bus struct.
-        // If mappers provide it, they would handle it.
-        // For now, returning 0 as if no PRG RAM or it's not enabled.
-        return 0; // Placeholder for PRG RAM
-    } else if (address >= 0x8000) { // PRG ROM
-        // $8000-$FFFF: PRG ROM
-        // Mapper might alter this address. For NROM, it's direct.
-        // Assuming nes->bus->prgRom is 32KB and correctly loaded/mirrored for 16KB ROMs.
-        //return nes->bus->prgRom[address & (nes->bus->prgRomSize * 0x4000 -1)]; // Mask to PRG ROM size
-        // Simpler NROM: return nes->bus->prgRom[address - 0x8000]; (if prgRom is exactly 32KB for $8000-$FFFF)
-        // A more robust solution would be:
-        // if (nes->bus->prgRomSize == 1) { // 16KB ROM, mirrored
-        //    return nes->bus->prgRom[(address - 0x8000) & 0x3FFF];
-        // } else { // 32KB ROM (or more, handled by mapper)
-        //    return nes->bus->prgRom[(address - 0x8000)]; // Assumes mapper handles larger ROMs
-        // }
-        // For now, using a common NROM-like access:
-        return nes->bus->prgRom[(address - 0x8000) & 0x7FFF]; // Access within a 32KB window
-                                                              // Actual mapping depends on mapper and ROM size.
-                                                              // For this example, let's assume prgRom array is 32KB
-                                                              // and loaded appropriately (16KB ROMs mirrored).
     }
-    // Default for unmapped regions (e.g. 0x4020-0x5FFF) is often open bus.
-    // Open bus behavior returns the last value read or a mix of things.
-    // Returning 0 is a simplification.
-    return 0;
+    // APU registers are mostly write-only or have specific read behavior (e.g., status reads)
+    // Not fully implemented here, returning 0 like the other unmapped regions.
+    return 0; // Placeholder for APU/IO reads
 }
 
-// BUS_Peek is for debuggers/tools that need to read memory without side effects.
-uint8_t BUS_Peek(NES* nes, uint16_t address) {
-    if (address < 0x2000) {
-        return nes->bus->memory[address & 0x07FF];
-    } else if (address >= 0x2000 && address < 0x4000) {
-        // For PPU registers, peeking should ideally not trigger side effects like PPUSTATUS VBlank clear.
-        // PPU_PeekRegister should be implemented in ppu.c if needed.
-        // For now, forwarding to PPU_ReadRegister, which *does* have side effects for PPUSTATUS.
-        // A true peek would need PPU to have its own peek functions.
-        // Corrected to use the same PPU register mapping as BUS_Read.
-        return PPU_ReadRegister(nes->ppu, 0x2000 + (address & 0x0007));
-    } else if (address == 0x4016) {
-        int controller_idx = 0;
-        // Return current state of shift register bit 0 without shifting or reloading from strobe
-        return nes->controller_shift[controller_idx] & 0x01;
-    } else if (address == 0x4017) {
-        int controller_idx = 1;
-        return nes->controller_shift[controller_idx] & 0x01;
-    } else if (address >= 0x4000 && address < 0x4020) {
-        // APU/IO, return 0 for peek
-        return 0;
-    } else if (address >= 0x6000 && address < 0x8000) {
-        return 0; // PRG RAM peek
-    } else if (address >= 0x8000) {
-         return nes->bus->prgRom[(address - 0x8000) & 0x7FFF]; // NROM-like peek
-    }
-    return 0;
-}
-
-void BUS_Write(NES* nes, uint16_t address, uint8_t value) {
-    if (address < 0x2000) { // Internal RAM
-        nes->bus->memory[address & 0x07FF] = value;
-    } else if (address >= 0x2000 && address < 0x4000) { // PPU Registers
-        PPU_WriteRegister(nes->ppu, 0x2000 + (address & 0x0007), value);
-    } else if (address == 0x4014) { // OAM DMA
+static void BUS_WriteIO(NES* nes, uint16_t address, uint8_t value) {
+    if (address == 0x4014) { // OAM DMA
+        NES_SyncPPU(nes); // The PPU must not see the new OAM before the DMA happened
         uint16_t dma_page_addr = (uint16_t)value << 8;
         uint8_t oam_start_addr = nes->ppu->oam_addr; // OAMADDR might not be 0 before DMA
         
-        // DMA takes ~513-514 CPU cycles. CPU is halted.
-        // For emulation, this can be an instant copy.
-        // CPU_HaltDMA(); // Pseudo-function for cycle accounting if needed
+        // The copy itself is instant, the CPU is halted for 513 cycles plus one
+        // more when DMA starts on an odd cycle. The write is the last thing the
+        // instruction does, so the stall can go straight onto the CPU clock and
+        // the PPU catches up over it at the end of the burst.
         for (uint16_t i = 0; i < 256; ++i) {
             // OAM DMA reads from CPU bus, so use BUS_Read
             uint8_t byte_to_write = BUS_Read(nes, dma_page_addr + i);
             nes->ppu->oam[(oam_start_addr + i) & 0xFF] = byte_to_write;
         }
-        // CPU_ResumeDMA();
+        nes->cpu->total_cycles += 513 + (nes->cpu->total_cycles & 1);
         // OAM_ADDR is not changed by DMA hardware. Sprites are written starting at current OAM_ADDR, wrapping around.
     } else if (address == 0x4016) { // Controller Strobe
         nes->controller_strobe = value & 0x01;
@@ -125,18 +105,76 @@ void BUS_Write(NES* nes, uint16_t address, uint8_t value) {
             nes->controller_shift[0] = nes->controllers[0];
             nes->controller_shift[1] = nes->controllers[1];
         }
-    } else if (address >= 0x4000 && address < 0x4020) { // APU and I/O Registers
-        // Handle APU register writes
-        // Not fully implemented here
-        // e.g. nes->apu->WriteRegister(address, value);
-    } else if (address >= 0x6000 && address < 0x8000) { // PRG RAM (WRAM)
-        // Write to PRG RAM if present and enabled by mapper
-        // For now, writes are ignored as no explicit PRG RAM modelled here.
-    } else if (address >= 0x8000) { // PRG ROM
-        // Writes to PRG ROM are usually ignored, or handled by mapper for bank switching etc.
-        // For NROM, ignored.
     }
-    // Writes to unmapped regions are ignored.
+    // Handle APU register writes
+    // Not fully implemented here
+    // e.g. nes->apu->WriteRegister(address, value);
+}
+
+void BUS_Init(BUS* bus) {
+    // Everything starts unmapped: reads see open bus (0) and writes are dropped
+    for (int page = 0; page < BUS_PAGE_COUNT; ++page) {
+        BUS_SetReadPage(bus, page, bus->open_bus);
+        bus->write_pages[page] = bus->discard;
+    }
+    memset(bus->open_bus, 0, sizeof(bus->open_bus));
+
+    // $0000-$1FFF: 2KB internal RAM, mirrored every 0x0800 bytes
+    for (int mirror = 0; mirror < 4; ++mirror) {
+        BUS_MapPages(bus, (uint8_t)(mirror * 0x08), 0x08, bus->ram, bus->ram);
+    }
+
+    // $2000-$3FFF: PPU registers, $4000-$40FF: APU and I/O registers
+    BUS_MapHandlers(bus, 0x20, 0x20, BUS_ReadPPU, BUS_WritePPU);
+    BUS_MapHandlers(bus, 0x40, 0x01, BUS_ReadIO, BUS_WriteIO);
+
+    // $6000-$7FFF: 8KB PRG RAM
+    BUS_MapPages(bus, 0x60, 0x20, bus->prg_ram, bus->prg_ram);
+
+    // $8000-$FFFF: PRG ROM, mapped by MAPPER_Reset once a cartridge is loaded.
+    // Mappers swap these pointers for bank switching, writes go to their handlers.
+    for (int slot = 0; slot < BUS_CHR_SLOT_COUNT; ++slot) {
+        bus->chr_pages[slot] = bus_no_chr;
+    }
+}
+
+// --- CPU bus access ---
+
+uint8_t BUS_Read(NES* nes, uint16_t address) {
+    const uint8_t *page = nes->bus->read_pages[address >> 8];
+    if (page) {
+        return page[address & 0xFF];
+    }
+    return nes->bus->read_handlers[address >> 8](nes, address);
+}
+
+// BUS_Peek is for debuggers/tools that need to read memory without side effects.
+uint8_t BUS_Peek(NES* nes, uint16_t address) {
+    const uint8_t *page = nes->bus->read_pages[address >> 8];
+    if (page) {
+        return page[address & 0xFF];
+    } else if (address >= 0x2000 && address < 0x4000) {
+        // For PPU registers, peeking should ideally not trigger side effects like PPUSTATUS VBlank clear.
+        // PPU_PeekRegister should be implemented in ppu.c if needed.
+        // For now, forwarding to PPU_ReadRegister, which *does* have side effects for PPUSTATUS.
+        return PPU_ReadRegister(nes->ppu, 0x2000 + (address & 0x0007));
+    } else if (address == 0x4016) {
+        // Return current state of shift register bit 0 without shifting or reloading from strobe
+        return nes->controller_shift[0] & 0x01;
+    } else if (address == 0x4017) {
+        return nes->controller_shift[1] & 0x01;
+    }
+    // APU/IO and mapper registers, return 0 for peek
+    return 0;
+}
+
+void BUS_Write(NES* nes, uint16_t address, uint8_t value) {
+    uint8_t *page = nes->bus->write_pages[address >> 8];
+    if (page) {
+        page[address & 0xFF] = value;
+        return;
+    }
+    nes->bus->write_handlers[address >> 8](nes, address, value);
 }
 
 uint16_t BUS_Read16(NES* nes, uint16_t address) {
@@ -172,11 +210,9 @@ void BUS_Write16(NES* nes, uint16_t address, uint16_t value) {
 
 // PPU reads from CHR ROM/RAM
 uint8_t BUS_PPU_ReadCHR(struct BUS* bus_ptr, uint16_t address) {
-    // CHR data is mapped at $0000-$1FFF in PPU address space.
+    // CHR data is mapped at $0000-$1FFF in PPU address space, in 1KB slots the mapper points at its banks
     address &= 0x1FFF; // Ensure address is within 8KB range.
-    // Actual CHR size can vary (e.g. 0 for CHR-RAM). Mappers handle banking for larger CHR.
-    // This direct access assumes bus_ptr->chrRom points to the currently mapped 8KB bank.
-    return bus_ptr->chrRom[address]; // Assuming chrRom is at least 8KB
+    return bus_ptr->chr_pages[address / BUS_CHR_SLOT_SIZE][address % BUS_CHR_SLOT_SIZE];
 }
 
 // PPU writes to CHR RAM
@@ -184,46 +220,8 @@ void BUS_PPU_WriteCHR(struct BUS* bus_ptr, uint16_t address, uint8_t value) {
     address &= 0x1FFF;
     // Writes to CHR are only effective if it's CHR RAM.
     // bus_ptr->chrRomSize == 0 often indicates CHR RAM.
-    if (bus_ptr->chrRomSize == 0) { // Heuristic for CHR RAM
-        bus_ptr->chrRom[address] = value;
+    if (bus_ptr->chrRomSize == 0 && bus_ptr->chr) { // Heuristic for CHR RAM
+        bus_ptr->chr_pages[address / BUS_CHR_SLOT_SIZE][address % BUS_CHR_SLOT_SIZE] = value;
     }
     // If CHR ROM, writes are typically ignored by hardware.
 }
-
-// PPU reads from VRAM (nametables) and palette RAM
-uint8_t BUS_PPU_Read(struct BUS* bus, uint16_t address)
-{
-    address &= 0x3FFF;
-    if (address < 0x2000) {
-        // Pattern tables (CHR ROM/RAM)
-        return BUS_PPU_ReadCHR(bus, address);
-    } else if (address < 0x3F00) {
-        // Nametables and mirrors ($2000-$2FFF, mirrored to $3EFF)
-        // 2KB internal VRAM, mirrored every 0x1000
-        uint16_t vram_addr = (address - 0x2000) & 0x0FFF;
-        return bus->vram[vram_addr];
-    } else if (address < 0x4000) {
-        // Palette RAM indexes ($3F00-$3FFF), mirrored every 32 bytes
-        uint16_t pal_addr = (address - 0x3F00) & 0x1F;
-        return bus->palette[pal_addr];
-    }
-    return 0;
-}
-
-// PPU writes to VRAM (nametables) and palette RAM
-void BUS_PPU_Write(struct BUS* bus, uint16_t address, uint8_t value)
-{
-    address &= 0x3FFF;
-    if (address < 0x2000) {
-        // Pattern tables (CHR RAM only; ignore if CHR ROM)
-        BUS_PPU_WriteCHR(bus, address, value);
-    } else if (address < 0x3F00) {
-        // Nametables and mirrors ($2000-$2FFF, mirrored to $3EFF)
-        uint16_t vram_addr = (address - 0x2000) & 0x0FFF;
-        bus->vram[vram_addr] = value;
-    } else if (address < 0x4000) {
-        // Palette RAM indexes ($3F00-$3FFF), mirrored every 32 bytes
-        uint16_t pal_addr = (address - 0x3F00) & 0x1F;
-        bus->palette[pal_addr] = value;
-    }
-}
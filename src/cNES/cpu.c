@@ -1,13 +1,25 @@
 #include <stdlib.h>
 #include <string.h>
+#include <stdatomic.h>
 
 #include "debug.h"
 #include "cNES/nes.h"
 #include "cNES/bus.h"
 #include "cNES/ppu.h"
+#include "cNES/rom.h"
 
 #include "cNES/cpu.h"
 
+// The block recompiler emits x86-64, see CPU_SetRecompiler
+#if defined(__x86_64__) || defined(_M_X64)
+#define CPU_RECOMPILER
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+#endif
+
 CPU_Opcode cpu_opcodes[256] = {
     // Opcode 0x00 - 0x0F
     { CPU_MODE_IMPLIED, "BRK", 7 }, { CPU_MODE_INDEXED_INDIRECT, "ORA", 6 }, { CPU_MODE_IMPLIED, "KIL", 2 }, { CPU_MODE_INDEXED_INDIRECT, "SLO", 8 }, { CPU_MODE_ZERO_PAGE, "NOP", 3 }, { CPU_MODE_ZERO_PAGE, "ORA", 3 }, { CPU_MODE_ZERO_PAGE, "ASL", 5 }, { CPU_MODE_ZERO_PAGE, "SLO", 5 }, { CPU_MODE_IMPLIED, "PHP", 3 }, { CPU_MODE_IMMEDIATE, "ORA", 2 }, { CPU_MODE_ACCUMULATOR, "ASL", 2 }, { CPU_MODE_IMMEDIATE, "ANC", 2 }, { CPU_MODE_ABSOLUTE, "NOP", 4 }, { CPU_MODE_ABSOLUTE, "ORA", 4 }, { CPU_MODE_ABSOLUTE, "ASL", 6 }, { CPU_MODE_ABSOLUTE, "SLO", 6 },
@@ -26,7 +38,7 @@ CPU_Opcode cpu_opcodes[256] = {
     // Opcode 0x70 - 0x7F
     { CPU_MODE_RELATIVE, "BVS", 2 }, { CPU_MODE_INDIRECT_INDEXED, "ADC", 5 }, { CPU_MODE_IMPLIED, "KIL", 2 }, { CPU_MODE_INDIRECT_INDEXED, "RRA", 8 }, { CPU_MODE_ZERO_PAGE_X, "NOP", 4 }, { CPU_MODE_ZERO_PAGE_X, "ADC", 4 }, { CPU_MODE_ZERO_PAGE_X, "ROR", 6 }, { CPU_MODE_ZERO_PAGE_X, "RRA", 6 }, { CPU_MODE_IMPLIED, "SEI", 2 }, { CPU_MODE_ABSOLUTE_Y, "ADC", 4 }, { CPU_MODE_IMPLIED, "NOP", 2 }, { CPU_MODE_ABSOLUTE_Y, "RRA", 7 }, { CPU_MODE_ABSOLUTE_X, "NOP", 4 }, { CPU_MODE_ABSOLUTE_X, "ADC", 4 }, { CPU_MODE_ABSOLUTE_X, "ROR", 7 }, { CPU_MODE_ABSOLUTE_X, "RRA", 7 },
     // Opcode 0x80 - 0x8F
-    { CPU_MODE_IMMEDIATE, "NOP", 2 }, { CPU_MODE_INDEXED_INDIRECT, "STA", 6 }, { CPU_MODE_IMMEDIATE, "NOP", 2 }, { CPU_MODE_INDEXED_INDIRECT, "SAX", 6 }, { CPU_MODE_ZERO_PAGE, "STY", 3 }, { CPU_MODE_ZERO_PAGE, "STA", 3 }, { CPU_MODE_ZERO_PAGE, "STX", 3 }, { CPU_MODE_ZERO_PAGE, "SAX", 3 }, { CPU_MODE_IMPLIED, "DEY", 2 }, { CPU_MODE_IMPLIED, "NOP", 2 }, { CPU_MODE_IMPLIED, "TXA", 2 }, { CPU_MODE_IMMEDIATE, "XAA", 2 }, { CPU_MODE_ABSOLUTE, "STY", 4 }, { CPU_MODE_ABSOLUTE, "STA", 4 }, { CPU_MODE_ABSOLUTE, "STX", 4 }, { CPU_MODE_ABSOLUTE, "SAX", 4 },
+    { CPU_MODE_IMMEDIATE, "NOP", 2 }, { CPU_MODE_INDEXED_INDIRECT, "STA", 6 }, { CPU_MODE_IMMEDIATE, "NOP", 2 }, { CPU_MODE_INDEXED_INDIRECT, "SAX", 6 }, { CPU_MODE_ZERO_PAGE, "STY", 3 }, { CPU_MODE_ZERO_PAGE, "STA", 3 }, { CPU_MODE_ZERO_PAGE, "STX", 3 }, { CPU_MODE_ZERO_PAGE, "SAX", 3 }, { CPU_MODE_IMPLIED, "DEY", 2 }, { CPU_MODE_IMMEDIATE, "NOP", 2 }, { CPU_MODE_IMPLIED, "TXA", 2 }, { CPU_MODE_IMMEDIATE, "XAA", 2 }, { CPU_MODE_ABSOLUTE, "STY", 4 }, { CPU_MODE_ABSOLUTE, "STA", 4 }, { CPU_MODE_ABSOLUTE, "STX", 4 }, { CPU_MODE_ABSOLUTE, "SAX", 4 },
     // Opcode 0x90 - 0x9F
     { CPU_MODE_RELATIVE, "BCC", 2 }, { CPU_MODE_INDIRECT_INDEXED, "STA", 6 }, { CPU_MODE_IMPLIED, "KIL", 2 }, { CPU_MODE_INDIRECT_INDEXED, "AHX", 6 }, { CPU_MODE_ZERO_PAGE_X, "STY", 4 }, { CPU_MODE_ZERO_PAGE_X, "STA", 4 }, { CPU_MODE_ZERO_PAGE_Y, "STX", 4 }, { CPU_MODE_ZERO_PAGE_Y, "SAX", 4 }, { CPU_MODE_IMPLIED, "TYA", 2 }, { CPU_MODE_ABSOLUTE_Y, "STA", 5 }, { CPU_MODE_IMPLIED, "TXS", 2 }, { CPU_MODE_ABSOLUTE_Y, "TAS", 5 }, { CPU_MODE_ABSOLUTE_X, "SHY", 5 }, { CPU_MODE_ABSOLUTE_X, "STA", 5 }, { CPU_MODE_ABSOLUTE_Y, "SHX", 5 }, { CPU_MODE_ABSOLUTE_Y, "AHX", 5 },
     // Opcode 0xA0 - 0xAF
@@ -34,7 +46,7 @@ CPU_Opcode cpu_opcodes[256] = {
     // Opcode 0xB0 - 0xBF
     { CPU_MODE_RELATIVE, "BCS", 2 }, { CPU_MODE_INDIRECT_INDEXED, "LDA", 5 }, { CPU_MODE_IMPLIED, "KIL", 2 }, { CPU_MODE_INDIRECT_INDEXED, "LAX", 5 }, { CPU_MODE_ZERO_PAGE_X, "LDY", 4 }, { CPU_MODE_ZERO_PAGE_X, "LDA", 4 }, { CPU_MODE_ZERO_PAGE_Y, "LDX", 4 }, { CPU_MODE_ZERO_PAGE_Y, "LAX", 4 }, { CPU_MODE_IMPLIED, "CLV", 2 }, { CPU_MODE_ABSOLUTE_Y, "LDA", 4 }, { CPU_MODE_IMPLIED, "TSX", 2 }, { CPU_MODE_ABSOLUTE_Y, "LAS", 4 }, { CPU_MODE_ABSOLUTE_X, "LDY", 4 }, { CPU_MODE_ABSOLUTE_X, "LDA", 4 }, { CPU_MODE_ABSOLUTE_Y, "LDX", 4 }, { CPU_MODE_ABSOLUTE_Y, "LAX", 4 },
     // Opcode 0xC0 - 0xCF
-    { CPU_MODE_IMMEDIATE, "CPY", 2 }, { CPU_MODE_INDEXED_INDIRECT, "CMP", 6 }, { CPU_MODE_IMPLIED, "NOP", 2 }, { CPU_MODE_INDEXED_INDIRECT, "DCP", 8 }, { CPU_MODE_ZERO_PAGE, "CPY", 3 }, { CPU_MODE_ZERO_PAGE, "CMP", 3 }, { CPU_MODE_ZERO_PAGE, "DEC", 5 }, { CPU_MODE_ZERO_PAGE, "DCP", 5 }, { CPU_MODE_IMPLIED, "INY", 2 }, { CPU_MODE_IMMEDIATE, "CMP", 2 }, { CPU_MODE_IMPLIED, "DEX", 2 }, { CPU_MODE_IMMEDIATE, "AXS", 2 }, { CPU_MODE_ABSOLUTE, "CPY", 4 }, { CPU_MODE_ABSOLUTE, "CMP", 4 }, { CPU_MODE_ABSOLUTE, "DEC", 6 }, { CPU_MODE_ABSOLUTE, "DCP", 6 },
+    { CPU_MODE_IMMEDIATE, "CPY", 2 }, { CPU_MODE_INDEXED_INDIRECT, "CMP", 6 }, { CPU_MODE_IMMEDIATE, "NOP", 2 }, { CPU_MODE_INDEXED_INDIRECT, "DCP", 8 }, { CPU_MODE_ZERO_PAGE, "CPY", 3 }, { CPU_MODE_ZERO_PAGE, "CMP", 3 }, { CPU_MODE_ZERO_PAGE, "DEC", 5 }, { CPU_MODE_ZERO_PAGE, "DCP", 5 }, { CPU_MODE_IMPLIED, "INY", 2 }, { CPU_MODE_IMMEDIATE, "CMP", 2 }, { CPU_MODE_IMPLIED, "DEX", 2 }, { CPU_MODE_IMMEDIATE, "AXS", 2 }, { CPU_MODE_ABSOLUTE, "CPY", 4 }, { CPU_MODE_ABSOLUTE, "CMP", 4 }, { CPU_MODE_ABSOLUTE, "DEC", 6 }, { CPU_MODE_ABSOLUTE, "DCP", 6 },
     // Opcode 0xD0 - 0xDF
     { CPU_MODE_RELATIVE, "BNE", 2 }, { CPU_MODE_INDIRECT_INDEXED, "CMP", 5 }, { CPU_MODE_IMPLIED, "KIL", 2 }, { CPU_MODE_INDIRECT_INDEXED, "DCP", 8 }, { CPU_MODE_ZERO_PAGE_X, "NOP", 4 }, { CPU_MODE_ZERO_PAGE_X, "CMP", 4 }, { CPU_MODE_ZERO_PAGE_X, "DEC", 6 }, { CPU_MODE_ZERO_PAGE_X, "DCP", 6 }, { CPU_MODE_IMPLIED, "CLD", 2 }, { CPU_MODE_ABSOLUTE_Y, "CMP", 4 }, { CPU_MODE_IMPLIED, "NOP", 2 }, { CPU_MODE_ABSOLUTE_Y, "DCP", 7 }, { CPU_MODE_ABSOLUTE_X, "NOP", 4 }, { CPU_MODE_ABSOLUTE_X, "CMP", 4 }, { CPU_MODE_ABSOLUTE_X, "DEC", 7 }, { CPU_MODE_ABSOLUTE_X, "DCP", 7 },
     // Opcode 0xE0 - 0xEF
@@ -43,13 +55,11 @@ CPU_Opcode cpu_opcodes[256] = {
     { CPU_MODE_RELATIVE, "BEQ", 2 }, { CPU_MODE_INDIRECT_INDEXED, "SBC", 5 }, { CPU_MODE_IMPLIED, "KIL", 2 }, { CPU_MODE_INDIRECT_INDEXED, "ISC", 8 }, { CPU_MODE_ZERO_PAGE_X, "NOP", 4 }, { CPU_MODE_ZERO_PAGE_X, "SBC", 4 }, { CPU_MODE_ZERO_PAGE_X, "INC", 6 }, { CPU_MODE_ZERO_PAGE_X, "ISC", 6 }, { CPU_MODE_IMPLIED, "SED", 2 }, { CPU_MODE_ABSOLUTE_Y, "SBC", 4 }, { CPU_MODE_IMPLIED, "NOP", 2 }, { CPU_MODE_ABSOLUTE_Y, "ISC", 7 }, { CPU_MODE_ABSOLUTE_X, "NOP", 4 }, { CPU_MODE_ABSOLUTE_X, "SBC", 4 }, { CPU_MODE_ABSOLUTE_X, "INC", 7 }, { CPU_MODE_ABSOLUTE_X, "ISC", 7 },
 };
 
-CPU *CPU_Create(NES *nes) 
+void CPU_Init(CPU *cpu, NES *nes) 
 {
-    // Initialize CPU
-    CPU *cpu = malloc(sizeof(CPU));
     memset(cpu, 0, sizeof(CPU)); 
     cpu->nes = nes;
-    return cpu;
+    cpu->decode_pages = nes->bus->decode_pages;
 }
 
 void CPU_Reset(CPU *cpu) 
@@ -65,14 +75,14 @@ void CPU_Reset(CPU *cpu)
 
 static inline void CPU_Push(CPU *cpu, uint8_t value) 
 {
-    cpu->nes->bus->memory[0x0100 + cpu->sp] = value; // Push to stack
+    cpu->nes->bus->ram[0x0100 + cpu->sp] = value; // Push to stack
     cpu->sp = (cpu->sp - 1) & 0xFF; // Decrement stack pointer and wrap at 0xFF
 }
 
 static inline uint8_t CPU_Pop(CPU *cpu) 
 {
     cpu->sp = (cpu->sp + 1) & 0xFF; // Increment stack pointer and wrap at 0xFF
-    return cpu->nes->bus->memory[0x0100 + cpu->sp]; // Pop from stack
+    return cpu->nes->bus->ram[0x0100 + cpu->sp]; // Pop from stack
 }
 
 static inline void CPU_Push16(CPU *cpu, uint16_t value) 
@@ -113,240 +123,223 @@ static inline void CPU_SetNegativeFlag(CPU *cpu, uint8_t value)
 }
 
 // Addressing modes
-static inline uint16_t CPU_Immediate(CPU *cpu) 
-{
-    return cpu->pc++; // Immediate mode, just return the current PC and increment
-}
-
-static inline uint16_t CPU_Accumulator(CPU *cpu) 
+// The operand bytes are fetched by CPU_Step before the handler runs, so these
+// only turn the raw operand into an effective address. Indexed reads add their
+// page crossing penalty to *cycles; writes and read-modify-write pass NULL since
+// they always take the fixed cycle count.
+static inline uint16_t CPU_Address_ZP(CPU *cpu, uint16_t operand, int *cycles) 
 {
-    return 0; // Accumulator mode, no address needed
+    return operand & 0x00FF; // Zero page mode
 }
 
-static inline uint16_t CPU_Implied(CPU *cpu) 
+static inline uint16_t CPU_Address_ZPX(CPU *cpu, uint16_t operand, int *cycles) 
 {
-    return 0; // Implied mode, no address needed
+    return (operand + cpu->x) & 0x00FF; // Zero page X mode, wraps inside zero page
 }
 
-static inline uint16_t CPU_ZeroPage(CPU *cpu) 
+static inline uint16_t CPU_Address_ZPY(CPU *cpu, uint16_t operand, int *cycles) 
 {
-    return BUS_Read(cpu->nes, cpu->pc++); // Zero page mode, read the address from memory
+    return (operand + cpu->y) & 0x00FF; // Zero page Y mode, wraps inside zero page
 }
 
-static inline uint16_t CPU_ZeroPageX(CPU *cpu) 
+static inline uint16_t CPU_Address_REL(CPU *cpu, uint16_t operand, int *cycles) 
 {
-    return (BUS_Read(cpu->nes, cpu->pc++) + cpu->x) & 0xFF; // Zero page X mode
+    return (uint16_t)(cpu->pc + (int8_t)operand); // PC already points past the branch
 }
 
-static inline uint16_t CPU_ZeroPageY(CPU *cpu) 
+static inline uint16_t CPU_Address_ABS(CPU *cpu, uint16_t operand, int *cycles) 
 {
-    return (BUS_Read(cpu->nes, cpu->pc++) + cpu->y) & 0xFF; // Zero page Y mode
+    return operand; // Absolute mode
 }
 
-static inline uint16_t CPU_Relative(CPU *cpu) 
+static inline uint16_t CPU_Address_ABX(CPU *cpu, uint16_t operand, int *cycles) 
 {
-    int8_t offset = (int8_t)BUS_Read(cpu->nes, cpu->pc++); // Read signed offset
-    return (uint16_t)(cpu->pc + offset); // Calculate effective address with explicit cast
-}
-
-static inline uint16_t CPU_Absolute(CPU *cpu) 
-{
-    uint16_t address = BUS_Read16(cpu->nes, cpu->pc); // Absolute mode, read the address from memory
-    cpu->pc += 2; // Increment program counter by 2
+    uint16_t address = (uint16_t)(operand + cpu->x); // Add X register
+    if (cycles && (operand & 0xFF00) != (address & 0xFF00)) 
+        (*cycles)++; // Add cycle penalty for page crossing
     return address;
 }
 
-static inline uint16_t CPU_AbsoluteX(CPU *cpu) 
+static inline uint16_t CPU_Address_ABY(CPU *cpu, uint16_t operand, int *cycles) 
 {
-    uint16_t base_addr = BUS_Read16(cpu->nes, cpu->pc); // Read base address
-    cpu->pc += 2; // Increment program counter by 2
-    uint16_t final_addr = base_addr + cpu->x; // Add X register
-
-    // Check for page boundary crossing
-    if ((base_addr & 0xFF00) != (final_addr & 0xFF00)) 
-        cpu->total_cycles++; // Add cycle penalty
-    
-    return final_addr; // Return effective address
-}
-
-static inline uint16_t CPU_AbsoluteY(CPU *cpu) 
-{
-    uint16_t base_addr = BUS_Read16(cpu->nes, cpu->pc); // Read base address
-    cpu->pc += 2; // Increment program counter by 2
-    uint16_t final_addr = base_addr + cpu->y; // Add Y register
-    if ((base_addr & 0xFF00) != (final_addr & 0xFF00)) { // Check for page boundary crossing
-        cpu->total_cycles++; // Add cycle penalty
-    }
-    return final_addr; // Return effective address
+    uint16_t address = (uint16_t)(operand + cpu->y); // Add Y register
+    if (cycles && (operand & 0xFF00) != (address & 0xFF00)) 
+        (*cycles)++; // Add cycle penalty for page crossing
+    return address;
 }
 
-static inline uint16_t CPU_Indirect(CPU *cpu) 
+static inline uint16_t CPU_Address_IND(CPU *cpu, uint16_t operand, int *cycles) 
 {
-    uint16_t addr = BUS_Read16(cpu->nes, cpu->pc); // Read address from memory
-    uint16_t lo = BUS_Read(cpu->nes, addr); // Read low byte
-    uint16_t hi = BUS_Read(cpu->nes, (addr & 0xFF00) | ((addr + 1) & 0x00FF)); // Handle page boundary bug
-    return (hi << 8) | lo; // Combine into 16-bit address
+    uint16_t lo = BUS_Read(cpu->nes, operand); // Read low byte
+    uint16_t hi = BUS_Read(cpu->nes, (operand & 0xFF00) | ((operand + 1) & 0x00FF)); // Handle page boundary bug
+    return (uint16_t)((hi << 8) | lo); // Combine into 16-bit address
 }
 
-static inline uint16_t CPU_IndexedIndirect(CPU *cpu) 
+static inline uint16_t CPU_Address_IZX(CPU *cpu, uint16_t operand, int *cycles) 
 {
-    uint8_t zp_addr = (BUS_Read(cpu->nes, cpu->pc++) + cpu->x) & 0xFF; // Add X and wrap around zero page
+    uint8_t zp_addr = (operand + cpu->x) & 0xFF; // Add X and wrap around zero page
     uint8_t lo = BUS_Read(cpu->nes, zp_addr); // Read low byte
     uint8_t hi = BUS_Read(cpu->nes, (zp_addr + 1) & 0xFF); // Read high byte, wrap around zero page
     return (uint16_t)lo | ((uint16_t)hi << 8); // Combine into 16-bit address
 }
 
-static inline uint16_t CPU_IndirectIndexed(CPU *cpu) 
+static inline uint16_t CPU_Address_IZY(CPU *cpu, uint16_t operand, int *cycles) 
 {
-    uint8_t zp_addr = BUS_Read(cpu->nes, cpu->pc++); // Read zero page address
+    uint8_t zp_addr = operand & 0xFF; // Zero page pointer
     uint16_t base_addr = (uint16_t)BUS_Read(cpu->nes, zp_addr) | ((uint16_t)BUS_Read(cpu->nes, (zp_addr + 1) & 0xFF) << 8); // Handle zero-page wraparound
-    uint16_t final_addr = base_addr + cpu->y; // Add Y register to base address
-
-    // Check for page boundary crossing
-    if ((base_addr & 0xFF00) != (final_addr & 0xFF00))
-        cpu->total_cycles++; // Add cycle penalty for page crossing
-
-    return final_addr; // Return the effective address
+    uint16_t address = (uint16_t)(base_addr + cpu->y); // Add Y register to base address
+    if (cycles && (base_addr & 0xFF00) != (address & 0xFF00))
+        (*cycles)++; // Add cycle penalty for page crossing
+    return address;
 }
 
 // Load/Store Operations
-void CPU_LDA(CPU *cpu, uint16_t address) 
+static inline void CPU_LDA(CPU *cpu, uint8_t value) 
 {
-    cpu->a = BUS_Read(cpu->nes, address); // Load A from memory
+    cpu->a = value; // Load A from memory
     CPU_UpdateZeroNegativeFlags(cpu, cpu->a); // Update flags
 }
 
-void CPU_LDX(CPU *cpu, uint16_t address) 
+static inline void CPU_LDX(CPU *cpu, uint8_t value) 
 {
-    cpu->x = BUS_Read(cpu->nes, address); // Load X from memory
+    cpu->x = value; // Load X from memory
     CPU_UpdateZeroNegativeFlags(cpu, cpu->x); // Update flags
 }
 
-void CPU_LDY(CPU *cpu, uint16_t address) 
+static inline void CPU_LDY(CPU *cpu, uint8_t value) 
 {
-    cpu->y = BUS_Read(cpu->nes, address); // Load Y from memory
+    cpu->y = value; // Load Y from memory
     CPU_UpdateZeroNegativeFlags(cpu, cpu->y); // Update flags
 }
 
-void CPU_STA(CPU *cpu, uint16_t address) 
+static inline void CPU_STA(CPU *cpu, uint16_t address) 
 {
     BUS_Write(cpu->nes, address, cpu->a); // Store A to memory
 }
 
-void CPU_STX(CPU *cpu, uint16_t address) 
+static inline void CPU_STX(CPU *cpu, uint16_t address) 
 {
     BUS_Write(cpu->nes, address, cpu->x); // Store X to memory
 }
 
-void CPU_STY(CPU *cpu, uint16_t address) 
+static inline void CPU_STY(CPU *cpu, uint16_t address) 
 {
     BUS_Write(cpu->nes, address, cpu->y); // Store Y to memory
 }
 
 // Register Transfer Operations
-void CPU_TAX(CPU *cpu) 
+static inline void CPU_TAX(CPU *cpu) 
 {
     cpu->x = cpu->a; // Transfer A to X
     CPU_UpdateZeroNegativeFlags(cpu, cpu->x); // Update flags
 }
 
-void CPU_TAY(CPU *cpu) 
+static inline void CPU_TAY(CPU *cpu) 
 {
     cpu->y = cpu->a; // Transfer A to Y
     CPU_UpdateZeroNegativeFlags(cpu, cpu->y); // Update flags
 }
 
-void CPU_TSX(CPU *cpu) 
+static inline void CPU_TSX(CPU *cpu) 
 {
     cpu->x = cpu->sp; // Transfer SP to X
     CPU_UpdateZeroNegativeFlags(cpu, cpu->x); // Update flags
 }
 
-void CPU_TXA(CPU *cpu) 
+static inline void CPU_TXA(CPU *cpu) 
 {
     cpu->a = cpu->x; // Transfer X to A
     CPU_UpdateZeroNegativeFlags(cpu, cpu->a); // Update flags
 }
 
-void CPU_TYA(CPU *cpu) 
+static inline void CPU_TYA(CPU *cpu) 
 {
     cpu->a = cpu->y; // Transfer Y to A
     CPU_UpdateZeroNegativeFlags(cpu, cpu->a); // Update flags
 }
 
-void CPU_TXS(CPU *cpu) 
+static inline void CPU_TXS(CPU *cpu) 
 {
     cpu->sp = cpu->x; // Transfer X to SP
 }
 
 // Stack Operations
-void CPU_PHA(CPU *cpu) 
+static inline void CPU_PHA(CPU *cpu) 
 {
     CPU_Push(cpu, cpu->a); // Push A to stack
 }
 
-void CPU_PLA(CPU *cpu) 
+static inline void CPU_PLA(CPU *cpu) 
 {
     cpu->a = CPU_Pop(cpu); // Pull A from stack
     CPU_UpdateZeroNegativeFlags(cpu, cpu->a); // Update flags
 }
 
-void CPU_PHP(CPU *cpu) 
+static inline void CPU_PHP(CPU *cpu) 
 {
     CPU_Push(cpu, cpu->status | CPU_FLAG_BREAK | CPU_FLAG_UNUSED); // Push status to stack
 }
 
-void CPU_PLP(CPU *cpu) 
+static inline void CPU_PLP(CPU *cpu) 
 {
     cpu->status = CPU_Pop(cpu); // Pull status from stack
     CPU_SetFlag(cpu, CPU_FLAG_BREAK, 0); // Clear break flag
     CPU_SetFlag(cpu, CPU_FLAG_UNUSED, 1); // Set unused flag
 }
 
+// Read-modify-write instructions write the value they read straight back on the
+// cycle before the result. Only registers can tell, plain memory skips the dummy write
+static inline uint8_t CPU_ReadModify(CPU *cpu, uint16_t address) 
+{
+    uint8_t value = BUS_Read(cpu->nes, address);
+    if (!cpu->nes->bus->write_pages[address >> 8])
+        BUS_Write(cpu->nes, address, value); // Dummy write
+    return value;
+}
+
 // Decrement/Increment Operations
-void CPU_DEC(CPU *cpu, uint16_t address) 
+static inline void CPU_DEC(CPU *cpu, uint16_t address) 
 {
-    uint8_t value = BUS_Read(cpu->nes, address) - 1; // Decrement memory
+    uint8_t value = CPU_ReadModify(cpu, address) - 1; // Decrement memory
     BUS_Write(cpu->nes, address, value); // Write back to memory
     CPU_UpdateZeroNegativeFlags(cpu, value); // Update flags
 }
 
-void CPU_INC(CPU *cpu, uint16_t address) 
+static inline void CPU_INC(CPU *cpu, uint16_t address) 
 {
-    uint8_t value = BUS_Read(cpu->nes, address) + 1; // Increment memory
+    uint8_t value = CPU_ReadModify(cpu, address) + 1; // Increment memory
     BUS_Write(cpu->nes, address, value); // Write back to memory
     CPU_UpdateZeroNegativeFlags(cpu, value); // Update flags
 }
 
 // Decrement/Increment Register Operations
-void CPU_DEX(CPU *cpu) 
+static inline void CPU_DEX(CPU *cpu) 
 {
     cpu->x--; // Decrement X
     CPU_UpdateZeroNegativeFlags(cpu, cpu->x); // Update flags
 }
 
-void CPU_DEY(CPU *cpu) 
+static inline void CPU_DEY(CPU *cpu) 
 {
     cpu->y--; // Decrement Y
     CPU_UpdateZeroNegativeFlags(cpu, cpu->y); // Update flags
 }
 
-void CPU_INX(CPU *cpu) 
+static inline void CPU_INX(CPU *cpu) 
 {
     cpu->x++; // Increment X
     CPU_UpdateZeroNegativeFlags(cpu, cpu->x); // Update flags
 }
 
-void CPU_INY(CPU *cpu) 
+static inline void CPU_INY(CPU *cpu) 
 {
     cpu->y++; // Increment Y
     CPU_UpdateZeroNegativeFlags(cpu, cpu->y); // Update flags
 }
 
 // Arithmetic Operations
-void CPU_ADC(CPU *cpu, uint16_t address) 
+static inline void CPU_ADC(CPU *cpu, uint8_t operand) 
 {
-    uint8_t operand = BUS_Read(cpu->nes, address); // Read operand from memory
     uint8_t carry = CPU_GetFlag(cpu, CPU_FLAG_CARRY) ? 1 : 0; // Get carry flag
     uint16_t sum = (uint16_t)((uint32_t)cpu->a + (uint32_t)operand + (uint32_t)carry); // Calculate sum
 
@@ -360,9 +353,8 @@ void CPU_ADC(CPU *cpu, uint16_t address)
     CPU_UpdateZeroNegativeFlags(cpu, cpu->a); // Update flags
 }
 
-void CPU_SBC(CPU *cpu, uint16_t address) 
+static inline void CPU_SBC(CPU *cpu, uint8_t operand) 
 {
-    uint8_t operand = BUS_Read(cpu->nes, address);
     uint8_t value = operand ^ 0xFF; // Invert for subtraction
     uint8_t carry = CPU_GetFlag(cpu, CPU_FLAG_CARRY) ? 1 : 0;
     uint16_t sum = (uint16_t)((int)cpu->a + (int)value + (int)carry);
@@ -378,41 +370,41 @@ void CPU_SBC(CPU *cpu, uint16_t address)
 }
 
 // Shift Operations
-void CPU_ASL(CPU *cpu, uint16_t address) 
+static inline void CPU_ASL(CPU *cpu, uint16_t address) 
 {
-    uint8_t value = BUS_Read(cpu->nes, address); // Read value from memory
+    uint8_t value = CPU_ReadModify(cpu, address); // Read value from memory
     CPU_SetFlag(cpu, CPU_FLAG_CARRY, (value & 0x80) != 0); // Set carry flag
     value <<= 1; // Shift left
     BUS_Write(cpu->nes, address, value); // Write back to memory
     CPU_UpdateZeroNegativeFlags(cpu, value); // Update flags
 }
 
-void CPU_ASL_A(CPU *cpu) 
+static inline void CPU_ASL_A(CPU *cpu) 
 {
     CPU_SetFlag(cpu, CPU_FLAG_CARRY, (cpu->a & 0x80) != 0); // Set carry flag
     cpu->a <<= 1; // Shift left
     CPU_UpdateZeroNegativeFlags(cpu, cpu->a); // Update flags
 }
 
-void CPU_LSR(CPU *cpu, uint16_t address) 
+static inline void CPU_LSR(CPU *cpu, uint16_t address) 
 {
-    uint8_t value = BUS_Read(cpu->nes, address); // Read value from memory
+    uint8_t value = CPU_ReadModify(cpu, address); // Read value from memory
     CPU_SetFlag(cpu, CPU_FLAG_CARRY, (value & 0x01) != 0); // Set carry flag
     value >>= 1; // Shift right
     BUS_Write(cpu->nes, address, value); // Write back to memory
     CPU_UpdateZeroNegativeFlags(cpu, value); // Update flags
 }
 
-void CPU_LSR_A(CPU *cpu) 
+static inline void CPU_LSR_A(CPU *cpu) 
 {
     CPU_SetFlag(cpu, CPU_FLAG_CARRY, (cpu->a & 0x01) != 0); // Set carry flag
     cpu->a >>= 1; // Shift right
     CPU_UpdateZeroNegativeFlags(cpu, cpu->a); // Update flags
 }
 
-void CPU_ROL(CPU *cpu, uint16_t address) 
+static inline void CPU_ROL(CPU *cpu, uint16_t address) 
 {
-    uint8_t value = BUS_Read(cpu->nes, address); // Read value from memory
+    uint8_t value = CPU_ReadModify(cpu, address); // Read value from memory
     int old_carry = CPU_GetFlag(cpu, CPU_FLAG_CARRY); // Get old carry flag
     CPU_SetFlag(cpu, CPU_FLAG_CARRY, (value & 0x80) != 0); // Set carry flag
     value <<= 1; // Shift left
@@ -421,7 +413,7 @@ void CPU_ROL(CPU *cpu, uint16_t address)
     CPU_UpdateZeroNegativeFlags(cpu, value); // Update flags
 }
 
-void CPU_ROL_A(CPU *cpu) 
+static inline void CPU_ROL_A(CPU *cpu) 
 {
     int old_carry = CPU_GetFlag(cpu, CPU_FLAG_CARRY); // Get old carry flag
     CPU_SetFlag(cpu, CPU_FLAG_CARRY, (cpu->a & 0x80) != 0); // Set carry flag
@@ -430,9 +422,9 @@ void CPU_ROL_A(CPU *cpu)
     CPU_UpdateZeroNegativeFlags(cpu, cpu->a); // Update flags
 }
 
-void CPU_ROR(CPU *cpu, uint16_t address) 
+static inline void CPU_ROR(CPU *cpu, uint16_t address) 
 {
-    uint8_t value = BUS_Read(cpu->nes, address); // Read value from memory
+    uint8_t value = CPU_ReadModify(cpu, address); // Read value from memory
     int old_carry = CPU_GetFlag(cpu, CPU_FLAG_CARRY); // Get old carry flag
     CPU_SetFlag(cpu, CPU_FLAG_CARRY, (value & 0x01) != 0); // Set carry flag
     value >>= 1; // Shift right
@@ -441,7 +433,7 @@ void CPU_ROR(CPU *cpu, uint16_t address)
     CPU_UpdateZeroNegativeFlags(cpu, value); // Update flags
 }
 
-void CPU_ROR_A(CPU *cpu) 
+static inline void CPU_ROR_A(CPU *cpu) 
 {
     int old_carry = CPU_GetFlag(cpu, CPU_FLAG_CARRY); // Get old carry flag
     CPU_SetFlag(cpu, CPU_FLAG_CARRY, (cpu->a & 0x01) != 0); // Set carry flag
@@ -451,180 +443,130 @@ void CPU_ROR_A(CPU *cpu)
 }
 
 // Logic Operations
-void CPU_AND(CPU *cpu, uint16_t address) 
+static inline void CPU_AND(CPU *cpu, uint8_t value) 
 {
-    cpu->a &= BUS_Read(cpu->nes, address); // AND A with memory
+    cpu->a &= value; // AND A with memory
     CPU_UpdateZeroNegativeFlags(cpu, cpu->a); // Update flags
 }
 
-void CPU_EOR(CPU *cpu, uint16_t address) 
+static inline void CPU_EOR(CPU *cpu, uint8_t value) 
 {
-    cpu->a ^= BUS_Read(cpu->nes, address); // EOR A with memory
+    cpu->a ^= value; // EOR A with memory
     CPU_UpdateZeroNegativeFlags(cpu, cpu->a); // Update flags
 }
 
-void CPU_ORA(CPU *cpu, uint16_t address) 
+static inline void CPU_ORA(CPU *cpu, uint8_t value) 
 {
-    cpu->a |= BUS_Read(cpu->nes, address); // OR A with memory
+    cpu->a |= value; // OR A with memory
     CPU_UpdateZeroNegativeFlags(cpu, cpu->a); // Update flags
 }
 
-void CPU_BIT(CPU *cpu, uint16_t address) 
+static inline void CPU_BIT(CPU *cpu, uint8_t value) 
 {
-    uint8_t value = BUS_Read(cpu->nes, address); // Read value from memory
     CPU_SetFlag(cpu, CPU_FLAG_ZERO, (cpu->a & value) == 0); // Set zero flag if result is zero
     CPU_SetFlag(cpu, CPU_FLAG_OVERFLOW, (value & 0x40) != 0); // Set overflow flag if bit 6 is set
     CPU_SetFlag(cpu, CPU_FLAG_NEGATIVE, (value & 0x80) != 0); // Set negative flag if bit 7 is set
 }
 
 // Compare Operations
-void CPU_CPX(CPU *cpu, uint16_t address) 
+static inline void CPU_CPX(CPU *cpu, uint8_t value) 
 {
-    uint8_t value = BUS_Read(cpu->nes, address); // Read value from memory
     uint16_t result = (uint16_t)cpu->x - (uint16_t)value; // Compare X with memory
     CPU_SetFlag(cpu, CPU_FLAG_CARRY, cpu->x >= value); // Set carry flag if no borrow
     CPU_UpdateZeroNegativeFlags(cpu, (uint8_t)(result & 0xFF)); // Update flags
 }
 
-void CPU_CPY(CPU *cpu, uint16_t address) 
+static inline void CPU_CPY(CPU *cpu, uint8_t value) 
 {
-    uint8_t value = BUS_Read(cpu->nes, address); // Read value from memory
     uint16_t result = (uint16_t)cpu->y - (uint16_t)value; // Compare Y with memory
     CPU_SetFlag(cpu, CPU_FLAG_CARRY, cpu->y >= value); // Set carry flag if no borrow
     CPU_UpdateZeroNegativeFlags(cpu, (uint8_t)(result & 0xFF)); // Update flags
 }
 
-void CPU_CMP(CPU *cpu, uint16_t address) 
+static inline void CPU_CMP(CPU *cpu, uint8_t value) 
 {
-    uint8_t value = BUS_Read(cpu->nes, address); // Read value from memory
     uint16_t result = (uint16_t)cpu->a - (uint16_t)value; // Compare A with memory
     CPU_SetFlag(cpu, CPU_FLAG_CARRY, cpu->a >= value); // Set carry flag if A >= value (fixed)
     CPU_UpdateZeroNegativeFlags(cpu, (uint8_t)(result & 0xFF)); // Update flags
 }
 
 // Branch Operations
-void CPU_BCC(CPU *cpu, uint16_t address) 
-{
-    if (!CPU_GetFlag(cpu, CPU_FLAG_CARRY)) { // Branch if carry flag is clear
-        uint16_t old_pc = cpu->pc; // Store old program counter
-        cpu->pc = address; // Set program counter to address
-        cpu->total_cycles++; // Add cycle for branch taken
-        if ((old_pc & 0xFF00) != (cpu->pc & 0xFF00)) { // Check if page boundary is crossed
-            cpu->total_cycles++; // Add cycle penalty for page crossing
-        }
-    }
+// Branches return the extra cycles they cost: one when taken, two when the
+// target lies on another page.
+static inline int CPU_Branch(CPU *cpu, int condition, uint16_t address) 
+{
+    if (!condition)
+        return 0;
+
+    uint16_t old_pc = cpu->pc; // Store old program counter
+    cpu->pc = address; // Set program counter to address
+    return ((old_pc & 0xFF00) != (address & 0xFF00)) ? 2 : 1; // Page crossing costs one more
 }
 
-void CPU_BCS(CPU *cpu, uint16_t address) 
+static inline int CPU_BCC(CPU *cpu, uint16_t address) 
 {
-    if (CPU_GetFlag(cpu, CPU_FLAG_CARRY)) { // Branch if carry flag is set
-        uint16_t old_pc = cpu->pc; // Store old program counter
-        cpu->pc = address; // Set program counter to address
-        cpu->total_cycles++; // Add cycle for branch taken
-        if ((old_pc & 0xFF00) != (cpu->pc & 0xFF00)) { // Check if page boundary is crossed
-            cpu->total_cycles++; // Add cycle penalty for page crossing
-        }
-    }
+    return CPU_Branch(cpu, !CPU_GetFlag(cpu, CPU_FLAG_CARRY), address); // Branch if carry flag is clear
 }
 
-void CPU_BEQ(CPU *cpu, uint16_t address) 
+static inline int CPU_BCS(CPU *cpu, uint16_t address) 
 {
-    if (CPU_GetFlag(cpu, CPU_FLAG_ZERO)) { // Branch if zero flag is set
-        uint16_t old_pc = cpu->pc; // Store old program counter
-        cpu->pc = address; // Set program counter to address
-        cpu->total_cycles++; // Add cycle for branch taken
-        if ((old_pc & 0xFF00) != (cpu->pc & 0xFF00)) { // Check if page boundary is crossed
-            cpu->total_cycles++; // Add cycle penalty for page crossing
-        }
-    }
+    return CPU_Branch(cpu, CPU_GetFlag(cpu, CPU_FLAG_CARRY), address); // Branch if carry flag is set
 }
 
-void CPU_BNE(CPU *cpu, uint16_t address) 
+static inline int CPU_BEQ(CPU *cpu, uint16_t address) 
 {
-    if (!CPU_GetFlag(cpu, CPU_FLAG_ZERO)) { // Branch if zero flag is clear
-        uint16_t old_pc = cpu->pc; // Store old program counter
-        cpu->pc = address; // Set program counter to address
-        cpu->total_cycles++; // Add cycle for branch taken
-        if ((old_pc & 0xFF00) != (cpu->pc & 0xFF00)) { // Check if page boundary is crossed
-            cpu->total_cycles++; // Add cycle penalty for page crossing
-        }
-    }
+    return CPU_Branch(cpu, CPU_GetFlag(cpu, CPU_FLAG_ZERO), address); // Branch if zero flag is set
 }
 
-void CPU_BMI(CPU *cpu, uint16_t address) 
+static inline int CPU_BNE(CPU *cpu, uint16_t address) 
 {
-    if (CPU_GetFlag(cpu, CPU_FLAG_NEGATIVE)) { // Branch if negative flag is set
-        uint16_t old_pc = cpu->pc; // Store old program counter
-        cpu->pc = address; // Set program counter to address
-        cpu->total_cycles++; // Add cycle for branch taken
-        if ((old_pc & 0xFF00) != (cpu->pc & 0xFF00)) { // Check if page boundary is crossed
-            cpu->total_cycles++; // Add cycle penalty for page crossing
-        }
-    }
+    return CPU_Branch(cpu, !CPU_GetFlag(cpu, CPU_FLAG_ZERO), address); // Branch if zero flag is clear
 }
 
-void CPU_BPL(CPU *cpu, uint16_t address) 
+static inline int CPU_BMI(CPU *cpu, uint16_t address) 
 {
-    if (!CPU_GetFlag(cpu, CPU_FLAG_NEGATIVE)) { // Branch if negative flag is clear
-        uint16_t old_pc = cpu->pc; // Store old program counter
-        cpu->pc = address; // Set program counter to address
-        cpu->total_cycles++; // Add cycle for branch taken
-        if ((old_pc & 0xFF00) != (cpu->pc & 0xFF00)) { // Check if page boundary is crossed
-            cpu->total_cycles++; // Add cycle penalty for page crossing
-        }
-    }
+    return CPU_Branch(cpu, CPU_GetFlag(cpu, CPU_FLAG_NEGATIVE), address); // Branch if negative flag is set
 }
 
-void CPU_BVS(CPU *cpu, uint16_t address) 
+static inline int CPU_BPL(CPU *cpu, uint16_t address) 
 {
-    if (CPU_GetFlag(cpu, CPU_FLAG_OVERFLOW)) 
-    { // Branch if overflow flag is set
-        uint16_t old_pc = cpu->pc; // Store old program counter
-        cpu->pc = address; // Set program counter to address
-        cpu->total_cycles++; // Add cycle for branch taken
-        if ((old_pc & 0xFF00) != (cpu->pc & 0xFF00)) 
-        { // Check if page boundary is crossed
-            cpu->total_cycles++; // Add cycle penalty for page crossing
-        }
-    }
+    return CPU_Branch(cpu, !CPU_GetFlag(cpu, CPU_FLAG_NEGATIVE), address); // Branch if negative flag is clear
 }
 
-void CPU_BVC(CPU *cpu, uint16_t address) 
+static inline int CPU_BVS(CPU *cpu, uint16_t address) 
 {
-    if (!CPU_GetFlag(cpu, CPU_FLAG_OVERFLOW)) { // Branch if overflow flag is clear
-        uint16_t old_pc = cpu->pc; // Store old program counter
-        cpu->pc = address; // Set program counter to address
-        cpu->total_cycles++; // Add cycle for branch taken
-        if ((old_pc & 0xFF00) != (cpu->pc & 0xFF00)) { // Check if page boundary is crossed
-            cpu->total_cycles++; // Add cycle penalty for page crossing
-        }
-    }
+    return CPU_Branch(cpu, CPU_GetFlag(cpu, CPU_FLAG_OVERFLOW), address); // Branch if overflow flag is set
+}
+
+static inline int CPU_BVC(CPU *cpu, uint16_t address) 
+{
+    return CPU_Branch(cpu, !CPU_GetFlag(cpu, CPU_FLAG_OVERFLOW), address); // Branch if overflow flag is clear
 }
 
 // Jump Operations
-void CPU_JMP(CPU *cpu, uint16_t address) 
+static inline void CPU_JMP(CPU *cpu, uint16_t address) 
 {
     cpu->pc = address; // Jump to address
 }
 
-void CPU_JMP_IND(CPU *cpu, uint16_t address) 
+static inline void CPU_JMP_IND(CPU *cpu, uint16_t address) 
 {
     uint16_t addr = BUS_Read16(cpu->nes, address); // Read address from memory
     cpu->pc = addr; // Jump to address
 }
 
-void CPU_JSR(CPU *cpu, uint16_t address) 
+static inline void CPU_JSR(CPU *cpu, uint16_t address) 
 {
     CPU_Push16(cpu, cpu->pc - 1); // Push decremented program counter to stack
     cpu->pc = address; // Jump to address
 }
 
-void CPU_RTS(CPU *cpu) 
+static inline void CPU_RTS(CPU *cpu) 
 {
     cpu->pc = CPU_Pop16(cpu) + 1; // Pull program counter from stack and increment
 }
 
-void CPU_RTI(CPU *cpu) 
+static inline void CPU_RTI(CPU *cpu) 
 {
     cpu->status = CPU_Pop(cpu); // Pull status from stack
     cpu->status &= (uint8_t)~CPU_FLAG_BREAK; // Clear break flag
@@ -640,6 +582,7 @@ void CPU_IRQ(CPU *cpu)
         CPU_Push(cpu, cpu->status & (uint8_t)~CPU_FLAG_BREAK); // Push status to stack with BREAK flag cleared
         CPU_SetFlag(cpu, CPU_FLAG_INTERRUPT, 1); // Set interrupt flag
         cpu->pc = BUS_Read16(cpu->nes, 0xFFFE); // Read interrupt vector
+        cpu->total_cycles += 7; // Same sequence as NMI
     }
 }
 
@@ -649,86 +592,86 @@ void CPU_NMI(CPU *cpu)
     CPU_Push(cpu, (uint8_t)(cpu->status & (uint8_t)~CPU_FLAG_BREAK)); // Push status to stack with BREAK flag cleared (fixed)
     CPU_SetFlag(cpu, CPU_FLAG_INTERRUPT, 1); // Set interrupt flag
     cpu->pc = BUS_Read16(cpu->nes, 0xFFFA); // Read NMI vector
+    cpu->total_cycles += 7; // Interrupt sequence takes as long as BRK
 }
 
-void CPU_BRK(CPU *cpu) 
+static inline void CPU_BRK(CPU *cpu) 
 {
-    CPU_Push16(cpu, cpu->pc); // Push program counter (already incremented past opcode and operand)
+    CPU_Push16(cpu, cpu->pc + 1); // BRK skips the padding byte after it
     CPU_Push(cpu, cpu->status | CPU_FLAG_BREAK); // Push status to stack with BREAK flag set (fixed)
     CPU_SetFlag(cpu, CPU_FLAG_INTERRUPT, 1); // Set interrupt flag
     cpu->pc = BUS_Read16(cpu->nes, 0xFFFE); // Read interrupt vector
 }
 
-void CPU_NOP(CPU *cpu) 
+static inline void CPU_NOP(CPU *cpu) 
 {
     // No operation
 }
 
 // Flag Operations
-void CPU_SEI(CPU *cpu) 
+static inline void CPU_SEI(CPU *cpu) 
 {
     CPU_SetFlag(cpu, CPU_FLAG_INTERRUPT, 1); // Set interrupt flag
 }
 
-void CPU_CLI(CPU *cpu) 
+static inline void CPU_CLI(CPU *cpu) 
 {
     CPU_SetFlag(cpu, CPU_FLAG_INTERRUPT, 0); // Clear interrupt flag
 }
 
-void CPU_CLV(CPU *cpu) 
+static inline void CPU_CLV(CPU *cpu) 
 {
     CPU_SetFlag(cpu, CPU_FLAG_OVERFLOW, 0); // Clear overflow flag
 }
 
-void CPU_CLD(CPU *cpu) 
+static inline void CPU_CLD(CPU *cpu) 
 {
     CPU_SetFlag(cpu, CPU_FLAG_DECIMAL, 0); // Clear decimal mode flag
 }
 
-void CPU_SED(CPU *cpu) 
+static inline void CPU_SED(CPU *cpu) 
 {
     CPU_SetFlag(cpu, CPU_FLAG_DECIMAL, 1); // Set decimal mode flag
 }
 
-void CPU_SEP(CPU *cpu, uint8_t value) 
+static inline void CPU_SEP(CPU *cpu, uint8_t value) 
 {
     cpu->status |= value; // Set status flags
 }
 
-void CPU_CLC(CPU *cpu) 
+static inline void CPU_CLC(CPU *cpu) 
 {
     CPU_SetFlag(cpu, CPU_FLAG_CARRY, 0); // Clear carry flag
 }
 
-void CPU_SEC(CPU *cpu) 
+static inline void CPU_SEC(CPU *cpu) 
 {
     CPU_SetFlag(cpu, CPU_FLAG_CARRY, 1); // Set carry flag
 }
 
 // Unofficial Opcodes
-void CPU_LAX(CPU *cpu, uint16_t address) 
+static inline void CPU_LAX(CPU *cpu, uint8_t value) 
 {
-    cpu->a = BUS_Read(cpu->nes, address); // Load A from memory
+    cpu->a = value; // Load A from memory
     cpu->x = cpu->a; // Transfer A to X
     CPU_UpdateZeroNegativeFlags(cpu, cpu->a); // Update flags
 }
 
-void CPU_SAX(CPU *cpu, uint16_t address) 
+static inline void CPU_SAX(CPU *cpu, uint16_t address) 
 {
     BUS_Write(cpu->nes, address, cpu->a & cpu->x); // Store A AND X to memory
 }
 
-void CPU_AYX(CPU *cpu, uint16_t address) 
+static inline void CPU_AYX(CPU *cpu, uint16_t address) 
 {
     cpu->y = cpu->a; // Transfer A to Y
     cpu->x = cpu->y; // Transfer Y to X
     CPU_UpdateZeroNegativeFlags(cpu, cpu->y); // Update flags
 }
 
-void CPU_ARR(CPU *cpu, uint16_t address) 
+static inline void CPU_ARR(CPU *cpu, uint8_t value) 
 {
     // ARR: AND then ROR A, set flags in a special way
-    uint8_t value = BUS_Read(cpu->nes, address);
     cpu->a &= value;
     cpu->a = (cpu->a >> 1) | (CPU_GetFlag(cpu, CPU_FLAG_CARRY) ? 0x80 : 0x00);
 
@@ -738,9 +681,9 @@ void CPU_ARR(CPU *cpu, uint16_t address)
     CPU_SetFlag(cpu, CPU_FLAG_OVERFLOW, ((cpu->a & 0x40) ^ ((cpu->a & 0x20) << 1)) != 0);
 }
 
-void CPU_SLO(CPU *cpu, uint16_t address) 
+static inline void CPU_SLO(CPU *cpu, uint16_t address) 
 {
-    uint8_t value = BUS_Read(cpu->nes, address); // Read value from memory
+    uint8_t value = CPU_ReadModify(cpu, address); // Read value from memory
     CPU_SetFlag(cpu, CPU_FLAG_CARRY, (value & 0x80) != 0); // Set carry flag
     value <<= 1; // Shift left
     BUS_Write(cpu->nes, address, value); // Write back to memory
@@ -748,9 +691,9 @@ void CPU_SLO(CPU *cpu, uint16_t address)
     CPU_UpdateZeroNegativeFlags(cpu, cpu->a); // Update flags
 }
 
-void CPU_RLA(CPU *cpu, uint16_t address) 
+static inline void CPU_RLA(CPU *cpu, uint16_t address) 
 {
-    uint8_t value = BUS_Read(cpu->nes, address); // Read value from memory
+    uint8_t value = CPU_ReadModify(cpu, address); // Read value from memory
     int old_carry = CPU_GetFlag(cpu, CPU_FLAG_CARRY); // Get old carry flag
     CPU_SetFlag(cpu, CPU_FLAG_CARRY, (value & 0x80) != 0); // Set carry flag
     value <<= 1; // Shift left
@@ -760,9 +703,9 @@ void CPU_RLA(CPU *cpu, uint16_t address)
     CPU_UpdateZeroNegativeFlags(cpu, cpu->a); // Update flags
 }
 
-void CPU_SRE(CPU *cpu, uint16_t address) 
+static inline void CPU_SRE(CPU *cpu, uint16_t address) 
 {
-    uint8_t value = BUS_Read(cpu->nes, address); // Read value from memory
+    uint8_t value = CPU_ReadModify(cpu, address); // Read value from memory
     CPU_SetFlag(cpu, CPU_FLAG_CARRY, (value & 0x01) != 0); // Set carry flag
     value >>= 1; // Shift right
     BUS_Write(cpu->nes, address, value); // Write back to memory
@@ -770,9 +713,9 @@ void CPU_SRE(CPU *cpu, uint16_t address)
     CPU_UpdateZeroNegativeFlags(cpu, cpu->a); // Update flags
 }
 
-void CPU_RRA(CPU *cpu, uint16_t address) 
+static inline void CPU_RRA(CPU *cpu, uint16_t address) 
 {
-    uint8_t value = BUS_Read(cpu->nes, address); // Read value from memory
+    uint8_t value = CPU_ReadModify(cpu, address); // Read value from memory
     int old_carry = CPU_GetFlag(cpu, CPU_FLAG_CARRY); // Get old carry flag
     CPU_SetFlag(cpu, CPU_FLAG_CARRY, (value & 0x01) != 0); // Set carry flag from bit 0
     value >>= 1; // Shift right
@@ -788,9 +731,9 @@ void CPU_RRA(CPU *cpu, uint16_t address)
     CPU_UpdateZeroNegativeFlags(cpu, cpu->a); // Update flags
 }
 
-void CPU_DCP(CPU *cpu, uint16_t address) 
+static inline void CPU_DCP(CPU *cpu, uint16_t address) 
 {
-    uint8_t value = BUS_Read(cpu->nes, address); // Read value from memory
+    uint8_t value = CPU_ReadModify(cpu, address); // Read value from memory
     value--; // Decrement memory
     BUS_Write(cpu->nes, address, value); // Write back to memory
 
@@ -799,9 +742,9 @@ void CPU_DCP(CPU *cpu, uint16_t address)
     CPU_UpdateZeroNegativeFlags(cpu, (uint8_t)result); // Update flags using the result
 }
 
-void CPU_ISC(CPU *cpu, uint16_t address) 
+static inline void CPU_ISC(CPU *cpu, uint16_t address) 
 {
-    uint8_t value = BUS_Read(cpu->nes, address); // Read value from memory
+    uint8_t value = CPU_ReadModify(cpu, address); // Read value from memory
     value++; // Increment memory
     BUS_Write(cpu->nes, address, value); // Write back to memory
 
@@ -812,26 +755,23 @@ void CPU_ISC(CPU *cpu, uint16_t address)
     CPU_UpdateZeroNegativeFlags(cpu, cpu->a); // Update flags
 }
 
-void CPU_ANC(CPU *cpu, uint16_t address) 
+static inline void CPU_ANC(CPU *cpu, uint8_t value) 
 {
-    uint8_t value = BUS_Read(cpu->nes, address); // Read value from memory
     cpu->a &= value; // AND A with memory
     CPU_SetFlag(cpu, CPU_FLAG_CARRY, (cpu->a & 0x80) != 0); // Set carry flag if bit 7 is set
     CPU_UpdateZeroNegativeFlags(cpu, cpu->a); // Update flags
 }
 
-void CPU_ALR(CPU *cpu, uint16_t address) 
+static inline void CPU_ALR(CPU *cpu, uint8_t value) 
 {
-    uint8_t value = BUS_Read(cpu->nes, address); // Read value from memory
     CPU_SetFlag(cpu, CPU_FLAG_CARRY, (value & 0x01) != 0); // Set carry flag
     value >>= 1; // Shift right
     cpu->a &= value; // AND A with shifted value
     CPU_UpdateZeroNegativeFlags(cpu, cpu->a); // Update flags
 }
 
-void CPU_SBX(CPU *cpu, uint16_t address) 
+static inline void CPU_SBX(CPU *cpu, uint8_t value) 
 {
-    uint8_t value = BUS_Read(cpu->nes, address); // Read value from memory
     uint16_t result = (uint16_t)cpu->x - (uint16_t)value; // Compare X with memory
     CPU_SetFlag(cpu, CPU_FLAG_CARRY, cpu->x >= value); // Set carry flag if no borrow
     CPU_UpdateZeroNegativeFlags(cpu, (uint8_t)(result & 0xFF)); // Update flags
@@ -839,535 +779,1512 @@ void CPU_SBX(CPU *cpu, uint16_t address)
     cpu->x -= value; // Decrement X
 }
 
-void CPU_SHY(CPU *cpu, uint16_t address) 
+static inline void CPU_SHY(CPU *cpu, uint16_t address) 
 {
     // Store Y & (high byte of address + 1) (fixed)
     uint8_t value = (uint8_t)(cpu->y & ((uint8_t)((address >> 8) + 1)));
     BUS_Write(cpu->nes, address, value);
 }
 
-void CPU_SHX(CPU *cpu, uint16_t address) 
+static inline void CPU_SHX(CPU *cpu, uint16_t address) 
 {
     // Store X & (high byte of address + 1) (fixed)
     uint8_t value = (uint8_t)(cpu->x & ((uint8_t)((address >> 8) + 1)));
     BUS_Write(cpu->nes, address, value);
 }
 
-void CPU_LAS(CPU *cpu, uint16_t address) 
+static inline void CPU_LAS(CPU *cpu, uint8_t value) 
 {
     // LAS: Mem & SP -> A, X, SP
-    uint8_t value = BUS_Read(cpu->nes, address) & cpu->sp;
-    cpu->a = value;
-    cpu->x = value;
-    cpu->sp = value;
-    CPU_UpdateZeroNegativeFlags(cpu, value);
+    uint8_t result = value & cpu->sp;
+    cpu->a = result;
+    cpu->x = result;
+    cpu->sp = result;
+    CPU_UpdateZeroNegativeFlags(cpu, result);
 }
 
-void CPU_TAS(CPU *cpu) 
+static inline void CPU_TAS(CPU *cpu) 
 {
     // TAS: SP = A & X
     cpu->sp = cpu->a & cpu->x;
 }
 
+// Opcode dispatch
+// Every opcode gets its own handler, generated from the instruction list below
+// with its addressing mode and operation fixed at compile time. Handlers take
+// the raw operand and return the cycles the instruction took (base cycles plus
+// any page crossing or branch penalty), or -1 if execution must halt. They never
+// touch total_cycles, so during a handler it still holds the cycle the
+// instruction started on. Each opcode also gets an execute wrapper that fetches
+// its operand bytes and advances the PC, so CPU_Step is a single indirect call.
+typedef int (*CPU_Execute)(CPU *cpu);
+
+typedef struct CPU_Instruction {
+    CPU_Execute execute; // Fetches the operand, then runs the handler
+    CPU_Handler handler; // Runs the instruction on an already fetched operand
+    uint8_t length; // Opcode byte plus operand bytes
+    uint8_t cycles; // Base cycles
+} CPU_Instruction;
+
+// Instruction length by addressing mode
+#define CPU_LENGTH_IMP 1
+#define CPU_LENGTH_ACC 1
+#define CPU_LENGTH_IMM 2
+#define CPU_LENGTH_ZP  2
+#define CPU_LENGTH_ZPX 2
+#define CPU_LENGTH_ZPY 2
+#define CPU_LENGTH_REL 2
+#define CPU_LENGTH_ABS 3
+#define CPU_LENGTH_ABX 3
+#define CPU_LENGTH_ABY 3
+#define CPU_LENGTH_IND 3
+#define CPU_LENGTH_IZX 2
+#define CPU_LENGTH_IZY 2
+
+// Operand fetch by instruction length, PC still points at the opcode
+#define CPU_FETCH_1(cpu) 0
+#define CPU_FETCH_2(cpu) BUS_Read((cpu)->nes, (uint16_t)((cpu)->pc + 1))
+#define CPU_FETCH_3(cpu) BUS_Read16((cpu)->nes, (uint16_t)((cpu)->pc + 1))
+#define CPU_FETCH(cpu, length) CPU_FETCH_##length(cpu)
+#define CPU_FETCH_MODE(cpu, length) CPU_FETCH(cpu, length)
+
+// Handler shapes
+// IMPLIED:   op(cpu), the operand (if any) is ignored
+// IMMEDIATE: op(cpu, operand byte)
+// READ:      op(cpu, value at the effective address), page crossing penalty applies
+// ADDRESS:   op(cpu, effective address) for stores, read-modify-write and jumps
+// BRANCH:    op(cpu, target) returns the extra cycles
+// SKIP:      unofficial NOP that decodes its operand for the page crossing penalty only
+// JAM:       KIL/JAM opcodes halt the CPU
+// UNKNOWN:   opcodes that are not implemented
+#define CPU_HANDLER_IMPLIED(code, mode, op, cycles) \
+    static int CPU_Op_##code(CPU *cpu, uint16_t operand) \
+    { \
+        (void)operand; \
+        op(cpu); \
+        return cycles; \
+    }
+
+#define CPU_HANDLER_IMMEDIATE(code, mode, op, cycles) \
+    static int CPU_Op_##code(CPU *cpu, uint16_t operand) \
+    { \
+        op(cpu, (uint8_t)operand); \
+        return cycles; \
+    }
+
+#define CPU_HANDLER_READ(code, mode, op, cycles) \
+    static int CPU_Op_##code(CPU *cpu, uint16_t operand) \
+    { \
+        int total = cycles; \
+        op(cpu, BUS_Read(cpu->nes, CPU_Address_##mode(cpu, operand, &total))); \
+        return total; \
+    }
+
+#define CPU_HANDLER_ADDRESS(code, mode, op, cycles) \
+    static int CPU_Op_##code(CPU *cpu, uint16_t operand) \
+    { \
+        op(cpu, CPU_Address_##mode(cpu, operand, NULL)); \
+        return cycles; \
+    }
+
+#define CPU_HANDLER_BRANCH(code, mode, op, cycles) \
+    static int CPU_Op_##code(CPU *cpu, uint16_t operand) \
+    { \
+        return cycles + op(cpu, CPU_Address_##mode(cpu, operand, NULL)); \
+    }
+
+#define CPU_HANDLER_SKIP(code, mode, op, cycles) \
+    static int CPU_Op_##code(CPU *cpu, uint16_t operand) \
+    { \
+        int total = cycles; \
+        (void)CPU_Address_##mode(cpu, operand, &total); \
+        return total; \
+    }
+
+#define CPU_HANDLER_JAM(code, mode, op, cycles) \
+    static int CPU_Op_##code(CPU *cpu, uint16_t operand) \
+    { \
+        (void)operand; \
+        DEBUG_DEBUG("KIL/JAM opcode encountered: 0x%02X at PC: 0x%04X", code, (uint16_t)(cpu->pc - 1)); \
+        return -1; \
+    }
+
+#define CPU_HANDLER_UNKNOWN(code, mode, op, cycles) \
+    static int CPU_Op_##code(CPU *cpu, uint16_t operand) \
+    { \
+        (void)operand; \
+        DEBUG_ERROR("Unimplemented or Unknown opcode 0x%02X at 0x%04X", code, (uint16_t)(cpu->pc - 1)); \
+        return -1; \
+    }
+
+// Instruction list: opcode, handler shape, addressing mode, operation, base cycles
+#define CPU_INSTRUCTIONS(X) \
+    /* Load/Store */ \
+    X(0xA9, IMMEDIATE, IMM, CPU_LDA, 2) \
+    X(0xA5, READ,      ZP,  CPU_LDA, 3) \
+    X(0xB5, READ,      ZPX, CPU_LDA, 4) \
+    X(0xAD, READ,      ABS, CPU_LDA, 4) \
+    X(0xBD, READ,      ABX, CPU_LDA, 4) \
+    X(0xB9, READ,      ABY, CPU_LDA, 4) \
+    X(0xA1, READ,      IZX, CPU_LDA, 6) \
+    X(0xB1, READ,      IZY, CPU_LDA, 5) \
+    X(0xA2, IMMEDIATE, IMM, CPU_LDX, 2) \
+    X(0xA6, READ,      ZP,  CPU_LDX, 3) \
+    X(0xB6, READ,      ZPY, CPU_LDX, 4) \
+    X(0xAE, READ,      ABS, CPU_LDX, 4) \
+    X(0xBE, READ,      ABY, CPU_LDX, 4) \
+    X(0xA0, IMMEDIATE, IMM, CPU_LDY, 2) \
+    X(0xA4, READ,      ZP,  CPU_LDY, 3) \
+    X(0xB4, READ,      ZPX, CPU_LDY, 4) \
+    X(0xAC, READ,      ABS, CPU_LDY, 4) \
+    X(0xBC, READ,      ABX, CPU_LDY, 4) \
+    X(0x85, ADDRESS,   ZP,  CPU_STA, 3) \
+    X(0x95, ADDRESS,   ZPX, CPU_STA, 4) \
+    X(0x8D, ADDRESS,   ABS, CPU_STA, 4) \
+    X(0x9D, ADDRESS,   ABX, CPU_STA, 5) \
+    X(0x99, ADDRESS,   ABY, CPU_STA, 5) \
+    X(0x81, ADDRESS,   IZX, CPU_STA, 6) \
+    X(0x91, ADDRESS,   IZY, CPU_STA, 6) \
+    X(0x86, ADDRESS,   ZP,  CPU_STX, 3) \
+    X(0x96, ADDRESS,   ZPY, CPU_STX, 4) \
+    X(0x8E, ADDRESS,   ABS, CPU_STX, 4) \
+    X(0x84, ADDRESS,   ZP,  CPU_STY, 3) \
+    X(0x94, ADDRESS,   ZPX, CPU_STY, 4) \
+    X(0x8C, ADDRESS,   ABS, CPU_STY, 4) \
+    /* Register Transfers */ \
+    X(0xAA, IMPLIED,   IMP, CPU_TAX, 2) \
+    X(0xA8, IMPLIED,   IMP, CPU_TAY, 2) \
+    X(0x8A, IMPLIED,   IMP, CPU_TXA, 2) \
+    X(0x98, IMPLIED,   IMP, CPU_TYA, 2) \
+    X(0xBA, IMPLIED,   IMP, CPU_TSX, 2) \
+    X(0x9A, IMPLIED,   IMP, CPU_TXS, 2) \
+    /* Stack */ \
+    X(0x48, IMPLIED,   IMP, CPU_PHA, 3) \
+    X(0x68, IMPLIED,   IMP, CPU_PLA, 4) \
+    X(0x08, IMPLIED,   IMP, CPU_PHP, 3) \
+    X(0x28, IMPLIED,   IMP, CPU_PLP, 4) \
+    /* Decrement/Increment */ \
+    X(0xC6, ADDRESS,   ZP,  CPU_DEC, 5) \
+    X(0xD6, ADDRESS,   ZPX, CPU_DEC, 6) \
+    X(0xCE, ADDRESS,   ABS, CPU_DEC, 6) \
+    X(0xDE, ADDRESS,   ABX, CPU_DEC, 7) \
+    X(0xCA, IMPLIED,   IMP, CPU_DEX, 2) \
+    X(0x88, IMPLIED,   IMP, CPU_DEY, 2) \
+    X(0xE6, ADDRESS,   ZP,  CPU_INC, 5) \
+    X(0xF6, ADDRESS,   ZPX, CPU_INC, 6) \
+    X(0xEE, ADDRESS,   ABS, CPU_INC, 6) \
+    X(0xFE, ADDRESS,   ABX, CPU_INC, 7) \
+    X(0xE8, IMPLIED,   IMP, CPU_INX, 2) \
+    X(0xC8, IMPLIED,   IMP, CPU_INY, 2) \
+    /* Arithmetic */ \
+    X(0x69, IMMEDIATE, IMM, CPU_ADC, 2) \
+    X(0x65, READ,      ZP,  CPU_ADC, 3) \
+    X(0x75, READ,      ZPX, CPU_ADC, 4) \
+    X(0x6D, READ,      ABS, CPU_ADC, 4) \
+    X(0x7D, READ,      ABX, CPU_ADC, 4) \
+    X(0x79, READ,      ABY, CPU_ADC, 4) \
+    X(0x61, READ,      IZX, CPU_ADC, 6) \
+    X(0x71, READ,      IZY, CPU_ADC, 5) \
+    X(0xE9, IMMEDIATE, IMM, CPU_SBC, 2) \
+    X(0xE5, READ,      ZP,  CPU_SBC, 3) \
+    X(0xF5, READ,      ZPX, CPU_SBC, 4) \
+    X(0xED, READ,      ABS, CPU_SBC, 4) \
+    X(0xFD, READ,      ABX, CPU_SBC, 4) \
+    X(0xF9, READ,      ABY, CPU_SBC, 4) \
+    X(0xE1, READ,      IZX, CPU_SBC, 6) \
+    X(0xF1, READ,      IZY, CPU_SBC, 5) \
+    X(0xEB, IMMEDIATE, IMM, CPU_SBC, 2) \
+    /* Compare */ \
+    X(0xC9, IMMEDIATE, IMM, CPU_CMP, 2) \
+    X(0xC5, READ,      ZP,  CPU_CMP, 3) \
+    X(0xD5, READ,      ZPX, CPU_CMP, 4) \
+    X(0xCD, READ,      ABS, CPU_CMP, 4) \
+    X(0xDD, READ,      ABX, CPU_CMP, 4) \
+    X(0xD9, READ,      ABY, CPU_CMP, 4) \
+    X(0xC1, READ,      IZX, CPU_CMP, 6) \
+    X(0xD1, READ,      IZY, CPU_CMP, 5) \
+    X(0xE0, IMMEDIATE, IMM, CPU_CPX, 2) \
+    X(0xE4, READ,      ZP,  CPU_CPX, 3) \
+    X(0xEC, READ,      ABS, CPU_CPX, 4) \
+    X(0xC0, IMMEDIATE, IMM, CPU_CPY, 2) \
+    X(0xC4, READ,      ZP,  CPU_CPY, 3) \
+    X(0xCC, READ,      ABS, CPU_CPY, 4) \
+    /* Logic */ \
+    X(0x29, IMMEDIATE, IMM, CPU_AND, 2) \
+    X(0x25, READ,      ZP,  CPU_AND, 3) \
+    X(0x35, READ,      ZPX, CPU_AND, 4) \
+    X(0x2D, READ,      ABS, CPU_AND, 4) \
+    X(0x3D, READ,      ABX, CPU_AND, 4) \
+    X(0x39, READ,      ABY, CPU_AND, 4) \
+    X(0x21, READ,      IZX, CPU_AND, 6) \
+    X(0x31, READ,      IZY, CPU_AND, 5) \
+    X(0x49, IMMEDIATE, IMM, CPU_EOR, 2) \
+    X(0x45, READ,      ZP,  CPU_EOR, 3) \
+    X(0x55, READ,      ZPX, CPU_EOR, 4) \
+    X(0x4D, READ,      ABS, CPU_EOR, 4) \
+    X(0x5D, READ,      ABX, CPU_EOR, 4) \
+    X(0x59, READ,      ABY, CPU_EOR, 4) \
+    X(0x41, READ,      IZX, CPU_EOR, 6) \
+    X(0x51, READ,      IZY, CPU_EOR, 5) \
+    X(0x09, IMMEDIATE, IMM, CPU_ORA, 2) \
+    X(0x05, READ,      ZP,  CPU_ORA, 3) \
+    X(0x15, READ,      ZPX, CPU_ORA, 4) \
+    X(0x0D, READ,      ABS, CPU_ORA, 4) \
+    X(0x1D, READ,      ABX, CPU_ORA, 4) \
+    X(0x19, READ,      ABY, CPU_ORA, 4) \
+    X(0x01, READ,      IZX, CPU_ORA, 6) \
+    X(0x11, READ,      IZY, CPU_ORA, 5) \
+    X(0x24, READ,      ZP,  CPU_BIT, 3) \
+    X(0x2C, READ,      ABS, CPU_BIT, 4) \
+    /* Shifts */ \
+    X(0x0A, IMPLIED,   ACC, CPU_ASL_A, 2) \
+    X(0x06, ADDRESS,   ZP,  CPU_ASL, 5) \
+    X(0x16, ADDRESS,   ZPX, CPU_ASL, 6) \
+    X(0x0E, ADDRESS,   ABS, CPU_ASL, 6) \
+    X(0x1E, ADDRESS,   ABX, CPU_ASL, 7) \
+    X(0x4A, IMPLIED,   ACC, CPU_LSR_A, 2) \
+    X(0x46, ADDRESS,   ZP,  CPU_LSR, 5) \
+    X(0x56, ADDRESS,   ZPX, CPU_LSR, 6) \
+    X(0x4E, ADDRESS,   ABS, CPU_LSR, 6) \
+    X(0x5E, ADDRESS,   ABX, CPU_LSR, 7) \
+    X(0x2A, IMPLIED,   ACC, CPU_ROL_A, 2) \
+    X(0x26, ADDRESS,   ZP,  CPU_ROL, 5) \
+    X(0x36, ADDRESS,   ZPX, CPU_ROL, 6) \
+    X(0x2E, ADDRESS,   ABS, CPU_ROL, 6) \
+    X(0x3E, ADDRESS,   ABX, CPU_ROL, 7) \
+    X(0x6A, IMPLIED,   ACC, CPU_ROR_A, 2) \
+    X(0x66, ADDRESS,   ZP,  CPU_ROR, 5) \
+    X(0x76, ADDRESS,   ZPX, CPU_ROR, 6) \
+    X(0x6E, ADDRESS,   ABS, CPU_ROR, 6) \
+    X(0x7E, ADDRESS,   ABX, CPU_ROR, 7) \
+    /* Branches */ \
+    X(0x90, BRANCH,    REL, CPU_BCC, 2) \
+    X(0xB0, BRANCH,    REL, CPU_BCS, 2) \
+    X(0xF0, BRANCH,    REL, CPU_BEQ, 2) \
+    X(0x30, BRANCH,    REL, CPU_BMI, 2) \
+    X(0xD0, BRANCH,    REL, CPU_BNE, 2) \
+    X(0x10, BRANCH,    REL, CPU_BPL, 2) \
+    X(0x50, BRANCH,    REL, CPU_BVC, 2) \
+    X(0x70, BRANCH,    REL, CPU_BVS, 2) \
+    /* Jumps and Interrupts */ \
+    X(0x4C, ADDRESS,   ABS, CPU_JMP, 3) \
+    X(0x6C, ADDRESS,   IND, CPU_JMP, 5) \
+    X(0x20, ADDRESS,   ABS, CPU_JSR, 6) \
+    X(0x60, IMPLIED,   IMP, CPU_RTS, 6) \
+    X(0x00, IMPLIED,   IMP, CPU_BRK, 7) \
+    X(0x40, IMPLIED,   IMP, CPU_RTI, 6) \
+    /* Flags */ \
+    X(0x18, IMPLIED,   IMP, CPU_CLC, 2) \
+    X(0x38, IMPLIED,   IMP, CPU_SEC, 2) \
+    X(0x58, IMPLIED,   IMP, CPU_CLI, 2) \
+    X(0x78, IMPLIED,   IMP, CPU_SEI, 2) \
+    X(0xB8, IMPLIED,   IMP, CPU_CLV, 2) \
+    X(0xD8, IMPLIED,   IMP, CPU_CLD, 2) \
+    X(0xF8, IMPLIED,   IMP, CPU_SED, 2) \
+    X(0xEA, IMPLIED,   IMP, CPU_NOP, 2) \
+    /* Unofficial: KIL/JAM (halt execution) */ \
+    X(0x02, JAM,       IMP, CPU_NOP, 0) \
+    X(0x12, JAM,       IMP, CPU_NOP, 0) \
+    X(0x22, JAM,       IMP, CPU_NOP, 0) \
+    X(0x32, JAM,       IMP, CPU_NOP, 0) \
+    X(0x42, JAM,       IMP, CPU_NOP, 0) \
+    X(0x52, JAM,       IMP, CPU_NOP, 0) \
+    X(0x62, JAM,       IMP, CPU_NOP, 0) \
+    X(0x72, JAM,       IMP, CPU_NOP, 0) \
+    X(0x92, JAM,       IMP, CPU_NOP, 0) \
+    X(0xB2, JAM,       IMP, CPU_NOP, 0) \
+    X(0xD2, JAM,       IMP, CPU_NOP, 0) \
+    X(0xF2, JAM,       IMP, CPU_NOP, 0) \
+    /* Unofficial: NOPs (various addressing modes, different cycle counts) */ \
+    X(0x1A, IMPLIED,   IMP, CPU_NOP, 2) \
+    X(0x3A, IMPLIED,   IMP, CPU_NOP, 2) \
+    X(0x5A, IMPLIED,   IMP, CPU_NOP, 2) \
+    X(0x7A, IMPLIED,   IMP, CPU_NOP, 2) \
+    X(0xDA, IMPLIED,   IMP, CPU_NOP, 2) \
+    X(0xFA, IMPLIED,   IMP, CPU_NOP, 2) \
+    X(0x80, IMPLIED,   IMM, CPU_NOP, 2) \
+    X(0x82, IMPLIED,   IMM, CPU_NOP, 2) \
+    X(0x89, IMPLIED,   IMM, CPU_NOP, 2) \
+    X(0xC2, IMPLIED,   IMM, CPU_NOP, 2) \
+    X(0xE2, IMPLIED,   IMM, CPU_NOP, 2) \
+    X(0x04, IMPLIED,   ZP,  CPU_NOP, 3) \
+    X(0x44, IMPLIED,   ZP,  CPU_NOP, 3) \
+    X(0x64, IMPLIED,   ZP,  CPU_NOP, 3) \
+    X(0x14, IMPLIED,   ZPX, CPU_NOP, 4) \
+    X(0x34, IMPLIED,   ZPX, CPU_NOP, 4) \
+    X(0x54, IMPLIED,   ZPX, CPU_NOP, 4) \
+    X(0x74, IMPLIED,   ZPX, CPU_NOP, 4) \
+    X(0xD4, IMPLIED,   ZPX, CPU_NOP, 4) \
+    X(0xF4, IMPLIED,   ZPX, CPU_NOP, 4) \
+    X(0x0C, IMPLIED,   ABS, CPU_NOP, 4) \
+    X(0x1C, SKIP,      ABX, CPU_NOP, 4) \
+    X(0x3C, SKIP,      ABX, CPU_NOP, 4) \
+    X(0x5C, SKIP,      ABX, CPU_NOP, 4) \
+    X(0x7C, SKIP,      ABX, CPU_NOP, 4) \
+    X(0xDC, SKIP,      ABX, CPU_NOP, 4) \
+    X(0xFC, SKIP,      ABX, CPU_NOP, 4) \
+    /* Unofficial: LAX (Load A & X) */ \
+    X(0xA7, READ,      ZP,  CPU_LAX, 3) \
+    X(0xB7, READ,      ZPY, CPU_LAX, 4) \
+    X(0xAF, READ,      ABS, CPU_LAX, 4) \
+    X(0xBF, READ,      ABY, CPU_LAX, 4) \
+    X(0xA3, READ,      IZX, CPU_LAX, 6) \
+    X(0xB3, READ,      IZY, CPU_LAX, 5) \
+    /* Unofficial: SAX (Store A & X) */ \
+    X(0x87, ADDRESS,   ZP,  CPU_SAX, 3) \
+    X(0x97, ADDRESS,   ZPY, CPU_SAX, 4) \
+    X(0x8F, ADDRESS,   ABS, CPU_SAX, 4) \
+    X(0x83, ADDRESS,   IZX, CPU_SAX, 6) \
+    /* Unofficial: DCP (DEC then CMP) */ \
+    X(0xC7, ADDRESS,   ZP,  CPU_DCP, 5) \
+    X(0xD7, ADDRESS,   ZPX, CPU_DCP, 6) \
+    X(0xCF, ADDRESS,   ABS, CPU_DCP, 6) \
+    X(0xDF, ADDRESS,   ABX, CPU_DCP, 7) \
+    X(0xDB, ADDRESS,   ABY, CPU_DCP, 7) \
+    X(0xC3, ADDRESS,   IZX, CPU_DCP, 8) \
+    X(0xD3, ADDRESS,   IZY, CPU_DCP, 8) \
+    /* Unofficial: ISC/ISB (INC then SBC) */ \
+    X(0xE7, ADDRESS,   ZP,  CPU_ISC, 5) \
+    X(0xF7, ADDRESS,   ZPX, CPU_ISC, 6) \
+    X(0xEF, ADDRESS,   ABS, CPU_ISC, 6) \
+    X(0xFF, ADDRESS,   ABX, CPU_ISC, 7) \
+    X(0xFB, ADDRESS,   ABY, CPU_ISC, 7) \
+    X(0xE3, ADDRESS,   IZX, CPU_ISC, 8) \
+    X(0xF3, ADDRESS,   IZY, CPU_ISC, 8) \
+    /* Unofficial: SLO (ASL then ORA) */ \
+    X(0x07, ADDRESS,   ZP,  CPU_SLO, 5) \
+    X(0x17, ADDRESS,   ZPX, CPU_SLO, 6) \
+    X(0x0F, ADDRESS,   ABS, CPU_SLO, 6) \
+    X(0x1F, ADDRESS,   ABX, CPU_SLO, 7) \
+    X(0x1B, ADDRESS,   ABY, CPU_SLO, 7) \
+    X(0x03, ADDRESS,   IZX, CPU_SLO, 8) \
+    X(0x13, ADDRESS,   IZY, CPU_SLO, 8) \
+    /* Unofficial: RLA (ROL then AND) */ \
+    X(0x27, ADDRESS,   ZP,  CPU_RLA, 5) \
+    X(0x37, ADDRESS,   ZPX, CPU_RLA, 6) \
+    X(0x2F, ADDRESS,   ABS, CPU_RLA, 6) \
+    X(0x3F, ADDRESS,   ABX, CPU_RLA, 7) \
+    X(0x3B, ADDRESS,   ABY, CPU_RLA, 7) \
+    X(0x23, ADDRESS,   IZX, CPU_RLA, 8) \
+    X(0x33, ADDRESS,   IZY, CPU_RLA, 8) \
+    /* Unofficial: SRE (LSR then EOR) */ \
+    X(0x47, ADDRESS,   ZP,  CPU_SRE, 5) \
+    X(0x57, ADDRESS,   ZPX, CPU_SRE, 6) \
+    X(0x4F, ADDRESS,   ABS, CPU_SRE, 6) \
+    X(0x5F, ADDRESS,   ABX, CPU_SRE, 7) \
+    X(0x5B, ADDRESS,   ABY, CPU_SRE, 7) \
+    X(0x43, ADDRESS,   IZX, CPU_SRE, 8) \
+    X(0x53, ADDRESS,   IZY, CPU_SRE, 8) \
+    /* Unofficial: RRA (ROR then ADC) */ \
+    X(0x67, ADDRESS,   ZP,  CPU_RRA, 5) \
+    X(0x77, ADDRESS,   ZPX, CPU_RRA, 6) \
+    X(0x6F, ADDRESS,   ABS, CPU_RRA, 6) \
+    X(0x7F, ADDRESS,   ABX, CPU_RRA, 7) \
+    X(0x7B, ADDRESS,   ABY, CPU_RRA, 7) \
+    X(0x63, ADDRESS,   IZX, CPU_RRA, 8) \
+    X(0x73, ADDRESS,   IZY, CPU_RRA, 8) \
+    /* Unofficial: immediate logic ops */ \
+    X(0x0B, IMMEDIATE, IMM, CPU_ANC, 2) \
+    X(0x2B, IMMEDIATE, IMM, CPU_ANC, 2) \
+    X(0x4B, IMMEDIATE, IMM, CPU_ALR, 2) \
+    X(0x6B, IMMEDIATE, IMM, CPU_ARR, 2) \
+    X(0xCB, IMMEDIATE, IMM, CPU_SBX, 2) \
+    /* Unofficial: unstable stores, simplified */ \
+    X(0x9C, ADDRESS,   ABX, CPU_SHY, 5) \
+    X(0x9E, ADDRESS,   ABY, CPU_SHX, 5) \
+    X(0xBB, READ,      ABY, CPU_LAS, 4) \
+    X(0x9B, IMPLIED,   ABY, CPU_TAS, 5) \
+    /* Unimplemented */ \
+    X(0x8B, UNKNOWN,   IMP, CPU_NOP, 0) \
+    X(0x93, UNKNOWN,   IMP, CPU_NOP, 0) \
+    X(0x9F, UNKNOWN,   IMP, CPU_NOP, 0) \
+    X(0xAB, UNKNOWN,   IMP, CPU_NOP, 0)
+
+#define CPU_DEFINE_HANDLER(code, shape, mode, op, cycles) \
+    CPU_HANDLER_##shape(code, mode, op, cycles) \
+    static int CPU_Exec_##code(CPU *cpu) \
+    { \
+        uint16_t operand = CPU_FETCH_MODE(cpu, CPU_LENGTH_##mode); \
+        cpu->pc += CPU_LENGTH_##mode; \
+        return CPU_Op_##code(cpu, operand); \
+    }
+CPU_INSTRUCTIONS(CPU_DEFINE_HANDLER)
+
+#define CPU_TABLE_ENTRY(code, shape, mode, op, cycles) [code] = { CPU_Exec_##code, CPU_Op_##code, CPU_LENGTH_##mode, cycles },
+static const CPU_Instruction cpu_instructions[256] = {
+    CPU_INSTRUCTIONS(CPU_TABLE_ENTRY)
+};
+
+// Decode cache entries: opcode in bits 0-7, operand in bits 8-23 and length in bits
+// 24-25. Every instruction is at least a byte long, so 0 means not decoded yet
+#define CPU_DECODED_OPCODE(decoded)  ((uint8_t)(decoded))
+#define CPU_DECODED_OPERAND(decoded) ((uint16_t)((decoded) >> 8))
+#define CPU_DECODED_LENGTH(decoded)  ((decoded) >> 24)
+
+// Table for one bank of the ROM's decode cache, NULL if it can't be allocated
+static _Atomic(uint32_t) *CPU_DecodeTable(_Atomic(_Atomic(uint32_t) *) *bank) 
+{
+    _Atomic(uint32_t) *table = atomic_load_explicit(bank, memory_order_acquire);
+    if (table)
+        return table;
+
+    // Another instance of the ROM may get there first, its table is as good as ours
+    table = calloc(ROM_DECODE_BANK_SIZE, sizeof(*table));
+    _Atomic(uint32_t) *expected = NULL;
+    if (table && !atomic_compare_exchange_strong_explicit(bank, &expected, table, memory_order_acq_rel, memory_order_acquire)) {
+        free(table);
+        table = expected;
+    }
+    return table;
+}
+
+// Decodes the instruction at PC on a miss, and points the bus at where the decode
+// cache keeps its page. 0 when PC isn't in PRG ROM or the instruction runs past
+// the end of the ROM, those are fetched normally
+static uint32_t CPU_DecodeMiss(CPU *cpu) 
+{
+    NES *nes = cpu->nes;
+    ROM *rom = nes->rom;
+    const uint8_t *page = nes->bus->read_pages[cpu->pc >> 8];
+    if (!rom || !page || page < rom->prg || page >= rom->prg + rom->prg_size)
+        return 0;
+
+    size_t offset = (size_t)(page - rom->prg) + (cpu->pc & 0xFF);
+    uint8_t opcode = rom->prg[offset];
+    uint8_t length = cpu_instructions[opcode].length;
+    if (offset + length > rom->prg_size)
+        return 0;
+
+    uint32_t operand = 0;
+    if (length > 1)
+        operand = rom->prg[offset + 1];
+    if (length > 2)
+        operand |= (uint32_t)rom->prg[offset + 2] << 8;
+    uint32_t decoded = (uint32_t)length << 24 | operand << 8 | opcode;
+
+    // Pages start 256 byte aligned in the ROM, so each lies inside one bank's table
+    _Atomic(uint32_t) *table = CPU_DecodeTable(&rom->decode_banks[offset / ROM_DECODE_BANK_SIZE]);
+    if (table) {
+        _Atomic(uint32_t) *entries = table + (offset % ROM_DECODE_BANK_SIZE - (cpu->pc & 0xFF));
+        atomic_store_explicit(&entries[cpu->pc & 0xFF], decoded, memory_order_relaxed);
+        cpu->decode_pages[(cpu->pc >> 8) - BUS_PAGE_COUNT / 2] = entries;
+    }
+    return decoded;
+}
+
+// Decoded instruction at PC, which must be $8000 or above, 0 if it has to be fetched normally
+static inline uint32_t CPU_Decode(CPU *cpu) 
+{
+    uint16_t pc = cpu->pc;
+    _Atomic(uint32_t) *entries = cpu->decode_pages[(pc >> 8) - BUS_PAGE_COUNT / 2];
+    uint32_t decoded = entries ? atomic_load_explicit(&entries[pc & 0xFF], memory_order_relaxed) : 0;
+    if (!decoded && !(decoded = CPU_DecodeMiss(cpu)))
+        return 0;
+
+    // Entries hold the bytes that follow in the ROM, an operand running onto the next
+    // page only matches them when that page continues the same bank
+    if ((pc & 0xFF) + CPU_DECODED_LENGTH(decoded) > 0x100
+        && (pc >= 0xFF00 || cpu->nes->bus->read_pages[(pc >> 8) + 1] != cpu->nes->bus->read_pages[pc >> 8] + 0x100))
+        return 0;
+    return decoded;
+}
+
 int CPU_Step(CPU *cpu) 
 {
-    uint16_t addr = 0; // Effective address for operand
-    uint64_t cycles = 2;    // Default cycles (most common)
-
-    uint16_t initial_pc = cpu->pc; // For debugging/logging
-    
-    uint8_t opcode = BUS_Read(cpu->nes, cpu->pc);
-    cpu->pc++; // Increment PC past opcode
-
-    switch (opcode) 
-    {
-        case 0xA9: addr = CPU_Immediate(cpu);      CPU_LDA(cpu, addr); cycles=2; break;
-        case 0xA5: addr = CPU_ZeroPage(cpu);       CPU_LDA(cpu, addr); cycles=3; break;
-        case 0xB5: addr = CPU_ZeroPageX(cpu);      CPU_LDA(cpu, addr); cycles=4; break;
-        case 0xAD: addr = CPU_Absolute(cpu);       CPU_LDA(cpu, addr); cycles=4; break;
-        case 0xBD: addr = CPU_AbsoluteX(cpu);      CPU_LDA(cpu, addr); cycles=4; break; // +1 page cross
-        case 0xB9: addr = CPU_AbsoluteY(cpu);      CPU_LDA(cpu, addr); cycles=4; break; // +1 page cross
-        case 0xA1: addr = CPU_IndexedIndirect(cpu);CPU_LDA(cpu, addr); cycles=6; break;
-        case 0xB1: addr = CPU_IndirectIndexed(cpu);CPU_LDA(cpu, addr); cycles=5; break; // +1 page cross
-
-        case 0xA2: addr = CPU_Immediate(cpu);      CPU_LDX(cpu, addr); cycles=2; break;
-        case 0xA6: addr = CPU_ZeroPage(cpu);       CPU_LDX(cpu, addr); cycles=3; break;
-        case 0xB6: addr = CPU_ZeroPageY(cpu);      CPU_LDX(cpu, addr); cycles=4; break;
-        case 0xAE: addr = CPU_Absolute(cpu);       CPU_LDX(cpu, addr); cycles=4; break;
-        case 0xBE: addr = CPU_AbsoluteY(cpu);      CPU_LDX(cpu, addr); cycles=4; break; // +1 page cross
-
-        case 0xA0: addr = CPU_Immediate(cpu);      CPU_LDY(cpu, addr); cycles=2; break;
-        case 0xA4: addr = CPU_ZeroPage(cpu);       CPU_LDY(cpu, addr); cycles=3; break;
-        case 0xB4: addr = CPU_ZeroPageX(cpu);      CPU_LDY(cpu, addr); cycles=4; break;
-        case 0xAC: addr = CPU_Absolute(cpu);       CPU_LDY(cpu, addr); cycles=4; break;
-        case 0xBC: addr = CPU_AbsoluteX(cpu);      CPU_LDY(cpu, addr); cycles=4; break; // +1 page cross
-
-        case 0x85: addr = CPU_ZeroPage(cpu);       CPU_STA(cpu, addr); cycles=3; break;
-        case 0x95: addr = CPU_ZeroPageX(cpu);      CPU_STA(cpu, addr); cycles=4; break;
-        case 0x8D: addr = CPU_Absolute(cpu);       CPU_STA(cpu, addr); cycles=4; break;
-        case 0x9D: addr = CPU_AbsoluteX(cpu);      CPU_STA(cpu, addr); cycles=5; if ((addr & 0xFF00) != ((addr - cpu->x) & 0xFF00)) cycles--; break;
-        case 0x99: addr = CPU_AbsoluteY(cpu);      CPU_STA(cpu, addr); cycles=5; if ((addr & 0xFF00) != ((addr - cpu->y) & 0xFF00)) cycles--; break;
-        case 0x81: addr = CPU_IndexedIndirect(cpu);CPU_STA(cpu, addr); cycles=6; break;
-        case 0x91: addr = CPU_IndirectIndexed(cpu);CPU_STA(cpu, addr); cycles=6; break;
-
-        case 0x86: addr = CPU_ZeroPage(cpu);       CPU_STX(cpu, addr); cycles=3; break;
-        case 0x96: addr = CPU_ZeroPageY(cpu);      CPU_STX(cpu, addr); cycles=4; break;
-        case 0x8E: addr = CPU_Absolute(cpu);       CPU_STX(cpu, addr); cycles=4; break;
-
-        case 0x84: addr = CPU_ZeroPage(cpu);       CPU_STY(cpu, addr); cycles=3; break;
-        case 0x94: addr = CPU_ZeroPageX(cpu);      CPU_STY(cpu, addr); cycles=4; break;
-        case 0x8C: addr = CPU_Absolute(cpu);       CPU_STY(cpu, addr); cycles=4; break;
-
-        case 0xAA: addr = CPU_Implied(cpu);        CPU_TAX(cpu); cycles=2; break;
-        case 0xA8: addr = CPU_Implied(cpu);        CPU_TAY(cpu); cycles=2; break;
-        case 0x8A: addr = CPU_Implied(cpu);        CPU_TXA(cpu); cycles=2; break;
-        case 0x98: addr = CPU_Implied(cpu);        CPU_TYA(cpu); cycles=2; break;
-        case 0xBA: addr = CPU_Implied(cpu);        CPU_TSX(cpu); cycles=2; break;
-        case 0x9A: addr = CPU_Implied(cpu);        CPU_TXS(cpu); cycles=2; break;
-
-        case 0x48: addr = CPU_Implied(cpu);        CPU_PHA(cpu); cycles=3; break;
-        case 0x68: addr = CPU_Implied(cpu);        CPU_PLA(cpu); cycles=4; break;
-        case 0x08: addr = CPU_Implied(cpu);        CPU_PHP(cpu); cycles=3; break;
-        case 0x28: addr = CPU_Implied(cpu);        CPU_PLP(cpu); cycles=4; break;
-
-        case 0xC6: addr = CPU_ZeroPage(cpu);       CPU_DEC(cpu, addr); cycles=5; break;
-        case 0xD6: addr = CPU_ZeroPageX(cpu);      CPU_DEC(cpu, addr); cycles=6; break;
-        case 0xCE: addr = CPU_Absolute(cpu);       CPU_DEC(cpu, addr); cycles=6; break;
-        case 0xDE: addr = CPU_AbsoluteX(cpu);      CPU_DEC(cpu, addr); cycles=7; break;
-        case 0xCA: addr = CPU_Implied(cpu);        CPU_DEX(cpu); cycles=2; break;
-        case 0x88: addr = CPU_Implied(cpu);        CPU_DEY(cpu); cycles=2; break;
-
-        case 0xE6: addr = CPU_ZeroPage(cpu);       CPU_INC(cpu, addr); cycles=5; break;
-        case 0xF6: addr = CPU_ZeroPageX(cpu);      CPU_INC(cpu, addr); cycles=6; break;
-        case 0xEE: addr = CPU_Absolute(cpu);       CPU_INC(cpu, addr); cycles=6; break;
-        case 0xFE: addr = CPU_AbsoluteX(cpu);      CPU_INC(cpu, addr); cycles=7; break;
-        case 0xE8: addr = CPU_Implied(cpu);        CPU_INX(cpu); cycles=2; break;
-        case 0xC8: addr = CPU_Implied(cpu);        CPU_INY(cpu); cycles=2; break;
-
-        case 0x69: addr = CPU_Immediate(cpu);      CPU_ADC(cpu, addr); cycles=2; break;
-        case 0x65: addr = CPU_ZeroPage(cpu);       CPU_ADC(cpu, addr); cycles=3; break;
-        case 0x75: addr = CPU_ZeroPageX(cpu);      CPU_ADC(cpu, addr); cycles=4; break;
-        case 0x6D: addr = CPU_Absolute(cpu);       CPU_ADC(cpu, addr); cycles=4; break;
-        case 0x7D: addr = CPU_AbsoluteX(cpu);      CPU_ADC(cpu, addr); cycles=4; break; // +1 page cross
-        case 0x79: addr = CPU_AbsoluteY(cpu);      CPU_ADC(cpu, addr); cycles=4; break; // +1 page cross
-        case 0x61: addr = CPU_IndexedIndirect(cpu);CPU_ADC(cpu, addr); cycles=6; break;
-        case 0x71: addr = CPU_IndirectIndexed(cpu);CPU_ADC(cpu, addr); cycles=5; break; // +1 page cross
-
-        case 0xE9: addr = CPU_Immediate(cpu);      CPU_SBC(cpu, addr); cycles=2; break;
-        case 0xE5: addr = CPU_ZeroPage(cpu);       CPU_SBC(cpu, addr); cycles=3; break;
-        case 0xF5: addr = CPU_ZeroPageX(cpu);      CPU_SBC(cpu, addr); cycles=4; break;
-        case 0xED: addr = CPU_Absolute(cpu);       CPU_SBC(cpu, addr); cycles=4; break;
-        case 0xFD: addr = CPU_AbsoluteX(cpu);      CPU_SBC(cpu, addr); cycles=4; break; // +1 if page crossed
-        case 0xF9: addr = CPU_AbsoluteY(cpu);      CPU_SBC(cpu, addr); cycles=4; break; // +1 if page crossed
-        case 0xE1: addr = CPU_IndexedIndirect(cpu);CPU_SBC(cpu, addr); cycles=6; break;
-        case 0xF1: addr = CPU_IndirectIndexed(cpu);CPU_SBC(cpu, addr); cycles=5; break; // +1 if page crossed
-        case 0xEB: addr = CPU_Immediate(cpu);      CPU_SBC(cpu, addr); cycles=2; break; // Unofficial SBC
-
-        case 0xC9: addr = CPU_Immediate(cpu);      CPU_CMP(cpu, addr); cycles=2; break;
-        case 0xC5: addr = CPU_ZeroPage(cpu);       CPU_CMP(cpu, addr); cycles=3; break;
-        case 0xD5: addr = CPU_ZeroPageX(cpu);      CPU_CMP(cpu, addr); cycles=4; break;
-        case 0xCD: addr = CPU_Absolute(cpu);       CPU_CMP(cpu, addr); cycles=4; break;
-        case 0xDD: addr = CPU_AbsoluteX(cpu);      CPU_CMP(cpu, addr); cycles=4; break; // +1 page cross
-        case 0xD9: addr = CPU_AbsoluteY(cpu);      CPU_CMP(cpu, addr); cycles=4; break; // +1 page cross
-        case 0xC1: addr = CPU_IndexedIndirect(cpu);CPU_CMP(cpu, addr); cycles=6; break;
-        case 0xD1: addr = CPU_IndirectIndexed(cpu);CPU_CMP(cpu, addr); cycles=5; break; // +1 page cross
-
-        case 0xE0: addr = CPU_Immediate(cpu);      CPU_CPX(cpu, addr); cycles=2; break;
-        case 0xE4: addr = CPU_ZeroPage(cpu);       CPU_CPX(cpu, addr); cycles=3; break;
-        case 0xEC: addr = CPU_Absolute(cpu);       CPU_CPX(cpu, addr); cycles=4; break;
-
-        case 0xC0: addr = CPU_Immediate(cpu);      CPU_CPY(cpu, addr); cycles=2; break;
-        case 0xC4: addr = CPU_ZeroPage(cpu);       CPU_CPY(cpu, addr); cycles=3; break;
-        case 0xCC: addr = CPU_Absolute(cpu);       CPU_CPY(cpu, addr); cycles=4; break;
-
-        case 0x29: addr = CPU_Immediate(cpu);      CPU_AND(cpu, addr); cycles=2; break;
-        case 0x25: addr = CPU_ZeroPage(cpu);       CPU_AND(cpu, addr); cycles=3; break;
-        case 0x35: addr = CPU_ZeroPageX(cpu);      CPU_AND(cpu, addr); cycles=4; break;
-        case 0x2D: addr = CPU_Absolute(cpu);       CPU_AND(cpu, addr); cycles=4; break;
-        case 0x3D: addr = CPU_AbsoluteX(cpu);      CPU_AND(cpu, addr); cycles=4; break; // +1 page cross
-        case 0x39: addr = CPU_AbsoluteY(cpu);      CPU_AND(cpu, addr); cycles=4; break; // +1 page cross
-        case 0x21: addr = CPU_IndexedIndirect(cpu);CPU_AND(cpu, addr); cycles=6; break;
-        case 0x31: addr = CPU_IndirectIndexed(cpu);CPU_AND(cpu, addr); cycles=5; break; // +1 page cross
-
-        case 0x49: addr = CPU_Immediate(cpu);      CPU_EOR(cpu, addr); cycles=2; break;
-        case 0x45: addr = CPU_ZeroPage(cpu);       CPU_EOR(cpu, addr); cycles=3; break;
-        case 0x55: addr = CPU_ZeroPageX(cpu);      CPU_EOR(cpu, addr); cycles=4; break;
-        case 0x4D: addr = CPU_Absolute(cpu);       CPU_EOR(cpu, addr); cycles=4; break;
-        case 0x5D: addr = CPU_AbsoluteX(cpu);      CPU_EOR(cpu, addr); cycles=4; break; // +1 page cross
-        case 0x59: addr = CPU_AbsoluteY(cpu);      CPU_EOR(cpu, addr); cycles=4; break; // +1 page cross
-        case 0x41: addr = CPU_IndexedIndirect(cpu);CPU_EOR(cpu, addr); cycles=6; break;
-        case 0x51: addr = CPU_IndirectIndexed(cpu);CPU_EOR(cpu, addr); cycles=5; break; // +1 page cross
-
-        case 0x09: addr = CPU_Immediate(cpu);      CPU_ORA(cpu, addr); cycles=2; break;
-        case 0x05: addr = CPU_ZeroPage(cpu);       CPU_ORA(cpu, addr); cycles=3; break;
-        case 0x15: addr = CPU_ZeroPageX(cpu);      CPU_ORA(cpu, addr); cycles=4; break;
-        case 0x0D: addr = CPU_Absolute(cpu);       CPU_ORA(cpu, addr); cycles=4; break;
-        case 0x1D: addr = CPU_AbsoluteX(cpu);      CPU_ORA(cpu, addr); cycles=4; break; // +1 page cross
-        case 0x19: addr = CPU_AbsoluteY(cpu);      CPU_ORA(cpu, addr); cycles=4; break; // +1 page cross
-        case 0x01: addr = CPU_IndexedIndirect(cpu);CPU_ORA(cpu, addr); cycles=6; break;
-        case 0x11: addr = CPU_IndirectIndexed(cpu);CPU_ORA(cpu, addr); cycles=5; break; // +1 page cross
-
-        case 0x24: addr = CPU_ZeroPage(cpu);       CPU_BIT(cpu, addr); cycles=3; break;
-        case 0x2C: addr = CPU_Absolute(cpu);       CPU_BIT(cpu, addr); cycles=4; break;
-
-        case 0x0A: addr = CPU_Accumulator(cpu);    CPU_ASL_A(cpu); cycles=2; break;
-        case 0x06: addr = CPU_ZeroPage(cpu);       CPU_ASL(cpu, addr); cycles=5; break;
-        case 0x16: addr = CPU_ZeroPageX(cpu);      CPU_ASL(cpu, addr); cycles=6; break;
-        case 0x0E: addr = CPU_Absolute(cpu);       CPU_ASL(cpu, addr); cycles=6; break;
-        case 0x1E: addr = CPU_AbsoluteX(cpu);      CPU_ASL(cpu, addr); cycles=7; break;
-
-        case 0x4A: addr = CPU_Accumulator(cpu);    CPU_LSR_A(cpu); cycles=2; break;
-        case 0x46: addr = CPU_ZeroPage(cpu);       CPU_LSR(cpu, addr); cycles=5; break;
-        case 0x56: addr = CPU_ZeroPageX(cpu);      CPU_LSR(cpu, addr); cycles=6; break;
-        case 0x4E: addr = CPU_Absolute(cpu);       CPU_LSR(cpu, addr); cycles=6; break;
-        case 0x5E: addr = CPU_AbsoluteX(cpu);      CPU_LSR(cpu, addr); cycles=7; break;
-
-        case 0x2A: addr = CPU_Accumulator(cpu);    CPU_ROL_A(cpu); cycles=2; break;
-        case 0x26: addr = CPU_ZeroPage(cpu);       CPU_ROL(cpu, addr); cycles=5; break;
-        case 0x36: addr = CPU_ZeroPageX(cpu);      CPU_ROL(cpu, addr); cycles=6; break;
-        case 0x2E: addr = CPU_Absolute(cpu);       CPU_ROL(cpu, addr); cycles=6; break;
-        case 0x3E: addr = CPU_AbsoluteX(cpu);      CPU_ROL(cpu, addr); cycles=7; break;
-
-        case 0x6A: addr = CPU_Accumulator(cpu);    CPU_ROR_A(cpu); cycles=2; break;
-        case 0x66: addr = CPU_ZeroPage(cpu);       CPU_ROR(cpu, addr); cycles=5; break;
-        case 0x76: addr = CPU_ZeroPageX(cpu);      CPU_ROR(cpu, addr); cycles=6; break;
-        case 0x6E: addr = CPU_Absolute(cpu);       CPU_ROR(cpu, addr); cycles=6; break;
-        case 0x7E: addr = CPU_AbsoluteX(cpu);      CPU_ROR(cpu, addr); cycles=7; break;
-        case 0x90: addr = CPU_Relative(cpu);       CPU_BCC(cpu, addr); cycles=2; break; // +1/+2
-        case 0xB0: addr = CPU_Relative(cpu);       CPU_BCS(cpu, addr); cycles=2; break; // +1/+2
-        case 0xF0: addr = CPU_Relative(cpu);       CPU_BEQ(cpu, addr); cycles=2; break; // +1/+2
-        case 0x30: addr = CPU_Relative(cpu);       CPU_BMI(cpu, addr); cycles=2; break; // +1/+2
-        case 0xD0: addr = CPU_Relative(cpu);       CPU_BNE(cpu, addr); cycles=2; break; // +1/+2
-        case 0x10: addr = CPU_Relative(cpu);       CPU_BPL(cpu, addr); cycles=2; break; // +1/+2
-        case 0x50: addr = CPU_Relative(cpu);       CPU_BVC(cpu, addr); cycles=2; break; // +1/+2
-        case 0x70: addr = CPU_Relative(cpu);       CPU_BVS(cpu, addr); cycles=2; break; // +1/+2
-        
-        case 0x4C: addr = CPU_Absolute(cpu);       CPU_JMP(cpu, addr); cycles=3; break;
-        case 0x6C: addr = CPU_Indirect(cpu);       CPU_JMP(cpu, addr); cycles=5; break;
-        case 0x20: addr = CPU_Absolute(cpu);       CPU_JSR(cpu, addr); cycles=6; break;
-        case 0x60: addr = CPU_Implied(cpu);        CPU_RTS(cpu); cycles=6; break;
-
-        case 0x00: addr = CPU_Implied(cpu);        CPU_BRK(cpu); cycles=7; break;
-        case 0x40: addr = CPU_Implied(cpu);        CPU_RTI(cpu); cycles=6; break;
-
-        case 0x18: addr = CPU_Implied(cpu);        CPU_CLC(cpu); cycles=2; break;
-        case 0x38: addr = CPU_Implied(cpu);        CPU_SEC(cpu); cycles=2; break;
-        case 0x58: addr = CPU_Implied(cpu);        CPU_CLI(cpu); cycles=2; break;
-        case 0x78: addr = CPU_Implied(cpu);        CPU_SEI(cpu); cycles=2; break;
-        case 0xB8: addr = CPU_Implied(cpu);        CPU_CLV(cpu); cycles=2; break;
-        case 0xD8: addr = CPU_Implied(cpu);        CPU_CLD(cpu); cycles=2; break;
-        case 0xF8: addr = CPU_Implied(cpu);        CPU_SED(cpu); cycles=2; break;
-
-        case 0xEA: addr = CPU_Implied(cpu);        CPU_NOP(cpu); cycles=2; break;
-
-        // Unofficial Opcodes
-
-        // KIL/JAM Opcodes (Halt execution)
-        case 0x02: case 0x12: case 0x22: case 0x32: case 0x42: case 0x52: 
-        case 0x62: case 0x72: case 0x92: case 0xB2: case 0xD2: case 0xF2:
-            DEBUG_DEBUG("KIL/JAM opcode encountered: 0x%02X at PC: 0x%04X", opcode, initial_pc);
-            return -1;
+    int cycles;
 
-        // NOPs (Various addressing modes, different cycle counts)
-        case 0x1A: case 0x3A: case 0x5A: case 0x7A: case 0xDA: case 0xFA: // NOP implied
-            addr = CPU_Implied(cpu); CPU_NOP(cpu); cycles = 2; break;
-        case 0x80: case 0x82: case 0x89: case 0xC2: case 0xE2: // NOP immediate
-            addr = CPU_Immediate(cpu); CPU_NOP(cpu); cycles = 2; break;
-        case 0x04: case 0x44: case 0x64: // NOP zero page
-            addr = CPU_ZeroPage(cpu); CPU_NOP(cpu); cycles = 3; break;
-        case 0x14: case 0x34: case 0x54: case 0x74: case 0xD4: case 0xF4: // NOP zero page, X
-            addr = CPU_ZeroPageX(cpu); CPU_NOP(cpu); cycles = 4; break;
-        case 0x0C: // NOP absolute
-            addr = CPU_Absolute(cpu); CPU_NOP(cpu); cycles = 4; break;
-        case 0x1C: case 0x3C: case 0x5C: case 0x7C: case 0xDC: case 0xFC: // NOP absolute, X
-            addr = CPU_AbsoluteX(cpu); CPU_NOP(cpu); cycles = 4; break; // +1 page cross
-
-            // LAX (Load A & X)
-        case 0xA7: addr = CPU_ZeroPage(cpu);        CPU_LAX(cpu, addr); cycles=3; break;
-        case 0xB7: addr = CPU_ZeroPageY(cpu);       CPU_LAX(cpu, addr); cycles=4; break;
-        case 0xAF: addr = CPU_Absolute(cpu);        CPU_LAX(cpu, addr); cycles=4; break;
-        case 0xBF: addr = CPU_AbsoluteY(cpu);       CPU_LAX(cpu, addr); cycles=4; break; // +1 page cross
-        case 0xA3: addr = CPU_IndexedIndirect(cpu); CPU_LAX(cpu, addr); cycles=6; break;
-        case 0xB3: addr = CPU_IndirectIndexed(cpu); CPU_LAX(cpu, addr); cycles=5; break; // +1 page cross
-
-            // SAX (Store A & X)
-        case 0x87: addr = CPU_ZeroPage(cpu);        CPU_SAX(cpu, addr); cycles=3; break;
-        case 0x97: addr = CPU_ZeroPageY(cpu);       CPU_SAX(cpu, addr); cycles=4; break;
-        case 0x8F: addr = CPU_Absolute(cpu);        CPU_SAX(cpu, addr); cycles=4; break;
-        case 0x83: addr = CPU_IndexedIndirect(cpu); CPU_SAX(cpu, addr); cycles=6; break;
-
-            // SBC #imm (Unofficial) - Already covered by 0xEB
-
-            // DCP (DEC then CMP)
-        case 0xC7: addr = CPU_ZeroPage(cpu);        CPU_DCP(cpu, addr); cycles=5; break;
-        case 0xD7: addr = CPU_ZeroPageX(cpu);       CPU_DCP(cpu, addr); cycles=6; break;
-        case 0xCF: addr = CPU_Absolute(cpu);        CPU_DCP(cpu, addr); cycles=6; break;
-        case 0xDF: 
-            addr = CPU_AbsoluteX(cpu); 
-            // 7 cycles normally, 6 if page boundary crossed
-            if (((addr - cpu->x) & 0xFF00) != (addr & 0xFF00)) {
-            cycles = 6;
-            } else {
-            cycles = 7;
-            }
-            CPU_DCP(cpu, addr); 
-            break;
-        case 0xDB: 
-            addr = CPU_AbsoluteY(cpu); 
-            // 7 cycles normally, 6 if page boundary crossed
-            if (((addr - cpu->y) & 0xFF00) != (addr & 0xFF00)) {
-            cycles = 6;
-            } else {
-            cycles = 7;
-            }
-            CPU_DCP(cpu, addr); 
-            break;
-        case 0xC3: addr = CPU_IndexedIndirect(cpu); CPU_DCP(cpu, addr); cycles=8; break;
-        case 0xD3: 
-            addr = CPU_IndirectIndexed(cpu); 
-            // Add cycle if page boundary is crossed
-            {
-            uint8_t zp_addr = BUS_Read(cpu->nes, cpu->pc - 1); // The zero page address used
-            uint16_t base_addr = (uint16_t)BUS_Read(cpu->nes, zp_addr) | ((uint16_t)BUS_Read(cpu->nes, (zp_addr + 1) & 0xFF) << 8);
-            uint16_t final_addr = base_addr + cpu->y;
-            if ((base_addr & 0xFF00) != (final_addr & 0xFF00)) {
-                cycles = 7;
-            } else {
-                cycles = 8;
-            }
-            }
-            CPU_DCP(cpu, addr); 
-            break;
-
-            // ISC / ISB (INC then SBC)
-        case 0xE7: addr = CPU_ZeroPage(cpu);        CPU_ISC(cpu, addr); cycles=5; break;
-        case 0xF7: addr = CPU_ZeroPageX(cpu);       CPU_ISC(cpu, addr); cycles=6; break;
-        case 0xEF: addr = CPU_Absolute(cpu);        CPU_ISC(cpu, addr); cycles=6; break;
-        case 0xFF: 
-            addr = CPU_AbsoluteX(cpu); 
-            // 7 cycles normally, 6 if page boundary crossed
-            if (((addr - cpu->x) & 0xFF00) != (addr & 0xFF00)) {
-            cycles = 6;
-            } else {
-            cycles = 7;
-            }
-            CPU_ISC(cpu, addr); 
-            break;
-        case 0xFB: 
-            addr = CPU_AbsoluteY(cpu); 
-            // 7 cycles normally, 6 if page boundary crossed
-            if (((addr - cpu->y) & 0xFF00) != (addr & 0xFF00)) {
-            cycles = 6;
-            } else {
-            cycles = 7;
-            }
-            CPU_ISC(cpu, addr); 
-            break;
-        case 0xE3: addr = CPU_IndexedIndirect(cpu); CPU_ISC(cpu, addr); cycles=8; break;
-        case 0xF3: 
-            addr = CPU_IndirectIndexed(cpu); 
-            // 8 cycles normally, 7 if page boundary crossed
-            {
-            uint8_t zp_addr = BUS_Read(cpu->nes, cpu->pc - 1); // The zero page address used
-            uint16_t base_addr = (uint16_t)BUS_Read(cpu->nes, zp_addr) | ((uint16_t)BUS_Read(cpu->nes, (zp_addr + 1) & 0xFF) << 8);
-            uint16_t final_addr = base_addr + cpu->y;
-            if ((base_addr & 0xFF00) != (final_addr & 0xFF00)) {
-                cycles = 7;
-            } else {
-                cycles = 8;
-            }
-            }
-            CPU_ISC(cpu, addr); 
-            break;
-        
-        // SLO (ASL then ORA)
-        case 0x07: addr = CPU_ZeroPage(cpu);        CPU_SLO(cpu, addr); cycles=5; break;
-        case 0x17: addr = CPU_ZeroPageX(cpu);       CPU_SLO(cpu, addr); cycles=6; break;
-        case 0x0F: addr = CPU_Absolute(cpu);        CPU_SLO(cpu, addr); cycles=6; break;
-        case 0x1F: 
-            addr = CPU_AbsoluteX(cpu);
-            if (((addr - cpu->x) & 0xFF00) != (addr & 0xFF00)) {
-                cycles = 6;
-            } else {
-                cycles = 7;
-            }
-            CPU_SLO(cpu, addr); 
-            break;
-        case 0x1B: 
-            addr = CPU_AbsoluteY(cpu);
-            if (((addr - cpu->y) & 0xFF00) != (addr & 0xFF00)) {
-                cycles = 6;
-            } else {
-                cycles = 7;
-            }
-            CPU_SLO(cpu, addr); 
-            break;
-        case 0x03: addr = CPU_IndexedIndirect(cpu); CPU_SLO(cpu, addr); cycles=8; break;
-        case 0x13: 
-            addr = CPU_IndirectIndexed(cpu);
-            {
-            uint8_t zp_addr = BUS_Read(cpu->nes, cpu->pc - 1); // The zero page address used
-            uint16_t base_addr = (uint16_t)BUS_Read(cpu->nes, zp_addr) | ((uint16_t)BUS_Read(cpu->nes, (zp_addr + 1) & 0xFF) << 8);
-            uint16_t final_addr = base_addr + cpu->y;
-            if ((base_addr & 0xFF00) != (final_addr & 0xFF00)) {
-                cycles = 7;
-            } else {
-                cycles = 8;
-            }
-            }
-            CPU_SLO(cpu, addr); 
-            break;
-
-            // RLA (ROL then AND)
-        case 0x27: addr = CPU_ZeroPage(cpu);        CPU_RLA(cpu, addr); cycles=5; break;
-        case 0x37: addr = CPU_ZeroPageX(cpu);       CPU_RLA(cpu, addr); cycles=6; break;
-        case 0x2F: addr = CPU_Absolute(cpu);        CPU_RLA(cpu, addr); cycles=6; break;
-        case 0x3F: 
-            addr = CPU_AbsoluteX(cpu); 
-            // 7 cycles normally, 8 if page boundary crossed
-            if (((addr - cpu->x) & 0xFF00) != (addr & 0xFF00)) {
-            cycles = 6;
-            } else {
-            cycles = 7;
-            }
-            CPU_RLA(cpu, addr); 
-            break;
-        case 0x3B: 
-            addr = CPU_AbsoluteY(cpu); 
-            // 7 cycles normally, 8 if page boundary crossed
-            if (((addr - cpu->y) & 0xFF00) != (addr & 0xFF00)) {
-            cycles = 6;
-            } else {
-            cycles = 7;
-            }
-            CPU_RLA(cpu, addr); 
-            break;
-        case 0x23: addr = CPU_IndexedIndirect(cpu); CPU_RLA(cpu, addr); cycles=8; break;
-        case 0x33: 
-            addr = CPU_IndirectIndexed(cpu); 
-            {
-            uint8_t zp_addr = BUS_Read(cpu->nes, cpu->pc - 1); // The zero page address used
-            uint16_t base_addr = (uint16_t)BUS_Read(cpu->nes, zp_addr) | ((uint16_t)BUS_Read(cpu->nes, (zp_addr + 1) & 0xFF) << 8);
-            uint16_t final_addr = base_addr + cpu->y;
-            if ((base_addr & 0xFF00) != (final_addr & 0xFF00)) {
-                cycles = 7;
-            } else {
-                cycles = 8;
-            }
-            }
-            CPU_RLA(cpu, addr); 
-            break;
-
-            // SRE (LSR then EOR)
-        case 0x47: addr = CPU_ZeroPage(cpu);        CPU_SRE(cpu, addr); cycles=5; break;
-        case 0x57: addr = CPU_ZeroPageX(cpu);       CPU_SRE(cpu, addr); cycles=6; break;
-        case 0x4F: addr = CPU_Absolute(cpu);        CPU_SRE(cpu, addr); cycles=6; break;
-        case 0x5F: 
-            addr = CPU_AbsoluteX(cpu);
-            // 7 cycles normally, 6 if page boundary crossed
-            if (((addr - cpu->x) & 0xFF00) != (addr & 0xFF00)) {
-            cycles = 6;
-            } else {
-            cycles = 7;
-            }
-            CPU_SRE(cpu, addr); 
-            break;
-        case 0x5B: 
-            addr = CPU_AbsoluteY(cpu);
-            // 7 cycles normally, 6 if page boundary crossed
-            if (((addr - cpu->y) & 0xFF00) != (addr & 0xFF00)) {
-            cycles = 6;
-            } else {
-            cycles = 7;
-            }
-            CPU_SRE(cpu, addr); 
-            break;
-        case 0x43: addr = CPU_IndexedIndirect(cpu); CPU_SRE(cpu, addr); cycles=8; break;
-        case 0x53: 
-            addr = CPU_IndirectIndexed(cpu); 
-            {
-            uint8_t zp_addr = BUS_Read(cpu->nes, cpu->pc - 1); // The zero page address used
-            uint16_t base_addr = (uint16_t)BUS_Read(cpu->nes, zp_addr) | ((uint16_t)BUS_Read(cpu->nes, (zp_addr + 1) & 0xFF) << 8);
-            uint16_t final_addr = base_addr + cpu->y;
-            if ((base_addr & 0xFF00) != (final_addr & 0xFF00)) {
-                cycles = 7;
-            } else {
-                cycles = 8;
-            }
-            }
-            CPU_SRE(cpu, addr); 
-            break;
-
-            // RRA (ROR then ADC)
-        case 0x67: addr = CPU_ZeroPage(cpu);        CPU_RRA(cpu, addr); cycles=5; break;
-        case 0x77: addr = CPU_ZeroPageX(cpu);       CPU_RRA(cpu, addr); cycles=6; break;
-        case 0x6F: addr = CPU_Absolute(cpu);        CPU_RRA(cpu, addr); cycles=6; break;
-        case 0x7F: 
-            addr = CPU_AbsoluteX(cpu);
-            // 7 cycles normally, 6 if page boundary crossed
-            if (((addr - cpu->x) & 0xFF00) != (addr & 0xFF00)) {
-            cycles = 6;
-            } else {
-            cycles = 7;
-            }
-            CPU_RRA(cpu, addr); 
-            break;
-        case 0x7B: 
-            addr = CPU_AbsoluteY(cpu);
-            // 7 cycles normally, 6 if page boundary crossed
-            if (((addr - cpu->y) & 0xFF00) != (addr & 0xFF00)) {
-            cycles = 6;
-            } else {
-            cycles = 7;
-            }
-            CPU_RRA(cpu, addr); 
-            break;
-        case 0x63: addr = CPU_IndexedIndirect(cpu); CPU_RRA(cpu, addr); cycles=8; break;
-        case 0x73: 
-            addr = CPU_IndirectIndexed(cpu); 
-            {
-            uint8_t zp_addr = BUS_Read(cpu->nes, cpu->pc - 1); // The zero page address used
-            uint16_t base_addr = (uint16_t)BUS_Read(cpu->nes, zp_addr) | ((uint16_t)BUS_Read(cpu->nes, (zp_addr + 1) & 0xFF) << 8);
-            uint16_t final_addr = base_addr + cpu->y;
-            if ((base_addr & 0xFF00) != (final_addr & 0xFF00)) {
-                cycles = 7;
-            } else {
-                cycles = 8;
-            }
-            }
-            CPU_RRA(cpu, addr); 
-            break;
+    // Code running from PRG ROM goes through the decode cache, RAM code is decoded every time
+    uint32_t decoded = cpu->pc >= 0x8000 ? CPU_Decode(cpu) : 0;
+    if (decoded) {
+        cpu->pc += CPU_DECODED_LENGTH(decoded);
+        cycles = cpu_instructions[CPU_DECODED_OPCODE(decoded)].handler(cpu, CPU_DECODED_OPERAND(decoded));
+    } else {
+        uint8_t opcode = BUS_Read(cpu->nes, cpu->pc);
+        cycles = cpu_instructions[opcode].execute(cpu);
+    }
 
-            // ANC (AND Immediate then N->C)
-        case 0x0B: case 0x2B: addr = CPU_Immediate(cpu); CPU_ANC(cpu, addr); cycles = 2; break;
+    if (cycles < 0)
+        return -1; // Halt on KIL/JAM or unknown opcodes
+
+    cpu->total_cycles += (uint64_t)cycles;
+    return cycles;
+}
+
+// Recompiler
+// Optional, switched on per CPU with CPU_SetRecompiler. Straight runs of PRG ROM code
+// are translated into x86-64 blocks that do what CPU_Step would do for each of their
+// instructions in turn. While blocks run, A, X, Y, SP, P and total_cycles live in host
+// registers. Loads, stores, arithmetic, the stack and branches on registers, zero page
+// and internal RAM run inline. Everything else stores the registers back, calls the
+// instruction's handler with PC and total_cycles as the interpreter would have left
+// them and loads the registers again. Before each instruction the block checks the
+// cycles against run_until, so bursts end on the same instruction as under the
+// interpreter and the bus handlers see the same cycle counts.
+//
+// A block ends at every jump, branch, return or interrupt. It also ends at the end of
+// its 256 byte page, and after any write that can reach a mapper and swap the bank it
+// runs from. Exits to a known PC are chained: once the block there has been found they
+// jump straight to it, for as long as its page still reads from the same place. Blocks
+// are found by their PRG ROM offset and CPU address, ROM is read only so they never go
+// stale. Once the code buffer is full every block is dropped and translation starts over.
+#if defined(CPU_RECOMPILER)
+
+#define CPU_RECOMPILER_CODE_SIZE   (1 << 20) // Bytes of translated code per CPU
+#define CPU_RECOMPILER_LINK_COUNT  (1 << 14) // Chained exits per CPU, kept after the code
+#define CPU_RECOMPILER_BLOCK_MAX   64        // Instructions per block
+#define CPU_RECOMPILER_INSTRUCTION 192       // Upper bound on the code for one instruction and its exits
+#define CPU_RECOMPILER_BANK_SIZE   0x2000    // PRG ROM bytes covered by one table of blocks
+#define CPU_RECOMPILER_PAGE_SIZE   0x1000    // Host pages, only those a new block goes into are made writable
+
+// Translated code only addresses the CPU with 8 bit displacements
+_Static_assert(offsetof(CPU, run_until) < 0x80, "CPU registers must stay at the start of the struct");
+
+// Where a chained exit jumps, while the page of its PC reads from page
+typedef struct CPU_BlockLink {
+    const uint8_t *target; // The exit's own way out until it is linked
+    const uint8_t *page;
+} CPU_BlockLink;
+
+// Loads the registers into the host's and runs block, 0 or -1 if the CPU halted
+typedef int (*CPU_BlockEnter)(CPU *cpu, uint8_t *ram, const uint8_t *block);
+
+typedef struct CPU_BlockEntry {
+    const uint8_t *block; // NULL until the code at this ROM offset first runs
+    uint16_t pc;          // Address it was translated for, a bank can be mapped at several
+} CPU_BlockEntry;
+
+struct CPU_Recompiler {
+    uint8_t *code;          // Executable, writable only while a block is translated
+    size_t used;
+    CPU_BlockLink *links;   // After the code, always writable
+    size_t links_used;
+    CPU_BlockLink *link;    // Exit the last block left through, to be linked to the next one
+    size_t generation;      // Counts flushes, links from before one are stale
+    CPU_BlockEnter enter;   // Shared code at the start of the buffer
+    size_t exit;            // Stores the registers back and returns 0
+    size_t halt;            // Returns -1, the handler left the registers in the CPU
+    size_t shared;          // Where blocks start
+    ROM *rom;               // Retained, the blocks were translated from it
+    CPU_BlockEntry **banks; // One table per 8KB of PRG ROM, allocated on first use
+    size_t bank_count;
+    uint8_t nz_flags[256];  // N and Z for each result
+};
 
-            // ALR / ASR (AND Immediate then LSR A)
-        case 0x4B: addr = CPU_Immediate(cpu); CPU_ALR(cpu, addr); cycles = 2; break;
+// Jump to a way out of the block, emitted after its last instruction
+typedef struct CPU_BlockStub {
+    size_t at;           // rel32 of the jump
+    uint16_t pc;
+    CPU_BlockLink *link; // NULL for an exit that isn't chained
+} CPU_BlockStub;
+
+typedef struct CPU_Emitter {
+    CPU_Recompiler *recompiler;
+    uint8_t *code;
+    size_t at;
+    CPU_BlockStub stubs[CPU_RECOMPILER_BLOCK_MAX + 4];
+    int stub_count;
+} CPU_Emitter;
+
+// Host registers. The 6502's registers are in the low bytes of r8-r12 and
+// total_cycles is in r13, rbx holds the CPU, r14 internal RAM and r15 nz_flags.
+// eax, ecx and edx are scratch
+enum {
+    CPU_X86_NONE = -1,
+    CPU_X86_EAX = 0, CPU_X86_ECX = 1, CPU_X86_EDX = 2, CPU_X86_CPU = 3,
+    CPU_X86_A = 8, CPU_X86_X = 9, CPU_X86_Y = 10, CPU_X86_SP = 11, CPU_X86_P = 12,
+    CPU_X86_CYCLES = 13, CPU_X86_RAM = 14, CPU_X86_NZ = 15
+};
 
-            // ARR (AND Immediate then ROR A, special flags)
-        case 0x6B: addr = CPU_Immediate(cpu); CPU_ARR(cpu, addr); cycles = 2; break;
+// ALU operations, the reg field of 0x80 and bits 3-5 of the op r/m8, r8 opcodes
+enum { CPU_X86_ADD, CPU_X86_OR, CPU_X86_ADC, CPU_X86_SBB, CPU_X86_AND, CPU_X86_SUB, CPU_X86_XOR, CPU_X86_CMP };
 
-            // SBX / AXS ( (A&X) - Immediate -> X )
-        case 0xCB: addr = CPU_Immediate(cpu); CPU_SBX(cpu, addr); cycles = 2; break;
+// A register, or memory at base + index + disp
+typedef struct CPU_X86Operand {
+    int reg;
+    int base;
+    int index;
+    int32_t disp;
+} CPU_X86Operand;
 
-            // SHY (Store Y & (Hi+1)) - Simplified to STY for stability
-        case 0x9C: addr = CPU_AbsoluteX(cpu); CPU_SHY(cpu, addr); cycles = 5; break;
+static CPU_X86Operand CPU_X86Reg(int reg) 
+{
+    return (CPU_X86Operand){ reg, CPU_X86_NONE, CPU_X86_NONE, 0 };
+}
 
-            // SHX (Store X & (Hi+1)) - Simplified to STX for stability
-        case 0x9E: addr = CPU_AbsoluteY(cpu); CPU_SHX(cpu, addr); cycles = 5; break;
+static CPU_X86Operand CPU_X86Mem(int base, int index, int32_t disp) 
+{
+    return (CPU_X86Operand){ CPU_X86_NONE, base, index, disp };
+}
 
-            // LAS (LDA/TSX variant: Mem & SP -> A, X, SP)
-        case 0xBB: addr = CPU_AbsoluteY(cpu); CPU_LAS(cpu, addr); cycles = 4; break; //+1 page cross
+#define CPU_X86_FIELD(field) CPU_X86Mem(CPU_X86_CPU, CPU_X86_NONE, (int32_t)offsetof(CPU, field))
 
-            // TAS / SHS (SP = A & X, Mem = SP & (Hi+1)) - Simplified to SP = A & X
-        case 0x9B: addr = CPU_AbsoluteY(cpu); CPU_TAS(cpu); cycles = 5; break;
+// The 6502's registers and where the handlers keep them
+static const struct {
+    int reg;
+    uint8_t field;
+} cpu_x86_registers[] = {
+    { CPU_X86_A, offsetof(CPU, a) },
+    { CPU_X86_X, offsetof(CPU, x) },
+    { CPU_X86_Y, offsetof(CPU, y) },
+    { CPU_X86_SP, offsetof(CPU, sp) },
+    { CPU_X86_P, offsetof(CPU, status) },
+};
+
+static void CPU_EmitBytes(CPU_Emitter *e, const uint8_t *bytes, size_t count) 
+{
+    memcpy(e->code + e->at, bytes, count);
+    e->at += count;
+}
+
+#define CPU_EMIT(e, ...) CPU_EmitBytes((e), (const uint8_t[]){ __VA_ARGS__ }, sizeof((const uint8_t[]){ __VA_ARGS__ }))
+
+static void CPU_Emit32(CPU_Emitter *e, uint32_t value) 
+{
+    for (int i = 0; i < 4; i++)
+        e->code[e->at++] = (uint8_t)(value >> (i * 8));
+}
+
+static void CPU_Emit64(CPU_Emitter *e, uint64_t value) 
+{
+    CPU_Emit32(e, (uint32_t)value);
+    CPU_Emit32(e, (uint32_t)(value >> 32));
+}
+
+// rel32 to target in the code buffer, for an instruction ending after it
+static void CPU_EmitTarget(CPU_Emitter *e, size_t target) 
+{
+    CPU_Emit32(e, (uint32_t)((int64_t)target - (int64_t)(e->at + 4)));
+}
 
-        default:
-            DEBUG_ERROR("Unimplemented or Unknown opcode 0x%02X at 0x%04X", opcode, initial_pc);
-            return -1; // Indicate error/halt for truly unknown opcodes
+// Instruction with a ModRM byte: opcode, two bytes for 0x0F xx, with reg in the reg
+// field and rm as the other operand, 64 bit if wide. Immediates go after it
+static void CPU_EmitX86(CPU_Emitter *e, int wide, unsigned opcode, int reg, CPU_X86Operand rm) 
+{
+    int base = rm.reg != CPU_X86_NONE ? rm.reg : rm.base;
+    int index = rm.index != CPU_X86_NONE ? rm.index : 0;
+    uint8_t rex = (uint8_t)(0x40 | (wide ? 0x08 : 0) | (reg & 8) >> 1 | (index & 8) >> 2 | (base & 8) >> 3);
+    if (rex != 0x40)
+        e->code[e->at++] = rex;
+    if (opcode > 0xFF)
+        e->code[e->at++] = (uint8_t)(opcode >> 8);
+    e->code[e->at++] = (uint8_t)opcode;
+
+    if (rm.reg != CPU_X86_NONE) {
+        e->code[e->at++] = (uint8_t)(0xC0 | (reg & 7) << 3 | (base & 7));
+        return;
+    }
+    int mod = !rm.disp && (base & 7) != 5 ? 0 : rm.disp == (int8_t)rm.disp ? 1 : 2;
+    if (rm.index != CPU_X86_NONE || (base & 7) == 4) {
+        e->code[e->at++] = (uint8_t)(mod << 6 | (reg & 7) << 3 | 4);
+        e->code[e->at++] = (uint8_t)((rm.index != CPU_X86_NONE ? rm.index & 7 : 4) << 3 | (base & 7));
+    } else {
+        e->code[e->at++] = (uint8_t)(mod << 6 | (reg & 7) << 3 | (base & 7));
+    }
+    if (mod == 1)
+        e->code[e->at++] = (uint8_t)rm.disp;
+    else if (mod == 2)
+        CPU_Emit32(e, (uint32_t)rm.disp);
+}
+
+// mov dst, src on bytes
+static void CPU_EmitMove8(CPU_Emitter *e, int dst, int src) 
+{
+    CPU_EmitX86(e, 0, 0x88, src, CPU_X86Reg(dst));
+}
+
+// movzx reg, byte rm
+static void CPU_EmitLoad8(CPU_Emitter *e, int reg, CPU_X86Operand rm) 
+{
+    CPU_EmitX86(e, 0, 0x0FB6, reg, rm);
+}
+
+// mov byte rm, reg
+static void CPU_EmitStore8(CPU_Emitter *e, CPU_X86Operand rm, int reg) 
+{
+    CPU_EmitX86(e, 0, 0x88, reg, rm);
+}
+
+// mov byte rm, value
+static void CPU_EmitSet8(CPU_Emitter *e, CPU_X86Operand rm, uint8_t value) 
+{
+    CPU_EmitX86(e, 0, 0xC6, 0, rm);
+    e->code[e->at++] = value;
+}
+
+// op byte rm, reg
+static void CPU_EmitAlu8(CPU_Emitter *e, int op, CPU_X86Operand rm, int reg) 
+{
+    CPU_EmitX86(e, 0, (unsigned)op << 3, reg, rm);
+}
+
+// op byte rm, value
+static void CPU_EmitAluImm8(CPU_Emitter *e, int op, CPU_X86Operand rm, uint8_t value) 
+{
+    CPU_EmitX86(e, 0, 0x80, op, rm);
+    e->code[e->at++] = value;
+}
+
+// setcc reg, condition is the low nibble of the jcc opcodes
+static void CPU_EmitSetCondition(CPU_Emitter *e, int condition, int reg) 
+{
+    CPU_EmitX86(e, 0, 0x0F90u | (unsigned)condition, 0, CPU_X86Reg(reg));
+}
+
+enum { CPU_X86_OVERFLOW = 0x0, CPU_X86_CARRY = 0x2, CPU_X86_NO_CARRY = 0x3, CPU_X86_ZERO = 0x4, CPU_X86_NOT_ZERO = 0x5 };
+
+static void CPU_EmitClearFlags(CPU_Emitter *e, uint8_t flags) 
+{
+    CPU_EmitAluImm8(e, CPU_X86_AND, CPU_X86Reg(CPU_X86_P), (uint8_t)~flags);
+}
+
+static void CPU_EmitSetFlags(CPU_Emitter *e, uint8_t flags) 
+{
+    CPU_EmitAluImm8(e, CPU_X86_OR, CPU_X86Reg(CPU_X86_P), flags);
+}
+
+// Sets N and Z from the byte at rm. Clobbers eax
+static void CPU_EmitNZ(CPU_Emitter *e, CPU_X86Operand rm) 
+{
+    CPU_EmitLoad8(e, CPU_X86_EAX, rm);
+    CPU_EmitClearFlags(e, CPU_FLAG_NEGATIVE | CPU_FLAG_ZERO);
+    CPU_EmitX86(e, 0, 0x0A, CPU_X86_P, CPU_X86Mem(CPU_X86_NZ, CPU_X86_EAX, 0)); // or p, [nz_flags + rax]
+}
+
+// Puts C in the host's carry, for adc, sbb, rcl and rcr
+static void CPU_EmitCarry(CPU_Emitter *e) 
+{
+    CPU_EmitX86(e, 0, 0x0FBA, 4, CPU_X86Reg(CPU_X86_P)); // bt p, 0
+    e->code[e->at++] = 0;
+}
+
+// Replaces C with the byte in reg, which is 0 or 1
+static void CPU_EmitSetCarry(CPU_Emitter *e, int reg) 
+{
+    CPU_EmitClearFlags(e, CPU_FLAG_CARRY);
+    CPU_EmitAlu8(e, CPU_X86_OR, CPU_X86Reg(CPU_X86_P), reg);
+}
+
+static void CPU_EmitAddCycles(CPU_Emitter *e, uint8_t cycles) 
+{
+    CPU_EmitX86(e, 1, 0x83, 0, CPU_X86Reg(CPU_X86_CYCLES)); // add cycles, imm8
+    e->code[e->at++] = cycles;
+}
+
+static void CPU_EmitStorePC(CPU_Emitter *e, uint16_t pc) 
+{
+    CPU_EMIT(e, 0x66, 0xC7, 0x43, (uint8_t)offsetof(CPU, pc), (uint8_t)pc, (uint8_t)(pc >> 8));
+}
+
+// Registers into the CPU, for a handler or the interpreter
+static void CPU_EmitSpill(CPU_Emitter *e) 
+{
+    for (size_t i = 0; i < sizeof(cpu_x86_registers) / sizeof(cpu_x86_registers[0]); i++)
+        CPU_EmitStore8(e, CPU_X86Mem(CPU_X86_CPU, CPU_X86_NONE, cpu_x86_registers[i].field), cpu_x86_registers[i].reg);
+    CPU_EmitX86(e, 1, 0x89, CPU_X86_CYCLES, CPU_X86_FIELD(total_cycles));
+}
+
+// And back out of it
+static void CPU_EmitReload(CPU_Emitter *e) 
+{
+    for (size_t i = 0; i < sizeof(cpu_x86_registers) / sizeof(cpu_x86_registers[0]); i++)
+        CPU_EmitLoad8(e, cpu_x86_registers[i].reg, CPU_X86Mem(CPU_X86_CPU, CPU_X86_NONE, cpu_x86_registers[i].field));
+    CPU_EmitX86(e, 1, 0x8B, CPU_X86_CYCLES, CPU_X86_FIELD(total_cycles));
+}
+
+// rel32 of a jump that leaves the block with PC at pc, filled in by CPU_EmitStubs
+static void CPU_EmitStub(CPU_Emitter *e, uint16_t pc, CPU_BlockLink *link) 
+{
+    e->stubs[e->stub_count++] = (CPU_BlockStub){ e->at, pc, link };
+    CPU_Emit32(e, 0);
+}
+
+// Ways out of the block, after its last instruction so the paths through it don't jump
+// over them. One that isn't linked yet tells CPU_FindBlock where it left from
+static void CPU_EmitStubs(CPU_Emitter *e) 
+{
+    CPU_Recompiler *recompiler = e->recompiler;
+    for (int i = 0; i < e->stub_count; i++) {
+        const CPU_BlockStub *stub = &e->stubs[i];
+        uint32_t rel = (uint32_t)(e->at - (stub->at + 4));
+        memcpy(e->code + stub->at, &rel, sizeof(rel));
+
+        if (stub->link)
+            stub->link->target = e->code + e->at;
+        CPU_EmitStorePC(e, stub->pc);
+        if (stub->link) {
+            CPU_EMIT(e, 0x48, 0xB8); // mov rax, link
+            CPU_Emit64(e, (uint64_t)(uintptr_t)stub->link);
+            CPU_EmitX86(e, 1, 0x89, CPU_X86_EAX, CPU_X86Mem(CPU_X86_NZ, CPU_X86_NONE,
+                (int32_t)offsetof(CPU_Recompiler, link) - (int32_t)offsetof(CPU_Recompiler, nz_flags)));
+        }
+        CPU_EMIT(e, 0xE9); // jmp exit
+        CPU_EmitTarget(e, recompiler->exit);
+    }
+}
+
+// Leaves the block with PC at pc once total_cycles has reached run_until
+static void CPU_EmitDeadline(CPU_Emitter *e, uint16_t pc) 
+{
+    CPU_EmitX86(e, 1, 0x3B, CPU_X86_CYCLES, CPU_X86_FIELD(run_until)); // cmp cycles, [run_until]
+    CPU_EMIT(e, 0x0F, 0x83);                                          // jae
+    CPU_EmitStub(e, pc, NULL);
+}
+
+// Goes on to the block at pc, straight there once it is linked and as long as the bus
+// still reads pc's page from where it did then
+static void CPU_EmitChain(CPU_Emitter *e, uint16_t pc) 
+{
+    CPU_Recompiler *recompiler = e->recompiler;
+    CPU_EmitDeadline(e, pc);
+    if (pc < 0x8000) {
+        CPU_EMIT(e, 0xE9); // Only PRG ROM has blocks
+        CPU_EmitStub(e, pc, NULL);
+        return;
+    }
+
+    CPU_BlockLink *link = &recompiler->links[recompiler->links_used++];
+    link->page = NULL;
+    int32_t page = (int32_t)(offsetof(BUS, read_pages) + (pc >> 8) * sizeof(uint8_t *)) - (int32_t)offsetof(BUS, ram);
+    CPU_EmitX86(e, 1, 0x8B, CPU_X86_EAX, CPU_X86Mem(CPU_X86_RAM, CPU_X86_NONE, page)); // mov rax, read_pages[pc >> 8]
+    CPU_EMIT(e, 0x48, 0x3B, 0x05);  // cmp rax, [rip + page]
+    CPU_EmitTarget(e, (size_t)((const uint8_t *)&link->page - e->code));
+    CPU_EMIT(e, 0x0F, 0x85);        // jne
+    CPU_EmitStub(e, pc, link);
+    CPU_EMIT(e, 0xFF, 0x25);        // jmp [rip + target]
+    CPU_EmitTarget(e, (size_t)((const uint8_t *)&link->target - e->code));
+}
+
+// Leaves the block with PC as the instruction left it
+static void CPU_EmitReturn(CPU_Emitter *e) 
+{
+    CPU_EMIT(e, 0xE9);
+    CPU_EmitTarget(e, e->recompiler->exit);
+}
+
+// Runs the instruction through its handler, with PC already at next
+static void CPU_EmitCall(CPU_Emitter *e, CPU_Handler handler, uint16_t operand, uint16_t next) 
+{
+    CPU_EmitSpill(e);
+    CPU_EmitStorePC(e, next);
+#if defined(_WIN32)
+    CPU_EMIT(e, 0x48, 0x89, 0xD9, 0xBA); // mov rcx, rbx; mov edx, operand
+#else
+    CPU_EMIT(e, 0x48, 0x89, 0xDF, 0xBE); // mov rdi, rbx; mov esi, operand
+#endif
+    CPU_Emit32(e, operand);
+    CPU_EMIT(e, 0x48, 0xB8);
+    CPU_Emit64(e, (uint64_t)(uintptr_t)handler);
+    CPU_EMIT(e, 0xFF, 0xD0);             // call rax
+    CPU_EMIT(e, 0x85, 0xC0, 0x0F, 0x88); // test eax, eax; js halt
+    CPU_EmitTarget(e, e->recompiler->halt);
+    CPU_EmitReload(e);
+    CPU_EMIT(e, 0x89, 0xC0);             // mov eax, eax
+    CPU_EmitX86(e, 1, 0x01, CPU_X86_EAX, CPU_X86Reg(CPU_X86_CYCLES)); // add cycles, rax
+}
+
+// Works out where a zero page or internal RAM operand is, 0 for other modes and addresses
+static int CPU_EmitRamOperand(CPU_Emitter *e, int mode, uint16_t operand, CPU_X86Operand *rm) 
+{
+    switch (mode) {
+    case CPU_MODE_ZERO_PAGE:
+        *rm = CPU_X86Mem(CPU_X86_RAM, CPU_X86_NONE, operand & 0xFF);
+        return 1;
+    case CPU_MODE_ABSOLUTE:
+        if (operand >= 0x2000)
+            return 0;
+        *rm = CPU_X86Mem(CPU_X86_RAM, CPU_X86_NONE, operand & 0x7FF);
+        return 1;
+    case CPU_MODE_ZERO_PAGE_X:
+    case CPU_MODE_ZERO_PAGE_Y:
+        CPU_EmitLoad8(e, CPU_X86_ECX, CPU_X86Reg(mode == CPU_MODE_ZERO_PAGE_X ? CPU_X86_X : CPU_X86_Y));
+        CPU_EmitAluImm8(e, CPU_X86_ADD, CPU_X86Reg(CPU_X86_ECX), (uint8_t)operand); // Wraps in the zero page
+        *rm = CPU_X86Mem(CPU_X86_RAM, CPU_X86_ECX, 0);
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+// Loads the operand of a read into reg, 0 if it is neither immediate nor in internal RAM
+static int CPU_EmitReadOperand(CPU_Emitter *e, int reg, int mode, uint16_t operand) 
+{
+    if (mode == CPU_MODE_IMMEDIATE) {
+        CPU_EmitSet8(e, CPU_X86Reg(reg), (uint8_t)operand);
+        return 1;
+    }
+    CPU_X86Operand rm;
+    if (!CPU_EmitRamOperand(e, mode, operand, &rm))
+        return 0;
+    CPU_EmitLoad8(e, reg, rm);
+    return 1;
+}
+
+// Stack slot at SP, addressed through ecx
+static CPU_X86Operand CPU_EmitStack(CPU_Emitter *e) 
+{
+    CPU_EmitLoad8(e, CPU_X86_ECX, CPU_X86Reg(CPU_X86_SP));
+    return CPU_X86Mem(CPU_X86_RAM, CPU_X86_ECX, 0x100);
+}
+
+#define CPU_MNEMONIC(a, b, c) ((uint32_t)(a) << 16 | (uint32_t)(b) << 8 | (uint32_t)(c))
+
+// Translation of one instruction
+typedef enum {
+    CPU_TRANSLATED_CALL, // Not translated, the handler has to run it
+    CPU_TRANSLATED,      // Inline, the block goes on after it
+    CPU_TRANSLATED_END   // Inline, and the block has left with PC set
+} CPU_Translation;
+
+// Host register of the mnemonic's register, for loads, stores, transfers and compares
+static int CPU_RegisterOf(char name) 
+{
+    switch (name) {
+    case 'X': return CPU_X86_X;
+    case 'Y': return CPU_X86_Y;
+    case 'S': return CPU_X86_SP;
+    default:  return CPU_X86_A;
+    }
+}
+
+static CPU_Translation CPU_TranslateInstruction(CPU_Emitter *e, uint8_t opcode, uint16_t operand, uint16_t next) 
+{
+    const char *name = cpu_opcodes[opcode].mnemonic;
+    int mode = cpu_opcodes[opcode].addressing_mode;
+    uint8_t cycles = cpu_instructions[opcode].cycles;
+    const CPU_X86Operand a = CPU_X86Reg(CPU_X86_A);
+    CPU_X86Operand rm;
+
+    switch (CPU_MNEMONIC(name[0], name[1], name[2])) {
+    case CPU_MNEMONIC('L', 'D', 'A'):
+    case CPU_MNEMONIC('L', 'D', 'X'):
+    case CPU_MNEMONIC('L', 'D', 'Y'):
+        if (!CPU_EmitReadOperand(e, CPU_RegisterOf(name[2]), mode, operand))
+            return CPU_TRANSLATED_CALL;
+        CPU_EmitNZ(e, CPU_X86Reg(CPU_RegisterOf(name[2])));
+        break;
+
+    case CPU_MNEMONIC('S', 'T', 'A'):
+    case CPU_MNEMONIC('S', 'T', 'X'):
+    case CPU_MNEMONIC('S', 'T', 'Y'):
+        if (!CPU_EmitRamOperand(e, mode, operand, &rm))
+            return CPU_TRANSLATED_CALL;
+        CPU_EmitStore8(e, rm, CPU_RegisterOf(name[2]));
+        break;
+
+    case CPU_MNEMONIC('T', 'A', 'X'):
+    case CPU_MNEMONIC('T', 'A', 'Y'):
+    case CPU_MNEMONIC('T', 'X', 'A'):
+    case CPU_MNEMONIC('T', 'Y', 'A'):
+    case CPU_MNEMONIC('T', 'S', 'X'):
+    case CPU_MNEMONIC('T', 'X', 'S'):
+        CPU_EmitMove8(e, CPU_RegisterOf(name[2]), CPU_RegisterOf(name[1]));
+        if (name[2] != 'S')
+            CPU_EmitNZ(e, CPU_X86Reg(CPU_RegisterOf(name[2])));
+        break;
+
+    case CPU_MNEMONIC('I', 'N', 'X'):
+    case CPU_MNEMONIC('I', 'N', 'Y'):
+    case CPU_MNEMONIC('D', 'E', 'X'):
+    case CPU_MNEMONIC('D', 'E', 'Y'):
+        rm = CPU_X86Reg(CPU_RegisterOf(name[2]));
+        CPU_EmitX86(e, 0, 0xFE, name[0] == 'I' ? 0 : 1, rm); // inc / dec
+        CPU_EmitNZ(e, rm);
+        break;
+
+    case CPU_MNEMONIC('I', 'N', 'C'):
+    case CPU_MNEMONIC('D', 'E', 'C'):
+        if (!CPU_EmitRamOperand(e, mode, operand, &rm))
+            return CPU_TRANSLATED_CALL;
+        CPU_EmitX86(e, 0, 0xFE, name[0] == 'I' ? 0 : 1, rm);
+        CPU_EmitNZ(e, rm);
+        break;
+
+    case CPU_MNEMONIC('A', 'S', 'L'):
+    case CPU_MNEMONIC('L', 'S', 'R'):
+    case CPU_MNEMONIC('R', 'O', 'L'):
+    case CPU_MNEMONIC('R', 'O', 'R'):
+        if (mode == CPU_MODE_ACCUMULATOR)
+            rm = a;
+        else if (!CPU_EmitRamOperand(e, mode, operand, &rm))
+            return CPU_TRANSLATED_CALL;
+        if (name[0] == 'R')
+            CPU_EmitCarry(e);
+        // rcl, rcr, shl or shr by 1
+        CPU_EmitX86(e, 0, 0xD0, name[0] == 'R' ? (name[2] == 'L' ? 2 : 3) : (name[0] == 'A' ? 4 : 5), rm);
+        CPU_EmitSetCondition(e, CPU_X86_CARRY, CPU_X86_EDX);
+        CPU_EmitSetCarry(e, CPU_X86_EDX);
+        CPU_EmitNZ(e, rm);
+        break;
+
+    case CPU_MNEMONIC('A', 'D', 'C'):
+    case CPU_MNEMONIC('S', 'B', 'C'):
+        if (!CPU_EmitReadOperand(e, CPU_X86_EDX, mode, operand))
+            return CPU_TRANSLATED_CALL;
+        CPU_EmitCarry(e);
+        if (name[0] == 'A') {
+            CPU_EmitAlu8(e, CPU_X86_ADC, a, CPU_X86_EDX);
+            CPU_EmitSetCondition(e, CPU_X86_CARRY, CPU_X86_ECX);
+        } else {
+            CPU_EMIT(e, 0xF5); // cmc, x86 borrows where the 6502 clears C
+            CPU_EmitAlu8(e, CPU_X86_SBB, a, CPU_X86_EDX);
+            CPU_EmitSetCondition(e, CPU_X86_NO_CARRY, CPU_X86_ECX);
+        }
+        CPU_EmitSetCondition(e, CPU_X86_OVERFLOW, CPU_X86_EAX);
+        CPU_EMIT(e, 0xC0, 0xE0, 0x06, 0x08, 0xC1); // shl al, 6; or cl, al
+        CPU_EmitClearFlags(e, CPU_FLAG_OVERFLOW);
+        CPU_EmitSetCarry(e, CPU_X86_ECX);
+        CPU_EmitNZ(e, a);
+        break;
+
+    case CPU_MNEMONIC('A', 'N', 'D'):
+    case CPU_MNEMONIC('O', 'R', 'A'):
+    case CPU_MNEMONIC('E', 'O', 'R'):
+        if (!CPU_EmitReadOperand(e, CPU_X86_EDX, mode, operand))
+            return CPU_TRANSLATED_CALL;
+        CPU_EmitAlu8(e, name[0] == 'A' ? CPU_X86_AND : name[0] == 'O' ? CPU_X86_OR : CPU_X86_XOR, a, CPU_X86_EDX);
+        CPU_EmitNZ(e, a);
+        break;
+
+    case CPU_MNEMONIC('C', 'M', 'P'):
+    case CPU_MNEMONIC('C', 'P', 'X'):
+    case CPU_MNEMONIC('C', 'P', 'Y'): {
+        int reg = CPU_RegisterOf(name[1] == 'M' ? 'A' : name[2]);
+        if (!CPU_EmitReadOperand(e, CPU_X86_EDX, mode, operand))
+            return CPU_TRANSLATED_CALL;
+        CPU_EmitAlu8(e, CPU_X86_CMP, CPU_X86Reg(reg), CPU_X86_EDX);
+        CPU_EmitSetCondition(e, CPU_X86_NO_CARRY, CPU_X86_ECX);
+        CPU_EmitMove8(e, CPU_X86_EAX, reg);
+        CPU_EmitAlu8(e, CPU_X86_SUB, CPU_X86Reg(CPU_X86_EAX), CPU_X86_EDX);
+        CPU_EmitSetCarry(e, CPU_X86_ECX);
+        CPU_EmitNZ(e, CPU_X86Reg(CPU_X86_EAX));
+        break;
     }
 
-    // TODO: Add accurate cycle calculation logic here based on page crossings, branches taken, etc.
-    cpu->total_cycles += cycles;
-    return (int)cycles;
-}
\ No newline at end of file
+    case CPU_MNEMONIC('B', 'I', 'T'):
+        if (!CPU_EmitReadOperand(e, CPU_X86_EDX, mode, operand))
+            return CPU_TRANSLATED_CALL;
+        CPU_EmitMove8(e, CPU_X86_EAX, CPU_X86_A);
+        CPU_EMIT(e, 0x20, 0xD0, 0x0F, 0x94, 0xC1, 0x00, 0xC9); // and al, dl; setz cl; add cl, cl
+        CPU_EMIT(e, 0x80, 0xE2, 0xC0, 0x08, 0xD1);             // and dl, 0xC0; or cl, dl
+        CPU_EmitClearFlags(e, CPU_FLAG_NEGATIVE | CPU_FLAG_ZERO | CPU_FLAG_OVERFLOW);
+        CPU_EmitAlu8(e, CPU_X86_OR, CPU_X86Reg(CPU_X86_P), CPU_X86_ECX);
+        break;
+
+    case CPU_MNEMONIC('C', 'L', 'C'): CPU_EmitClearFlags(e, CPU_FLAG_CARRY); break;
+    case CPU_MNEMONIC('S', 'E', 'C'): CPU_EmitSetFlags(e, CPU_FLAG_CARRY); break;
+    case CPU_MNEMONIC('C', 'L', 'I'): CPU_EmitClearFlags(e, CPU_FLAG_INTERRUPT); break;
+    case CPU_MNEMONIC('S', 'E', 'I'): CPU_EmitSetFlags(e, CPU_FLAG_INTERRUPT); break;
+    case CPU_MNEMONIC('C', 'L', 'V'): CPU_EmitClearFlags(e, CPU_FLAG_OVERFLOW); break;
+    case CPU_MNEMONIC('C', 'L', 'D'): CPU_EmitClearFlags(e, CPU_FLAG_DECIMAL); break;
+    case CPU_MNEMONIC('S', 'E', 'D'): CPU_EmitSetFlags(e, CPU_FLAG_DECIMAL); break;
+
+    case CPU_MNEMONIC('N', 'O', 'P'):
+        if (mode == CPU_MODE_ABSOLUTE_X)
+            return CPU_TRANSLATED_CALL; // Page crossing penalty
+        break;
+
+    case CPU_MNEMONIC('P', 'H', 'A'):
+    case CPU_MNEMONIC('P', 'H', 'P'):
+        rm = CPU_EmitStack(e);
+        if (name[2] == 'A') {
+            CPU_EmitStore8(e, rm, CPU_X86_A);
+        } else {
+            CPU_EmitMove8(e, CPU_X86_EAX, CPU_X86_P);
+            CPU_EmitAluImm8(e, CPU_X86_OR, CPU_X86Reg(CPU_X86_EAX), CPU_FLAG_BREAK | CPU_FLAG_UNUSED);
+            CPU_EmitStore8(e, rm, CPU_X86_EAX);
+        }
+        CPU_EmitX86(e, 0, 0xFE, 1, CPU_X86Reg(CPU_X86_SP)); // dec sp
+        break;
+
+    case CPU_MNEMONIC('P', 'L', 'A'):
+    case CPU_MNEMONIC('P', 'L', 'P'):
+        CPU_EmitX86(e, 0, 0xFE, 0, CPU_X86Reg(CPU_X86_SP)); // inc sp
+        rm = CPU_EmitStack(e);
+        if (name[2] == 'A') {
+            CPU_EmitLoad8(e, CPU_X86_A, rm);
+            CPU_EmitNZ(e, a);
+        } else {
+            CPU_EmitLoad8(e, CPU_X86_P, rm);
+            CPU_EmitClearFlags(e, CPU_FLAG_BREAK);
+            CPU_EmitSetFlags(e, CPU_FLAG_UNUSED);
+        }
+        break;
+
+    case CPU_MNEMONIC('B', 'C', 'C'):
+    case CPU_MNEMONIC('B', 'C', 'S'):
+    case CPU_MNEMONIC('B', 'N', 'E'):
+    case CPU_MNEMONIC('B', 'E', 'Q'):
+    case CPU_MNEMONIC('B', 'P', 'L'):
+    case CPU_MNEMONIC('B', 'M', 'I'):
+    case CPU_MNEMONIC('B', 'V', 'C'):
+    case CPU_MNEMONIC('B', 'V', 'S'): {
+        uint8_t flag = name[1] == 'C' ? CPU_FLAG_CARRY
+                     : name[1] == 'N' || name[1] == 'E' ? CPU_FLAG_ZERO
+                     : name[1] == 'V' ? CPU_FLAG_OVERFLOW : CPU_FLAG_NEGATIVE;
+        int if_set = name[2] == 'S' || name[2] == 'Q' || name[2] == 'I';
+        uint16_t target = (uint16_t)(next + (int8_t)operand);
+
+        CPU_EmitX86(e, 0, 0xF6, 0, CPU_X86Reg(CPU_X86_P)); // test p, flag
+        e->code[e->at++] = flag;
+        CPU_EMIT(e, 0x0F, if_set ? 0x85 : 0x84);           // jnz/jz taken
+        size_t taken = e->at;
+        CPU_Emit32(e, 0);
+        CPU_EmitAddCycles(e, cycles);
+        CPU_EmitChain(e, next);
+
+        uint32_t rel = (uint32_t)(e->at - (taken + 4));
+        memcpy(e->code + taken, &rel, sizeof(rel));
+        CPU_EmitAddCycles(e, (uint8_t)(cycles + ((next ^ target) & 0xFF00 ? 2 : 1)));
+        CPU_EmitChain(e, target);
+        return CPU_TRANSLATED_END;
+    }
+
+    case CPU_MNEMONIC('J', 'M', 'P'):
+        if (mode != CPU_MODE_ABSOLUTE)
+            return CPU_TRANSLATED_CALL;
+        CPU_EmitAddCycles(e, cycles);
+        CPU_EmitChain(e, operand);
+        return CPU_TRANSLATED_END;
+
+    case CPU_MNEMONIC('J', 'S', 'R'): {
+        uint16_t ret = (uint16_t)(next - 1);
+        rm = CPU_EmitStack(e);
+        CPU_EmitSet8(e, rm, (uint8_t)(ret >> 8));
+        CPU_EMIT(e, 0xFE, 0xC9); // dec cl
+        CPU_EmitSet8(e, rm, (uint8_t)ret);
+        CPU_EmitAluImm8(e, CPU_X86_SUB, CPU_X86Reg(CPU_X86_SP), 2);
+        CPU_EmitAddCycles(e, cycles);
+        CPU_EmitChain(e, operand);
+        return CPU_TRANSLATED_END;
+    }
+
+    case CPU_MNEMONIC('R', 'T', 'S'):
+        CPU_EmitX86(e, 0, 0xFE, 0, CPU_X86Reg(CPU_X86_SP));
+        CPU_EmitLoad8(e, CPU_X86_EAX, CPU_EmitStack(e));
+        CPU_EmitX86(e, 0, 0xFE, 0, CPU_X86Reg(CPU_X86_SP));
+        CPU_EmitLoad8(e, CPU_X86_EDX, CPU_EmitStack(e));
+        CPU_EMIT(e, 0xC1, 0xE2, 0x08, 0x09, 0xD0, 0xFF, 0xC0); // shl edx, 8; or eax, edx; inc eax
+        CPU_EMIT(e, 0x66, 0x89, 0x43, (uint8_t)offsetof(CPU, pc)); // mov [rbx + pc], ax
+        CPU_EmitAddCycles(e, cycles);
+        CPU_EmitReturn(e);
+        return CPU_TRANSLATED_END;
+
+    default:
+        return CPU_TRANSLATED_CALL;
+    }
+
+    CPU_EmitAddCycles(e, cycles);
+    return CPU_TRANSLATED;
+}
+
+// Whether a block has to end after running the instruction through its handler, 1 if
+// it leaves PC where it can't be told in advance and 2 if it goes on at the next
+// instruction but may have switched banks
+static int CPU_EndsBlock(uint8_t opcode, uint16_t operand) 
+{
+    const char *name = cpu_opcodes[opcode].mnemonic;
+    switch (CPU_MNEMONIC(name[0], name[1], name[2])) {
+    case CPU_MNEMONIC('J', 'M', 'P'):
+    case CPU_MNEMONIC('R', 'T', 'I'):
+    case CPU_MNEMONIC('B', 'R', 'K'):
+        return 1;
+    // Reads only, whatever they address
+    case CPU_MNEMONIC('L', 'D', 'A'):
+    case CPU_MNEMONIC('L', 'D', 'X'):
+    case CPU_MNEMONIC('L', 'D', 'Y'):
+    case CPU_MNEMONIC('L', 'A', 'X'):
+    case CPU_MNEMONIC('L', 'A', 'S'):
+    case CPU_MNEMONIC('A', 'D', 'C'):
+    case CPU_MNEMONIC('S', 'B', 'C'):
+    case CPU_MNEMONIC('A', 'N', 'D'):
+    case CPU_MNEMONIC('O', 'R', 'A'):
+    case CPU_MNEMONIC('E', 'O', 'R'):
+    case CPU_MNEMONIC('C', 'M', 'P'):
+    case CPU_MNEMONIC('C', 'P', 'X'):
+    case CPU_MNEMONIC('C', 'P', 'Y'):
+    case CPU_MNEMONIC('B', 'I', 'T'):
+    case CPU_MNEMONIC('N', 'O', 'P'):
+    case CPU_MNEMONIC('T', 'A', 'S'):
+        return 0;
+    }
+
+    // Writes end the block unless they stay below the cartridge
+    switch (cpu_opcodes[opcode].addressing_mode) {
+    case CPU_MODE_IMPLIED:
+    case CPU_MODE_ACCUMULATOR:
+    case CPU_MODE_IMMEDIATE:
+    case CPU_MODE_ZERO_PAGE:
+    case CPU_MODE_ZERO_PAGE_X:
+    case CPU_MODE_ZERO_PAGE_Y:
+        return 0;
+    case CPU_MODE_ABSOLUTE:
+        return operand >= 0x4020 ? 2 : 0;
+    default:
+        return 2;
+    }
+}
+
+// Makes the part of the code buffer from..to writable for translating, or executable
+// again for running it
+static int CPU_ProtectCode(CPU_Recompiler *recompiler, size_t from, size_t to, int writable) 
+{
+    from &= ~(size_t)(CPU_RECOMPILER_PAGE_SIZE - 1);
+    to = to < CPU_RECOMPILER_CODE_SIZE ? to : CPU_RECOMPILER_CODE_SIZE;
+#if defined(_WIN32)
+    DWORD old;
+    if (!VirtualProtect(recompiler->code + from, to - from, writable ? PAGE_READWRITE : PAGE_EXECUTE_READ, &old))
+        return -1;
+    if (!writable)
+        FlushInstructionCache(GetCurrentProcess(), recompiler->code + from, to - from);
+    return 0;
+#else
+    return mprotect(recompiler->code + from, to - from, writable ? PROT_READ | PROT_WRITE : PROT_READ | PROT_EXEC);
+#endif
+}
+
+// Drops every block and link, the shared code at the start of the buffer stays
+static void CPU_FlushBlocks(CPU_Recompiler *recompiler) 
+{
+    for (size_t bank = 0; bank < recompiler->bank_count; bank++)
+        if (recompiler->banks[bank])
+            memset(recompiler->banks[bank], 0, CPU_RECOMPILER_BANK_SIZE * sizeof(CPU_BlockEntry));
+    recompiler->used = recompiler->shared;
+    recompiler->links_used = 0;
+    recompiler->link = NULL;
+    recompiler->generation++;
+}
+
+static void CPU_FreeBlocks(CPU_Recompiler *recompiler) 
+{
+    for (size_t bank = 0; bank < recompiler->bank_count; bank++)
+        free(recompiler->banks[bank]);
+    free(recompiler->banks);
+    ROM_Release(recompiler->rom);
+    recompiler->banks = NULL;
+    recompiler->bank_count = 0;
+    recompiler->rom = NULL;
+}
+
+// Starts over on a newly attached ROM, -1 if its tables can't be allocated
+static int CPU_AttachBlocks(CPU_Recompiler *recompiler, ROM *rom) 
+{
+    CPU_FreeBlocks(recompiler);
+    size_t count = (rom->prg_size + CPU_RECOMPILER_BANK_SIZE - 1) / CPU_RECOMPILER_BANK_SIZE;
+    recompiler->banks = calloc(count, sizeof(*recompiler->banks));
+    if (!recompiler->banks)
+        return -1;
+    recompiler->bank_count = count;
+    recompiler->rom = ROM_Retain(rom);
+    CPU_FlushBlocks(recompiler);
+    return 0;
+}
+
+// Translates the block at PC from page, where the bus reads PC's page from. NULL if
+// its first instruction runs onto the next page or the code buffer can't be written
+static const uint8_t *CPU_Translate(CPU *cpu, const uint8_t *page) 
+{
+    CPU_Recompiler *recompiler = cpu->recompiler;
+    if ((cpu->pc & 0xFF) + cpu_instructions[page[cpu->pc & 0xFF]].length > 0x100)
+        return NULL;
+    if (CPU_RECOMPILER_CODE_SIZE - recompiler->used < CPU_RECOMPILER_BLOCK_MAX * CPU_RECOMPILER_INSTRUCTION
+        || CPU_RECOMPILER_LINK_COUNT - recompiler->links_used < 2)
+        CPU_FlushBlocks(recompiler);
+    size_t limit = recompiler->used + CPU_RECOMPILER_BLOCK_MAX * CPU_RECOMPILER_INSTRUCTION;
+    if (CPU_ProtectCode(recompiler, recompiler->used, limit, 1))
+        return NULL;
+
+    CPU_Emitter emitter = { .recompiler = recompiler, .code = recompiler->code, .at = recompiler->used };
+    CPU_Emitter *e = &emitter;
+    size_t start = e->at;
+
+    uint16_t pc = cpu->pc;
+    int count = 0;
+    int open = 1;
+    while (open && count < CPU_RECOMPILER_BLOCK_MAX && (pc & 0xFF00) == (cpu->pc & 0xFF00)) {
+        uint8_t opcode = page[pc & 0xFF];
+        const CPU_Instruction *instruction = &cpu_instructions[opcode];
+        if ((pc & 0xFF) + instruction->length > 0x100)
+            break; // The operand is on the next page, which may come from another bank
+
+        uint16_t operand = 0;
+        if (instruction->length > 1)
+            operand = page[(pc & 0xFF) + 1];
+        if (instruction->length > 2)
+            operand |= (uint16_t)(page[(pc & 0xFF) + 2] << 8);
+        uint16_t next = (uint16_t)(pc + instruction->length);
+
+        // The first instruction was checked before the block was entered
+        if (count)
+            CPU_EmitDeadline(e, pc);
+        CPU_Translation translation = CPU_TranslateInstruction(e, opcode, operand, next);
+        if (translation == CPU_TRANSLATED_CALL) {
+            CPU_EmitCall(e, instruction->handler, operand, next);
+            switch (CPU_EndsBlock(opcode, operand)) {
+            case 1:
+                CPU_EmitReturn(e);
+                open = 0;
+                break;
+            case 2:
+                CPU_EmitChain(e, next);
+                open = 0;
+                break;
+            }
+        } else if (translation == CPU_TRANSLATED_END) {
+            open = 0;
+        }
+        pc = next;
+        count++;
+    }
+    if (open)
+        CPU_EmitChain(e, pc);
+    CPU_EmitStubs(e);
+
+    size_t used = recompiler->used;
+    recompiler->used = e->at;
+    if (CPU_ProtectCode(recompiler, used, limit, 0))
+        return NULL;
+    return recompiler->code + start;
+}
+
+// Block for the code at PC, NULL where the interpreter has to run it. The exit the
+// last block left through, if it is chained, is linked to it
+static const uint8_t *CPU_FindBlock(CPU *cpu) 
+{
+    CPU_Recompiler *recompiler = cpu->recompiler;
+    CPU_BlockLink *link = recompiler->link;
+    size_t generation = recompiler->generation;
+    recompiler->link = NULL;
+
+    NES *nes = cpu->nes;
+    ROM *rom = nes->rom;
+    const uint8_t *page = nes->bus->read_pages[cpu->pc >> 8];
+    if (cpu->pc < 0x8000 || !rom || !page || page < rom->prg || page >= rom->prg + rom->prg_size)
+        return NULL;
+    if (recompiler->rom != rom && CPU_AttachBlocks(recompiler, rom))
+        return NULL;
+
+    size_t offset = (size_t)(page - rom->prg) + (cpu->pc & 0xFF);
+    CPU_BlockEntry **table = &recompiler->banks[offset / CPU_RECOMPILER_BANK_SIZE];
+    if (!*table && !(*table = calloc(CPU_RECOMPILER_BANK_SIZE, sizeof(CPU_BlockEntry))))
+        return NULL;
+
+    CPU_BlockEntry *entry = &(*table)[offset % CPU_RECOMPILER_BANK_SIZE];
+    if (!entry->block || entry->pc != cpu->pc) {
+        const uint8_t *block = CPU_Translate(cpu, page);
+        if (!block)
+            return NULL;
+        entry->block = block;
+        entry->pc = cpu->pc;
+    }
+    if (link && recompiler->generation == generation) {
+        link->target = entry->block;
+        link->page = page;
+    }
+    return entry->block;
+}
+
+#endif // CPU_RECOMPILER
+
+int CPU_SetRecompiler(CPU *cpu, bool enabled) 
+{
+#if defined(CPU_RECOMPILER)
+    const size_t size = CPU_RECOMPILER_CODE_SIZE + CPU_RECOMPILER_LINK_COUNT * sizeof(CPU_BlockLink);
+    CPU_Recompiler *recompiler = cpu->recompiler;
+    if (!enabled || recompiler) {
+        if (!enabled && recompiler) {
+            CPU_FreeBlocks(recompiler);
+#if defined(_WIN32)
+            VirtualFree(recompiler->code, 0, MEM_RELEASE);
+#else
+            munmap(recompiler->code, size);
+#endif
+            free(recompiler);
+            cpu->recompiler = NULL;
+        }
+        return 0;
+    }
+
+    recompiler = calloc(1, sizeof(*recompiler));
+    if (!recompiler)
+        return -1;
+#if defined(_WIN32)
+    recompiler->code = VirtualAlloc(NULL, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+#else
+    recompiler->code = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (recompiler->code == MAP_FAILED)
+        recompiler->code = NULL;
+#endif
+    if (!recompiler->code) {
+        free(recompiler);
+        return -1;
+    }
+    recompiler->links = (CPU_BlockLink *)(recompiler->code + CPU_RECOMPILER_CODE_SIZE);
+    for (int value = 0; value < 256; value++)
+        recompiler->nz_flags[value] = (uint8_t)((value & CPU_FLAG_NEGATIVE) | (value ? 0 : CPU_FLAG_ZERO));
+
+    // Shared code. Exit stores the registers back and returns 0, halt returns -1, both
+    // restore what enter saved. Enter loads the registers and jumps to the block
+    CPU_Emitter emitter = { .recompiler = recompiler, .code = recompiler->code };
+    CPU_Emitter *e = &emitter;
+    recompiler->exit = e->at;
+    CPU_EmitSpill(e);
+    CPU_EMIT(e, 0x31, 0xC0);                   // xor eax, eax
+    size_t leave = e->at;
+#if defined(_WIN32)
+    CPU_EMIT(e, 0x48, 0x83, 0xC4, 0x20);       // add rsp, 32
+#endif
+    CPU_EMIT(e, 0x41, 0x5F, 0x41, 0x5E, 0x41, 0x5D, 0x41, 0x5C, 0x5B, 0xC3); // pop r15, r14, r13, r12, rbx; ret
+    recompiler->halt = e->at;
+    CPU_EMIT(e, 0xB8, 0xFF, 0xFF, 0xFF, 0xFF, 0xE9); // mov eax, -1; jmp leave
+    CPU_EmitTarget(e, leave);
+
+    recompiler->enter = (CPU_BlockEnter)(void *)(recompiler->code + e->at);
+    CPU_EMIT(e, 0x53, 0x41, 0x54, 0x41, 0x55, 0x41, 0x56, 0x41, 0x57); // push rbx, r12, r13, r14, r15
+#if defined(_WIN32)
+    CPU_EMIT(e, 0x48, 0x83, 0xEC, 0x20);       // sub rsp, 32
+    CPU_EMIT(e, 0x48, 0x89, 0xCB, 0x49, 0x89, 0xD6, 0x4C, 0x89, 0xC0); // mov rbx, rcx; mov r14, rdx; mov rax, r8
+#else
+    CPU_EMIT(e, 0x48, 0x89, 0xFB, 0x49, 0x89, 0xF6, 0x48, 0x89, 0xD0); // mov rbx, rdi; mov r14, rsi; mov rax, rdx
+#endif
+    CPU_EMIT(e, 0x49, 0xBF);                   // mov r15, nz_flags
+    CPU_Emit64(e, (uint64_t)(uintptr_t)recompiler->nz_flags);
+    CPU_EmitReload(e);
+    CPU_EMIT(e, 0xFF, 0xE0);                   // jmp rax
+    recompiler->shared = (e->at + 15) & ~(size_t)15;
+    recompiler->used = recompiler->shared;
+
+    if (CPU_ProtectCode(recompiler, 0, CPU_RECOMPILER_CODE_SIZE, 0)) {
+        cpu->recompiler = recompiler;
+        CPU_SetRecompiler(cpu, false);
+        return -1;
+    }
+
+    cpu->recompiler = recompiler;
+    return 0;
+#else
+    return enabled ? -1 : 0;
+#endif
+}
+
+int CPU_Run(CPU *cpu, uint64_t until) 
+{
+    cpu->run_until = until;
+#if defined(CPU_RECOMPILER)
+    CPU_Recompiler *recompiler = cpu->recompiler;
+    if (recompiler) {
+        uint8_t *ram = cpu->nes->bus->ram;
+        recompiler->link = NULL; // PC may have moved since the last burst
+        while (cpu->total_cycles < cpu->run_until) {
+            const uint8_t *block = CPU_FindBlock(cpu);
+            if (block ? recompiler->enter(cpu, ram, block) < 0 : CPU_Step(cpu) < 0)
+                return -1;
+        }
+        return 0;
+    }
+#endif
+    while (cpu->total_cycles < cpu->run_until) {
+        if (CPU_Step(cpu) < 0)
+            return -1;
+    }
+    return 0;
+}
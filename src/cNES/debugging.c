@@ -22,10 +22,23 @@ void format_operand(char *buffer, size_t buffer_size, const char *fmt, ...) {
     // No warning for truncation here, as it's less critical for disassembly logging
 }
 
+static uint8_t disassemble_read_bus(const void *memory, uint16_t address)
+{
+    return BUS_Read((NES *)memory, address);
+}
+
 // Disassemble one instruction at 'address'
 uint16_t disassemble(NES *nes, uint16_t address, char *buffer, size_t buffer_size) 
 {
-    uint8_t opcode = BUS_Read(nes, address);
+    return disassemble_memory(disassemble_read_bus, nes, address, buffer, buffer_size);
+}
+
+#define DISASSEMBLE_READ(address) read(memory, (uint16_t)(address))
+#define DISASSEMBLE_READ16(address) (uint16_t)(DISASSEMBLE_READ(address) | DISASSEMBLE_READ((address) + 1) << 8)
+
+uint16_t disassemble_memory(disassemble_read_func read, const void *memory, uint16_t address, char *buffer, size_t buffer_size)
+{
+    uint8_t opcode = DISASSEMBLE_READ(address);
     uint16_t next_addr = address;
     char mnemonic[4] = "???";
     char operand_str[32] = "";
@@ -33,26 +46,26 @@ uint16_t disassemble(NES *nes, uint16_t address, char *buffer, size_t buffer_siz
     // Special handling for JMP/JSR
     if (opcode == 0x4C) { // JMP Absolute
         strcpy(mnemonic, "JMP");
-        uint16_t target = BUS_Read16(nes, address + 1);
+        uint16_t target = DISASSEMBLE_READ16(address + 1);
         format_operand(operand_str, sizeof(operand_str), "$%04X", target);
         next_addr = target;
     } else if (opcode == 0x6C) { // JMP Indirect
         strcpy(mnemonic, "JMP");
-        uint16_t ptr = BUS_Read16(nes, address + 1);
+        uint16_t ptr = DISASSEMBLE_READ16(address + 1);
         // Emulate 6502 JMP indirect bug: if low byte is 0xFF, high byte wraps within the page
         uint16_t indirect_addr;
         if ((ptr & 0x00FF) == 0x00FF) {
-            uint8_t low = BUS_Read(nes, ptr);
-            uint8_t high = BUS_Read(nes, ptr & 0xFF00);
+            uint8_t low = DISASSEMBLE_READ(ptr);
+            uint8_t high = DISASSEMBLE_READ(ptr & 0xFF00);
             indirect_addr = (high << 8) | low;
         } else {
-            indirect_addr = BUS_Read16(nes, ptr);
+            indirect_addr = DISASSEMBLE_READ16(ptr);
         }
         format_operand(operand_str, sizeof(operand_str), "($%04X)", ptr);
         next_addr = indirect_addr;
     } else if (opcode == 0x20) { // JSR Absolute
         strcpy(mnemonic, "JSR");
-        uint16_t target = BUS_Read16(nes, address + 1);
+        uint16_t target = DISASSEMBLE_READ16(address + 1);
         format_operand(operand_str, sizeof(operand_str), "$%04X", target);
         next_addr = target;
     } else {
@@ -63,47 +76,47 @@ uint16_t disassemble(NES *nes, uint16_t address, char *buffer, size_t buffer_siz
 
         switch (op->addressing_mode) {
             case CPU_MODE_IMMEDIATE:
-                format_operand(operand_str, sizeof(operand_str), "#$%02X", BUS_Read(nes, address + 1));
+                format_operand(operand_str, sizeof(operand_str), "#$%02X", DISASSEMBLE_READ(address + 1));
                 next_addr = address + 2;
                 break;
             case CPU_MODE_ZERO_PAGE:
-                format_operand(operand_str, sizeof(operand_str), "$%02X", BUS_Read(nes, address + 1));
+                format_operand(operand_str, sizeof(operand_str), "$%02X", DISASSEMBLE_READ(address + 1));
                 next_addr = address + 2;
                 break;
             case CPU_MODE_ZERO_PAGE_X:
-                format_operand(operand_str, sizeof(operand_str), "$%02X,X", BUS_Read(nes, address + 1));
+                format_operand(operand_str, sizeof(operand_str), "$%02X,X", DISASSEMBLE_READ(address + 1));
                 next_addr = address + 2;
                 break;
             case CPU_MODE_ZERO_PAGE_Y:
-                format_operand(operand_str, sizeof(operand_str), "$%02X,Y", BUS_Read(nes, address + 1));
+                format_operand(operand_str, sizeof(operand_str), "$%02X,Y", DISASSEMBLE_READ(address + 1));
                 next_addr = address + 2;
                 break;
             case CPU_MODE_ABSOLUTE:
-                format_operand(operand_str, sizeof(operand_str), "$%04X", BUS_Read16(nes, address + 1));
+                format_operand(operand_str, sizeof(operand_str), "$%04X", DISASSEMBLE_READ16(address + 1));
                 next_addr = address + 3;
                 break;
             case CPU_MODE_ABSOLUTE_X:
-                format_operand(operand_str, sizeof(operand_str), "$%04X,X", BUS_Read16(nes, address + 1));
+                format_operand(operand_str, sizeof(operand_str), "$%04X,X", DISASSEMBLE_READ16(address + 1));
                 next_addr = address + 3;
                 break;
             case CPU_MODE_ABSOLUTE_Y:
-                format_operand(operand_str, sizeof(operand_str), "$%04X,Y", BUS_Read16(nes, address + 1));
+                format_operand(operand_str, sizeof(operand_str), "$%04X,Y", DISASSEMBLE_READ16(address + 1));
                 next_addr = address + 3;
                 break;
             case CPU_MODE_INDIRECT:
-                format_operand(operand_str, sizeof(operand_str), "($%04X)", BUS_Read16(nes, address + 1));
+                format_operand(operand_str, sizeof(operand_str), "($%04X)", DISASSEMBLE_READ16(address + 1));
                 next_addr = address + 3;
                 break;
             case CPU_MODE_INDEXED_INDIRECT:
-                format_operand(operand_str, sizeof(operand_str), "($%02X,X)", BUS_Read(nes, address + 1));
+                format_operand(operand_str, sizeof(operand_str), "($%02X,X)", DISASSEMBLE_READ(address + 1));
                 next_addr = address + 2;
                 break;
             case CPU_MODE_INDIRECT_INDEXED:
-                format_operand(operand_str, sizeof(operand_str), "($%02X),Y", BUS_Read(nes, address + 1));
+                format_operand(operand_str, sizeof(operand_str), "($%02X),Y", DISASSEMBLE_READ(address + 1));
                 next_addr = address + 2;
                 break;
             case CPU_MODE_RELATIVE: {
-                int8_t offset = (int8_t)BUS_Read(nes, address + 1);
+                int8_t offset = (int8_t)DISASSEMBLE_READ(address + 1);
                 format_operand(operand_str, sizeof(operand_str), "$%04X", address + 2 + offset);
                 next_addr = address + 2;
                 break;
@@ -0,0 +1,407 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+
+#include "debug.h"
+#include "cNES/nes.h"
+#include "cNES/bus.h"
+#include "cNES/cpu.h"
+#include "cNES/ppu.h"
+#include "cNES/movie.h"
+
+#include "cNES/emuthread.h"
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <time.h>
+#endif
+
+#define EMUTHREAD_FRAME_NS ((uint64_t)(1e9 / EMUTHREAD_NTSC_FPS))
+#define EMUTHREAD_MAX_LAG  4 // Frames the thread may fall behind before it stops trying to catch up
+
+#define EMUTHREAD_SLOT_MASK 0x3
+#define EMUTHREAD_FRESH     0x4 // Set on the shared slot when it holds a frame the consumer hasn't taken
+
+#define EMUTHREAD_INPUT_SIZE 64 // Power of two
+
+// --- Platform ---
+
+#if defined(_MSC_VER)
+#define EMUTHREAD_THREAD_LOCAL __declspec(thread)
+#else
+#define EMUTHREAD_THREAD_LOCAL _Thread_local
+#endif
+
+#if defined(_WIN32)
+typedef HANDLE EMUTHREAD_Handle;
+typedef CRITICAL_SECTION EMUTHREAD_Mutex;
+
+static uint64_t EMUTHREAD_Now(void)
+{
+    LARGE_INTEGER counter, frequency;
+    QueryPerformanceCounter(&counter);
+    QueryPerformanceFrequency(&frequency);
+    return (uint64_t)((double)counter.QuadPart * 1e9 / (double)frequency.QuadPart);
+}
+
+static void EMUTHREAD_Sleep(uint64_t ns)
+{
+    Sleep((DWORD)(ns / 1000000));
+}
+
+static int EMUTHREAD_InitMutex(EMUTHREAD_Mutex *mutex) { InitializeCriticalSection(mutex); return 0; }
+static void EMUTHREAD_DestroyMutex(EMUTHREAD_Mutex *mutex) { DeleteCriticalSection(mutex); }
+static void EMUTHREAD_LockMutex(EMUTHREAD_Mutex *mutex) { EnterCriticalSection(mutex); }
+static void EMUTHREAD_UnlockMutex(EMUTHREAD_Mutex *mutex) { LeaveCriticalSection(mutex); }
+#else
+typedef pthread_t EMUTHREAD_Handle;
+typedef pthread_mutex_t EMUTHREAD_Mutex;
+
+static uint64_t EMUTHREAD_Now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static void EMUTHREAD_Sleep(uint64_t ns)
+{
+    struct timespec ts = { (time_t)(ns / 1000000000ULL), (long)(ns % 1000000000ULL) };
+    nanosleep(&ts, NULL);
+}
+
+static int EMUTHREAD_InitMutex(EMUTHREAD_Mutex *mutex) { return pthread_mutex_init(mutex, NULL) ? -1 : 0; }
+static void EMUTHREAD_DestroyMutex(EMUTHREAD_Mutex *mutex) { pthread_mutex_destroy(mutex); }
+static void EMUTHREAD_LockMutex(EMUTHREAD_Mutex *mutex) { pthread_mutex_lock(mutex); }
+static void EMUTHREAD_UnlockMutex(EMUTHREAD_Mutex *mutex) { pthread_mutex_unlock(mutex); }
+#endif
+
+struct EMUTHREAD {
+    NES *nes;
+    EMUTHREAD_FrameFunc run_frame;
+    void *userdata;
+
+    // Triple buffer: the thread fills back, the consumer reads front and the third
+    // slot is swapped between them through shared
+    EMUTHREAD_Frame *frames[3];
+    int back;
+    int front;
+    atomic_int shared;
+
+    // Input queue, the consumer pushes at tail and the thread pops at head.
+    // Entries are controller 1 | controller 2 << 8
+    uint16_t input[EMUTHREAD_INPUT_SIZE];
+    atomic_uint input_head;
+    atomic_uint input_tail;
+    uint16_t input_state; // Input the last frame ran with, thread only
+
+    atomic_bool running;
+    atomic_bool paused;
+    atomic_bool republish; // Something changed the NES under the lock
+    atomic_int step_frames;
+    atomic_int step_instructions;
+    _Atomic uint64_t frame_count;
+
+    EMUTHREAD_Mutex mutex;
+    bool mutex_ready;
+    EMUTHREAD_Handle handle;
+    bool started;
+};
+
+// --- Emulation thread ---
+
+static EMUTHREAD_THREAD_LOCAL EMUTHREAD *emuthread_current; // Thread whose frame function is running on this thread
+
+static void EMUTHREAD_Capture(EMUTHREAD *thread, EMUTHREAD_Frame *frame)
+{
+    NES *nes = thread->nes;
+    memcpy(frame->framebuffer, nes->ppu->framebuffer, sizeof(frame->framebuffer));
+    frame->ppu = *nes->ppu;
+    frame->ppu.framebuffer = frame->framebuffer;
+    frame->cpu = *nes->cpu;
+    memcpy(frame->ram, nes->bus->ram, sizeof(frame->ram));
+    for (int page = 0; page < (int)sizeof(frame->cart) / 0x100; page++)
+    {
+        const uint8_t *read = nes->bus->read_pages[0x60 + page];
+        if (read)
+            memcpy(frame->cart + page * 0x100, read, 0x100);
+        else
+            memset(frame->cart + page * 0x100, 0, 0x100);
+    }
+    frame->movie = nes->movie != NULL;
+    frame->movie_recording = nes->movie && MOVIE_IsRecording(nes->movie);
+    frame->movie_frame = nes->movie ? MOVIE_GetFrame(nes->movie) : 0;
+    frame->movie_length = nes->movie ? MOVIE_GetLength(nes->movie) : 0;
+    frame->frame = atomic_load(&thread->frame_count);
+}
+
+static void EMUTHREAD_Publish(EMUTHREAD *thread)
+{
+    EMUTHREAD_Capture(thread, thread->frames[thread->back]);
+    thread->back = atomic_exchange(&thread->shared, thread->back | EMUTHREAD_FRESH) & EMUTHREAD_SLOT_MASK;
+    thread->frames[thread->back]->timing_count = 0; // The slot comes back with the timings of an older frame
+}
+
+// Takes everything queued since the last frame. Buttons pressed and released again
+// in between are still held for this frame, so short taps aren't lost
+static void EMUTHREAD_ApplyInput(EMUTHREAD *thread)
+{
+    unsigned head = atomic_load_explicit(&thread->input_head, memory_order_relaxed);
+    unsigned tail = atomic_load_explicit(&thread->input_tail, memory_order_acquire);
+
+    uint16_t state = thread->input_state;
+    uint16_t taps = 0;
+    for (; head != tail; head++)
+    {
+        uint16_t next = thread->input[head & (EMUTHREAD_INPUT_SIZE - 1)];
+        taps |= next & ~state;
+        state = next;
+    }
+    atomic_store_explicit(&thread->input_head, head, memory_order_release);
+
+    thread->input_state = state;
+    NES_SetController(thread->nes, 0, (uint8_t)(state | taps));
+    NES_SetController(thread->nes, 1, (uint8_t)((state | taps) >> 8));
+}
+
+static void EMUTHREAD_RunFrame(EMUTHREAD *thread)
+{
+    EMUTHREAD_ApplyInput(thread);
+    if (thread->run_frame)
+    {
+        emuthread_current = thread;
+        thread->run_frame(thread->nes, thread->userdata);
+        emuthread_current = NULL;
+    }
+    else
+    {
+        NES_StepFrame(thread->nes);
+    }
+    atomic_fetch_add(&thread->frame_count, 1);
+}
+
+static void EMUTHREAD_Main(EMUTHREAD *thread)
+{
+    uint64_t deadline = EMUTHREAD_Now();
+
+    while (atomic_load(&thread->running))
+    {
+        bool paused = atomic_load(&thread->paused);
+        bool frame = !paused;
+        bool instruction = false;
+        if (paused)
+        {
+            // Steps are only taken while paused, one per pass
+            int steps = atomic_load(&thread->step_instructions);
+            if (steps > 0 && atomic_compare_exchange_strong(&thread->step_instructions, &steps, steps - 1))
+                instruction = true;
+            steps = atomic_load(&thread->step_frames);
+            if (!instruction && steps > 0 && atomic_compare_exchange_strong(&thread->step_frames, &steps, steps - 1))
+                frame = true;
+        }
+
+        if (frame || instruction || atomic_load(&thread->republish))
+        {
+            EMUTHREAD_LockMutex(&thread->mutex);
+            atomic_store(&thread->republish, false);
+            if (frame)
+                EMUTHREAD_RunFrame(thread);
+            else if (instruction)
+                NES_Step(thread->nes);
+            EMUTHREAD_Publish(thread);
+            EMUTHREAD_UnlockMutex(&thread->mutex);
+        }
+
+        if (paused)
+        {
+            EMUTHREAD_Sleep(1000000);
+            deadline = EMUTHREAD_Now();
+            continue;
+        }
+
+        // Next frame is due one frame period after the last one was, not after it finished
+        deadline += EMUTHREAD_FRAME_NS;
+        uint64_t now = EMUTHREAD_Now();
+        if (now < deadline)
+            EMUTHREAD_Sleep(deadline - now);
+        else if (now - deadline > EMUTHREAD_MAX_LAG * EMUTHREAD_FRAME_NS)
+            deadline = now; // Too far behind, run on from here rather than in a burst
+    }
+}
+
+#if defined(_WIN32)
+static DWORD WINAPI EMUTHREAD_ThreadMain(LPVOID arg)
+{
+    EMUTHREAD_Main(arg);
+    return 0;
+}
+
+static int EMUTHREAD_Start(EMUTHREAD *thread)
+{
+    thread->handle = CreateThread(NULL, 0, EMUTHREAD_ThreadMain, thread, 0, NULL);
+    return thread->handle ? 0 : -1;
+}
+
+static void EMUTHREAD_Join(EMUTHREAD *thread)
+{
+    WaitForSingleObject(thread->handle, INFINITE);
+    CloseHandle(thread->handle);
+}
+#else
+static void *EMUTHREAD_ThreadMain(void *arg)
+{
+    EMUTHREAD_Main(arg);
+    return NULL;
+}
+
+static int EMUTHREAD_Start(EMUTHREAD *thread)
+{
+    return pthread_create(&thread->handle, NULL, EMUTHREAD_ThreadMain, thread) ? -1 : 0;
+}
+
+static void EMUTHREAD_Join(EMUTHREAD *thread)
+{
+    pthread_join(thread->handle, NULL);
+}
+#endif
+
+// --- Emulation thread API ---
+
+EMUTHREAD *EMUTHREAD_Create(NES *nes, EMUTHREAD_FrameFunc run_frame, void *userdata)
+{
+    EMUTHREAD *thread = calloc(1, sizeof(EMUTHREAD));
+    if (!thread) {goto error;}
+
+    thread->nes = nes;
+    thread->run_frame = run_frame;
+    thread->userdata = userdata;
+    thread->input_state = (uint16_t)(nes->controllers[0] | nes->controllers[1] << 8);
+
+    for (int i = 0; i < 3; i++)
+    {
+        thread->frames[i] = calloc(1, sizeof(EMUTHREAD_Frame));
+        if (!thread->frames[i]) {goto error;}
+    }
+
+    if (EMUTHREAD_InitMutex(&thread->mutex)) {goto error;}
+    thread->mutex_ready = true;
+
+    // Every slot starts out as the NES as it is now
+    for (int i = 0; i < 3; i++)
+        EMUTHREAD_Capture(thread, thread->frames[i]);
+    thread->front = 0;
+    thread->back = 1;
+    atomic_store(&thread->shared, 2);
+
+    atomic_store(&thread->running, true);
+    if (EMUTHREAD_Start(thread)) {goto error;}
+    thread->started = true;
+
+    return thread;
+
+error:
+    EMUTHREAD_Destroy(thread);
+    DEBUG_ERROR("Failed to create emulation thread");
+
+    return NULL;
+}
+
+void EMUTHREAD_Destroy(EMUTHREAD *thread)
+{
+    if (!thread)
+        return;
+
+    if (thread->started)
+    {
+        atomic_store(&thread->running, false);
+        EMUTHREAD_Join(thread);
+    }
+    if (thread->mutex_ready)
+        EMUTHREAD_DestroyMutex(&thread->mutex);
+    for (int i = 0; i < 3; i++)
+        free(thread->frames[i]);
+    free(thread);
+}
+
+const EMUTHREAD_Frame *EMUTHREAD_AcquireFrame(EMUTHREAD *thread)
+{
+    if (atomic_load(&thread->shared) & EMUTHREAD_FRESH)
+        thread->front = atomic_exchange(&thread->shared, thread->front) & EMUTHREAD_SLOT_MASK;
+    return thread->frames[thread->front];
+}
+
+uint8_t EMUTHREAD_PeekFrame(const EMUTHREAD_Frame *frame, uint16_t address)
+{
+    if (address < 0x2000)
+        return frame->ram[address & 0x7FF];
+    if (address >= 0x6000)
+        return frame->cart[address - 0x6000];
+    return 0;
+}
+
+int EMUTHREAD_PushInput(EMUTHREAD *thread, uint8_t controller1, uint8_t controller2)
+{
+    unsigned tail = atomic_load_explicit(&thread->input_tail, memory_order_relaxed);
+    unsigned head = atomic_load_explicit(&thread->input_head, memory_order_acquire);
+    if (tail - head >= EMUTHREAD_INPUT_SIZE)
+        return -1;
+
+    thread->input[tail & (EMUTHREAD_INPUT_SIZE - 1)] = (uint16_t)(controller1 | controller2 << 8);
+    atomic_store_explicit(&thread->input_tail, tail + 1, memory_order_release);
+    return 0;
+}
+
+void EMUTHREAD_Lock(EMUTHREAD *thread)
+{
+    if (thread)
+        EMUTHREAD_LockMutex(&thread->mutex);
+}
+
+void EMUTHREAD_Unlock(EMUTHREAD *thread)
+{
+    if (!thread)
+        return;
+    atomic_store(&thread->republish, true);
+    EMUTHREAD_UnlockMutex(&thread->mutex);
+}
+
+void EMUTHREAD_SetPaused(EMUTHREAD *thread, bool paused)
+{
+    atomic_store(&thread->paused, paused);
+}
+
+bool EMUTHREAD_IsPaused(EMUTHREAD *thread)
+{
+    return atomic_load(&thread->paused);
+}
+
+void EMUTHREAD_StepFrame(EMUTHREAD *thread)
+{
+    atomic_fetch_add(&thread->step_frames, 1);
+}
+
+void EMUTHREAD_StepInstruction(EMUTHREAD *thread)
+{
+    atomic_fetch_add(&thread->step_instructions, 1);
+}
+
+uint64_t EMUTHREAD_GetFrameCount(EMUTHREAD *thread)
+{
+    return atomic_load(&thread->frame_count);
+}
+
+int EMUTHREAD_AddTiming(const char *name, uint64_t ns)
+{
+    EMUTHREAD *thread = emuthread_current;
+    if (!thread)
+        return -1;
+
+    // The back slot belongs to the emulation thread until it is published
+    EMUTHREAD_Frame *frame = thread->frames[thread->back];
+    if (frame->timing_count >= EMUTHREAD_MAX_TIMINGS)
+        return -1;
+    frame->timings[frame->timing_count++] = (EMUTHREAD_Timing){ name, ns };
+    return 0;
+}
@@ -0,0 +1,151 @@
+#include <stdint.h>
+
+#include "debug.h"
+
+#include "cNES/filemap.h"
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#if defined(_WIN32)
+
+void *FILEMAP_OpenReadOnly(const char *path, size_t *size)
+{
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+        return NULL;
+
+    LARGE_INTEGER file_size;
+    if (!GetFileSizeEx(file, &file_size) || file_size.QuadPart <= 0 || (unsigned long long)file_size.QuadPart > SIZE_MAX)
+    {
+        CloseHandle(file);
+        return NULL;
+    }
+
+    // The view keeps the file and its mapping object alive, both handles can go now
+    HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    CloseHandle(file);
+    if (!mapping)
+        return NULL;
+    void *data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(mapping);
+    if (!data)
+        return NULL;
+
+    *size = (size_t)file_size.QuadPart;
+    return data;
+}
+
+void *FILEMAP_OpenReadWrite(const char *path, size_t size)
+{
+    HANDLE file = CreateFileA(path, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+    {
+        DEBUG_WARN("Could not open %s for writing", path);
+        return NULL;
+    }
+
+    // A mapping larger than the file grows it, the new bytes read as zero
+    HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READWRITE, (DWORD)((uint64_t)size >> 32), (DWORD)size, NULL);
+    CloseHandle(file);
+    if (!mapping)
+    {
+        DEBUG_WARN("Could not map %s", path);
+        return NULL;
+    }
+    void *data = MapViewOfFile(mapping, FILE_MAP_WRITE, 0, 0, size);
+    CloseHandle(mapping);
+    if (!data)
+        DEBUG_WARN("Could not map %s", path);
+    return data;
+}
+
+int FILEMAP_Flush(void *data, size_t offset, size_t size, bool wait)
+{
+    // FlushViewOfFile hands the pages to the OS, the file handle that could wait on the disk is gone
+    return FlushViewOfFile((uint8_t *)data + offset, size) ? 0 : -1;
+}
+
+void FILEMAP_Close(void *data, size_t size)
+{
+    if (data)
+        UnmapViewOfFile(data);
+}
+
+#else
+
+void *FILEMAP_OpenReadOnly(const char *path, size_t *size)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return NULL;
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || !S_ISREG(info.st_mode) || info.st_size <= 0)
+    {
+        close(fd);
+        return NULL;
+    }
+
+    // The mapping holds its own reference to the file
+    void *data = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+    {
+        DEBUG_WARN("Could not map %s", path);
+        return NULL;
+    }
+
+    *size = (size_t)info.st_size;
+    return data;
+}
+
+void *FILEMAP_OpenReadWrite(const char *path, size_t size)
+{
+    int fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (fd < 0)
+    {
+        DEBUG_WARN("Could not open %s for writing", path);
+        return NULL;
+    }
+
+    // Growing with ftruncate fills with zeros, a longer file keeps its tail
+    struct stat info;
+    if (fstat(fd, &info) != 0 || (info.st_size < (off_t)size && ftruncate(fd, (off_t)size) != 0))
+    {
+        DEBUG_WARN("Could not resize %s", path);
+        close(fd);
+        return NULL;
+    }
+
+    void *data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+    {
+        DEBUG_WARN("Could not map %s", path);
+        return NULL;
+    }
+    return data;
+}
+
+int FILEMAP_Flush(void *data, size_t offset, size_t size, bool wait)
+{
+    // msync takes whole pages, hosts with pages larger than the range flush the page around it
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t start = offset & ~(page - 1);
+    return msync((uint8_t *)data + start, offset + size - start, wait ? MS_SYNC : MS_ASYNC) ? -1 : 0;
+}
+
+void FILEMAP_Close(void *data, size_t size)
+{
+    if (data)
+        munmap(data, size);
+}
+
+#endif
@@ -0,0 +1,95 @@
+#include <string.h>
+
+#include "cNES/hash.h"
+
+#define HASH_PRIME1 0x9E3779B185EBCA87ULL
+#define HASH_PRIME2 0xC2B2AE3D27D4EB4FULL
+#define HASH_PRIME3 0x165667B19E3779F9ULL
+#define HASH_PRIME4 0x85EBCA77C2B2AE63ULL
+#define HASH_PRIME5 0x27D4EB2F165667C5ULL
+
+static inline uint64_t HASH_Rotl(uint64_t value, int bits)
+{
+    return (value << bits) | (value >> (64 - bits));
+}
+
+static inline uint64_t HASH_Read64(const uint8_t *in)
+{
+    uint64_t value;
+    memcpy(&value, in, sizeof(value));
+    return value;
+}
+
+static inline uint32_t HASH_Read32(const uint8_t *in)
+{
+    uint32_t value;
+    memcpy(&value, in, sizeof(value));
+    return value;
+}
+
+static inline uint64_t HASH_Round(uint64_t acc, uint64_t input)
+{
+    acc += input * HASH_PRIME2;
+    acc = HASH_Rotl(acc, 31);
+    return acc * HASH_PRIME1;
+}
+
+static inline uint64_t HASH_Merge(uint64_t acc, uint64_t lane)
+{
+    acc ^= HASH_Round(0, lane);
+    return acc * HASH_PRIME1 + HASH_PRIME4;
+}
+
+uint64_t HASH_Bytes(const void *data, size_t size, uint64_t seed)
+{
+    const uint8_t *in = data;
+    const uint8_t *end = in + size;
+    uint64_t hash;
+
+    if (size >= 32)
+    {
+        uint64_t lanes[4] = { seed + HASH_PRIME1 + HASH_PRIME2, seed + HASH_PRIME2, seed, seed - HASH_PRIME1 };
+        const uint8_t *limit = end - 32;
+        do
+        {
+            for (int i = 0; i < 4; i++)
+                lanes[i] = HASH_Round(lanes[i], HASH_Read64(in + i * 8));
+            in += 32;
+        } while (in <= limit);
+
+        hash = HASH_Rotl(lanes[0], 1) + HASH_Rotl(lanes[1], 7) + HASH_Rotl(lanes[2], 12) + HASH_Rotl(lanes[3], 18);
+        for (int i = 0; i < 4; i++)
+            hash = HASH_Merge(hash, lanes[i]);
+    }
+    else
+    {
+        hash = seed + HASH_PRIME5;
+    }
+
+    hash += (uint64_t)size;
+
+    for (; in + 8 <= end; in += 8)
+    {
+        hash ^= HASH_Round(0, HASH_Read64(in));
+        hash = HASH_Rotl(hash, 27) * HASH_PRIME1 + HASH_PRIME4;
+    }
+    if (in + 4 <= end)
+    {
+        hash ^= (uint64_t)HASH_Read32(in) * HASH_PRIME1;
+        hash = HASH_Rotl(hash, 23) * HASH_PRIME2 + HASH_PRIME3;
+        in += 4;
+    }
+    for (; in < end; in++)
+    {
+        hash ^= *in * HASH_PRIME5;
+        hash = HASH_Rotl(hash, 11) * HASH_PRIME1;
+    }
+
+    // Avalanche
+    hash ^= hash >> 33;
+    hash *= HASH_PRIME2;
+    hash ^= hash >> 29;
+    hash *= HASH_PRIME3;
+    hash ^= hash >> 32;
+    return hash;
+}
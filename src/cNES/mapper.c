@@ -0,0 +1,337 @@
+#include <string.h>
+
+#include "cNES/nes.h"
+#include "cNES/bus.h"
+#include "cNES/cpu.h"
+#include "cNES/ppu.h"
+
+#include "cNES/mapper.h"
+
+#define MAPPER_PRG_UNIT 0x2000 // PRG ROM is mapped in 8KB units, the smallest bank any mapper here uses
+
+// --- Bank mapping ---
+
+// Maps PRG ROM bank `bank` of `size` bytes at a CPU address. Negative banks count back
+// from the end of the ROM, banks past the end wrap around like the unconnected address lines.
+static void MAPPER_MapPRG(NES *nes, uint16_t address, size_t size, int bank)
+{
+    BUS *bus = nes->bus;
+    int units = (int)(size / MAPPER_PRG_UNIT);
+    int count = (int)(bus->prg_rom_size / MAPPER_PRG_UNIT);
+
+    for (int i = 0; i < units; i++)
+    {
+        int unit = (bank * units + i) % count;
+        if (unit < 0)
+            unit += count;
+
+        uint8_t *data = bus->prg_rom + (size_t)unit * MAPPER_PRG_UNIT;
+        uint8_t page = (uint8_t)((address + i * MAPPER_PRG_UNIT) >> 8);
+        BUS_MapPages(bus, page, MAPPER_PRG_UNIT >> 8, data, NULL);
+    }
+}
+
+// Maps CHR bank `bank` of `size` bytes at a PPU address, wrapping like MAPPER_MapPRG
+static void MAPPER_MapCHR(NES *nes, uint16_t address, size_t size, int bank)
+{
+    BUS *bus = nes->bus;
+    int units = (int)(size / BUS_CHR_SLOT_SIZE);
+    int count = (int)(bus->chr_size / BUS_CHR_SLOT_SIZE);
+
+    for (int i = 0; i < units; i++)
+    {
+        int unit = (bank * units + i) % count;
+        if (unit < 0)
+            unit += count;
+        bus->chr_pages[address / BUS_CHR_SLOT_SIZE + i] = bus->chr + (size_t)unit * BUS_CHR_SLOT_SIZE;
+    }
+}
+
+// Mirroring soldered on the board, as the iNES header gives it
+static MirrorMode MAPPER_HeaderMirroring(NES *nes)
+{
+    return nes->bus->mirroring ? MIRROR_VERTICAL : MIRROR_HORIZONTAL;
+}
+
+// Writes to $8000-$FFFF
+static void MAPPER_Write(NES *nes, uint16_t address, uint8_t value)
+{
+    NES_SyncPPU(nes); // Everything up to this cycle is drawn with the old banks
+    nes->mapper->write(nes, address, value);
+
+    // End the burst, the write may have enabled or acknowledged an IRQ
+    NES_Schedule(nes, NES_EVENT_IRQ, nes->cpu->total_cycles);
+}
+
+// --- NROM (0): 16 or 32KB PRG, 8KB CHR, no registers ---
+
+static void MAPPER_NROM_Sync(NES *nes)
+{
+    MAPPER_MapPRG(nes, 0x8000, 0x8000, 0); // 16KB ROMs wrap into both halves
+    MAPPER_MapCHR(nes, 0x0000, 0x2000, 0);
+    PPU_SetMirroring(nes->ppu, MAPPER_HeaderMirroring(nes));
+}
+
+// --- MMC1 (1): registers are loaded one bit per write through a serial port ---
+
+static void MAPPER_MMC1_Reset(NES *nes)
+{
+    nes->bus->mapper_state.control = 0x0C; // PRG mode 3, last bank fixed at $C000
+}
+
+static void MAPPER_MMC1_Sync(NES *nes)
+{
+    const MAPPER_State *state = &nes->bus->mapper_state;
+
+    static const MirrorMode mirroring[4] = { MIRROR_SINGLE_SCREEN_LOW, MIRROR_SINGLE_SCREEN_HIGH, MIRROR_VERTICAL, MIRROR_HORIZONTAL };
+    PPU_SetMirroring(nes->ppu, mirroring[state->control & 0x03]);
+
+    // SUROM and SXROM use CHR bit 4 to pick the 256KB half of a 512KB PRG ROM
+    int outer = nes->bus->prg_rom_size > 0x40000 ? (state->banks[0] & 0x10) : 0;
+    int prg = (state->banks[2] & 0x0F) | outer;
+    switch ((state->control >> 2) & 0x03)
+    {
+        case 0:
+        case 1: // 32KB, low bit ignored
+            MAPPER_MapPRG(nes, 0x8000, 0x8000, prg >> 1);
+            break;
+        case 2: // First bank fixed at $8000
+            MAPPER_MapPRG(nes, 0x8000, 0x4000, outer);
+            MAPPER_MapPRG(nes, 0xC000, 0x4000, prg);
+            break;
+        case 3: // Last bank fixed at $C000
+            MAPPER_MapPRG(nes, 0x8000, 0x4000, prg);
+            MAPPER_MapPRG(nes, 0xC000, 0x4000, outer | 0x0F);
+            break;
+    }
+
+    if (state->control & 0x10)
+    {
+        MAPPER_MapCHR(nes, 0x0000, 0x1000, state->banks[0]);
+        MAPPER_MapCHR(nes, 0x1000, 0x1000, state->banks[1]);
+    }
+    else
+    {
+        MAPPER_MapCHR(nes, 0x0000, 0x2000, state->banks[0] >> 1);
+    }
+}
+
+static void MAPPER_MMC1_Write(NES *nes, uint16_t address, uint8_t value)
+{
+    MAPPER_State *state = &nes->bus->mapper_state;
+
+    // A write on the cycle after the last one is dropped, so the read-modify-write
+    // instructions games reset it with only get their dummy write through. Writes
+    // of one instruction all see the cycle it started on (see cpu.c)
+    uint64_t cycle = nes->cpu->total_cycles + 1;
+    if (state->write_cycle == cycle)
+        return;
+    state->write_cycle = cycle;
+
+    if (value & 0x80)
+    {
+        // Clears the serial port and goes back to PRG mode 3
+        state->shift = 0;
+        state->shift_count = 0;
+        state->control |= 0x0C;
+        MAPPER_MMC1_Sync(nes);
+        return;
+    }
+
+    state->shift |= (uint8_t)((value & 0x01) << state->shift_count);
+    if (++state->shift_count < 5)
+        return;
+
+    // The fifth write's address picks the register the bits go to
+    switch ((address >> 13) & 0x03)
+    {
+        case 0: state->control = state->shift; break;
+        case 1: state->banks[0] = state->shift; break;
+        case 2: state->banks[1] = state->shift; break;
+        case 3: state->banks[2] = state->shift; break;
+    }
+    state->shift = 0;
+    state->shift_count = 0;
+    MAPPER_MMC1_Sync(nes);
+}
+
+// --- UxROM (2): 16KB switchable PRG at $8000, last bank fixed at $C000 ---
+
+static void MAPPER_UxROM_Sync(NES *nes)
+{
+    MAPPER_MapPRG(nes, 0x8000, 0x4000, nes->bus->mapper_state.banks[0]);
+    MAPPER_MapPRG(nes, 0xC000, 0x4000, -1);
+    MAPPER_MapCHR(nes, 0x0000, 0x2000, 0);
+    PPU_SetMirroring(nes->ppu, MAPPER_HeaderMirroring(nes));
+}
+
+// Single bank register written anywhere in $8000-$FFFF (UxROM, CNROM, AxROM), bus conflicts aren't modelled
+static void MAPPER_BankWrite(NES *nes, uint16_t address, uint8_t value)
+{
+    nes->bus->mapper_state.banks[0] = value;
+    nes->mapper->sync(nes);
+}
+
+// --- CNROM (3): fixed PRG, 8KB switchable CHR ---
+
+static void MAPPER_CNROM_Sync(NES *nes)
+{
+    MAPPER_MapPRG(nes, 0x8000, 0x8000, 0);
+    MAPPER_MapCHR(nes, 0x0000, 0x2000, nes->bus->mapper_state.banks[0]);
+    PPU_SetMirroring(nes->ppu, MAPPER_HeaderMirroring(nes));
+}
+
+// --- MMC3 (4): 8KB PRG and 1/2KB CHR banks, scanline counter IRQ ---
+
+static void MAPPER_MMC3_Reset(NES *nes)
+{
+    nes->bus->mapper_state.mirroring = nes->bus->mirroring ? 0 : 1;
+}
+
+static void MAPPER_MMC3_Sync(NES *nes)
+{
+    const MAPPER_State *state = &nes->bus->mapper_state;
+
+    // Bit 6 swaps the switchable R6 bank at $8000 with the fixed second to last one at $C000
+    uint16_t swap = (state->control & 0x40) ? 0x4000 : 0;
+    MAPPER_MapPRG(nes, 0x8000 ^ swap, 0x2000, state->banks[6]);
+    MAPPER_MapPRG(nes, 0xA000, 0x2000, state->banks[7]);
+    MAPPER_MapPRG(nes, 0xC000 ^ swap, 0x2000, -2);
+    MAPPER_MapPRG(nes, 0xE000, 0x2000, -1);
+
+    // Bit 7 swaps the 2KB banks (R0, R1) into the upper pattern table and the 1KB ones (R2-R5) into the lower
+    uint16_t invert = (state->control & 0x80) ? 0x1000 : 0;
+    MAPPER_MapCHR(nes, 0x0000 ^ invert, 0x0800, state->banks[0] >> 1);
+    MAPPER_MapCHR(nes, 0x0800 ^ invert, 0x0800, state->banks[1] >> 1);
+    for (int i = 0; i < 4; i++)
+        MAPPER_MapCHR(nes, (uint16_t)((0x1000 + i * 0x0400) ^ invert), 0x0400, state->banks[2 + i]);
+
+    PPU_SetMirroring(nes->ppu, state->mirroring ? MIRROR_HORIZONTAL : MIRROR_VERTICAL);
+}
+
+static void MAPPER_MMC3_Write(NES *nes, uint16_t address, uint8_t value)
+{
+    MAPPER_State *state = &nes->bus->mapper_state;
+
+    // Registers are decoded from A0 and A13-A14, each pair repeats through its 8KB
+    switch (address & 0xE001)
+    {
+        case 0x8000: state->control = value; break;
+        case 0x8001: state->banks[state->control & 0x07] = value; break;
+        case 0xA000: state->mirroring = value & 0x01; break;
+        case 0xA001:
+            // Bit 7 enables the PRG RAM, bit 6 protects it from writes
+            state->prg_ram_protect = (uint8_t)(((value & 0x80) ? 0 : MAPPER_PRG_RAM_DISABLED) | ((value & 0x40) ? MAPPER_PRG_RAM_READ_ONLY : 0));
+            MAPPER_MapPRGRAM(nes);
+            return;
+        case 0xC000: state->irq_latch = value; return;
+        case 0xC001: state->irq_counter = 0; state->irq_reload = true; return;
+        case 0xE000: state->irq_enabled = false; state->irq_line = false; return;
+        case 0xE001: state->irq_enabled = true; return;
+    }
+    MAPPER_MMC3_Sync(nes);
+}
+
+static void MAPPER_MMC3_Scanline(NES *nes)
+{
+    MAPPER_State *state = &nes->bus->mapper_state;
+
+    if (state->irq_counter == 0 || state->irq_reload)
+    {
+        state->irq_counter = state->irq_latch;
+        state->irq_reload = false;
+    }
+    else
+    {
+        state->irq_counter--;
+    }
+
+    if (state->irq_counter == 0 && state->irq_enabled)
+        state->irq_line = true;
+}
+
+// --- AxROM (7): 32KB switchable PRG, single screen mirroring picked by the same register ---
+
+static void MAPPER_AxROM_Sync(NES *nes)
+{
+    uint8_t bank = nes->bus->mapper_state.banks[0];
+    MAPPER_MapPRG(nes, 0x8000, 0x8000, bank & 0x07);
+    MAPPER_MapCHR(nes, 0x0000, 0x2000, 0);
+    PPU_SetMirroring(nes->ppu, (bank & 0x10) ? MIRROR_SINGLE_SCREEN_HIGH : MIRROR_SINGLE_SCREEN_LOW);
+}
+
+static const MAPPER mapper_table[] = {
+    { 0, "NROM",  NULL,              NULL,              MAPPER_NROM_Sync,  NULL },
+    { 1, "MMC1",  MAPPER_MMC1_Reset, MAPPER_MMC1_Write, MAPPER_MMC1_Sync,  NULL },
+    { 2, "UxROM", NULL,              MAPPER_BankWrite,  MAPPER_UxROM_Sync, NULL },
+    { 3, "CNROM", NULL,              MAPPER_BankWrite,  MAPPER_CNROM_Sync, NULL },
+    { 4, "MMC3",  MAPPER_MMC3_Reset, MAPPER_MMC3_Write, MAPPER_MMC3_Sync,  MAPPER_MMC3_Scanline },
+    { 7, "AxROM", NULL,              MAPPER_BankWrite,  MAPPER_AxROM_Sync, NULL },
+};
+
+const MAPPER *MAPPER_Get(uint8_t number)
+{
+    for (size_t i = 0; i < sizeof(mapper_table) / sizeof(mapper_table[0]); i++)
+    {
+        if (mapper_table[i].number == number)
+            return &mapper_table[i];
+    }
+    return NULL;
+}
+
+void MAPPER_Reset(NES *nes)
+{
+    BUS *bus = nes->bus;
+    memset(&bus->mapper_state, 0, sizeof(bus->mapper_state));
+    if (!nes->mapper)
+        return;
+
+    // Writes to ROM go to the mapper's registers, or nowhere when it has none
+    if (nes->mapper->write)
+    {
+        BUS_MapHandlers(bus, 0x80, 0x80, NULL, MAPPER_Write);
+    }
+    else
+    {
+        for (int page = 0x80; page < BUS_PAGE_COUNT; page++)
+            bus->write_pages[page] = bus->discard;
+    }
+
+    if (nes->mapper->reset)
+        nes->mapper->reset(nes);
+    MAPPER_Sync(nes);
+}
+
+void MAPPER_Sync(NES *nes)
+{
+    if (nes->mapper)
+        nes->mapper->sync(nes);
+    MAPPER_MapPRGRAM(nes);
+}
+
+void MAPPER_MapPRGRAM(NES *nes)
+{
+    BUS *bus = nes->bus;
+    uint8_t protect = bus->mapper_state.prg_ram_protect;
+
+    if (!(protect & MAPPER_PRG_RAM_DISABLED))
+        BUS_MapPages(bus, 0x60, 0x20, bus->prg_ram, NULL);
+
+    if (protect & (MAPPER_PRG_RAM_DISABLED | MAPPER_PRG_RAM_READ_ONLY))
+    {
+        for (int page = 0x60; page < 0x80; page++)
+        {
+            if (protect & MAPPER_PRG_RAM_DISABLED)
+                bus->read_pages[page] = bus->open_bus;
+            bus->write_pages[page] = bus->discard;
+        }
+    }
+    else if (bus->prg_ram_write)
+    {
+        BUS_MapHandlers(bus, 0x60, 0x20, NULL, bus->prg_ram_write);
+    }
+    else
+    {
+        BUS_MapPages(bus, 0x60, 0x20, NULL, bus->prg_ram);
+    }
+}
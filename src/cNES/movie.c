@@ -0,0 +1,326 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "debug.h"
+
+#include "cNES/battery.h"
+#include "cNES/bus.h"
+#include "cNES/nes.h"
+#include "cNES/movie.h"
+
+#define MOVIE_MAGIC   "CNMV"
+#define MOVIE_VERSION 1
+
+#define MOVIE_HEADER_SIZE       28
+#define MOVIE_FRAME_COUNT_AT    16 // Offset of the frame count, filled in when recording finishes
+#define MOVIE_MAX_CONTROLLERS   2
+
+struct MOVIE {
+    NES *nes;
+    FILE *file;
+    bool recording;
+    bool finished;
+    bool failed; // A write went wrong, the file is incomplete
+
+    int controllers;
+    uint64_t frame;
+    uint64_t length;
+
+    // Current run of identical input. Recording counts the frames in it, playback the frames left
+    uint8_t run_input[MOVIE_MAX_CONTROLLERS];
+    uint64_t run_frames;
+};
+
+static void MOVIE_Put(uint8_t *out, uint64_t value, int bytes)
+{
+    for (int i = 0; i < bytes; i++)
+        out[i] = (uint8_t)(value >> (i * 8));
+}
+
+static uint64_t MOVIE_Get(const uint8_t *in, int bytes)
+{
+    uint64_t value = 0;
+    for (int i = 0; i < bytes; i++)
+        value |= (uint64_t)in[i] << (i * 8);
+    return value;
+}
+
+// Puts the NES in the same state every power-on movie starts from. A reset alone
+// keeps CHR RAM, PRG RAM and the controller latches, which the game could see
+static void MOVIE_PowerOn(NES *nes)
+{
+    memset(nes->bus->chr_ram, 0, sizeof(nes->bus->chr_ram));
+    memset(nes->bus->prg_ram, 0, sizeof(nes->bus->prg_ram));
+    nes->controller_strobe = 0;
+    memset(nes->controller_shift, 0, sizeof(nes->controller_shift));
+
+    NES_Reset(nes);
+}
+
+static void MOVIE_WriteRun(MOVIE *movie)
+{
+    if (movie->run_frames == 0)
+        return;
+
+    uint8_t record[10 + MOVIE_MAX_CONTROLLERS];
+    size_t size = 0;
+    uint64_t frames = movie->run_frames;
+    do
+    {
+        record[size++] = (uint8_t)((frames & 0x7F) | (frames > 0x7F ? 0x80 : 0));
+        frames >>= 7;
+    } while (frames);
+    memcpy(&record[size], movie->run_input, (size_t)movie->controllers);
+    size += (size_t)movie->controllers;
+
+    if (fwrite(record, 1, size, movie->file) != size && !movie->failed)
+    {
+        DEBUG_ERROR("MOVIE: Could not write input, the movie is incomplete");
+        movie->failed = true;
+    }
+    movie->run_frames = 0;
+}
+
+// Reads the next run, false at the end of the movie
+static bool MOVIE_ReadRun(MOVIE *movie)
+{
+    uint64_t frames = 0;
+    for (int shift = 0; ; shift += 7)
+    {
+        int byte = fgetc(movie->file);
+        if (byte == EOF || shift > 63)
+            return false;
+        frames |= (uint64_t)(byte & 0x7F) << shift;
+        if (!(byte & 0x80))
+            break;
+    }
+
+    if (frames == 0 || fread(movie->run_input, 1, (size_t)movie->controllers, movie->file) != (size_t)movie->controllers)
+        return false;
+    movie->run_frames = frames;
+    return true;
+}
+
+static MOVIE *MOVIE_Open(NES *nes, const char *path, const char *mode)
+{
+    if (nes->movie)
+    {
+        DEBUG_ERROR("MOVIE: A movie is already attached");
+        return NULL;
+    }
+
+    MOVIE *movie = calloc(1, sizeof(MOVIE));
+    if (!movie)
+    {
+        DEBUG_ERROR("MOVIE: Could not allocate a movie");
+        return NULL;
+    }
+
+    movie->nes = nes;
+    movie->controllers = MOVIE_MAX_CONTROLLERS;
+    movie->file = fopen(path, mode);
+    if (!movie->file)
+    {
+        DEBUG_ERROR("MOVIE: Unable to open %s", path);
+        free(movie);
+        return NULL;
+    }
+    return movie;
+}
+
+MOVIE *MOVIE_Record(NES *nes, const char *path, MOVIE_Anchor anchor)
+{
+    uint8_t *state = NULL;
+    size_t state_size = 0;
+    MOVIE *movie = MOVIE_Open(nes, path, "wb");
+    if (!movie)
+        return NULL;
+    movie->recording = true;
+    BATTERY_Suspend(nes->battery);
+
+    if (anchor == MOVIE_ANCHOR_STATE)
+    {
+        state_size = NES_GetStateSize(nes);
+        state = malloc(state_size);
+        if (!state || NES_SaveState(nes, state, state_size) != state_size)
+        {
+            DEBUG_ERROR("MOVIE_Record: Could not save the anchor state");
+            goto error;
+        }
+    }
+    else
+    {
+        MOVIE_PowerOn(nes);
+    }
+
+    uint8_t header[MOVIE_HEADER_SIZE];
+    memcpy(header, MOVIE_MAGIC, 4);
+    MOVIE_Put(&header[4], MOVIE_VERSION, 2);
+    header[6] = (uint8_t)anchor;
+    header[7] = (uint8_t)movie->controllers;
+    MOVIE_Put(&header[8], nes->rom_hash, 8);
+    MOVIE_Put(&header[MOVIE_FRAME_COUNT_AT], 0, 8);
+    MOVIE_Put(&header[24], state_size, 4);
+
+    if (fwrite(header, 1, sizeof(header), movie->file) != sizeof(header) ||
+        (state_size && fwrite(state, 1, state_size, movie->file) != state_size))
+    {
+        DEBUG_ERROR("MOVIE_Record: Could not write %s", path);
+        goto error;
+    }
+
+    free(state);
+    nes->movie = movie;
+    return movie;
+
+error:
+    BATTERY_Resume(nes->battery);
+    free(state);
+    fclose(movie->file);
+    free(movie);
+    return NULL;
+}
+
+MOVIE *MOVIE_Play(NES *nes, const char *path)
+{
+    uint8_t *state = NULL;
+    MOVIE *movie = MOVIE_Open(nes, path, "rb");
+    if (!movie)
+        return NULL;
+    BATTERY_Suspend(nes->battery);
+
+    uint8_t header[MOVIE_HEADER_SIZE];
+    if (fread(header, 1, sizeof(header), movie->file) != sizeof(header) || memcmp(header, MOVIE_MAGIC, 4) != 0)
+    {
+        DEBUG_ERROR("MOVIE_Play: %s is not a movie", path);
+        goto error;
+    }
+    if (MOVIE_Get(&header[4], 2) != MOVIE_VERSION || header[6] > MOVIE_ANCHOR_STATE ||
+        header[7] == 0 || header[7] > MOVIE_MAX_CONTROLLERS)
+    {
+        DEBUG_ERROR("MOVIE_Play: %s is not a version %d movie", path, MOVIE_VERSION);
+        goto error;
+    }
+    if (MOVIE_Get(&header[8], 8) != nes->rom_hash)
+    {
+        DEBUG_ERROR("MOVIE_Play: %s was recorded on a different ROM", path);
+        goto error;
+    }
+
+    movie->controllers = header[7];
+    movie->length = MOVIE_Get(&header[MOVIE_FRAME_COUNT_AT], 8);
+    size_t state_size = (size_t)MOVIE_Get(&header[24], 4);
+
+    if (header[6] == MOVIE_ANCHOR_STATE)
+    {
+        // The size comes from the file, anything but this build's state size is a damaged or foreign movie
+        if (state_size != NES_GetStateSize(nes))
+        {
+            DEBUG_ERROR("MOVIE_Play: The anchor state of %s doesn't fit this build", path);
+            goto error;
+        }
+        state = malloc(state_size ? state_size : 1);
+        if (!state || fread(state, 1, state_size, movie->file) != state_size)
+        {
+            DEBUG_ERROR("MOVIE_Play: Could not read the anchor state of %s", path);
+            goto error;
+        }
+        if (NES_LoadState(nes, state, state_size))
+            goto error;
+    }
+    else
+    {
+        MOVIE_PowerOn(nes);
+    }
+
+    free(state);
+    nes->movie = movie;
+    return movie;
+
+error:
+    BATTERY_Resume(nes->battery);
+    free(state);
+    fclose(movie->file);
+    free(movie);
+    return NULL;
+}
+
+int MOVIE_Close(MOVIE *movie)
+{
+    if (!movie)
+        return 0;
+
+    if (movie->nes->movie == movie)
+    {
+        movie->nes->movie = NULL;
+        BATTERY_Resume(movie->nes->battery);
+    }
+
+    if (movie->recording)
+    {
+        MOVIE_WriteRun(movie);
+
+        uint8_t count[8];
+        MOVIE_Put(count, movie->frame, 8);
+        if (fseek(movie->file, MOVIE_FRAME_COUNT_AT, SEEK_SET) != 0 || fwrite(count, 1, sizeof(count), movie->file) != sizeof(count))
+            movie->failed = true;
+    }
+
+    if (fclose(movie->file) != 0 && movie->recording)
+        movie->failed = true;
+
+    int result = movie->failed ? -1 : 0;
+    if (movie->failed)
+        DEBUG_ERROR("MOVIE_Close: The movie could not be written completely");
+    free(movie);
+    return result;
+}
+
+void MOVIE_Frame(MOVIE *movie)
+{
+    NES *nes = movie->nes;
+
+    if (movie->recording)
+    {
+        if (movie->run_frames && memcmp(movie->run_input, nes->controllers, (size_t)movie->controllers) != 0)
+            MOVIE_WriteRun(movie);
+        memcpy(movie->run_input, nes->controllers, (size_t)movie->controllers);
+        movie->run_frames++;
+        movie->frame++;
+        return;
+    }
+
+    if (movie->finished)
+        return;
+    if (movie->run_frames == 0 && !MOVIE_ReadRun(movie))
+    {
+        movie->finished = true;
+        return;
+    }
+
+    for (int i = 0; i < movie->controllers; i++)
+        NES_SetController(nes, i, movie->run_input[i]);
+    movie->run_frames--;
+    movie->frame++;
+}
+
+bool MOVIE_IsRecording(const MOVIE *movie)
+{
+    return movie->recording;
+}
+
+bool MOVIE_IsFinished(const MOVIE *movie)
+{
+    return movie->finished || (!movie->recording && movie->length && movie->frame >= movie->length);
+}
+
+uint64_t MOVIE_GetFrame(const MOVIE *movie)
+{
+    return movie->frame;
+}
+
+uint64_t MOVIE_GetLength(const MOVIE *movie)
+{
+    return movie->recording ? movie->frame : movie->length;
+}
@@ -1,6 +1,8 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stddef.h>
+#include <stdalign.h>
 
 #include "debug.h"
 
@@ -8,225 +10,469 @@
 #include "cNES/cpu.h"
 #include "cNES/ppu.h"
 #include "cNES/nes.h"
+#include "cNES/mapper.h"
+#include "cNES/movie.h"
+#include "cNES/hash.h"
+#include "cNES/rom.h"
+#include "cNES/battery.h"
+
+#define NES_CACHE_LINE 64
+
+// Everything an instance mutates lives in one cache line aligned block, ordered
+// by how often the emulation loop touches it: the NES with its scheduler, the
+// CPU registers, the PPU (its timing and pipeline lead its struct), the bus with
+// its page tables and memories, and the framebuffer last. The ROM, with the
+// decode cache that hangs off it, is shared rather than copied, so copying this
+// block and fixing up its pointers is a complete copy of the machine.
+typedef struct NES_Arena {
+    alignas(NES_CACHE_LINE) NES nes; // First, so the NES pointer is the block's address
+    alignas(NES_CACHE_LINE) CPU cpu;
+    alignas(NES_CACHE_LINE) PPU ppu;
+    alignas(NES_CACHE_LINE) BUS bus;
+    alignas(NES_CACHE_LINE) uint8_t framebuffer[PPU_FRAMEBUFFER_WIDTH * PPU_FRAMEBUFFER_HEIGHT];
+} NES_Arena;
+
+static NES_Arena *NES_AllocArena(void)
+{
+#if defined(_WIN32) // MSVC and MinGW runtimes have no aligned_alloc
+    NES_Arena *arena = _aligned_malloc(sizeof(NES_Arena), NES_CACHE_LINE);
+#else
+    NES_Arena *arena = aligned_alloc(NES_CACHE_LINE, sizeof(NES_Arena)); // Size is a multiple of the alignment
+#endif
+    if (arena)
+        memset(arena, 0, sizeof(NES_Arena));
+    return arena;
+}
 
-NES *NES_Create() 
+static void NES_FreeArena(NES_Arena *arena)
 {
-    NES *nes = malloc(sizeof(NES));
-    if (!nes) {goto error;}
-    memset(nes, 0, sizeof(NES)); // Initialize NES structure to zero
+#if defined(_WIN32)
+    _aligned_free(arena);
+#else
+    free(arena);
+#endif
+}
 
-    nes->cpu = CPU_Create(nes);
-    if (!nes->cpu) {goto error;}
+NES *NES_Create() 
+{
+    NES_Arena *arena = NES_AllocArena();
+    if (!arena) 
+    {
+        DEBUG_ERROR("Failed to allocate NES instance");
+        return NULL;
+    }
 
-    nes->ppu = PPU_Create(nes);
-    if (!nes->ppu) {goto error;}
+    NES *nes = &arena->nes;
+    nes->cpu = &arena->cpu;
+    nes->ppu = &arena->ppu;
+    nes->bus = &arena->bus;
 
-    nes->bus = malloc(sizeof(BUS));
-    if (!nes->bus) {goto error;}
-    memset(nes->bus, 0, sizeof(BUS)); // Initialize BUS structure to zero
+    CPU_Init(nes->cpu, nes);
+    PPU_Init(nes->ppu, nes, arena->framebuffer);
+    BUS_Init(nes->bus);
 
     NES_Reset(nes);
 
     return nes;
+}
 
-error:
-    NES_Destroy(nes);
-    DEBUG_ERROR("Failed to create NES instance");
-
-    return NULL;
+// Drops the attached ROM, the instance goes back to having no cartridge
+static void NES_ReleaseCartridge(NES *nes)
+{
+    ROM_Release(nes->rom);
+
+    nes->rom = NULL;
+    memset(nes->bus->decode_pages, 0, sizeof(nes->bus->decode_pages)); // They led into the ROM's decode cache
+    nes->bus->prg_rom = NULL;
+    nes->bus->prg_rom_size = 0;
+    nes->bus->chr = NULL;
+    nes->bus->chr_size = 0;
 }
 
 void NES_Destroy(NES* nes) 
 {
     if (nes) {
-        if (nes->cpu) free(nes->cpu);
-        if (nes->ppu) free(nes->ppu);
-        if (nes->bus) free(nes->bus);
-        free(nes);
+        MOVIE_Close(nes->movie); // Before the battery, closing gives PRG RAM back to the save
+        BATTERY_Close(nes->battery);
+        NES_ReleaseCartridge(nes);
+        CPU_SetRecompiler(nes->cpu, false);
+        free(nes->runahead_state);
+        NES_FreeArena((NES_Arena *)nes);
     }
 }
 
-int NES_Load(const char* path, NES* nes) 
+// Moves a pointer that led into one arena to the same place in another
+static void *NES_Rebase(void *pointer, const NES_Arena *from, NES_Arena *to)
 {
-    FILE *file = fopen(path, "rb");
-    if (!file) 
-    {
-        DEBUG_ERROR("Unable to open ROM file %s", path);
-        return -1;
-    }
+    uintptr_t address = (uintptr_t)pointer;
+    if (address < (uintptr_t)from || address >= (uintptr_t)from + sizeof(NES_Arena))
+        return pointer;
+    return (uint8_t *)to + (address - (uintptr_t)from);
+}
 
-    // Read the NES header (first 16 bytes)
-    uint8_t header[16];
-    if (fread(header, 1, sizeof(header), file) != sizeof(header)) 
+NES *NES_Clone(const NES *source)
+{
+    const NES_Arena *from = (const NES_Arena *)source;
+    NES_Arena *arena = NES_AllocArena();
+    if (!arena) 
     {
-        DEBUG_ERROR("Could not read NES header from %s", path);
-        fclose(file);
-        return -1;
+        DEBUG_ERROR("Failed to allocate NES instance");
+        return NULL;
     }
-
-    // Check for valid NES header
-    if (header[0] != 'N' || header[1] != 'E' || header[2] != 'S' || header[3] != 0x1A) 
-    {
-        DEBUG_ERROR("Invalid NES ROM file format");
-        fclose(file);
-        return -1;
+    memcpy(arena, from, sizeof(NES_Arena));
+
+    // Pointers into the arena follow the copy, everything else is shared or left behind
+    NES *nes = &arena->nes;
+    nes->cpu = &arena->cpu;
+    nes->ppu = &arena->ppu;
+    nes->bus = &arena->bus;
+    nes->cpu->nes = nes;
+    nes->cpu->decode_pages = nes->bus->decode_pages;
+    nes->cpu->recompiler = NULL;
+    if (source->cpu->recompiler)
+        CPU_SetRecompiler(nes->cpu, true); // Translates its own blocks, the interpreter runs it if that fails
+    nes->ppu->nes = nes;
+    nes->ppu->framebuffer = arena->framebuffer;
+    for (int page = 0; page < BUS_PAGE_COUNT; page++) {
+        nes->bus->read_pages[page] = NES_Rebase(nes->bus->read_pages[page], from, arena);
+        nes->bus->write_pages[page] = NES_Rebase(nes->bus->write_pages[page], from, arena);
     }
+    for (int slot = 0; slot < BUS_CHR_SLOT_COUNT; slot++)
+        nes->bus->chr_pages[slot] = NES_Rebase(nes->bus->chr_pages[slot], from, arena);
+    nes->bus->chr = NES_Rebase(nes->bus->chr, from, arena);
+
+    if (nes->rom)
+        ROM_Retain(nes->rom);
+    nes->movie = NULL;
+    nes->battery = NULL;
+    nes->bus->prg_ram_write = NULL; // PRG RAM writes of the clone don't mark the source's save dirty
+    MAPPER_MapPRGRAM(nes);
+    nes->runahead_state = NULL;
+    nes->runahead_state_size = 0;
 
-    // Read PRG ROM size (in 16KB units)
-    uint8_t prg_rom_banks = header[4];
-    uint8_t chr_rom_banks = header[5]; // Not used in nestest, but read for completeness
-    uint8_t mapper_info = header[6]; // Mapper info byte
-    uint8_t mirroring = header[6] & 0x01; // Mirroring info (0: horizontal, 1: vertical)
-    uint8_t has_trainer = (header[6] & 0x04) >> 2; // Trainer presence (0: no trainer, 1: trainer present)
-    uint8_t has_battery = (header[6] & 0x02) >> 1; // Battery presence (0: no battery, 1: battery present)
-    uint8_t mapper_number = ((header[7] & 0xF0) >> 4) | (mapper_info & 0xF0); // Mapper number
+    return nes;
+}
+
+int NES_AttachROM(NES *nes, ROM *rom)
+{
+    ROM_Retain(rom); // Before the release, rom may be the one already attached
+    NES_SetBatteryFile(nes, NULL); // The save belongs to the old cartridge
+    NES_ReleaseCartridge(nes);
+    nes->rom = rom;
 
-    uint16_t prg_rom_size = prg_rom_banks * 0x4000; // Total PRG ROM size in bytes
-    uint16_t chr_rom_size = chr_rom_banks * 0x2000; // Total CHR ROM size in bytes
-    uint16_t trainer_size = has_trainer ? 512 : 0; // Trainer size in bytes
-    size_t total_size = (size_t)prg_rom_size + (size_t)chr_rom_size + (size_t)trainer_size; // Total size of the ROM
+    // ROM banks are read in place, only carts without CHR ROM get the instance's CHR RAM
+    nes->bus->prg_rom = rom->prg;
+    nes->bus->prg_rom_size = rom->prg_size;
+    nes->bus->chr = rom->chr ? rom->chr : nes->bus->chr_ram;
+    nes->bus->chr_size = rom->chr ? rom->chr_size : sizeof(nes->bus->chr_ram);
 
-    uint8_t *prg_data = malloc(prg_rom_size);
-    if (!prg_data) 
-    {
-        DEBUG_ERROR("Could not allocate memory for PRG ROM");
-        fclose(file);
+    memset(nes->bus->chr_ram, 0, sizeof(nes->bus->chr_ram));
+    memset(nes->bus->prg_ram, 0, sizeof(nes->bus->prg_ram));
+
+    // Set mapper, mirroring, and ROM size info in the BUS struct
+    nes->mapper = rom->mapper;
+    nes->bus->mapper = rom->mapper_number;
+    nes->bus->mirroring = rom->mirroring;
+    nes->bus->prgRomSize = rom->prg_banks;
+    nes->bus->chrRomSize = rom->chr_banks;
+    nes->rom_hash = rom->hash;
+
+    NES_Reset(nes); // Reset the NES after loading the ROM
+
+    return 0;
+}
+
+int NES_Load(const char* path, NES* nes) 
+{
+    ROM *rom = ROM_Load(path);
+    if (!rom)
         return -1;
-    }
 
-    uint8_t *chr_data = malloc(chr_rom_size);
-    if (!chr_data) 
+    int result = NES_AttachROM(nes, rom);
+    ROM_Release(rom); // The NES holds its own reference
+    if (result != 0 || !nes->rom->has_battery)
+        return result;
+
+    // game.nes saves to game.sav next to it, a cart that can't save still runs
+    size_t length = strlen(path);
+    const char *extension = strrchr(path, '.');
+    if (extension && (strchr(extension, '/') || strchr(extension, '\\')))
+        extension = NULL;
+    size_t stem = extension ? (size_t)(extension - path) : length;
+
+    char *save_path = malloc(stem + sizeof(".sav"));
+    if (save_path)
     {
-        DEBUG_ERROR("Could not allocate memory for CHR ROM");
-        free(prg_data);
-        fclose(file);
-        return -1;
+        memcpy(save_path, path, stem);
+        memcpy(save_path + stem, ".sav", sizeof(".sav"));
+        NES_SetBatteryFile(nes, save_path);
+        free(save_path);
     }
+    return 0;
+}
 
-    uint8_t *trainer_data = NULL;
-    if (has_trainer) {
-        trainer_data = malloc(trainer_size);
-        if (!trainer_data) 
-        {
-            DEBUG_ERROR("Could not allocate memory for trainer data");
-            free(prg_data);
-            free(chr_data);
-            fclose(file);
-            return -1;
-        }
-        // Read the trainer data if present
-        if (fread(trainer_data, 1, trainer_size, file) != trainer_size) 
-        {
-            DEBUG_ERROR("Could not read trainer data from %s", path);
-            free(prg_data);
-            free(chr_data);
-            free(trainer_data);
-            fclose(file);
-            return -1;
-        }
-    }
+int NES_SetBatteryFile(NES *nes, const char *path)
+{
+    BATTERY_Close(nes->battery);
+    nes->battery = NULL;
+    if (!path)
+        return 0;
+
+    nes->battery = BATTERY_Open(nes, path);
+    if (nes->movie)
+        BATTERY_Suspend(nes->battery); // The movie's PRG RAM stays out of the new save too
+    return nes->battery ? 0 : -1;
+}
 
-    // Read the PRG ROM data
-    if (fread(prg_data, 1, prg_rom_size, file) != prg_rom_size) 
-    {
-        DEBUG_ERROR("Could not read PRG ROM data from %s", path);
-        free(prg_data);
-        free(chr_data);
-        if (trainer_data) free(trainer_data);
-        fclose(file);
+int NES_LoadMemory(NES *nes, const uint8_t *data, size_t size)
+{
+    ROM *rom = ROM_LoadMemory(data, size);
+    if (!rom)
         return -1;
-    }
 
-    // Read the CHR ROM data
-    if (chr_rom_size > 0) {
-        if (fread(chr_data, 1, chr_rom_size, file) != chr_rom_size) 
-        {
-            DEBUG_ERROR("Could not read CHR ROM data from %s", path);
-            free(prg_data);
-            free(chr_data);
-            if (trainer_data) free(trainer_data);
-            fclose(file);
-            return -1;
-        }
-    }
+    int result = NES_AttachROM(nes, rom);
+    ROM_Release(rom);
+    return result;
+}
 
-    fclose(file); // Close the ROM file after reading
+// --- Scheduler ---
+// The CPU runs in bursts up to the next event deadline. The PPU lags behind and
+// only catches up at the end of each burst, or earlier when the CPU touches its
+// registers or OAM (see the PPU and DMA handlers in bus.c).
 
-    // Load the PRG ROM into the BUS's PRG ROM area
-    memcpy(nes->bus->prgRom, prg_data, prg_rom_size);
-    // If only one PRG ROM bank, mirror it into the upper 16KB
-    if (prg_rom_banks == 1) {
-        memcpy(nes->bus->prgRom + 0x4000, prg_data, 0x4000);
-    }
+#define NES_PPU_DOTS_PER_CYCLE 3
+#define NES_PPU_DOTS_PER_LINE 341
+#define NES_PPU_NMI_DOT   (241 * NES_PPU_DOTS_PER_LINE + 1)   // First vblank dot
+#define NES_PPU_FRAME_DOT (261 * NES_PPU_DOTS_PER_LINE + 340) // Last dot of the pre-render line
+#define NES_PPU_MAPPER_DOT 260 // Dot of each rendered line that clocks a mapper's scanline counter
 
-    // --- DO NOT copy PRG ROM into CPU memory map ($8000-$FFFF) ---
-    // The bus will always use prgRom for $8000-$FFFF
+void NES_Schedule(NES *nes, NES_Event event, uint64_t cycle)
+{
+    nes->scheduler.deadlines[event] = cycle;
+    if (cycle < nes->cpu->run_until)
+        nes->cpu->run_until = cycle;
+}
 
-    // Load the CHR ROM into the BUS's CHR ROM area
-    if (chr_rom_size > 0) {
-        memcpy(nes->bus->chrRom, chr_data, chr_rom_size);
-    } else {
-        // If no CHR ROM, allocate CHR RAM (8KB)
-        memset(nes->bus->chrRom, 0, 0x2000);
-    }
+void NES_SyncPPU(NES *nes)
+{
+    PPU_CatchUp(nes->ppu, nes->cpu->total_cycles * NES_PPU_DOTS_PER_CYCLE);
+}
 
-    // Initialize VRAM and palette RAM to zero
-    memset(nes->bus->vram, 0, sizeof(nes->bus->vram));
-    memset(nes->bus->palette, 0, sizeof(nes->bus->palette));
+// Works out when the PPU raises NMI and finishes the frame from where it is now
+static void NES_ScheduleVideo(NES *nes)
+{
+    PPU *ppu = nes->ppu;
+    uint64_t now = ppu->clock / NES_PPU_DOTS_PER_CYCLE;
+    int dot = ppu->scanline * NES_PPU_DOTS_PER_LINE + ppu->cycle;
 
-    // Set mapper, mirroring, and ROM size info in the BUS struct
-    nes->bus->mapper = mapper_number;
-    nes->bus->mirroring = mirroring;
-    nes->bus->prgRomSize = prg_rom_banks;
-    nes->bus->chrRomSize = chr_rom_banks;
+    // Dots until each event's dot has been processed, rounded up to CPU cycles
+    int frame_dots = NES_PPU_FRAME_DOT - dot + 1;
+    nes->scheduler.deadlines[NES_EVENT_FRAME_END] = now + (uint64_t)(frame_dots + NES_PPU_DOTS_PER_CYCLE - 1) / NES_PPU_DOTS_PER_CYCLE;
 
-    // Free allocated memory
-    free(prg_data);
-    free(chr_data);
-    if (trainer_data) free(trainer_data);
+    if (dot <= NES_PPU_NMI_DOT) {
+        int nmi_dots = NES_PPU_NMI_DOT - dot + 1;
+        nes->scheduler.deadlines[NES_EVENT_NMI] = now + (uint64_t)(nmi_dots + NES_PPU_DOTS_PER_CYCLE - 1) / NES_PPU_DOTS_PER_CYCLE;
+    } else {
+        nes->scheduler.deadlines[NES_EVENT_NMI] = NES_EVENT_NEVER; // Next one is after the frame ends
+    }
+}
 
-    NES_Reset(nes); // Reset the NES after loading the ROM
+// Ends a burst just after the mapper's scanline counter is next clocked, so an IRQ
+// it raises is taken before the next instruction
+static void NES_ScheduleIRQ(NES *nes)
+{
+    const MAPPER_State *state = &nes->bus->mapper_state;
+    PPU *ppu = nes->ppu;
 
-    return 0;
+    if (state->irq_line) {
+        // Raised but masked, look again after every instruction until it is taken or acknowledged
+        nes->scheduler.deadlines[NES_EVENT_IRQ] = nes->cpu->total_cycles + 1;
+        return;
+    }
+    if (!state->irq_enabled || !nes->mapper || !nes->mapper->scanline) {
+        nes->scheduler.deadlines[NES_EVENT_IRQ] = NES_EVENT_NEVER;
+        return;
+    }
+
+    // Counted on lines 0-239 and the pre-render line, whether rendering is on is checked when it happens
+    int line = ppu->scanline;
+    int dots;
+    if ((line <= 239 || line == 261) && ppu->cycle <= NES_PPU_MAPPER_DOT) {
+        dots = NES_PPU_MAPPER_DOT - ppu->cycle + 1;
+    } else {
+        int next = line < 239 ? line + 1 : (line == 261 ? 0 : 261);
+        int lines = (next - line + 262) % 262;
+        dots = lines * NES_PPU_DOTS_PER_LINE - ppu->cycle + NES_PPU_MAPPER_DOT + 1;
+    }
+    uint64_t now = ppu->clock / NES_PPU_DOTS_PER_CYCLE;
+    nes->scheduler.deadlines[NES_EVENT_IRQ] = now + (uint64_t)(dots + NES_PPU_DOTS_PER_CYCLE - 1) / NES_PPU_DOTS_PER_CYCLE;
 }
 
-// Add NES_Step function to step PPU and CPU, and handle NMI interrupts
-void NES_Step(NES *nes)
+static uint64_t NES_NextDeadline(NES *nes)
 {
-    // Step the PPU three times for every CPU step (PPU runs 3x faster)
-    for (int i = 0; i < 3; ++i) {
-        PPU_Step(nes->ppu);
+    uint64_t next = NES_EVENT_NEVER;
+    for (int i = 0; i < NES_EVENT_COUNT; ++i) {
+        if (nes->scheduler.deadlines[i] < next)
+            next = nes->scheduler.deadlines[i];
     }
+    return next;
+}
 
-    // Handle NMI if triggered by PPU
+// Takes the NMI if the PPU has raised it, interrupts are taken between instructions
+static void NES_PollNMI(NES *nes)
+{
     if (nes->ppu->nmi_interrupt_line) {
         CPU_NMI(nes->cpu);
         nes->ppu->nmi_interrupt_line = 0; // Clear the NMI interrupt after CPU services it
     }
+}
+
+// Takes the mapper's IRQ while it is raised and the CPU has interrupts enabled
+static void NES_PollIRQ(NES *nes)
+{
+    if (nes->bus->mapper_state.irq_line && !CPU_GetFlag(nes->cpu, CPU_FLAG_INTERRUPT))
+        CPU_IRQ(nes->cpu);
+}
+
+// Runs a single instruction and catches the PPU up behind it, used by the debugger
+void NES_Step(NES *nes)
+{
+    NES_PollNMI(nes);
+    NES_PollIRQ(nes);
 
     // Step the CPU
     if (CPU_Step(nes->cpu) == -1) {
         DEBUG_ERROR("CPU execution halted due to error");
+        nes->cpu->total_cycles++; // A jammed CPU still lets time pass
     }
+
+    NES_SyncPPU(nes);
+}
+
+// Everything a frame's output and timing depend on, chained into one hash
+uint64_t NES_HashFrame(NES *nes)
+{
+    CPU *cpu = nes->cpu;
+    PPU *ppu = nes->ppu;
+
+    // Registers packed by hand, the struct has padding
+    uint8_t registers[15] = { cpu->a, cpu->x, cpu->y, cpu->sp, cpu->status, (uint8_t)cpu->pc, (uint8_t)(cpu->pc >> 8) };
+    for (int i = 0; i < 8; i++)
+        registers[7 + i] = (uint8_t)(cpu->total_cycles >> (i * 8));
+
+    uint64_t hash = HASH_Bytes(ppu->framebuffer, PPU_FRAMEBUFFER_WIDTH * PPU_FRAMEBUFFER_HEIGHT, 0);
+    hash = HASH_Bytes(ppu->line_emphasis, sizeof(ppu->line_emphasis), hash);
+    hash = HASH_Bytes(registers, sizeof(registers), hash);
+    return HASH_Bytes(nes->bus->ram, sizeof(nes->bus->ram), hash);
 }
 
 // Add NES_StepFrame function to run the NES for one frame
 void NES_StepFrame(NES *nes)
 {
+    if (nes->movie)
+        MOVIE_Frame(nes->movie);
+
     // Run until we enter the next frame
     int current_frame = nes->ppu->frame_odd;
     while (current_frame == nes->ppu->frame_odd) {
-        NES_Step(nes);
+        NES_PollNMI(nes);
+        NES_PollIRQ(nes);
+        NES_ScheduleVideo(nes);
+        NES_ScheduleIRQ(nes);
+
+        if (CPU_Run(nes->cpu, NES_NextDeadline(nes)) == -1) {
+            DEBUG_ERROR("CPU execution halted due to error");
+            nes->cpu->total_cycles = nes->cpu->run_until; // A jammed CPU still lets time pass
+        }
+
+        NES_SyncPPU(nes);
+    }
+
+    if (nes->hash_frames)
+        nes->frame_hash = NES_HashFrame(nes);
+
+    // Suspended while a movie runs, see BATTERY_Suspend
+    if (nes->battery)
+        BATTERY_Flush(nes->battery);
+}
+
+int NES_RunAhead(NES *nes, int frames)
+{
+    if (frames <= 0)
+    {
+        NES_StepFrame(nes);
+        return 0;
+    }
+
+    size_t state_size = NES_GetStateSize(nes);
+    if (state_size > nes->runahead_state_size)
+    {
+        uint8_t *state = realloc(nes->runahead_state, state_size);
+        if (!state)
+        {
+            DEBUG_ERROR("NES_RunAhead: Could not allocate %zu bytes", state_size);
+            NES_StepFrame(nes);
+            return -1;
+        }
+        nes->runahead_state = state;
+        nes->runahead_state_size = state_size;
+    }
+
+    // The real frame is never shown, only the last one ahead of it
+    nes->ppu->suppress_output = true;
+    NES_StepFrame(nes);
+    NES_SaveState(nes, nes->runahead_state, state_size);
+    int saved_line = nes->ppu->scanline >= 0 && nes->ppu->scanline < PPU_FRAMEBUFFER_HEIGHT ? nes->ppu->scanline : 0;
+
+    // Frames ahead aren't real, a movie or save file only sees the one above
+    MOVIE *movie = nes->movie;
+    BATTERY *battery = nes->battery;
+    nes->movie = NULL;
+    nes->battery = NULL;
+    for (int frame = 1; frame <= frames; frame++)
+    {
+        nes->ppu->suppress_output = frame < frames;
+        NES_StepFrame(nes);
+    }
+    nes->movie = movie;
+    nes->battery = battery;
+
+    // Loading puts back the framebuffer line that was being drawn when the state was saved
+    // and its emphasis slots, keep the shown frame's
+    PPU *ppu = nes->ppu;
+    uint8_t line[PPU_FRAMEBUFFER_WIDTH];
+    uint8_t emphasis[PPU_EMPHASIS_SLOTS];
+    uint8_t *row = &ppu->framebuffer[saved_line * PPU_FRAMEBUFFER_WIDTH];
+    uint8_t emphasis_count = ppu->line_emphasis_count[saved_line];
+    memcpy(line, row, sizeof(line));
+    memcpy(emphasis, ppu->line_emphasis[saved_line], sizeof(emphasis));
+    int result = NES_LoadState(nes, nes->runahead_state, state_size);
+    memcpy(row, line, sizeof(line));
+    memcpy(ppu->line_emphasis[saved_line], emphasis, sizeof(emphasis));
+    ppu->line_emphasis_count[saved_line] = emphasis_count;
+    return result;
+}
+
+void NES_FastForward(NES *nes, int frames)
+{
+    // Only the last frame is drawn, the ones before it still run the PPU for timing and status flags
+    for (int frame = 1; frame <= frames; frame++)
+    {
+        nes->ppu->suppress_output = frame < frames;
+        NES_StepFrame(nes);
     }
+    nes->ppu->suppress_output = false;
 }
 
 void NES_Reset(NES *nes) 
 {
-    CPU_Reset(nes->cpu);
     PPU_Reset(nes->ppu);
+    MAPPER_Reset(nes); // Before the CPU reads its reset vector, and after the PPU's mirroring is reset
+    CPU_Reset(nes->cpu);
+    nes->ppu->clock = nes->cpu->total_cycles * NES_PPU_DOTS_PER_CYCLE;
 
-    // Reset the BUS memory
-    memset(nes->bus->memory, 0, sizeof(nes->bus->memory));
+    // Reset the internal RAM
+    memset(nes->bus->ram, 0, sizeof(nes->bus->ram));
 
     // Reset controller states
     nes->controllers[0] = 0;
@@ -234,7 +480,34 @@ void NES_Reset(NES *nes)
 
 }
 
+void NES_SetFrameHashing(NES *nes, bool enabled)
+{
+    nes->hash_frames = enabled;
+}
+
+uint64_t NES_GetFrameHash(NES *nes)
+{
+    return nes->frame_hash;
+}
+
+int NES_GetTestStatus(NES *nes, const char **message)
+{
+    const uint8_t *ram = nes->bus->prg_ram;
+    if (ram[1] != 0xDE || ram[2] != 0xB0 || ram[3] != 0x61)
+        return -1;
+
+    // A message that isn't terminated yet is still being written
+    if (message)
+        *message = memchr(ram + 4, 0, sizeof(nes->bus->prg_ram) - 4) ? (const char *)ram + 4 : "";
+    return ram[0];
+}
+
 // Poll controller state (returns the current state of the specified controller)
+const uint8_t* NES_GetFramebuffer(NES *nes)
+{
+    return PPU_GetFramebuffer(nes->ppu);
+}
+
 uint8_t NES_PollController(NES* nes, int controller)
 {
     return nes->controllers[controller];
@@ -3,35 +3,21 @@
 #include <string.h>
 #include <stdint.h>
 #include <stdbool.h>
-#include <malloc.h>
 #include <math.h> // For fabsf in scalar color emphasis, or general float math
-
-
-#ifdef __AVX2__ //AVX2
-
-#elif defined ( __AVX__ ) //AVX
-
-#elif (defined(_M_AMD64) || defined(_M_X64)) //SSE2 x64
-
-#define PPU_USE_SIMD_COLOR_EMPHASIS
-
-#elif _M_IX86_FP == 2 //SSE2 x32
-
-#define PPU_USE_SIMD_COLOR_EMPHASIS
-
-#elif _M_IX86_FP == 1 //SSE x32
-
-#else
-//nothing
+#include <stdatomic.h>
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define PPU_CONVERT_AVX2 // Built for every x86 target, picked at runtime when the CPU has AVX2
+#include <immintrin.h> // Gathers for PPU_ConvertFramebuffer
+#if defined(_MSC_VER)
+#include <intrin.h>
 #endif
-
-#ifdef PPU_USE_SIMD_COLOR_EMPHASIS
-#include <emmintrin.h> // SSE2 intrinsics
 #endif
 
+
 #include "debug.h"    // Assuming debug logging is desired
 #include "cNES/nes.h" // Assuming NES structure is needed
 #include "cNES/bus.h" // Assuming BUS access is needed
+#include "cNES/mapper.h"
 
 #include "cNES/ppu.h" // Header for PPU struct, MirrorMode, PPUSTATUS/PPUCTRL/PPUMASK bits
 
@@ -255,9 +241,8 @@ static void fetch_sprite_patterns(PPU *ppu) {
 }
 
 // --- Color Emphasis Helpers ---
-#ifndef PPU_USE_SIMD_COLOR_EMPHASIS
-// Scalar version using floating point for clarity on the emphasis model
-static inline uint32_t apply_color_emphasis(uint32_t color_val, uint8_t ppu_mask) {
+// Only used to bake the emphasis palettes, so floating point is fine here
+static uint32_t apply_color_emphasis(uint32_t color_val, uint8_t ppu_mask) {
     if (!(ppu_mask & (PPUMASK_EMPHASIZE_RED | PPUMASK_EMPHASIZE_GREEN | PPUMASK_EMPHASIZE_BLUE))) {
         return color_val;
     }
@@ -297,109 +282,44 @@ static inline uint32_t apply_color_emphasis(uint32_t color_val, uint8_t ppu_mask
     
     return (R_final << 24) | (G_final << 16) | (B_final << 8) | a;
 }
-#else // PPU_USE_SIMD_COLOR_EMPHASIS
-// SIMD (SSE2) version using fixed-point arithmetic
-static inline uint32_t apply_color_emphasis(uint32_t color_val, uint8_t ppu_mask) {
-    if (!(ppu_mask & (PPUMASK_EMPHASIZE_RED | PPUMASK_EMPHASIZE_GREEN | PPUMASK_EMPHASIZE_BLUE))) {
-        return color_val;
-    }
-
-    // color_val is 0xRRGGBBAA. SSE2 deals with it as little-endian, so bytes are A,B,G,R in memory.
-    __m128i color_vec = _mm_cvtsi32_si128(color_val); // Loads color_val into the low 32 bits of an XMM register.
-                                                     // In memory order for the XMM reg: [AA, BB, GG, RR, 0, ...]
-
-    // Unpack 8-bit components to 16-bit components for multiplication room.
-    // Input bytes: val[0]=AA, val[1]=BB, val[2]=GG, val[3]=RR
-    // Output words: {AA,0, BB,0, GG,0, RR,0 ...}
-    color_vec = _mm_unpacklo_epi8(color_vec, _mm_setzero_si128()); // Now holds [A, B, G, R] as 16-bit words (alpha, blue, green, red)
 
-    // Attenuation factor: 192 represents 192/256 = 0.75
-    // Normal factor: 256 represents 256/256 = 1.0
-    const uint16_t factor_attenuate = 192;
-    const uint16_t factor_normal = 256;
-
-    uint16_t r_f = factor_normal, g_f = factor_normal, b_f = factor_normal;
-    // Alpha component (at index 0 in color_vec words) is not affected, its factor is always 256.
-
-    if (ppu_mask & PPUMASK_EMPHASIZE_RED) {
-        g_f = (uint16_t)(((uint32_t)g_f * factor_attenuate) / factor_normal);
-        b_f = (uint16_t)(((uint32_t)b_f * factor_attenuate) / factor_normal);
-    }
-    if (ppu_mask & PPUMASK_EMPHASIZE_GREEN) {
-        r_f = (uint16_t)(((uint32_t)r_f * factor_attenuate) / factor_normal);
-        b_f = (uint16_t)(((uint32_t)b_f * factor_attenuate) / factor_normal);
-    }
-    if (ppu_mask & PPUMASK_EMPHASIZE_BLUE) {
-        r_f = (uint16_t)(((uint32_t)r_f * factor_attenuate) / factor_normal);
-        g_f = (uint16_t)(((uint32_t)g_f * factor_attenuate) / factor_normal);
+// Bakes the master palette under each of the 8 PPUMASK emphasis combinations
+static void ppu_build_emphasis_palettes(PPU *ppu) {
+    for (int emphasis = 0; emphasis < 8; ++emphasis) {
+        for (int color = 0; color < 64; ++color) {
+            ppu->emphasis_palettes[emphasis][color] = apply_color_emphasis(ppu->master_palette[color], (uint8_t)(emphasis << 5));
+        }
     }
+}
 
-    // Factors in XMM register, matching component order A, B, G, R (lowest to highest words)
-    __m128i factors = _mm_set_epi16(
-        0, 0, 0, 0,      // High 4 words unused
-        r_f, g_f, b_f, factor_normal // Factors for R, G, B, A (order from high word to low word)
-    );
-    
-    // Multiply components by factors: (component * factor)
-    color_vec = _mm_mullo_epi16(color_vec, factors);
-    // Divide by 256 (effectively scaling back after fixed-point multiplication)
-    color_vec = _mm_srli_epi16(color_vec, 8);
-
-    // Pack 16-bit words back to 8-bit bytes with saturation.
-    // Result: {A,B,G,R, A,B,G,R, ...} in bytes.
-    color_vec = _mm_packus_epi16(color_vec, color_vec); 
 
-    return _mm_cvtsi128_si32(color_vec); // Extract the low 32 bits (AABBGGRR)
+// Every scanline starts out with the emphasis PPUMASK has at its first pixel
+static inline void ppu_begin_line_emphasis(PPU *ppu) {
+    ppu->line_emphasis[ppu->scanline][0] = ppu->mask >> 5;
+    ppu->line_emphasis_count[ppu->scanline] = 1;
+    ppu->pixel_tag = 0;
 }
-#endif // PPU_USE_SIMD_COLOR_EMPHASIS
 
+// Tags the rest of the line with new emphasis bits, past the last slot it overwrites that one
+static void ppu_split_line_emphasis(PPU *ppu, uint8_t emphasis) {
+    uint8_t slot = ppu->line_emphasis_count[ppu->scanline];
+    if (slot < PPU_EMPHASIS_SLOTS) {
+        ppu->line_emphasis_count[ppu->scanline]++;
+    } else {
+        slot = PPU_EMPHASIS_SLOTS - 1;
+    }
+    ppu->line_emphasis[ppu->scanline][slot] = emphasis;
+    ppu->pixel_tag = (uint8_t)(slot << 6);
+}
 
 // --- PPU API Implementation ---
-PPU *PPU_Create(NES *nes) {
-    PPU *ppu = calloc(1, sizeof(PPU));
-    if (!ppu) {
-        DEBUG_ERROR("PPU_Create: Failed to allocate memory for PPU.");
-        return NULL;
-    }
+void PPU_Init(PPU *ppu, NES *nes, uint8_t *framebuffer) {
     ppu->nes = nes;
+    ppu->framebuffer = framebuffer;
+    memset(ppu->framebuffer, 0, PPU_FRAMEBUFFER_WIDTH * PPU_FRAMEBUFFER_HEIGHT);
 
-    // Allocate framebuffer with alignment for potential SIMD operations
-    size_t framebuffer_size = PPU_FRAMEBUFFER_WIDTH * PPU_FRAMEBUFFER_HEIGHT * sizeof(uint32_t);
-
-#if defined(_MSC_VER)
-    #include <stdlib.h> // Ensure aligned_alloc is declared
-    ppu->framebuffer = _aligned_alloc(16, framebuffer_size);
-#elif __STDC_VERSION__ >= 201112L
-    ppu->framebuffer = _aligned_malloc(framebuffer_size, 16);
-#else
-    // Fallback: use regular calloc, alignment not guaranteed but often works for 16-bytes on modern systems.
-    // Or use posix_memalign if available.
-    ppu->framebuffer = calloc(PPU_FRAMEBUFFER_WIDTH * PPU_FRAMEBUFFER_HEIGHT, sizeof(uint32_t));
-    DEBUG_WARN("PPU_Create: Using calloc for framebuffer, 16-byte alignment not guaranteed without C11 or MSVC specifics.");
-#endif
-    if (!ppu->framebuffer) {
-        DEBUG_ERROR("PPU_Create: Failed to allocate memory for framebuffer.");
-        free(ppu);
-        return NULL;
-    }
-    memset(ppu->framebuffer, 0, framebuffer_size);
-
-
+    PPU_SetPalette(ppu, NULL);
     PPU_Reset(ppu);
-    return ppu;
-}
-
-void PPU_Destroy(PPU *ppu) {
-    if (ppu) {
-        if (ppu->framebuffer) {
-#if defined(_MSC_VER) && !(__STDC_VERSION__ >= 201112L) // Use _aligned_free if _aligned_malloc was used
-            _aligned_free(ppu->framebuffer);
-#else // Standard free for aligned_alloc or calloc
-            free(ppu->framebuffer);
-#endif
-        }
-        free(ppu);
-    }
 }
 
 void PPU_Reset(PPU *ppu) {
@@ -424,6 +344,7 @@ void PPU_Reset(PPU *ppu) {
     ppu->scanline = 261; 
     ppu->cycle = 0;
     ppu->frame_odd = false; 
+    ppu->clock = 0;
 
     ppu->nmi_occured = false;
     ppu->nmi_output = false; 
@@ -443,8 +364,8 @@ void PPU_Reset(PPU *ppu) {
     ppu->sprite_zero_found_for_next_scanline = false;
     memset(ppu->sprite_shifters, 0, sizeof(ppu->sprite_shifters));
     
-    // Framebuffer is cleared in PPU_Create, not reset usually, unless explicitly needed.
-    // memset(ppu->framebuffer, 0, PPU_FRAMEBUFFER_WIDTH * PPU_FRAMEBUFFER_HEIGHT * sizeof(uint32_t));
+    // Framebuffer is cleared in PPU_Init, not reset usually, unless explicitly needed.
+    // memset(ppu->framebuffer, 0, PPU_FRAMEBUFFER_WIDTH * PPU_FRAMEBUFFER_HEIGHT);
 
     ppu->mirror_mode = MIRROR_HORIZONTAL; 
 }
@@ -500,6 +421,10 @@ void PPU_WriteRegister(PPU *ppu, uint16_t addr, uint8_t value) {
             break;
 
         case 0x0001: // PPUMASK ($2001)
+            // Emphasis changing after the line's first pixel gets its own slot
+            if (((ppu->mask ^ value) & 0xE0) && ppu->scanline <= 239 && ppu->cycle >= 2 && ppu->cycle <= 256) {
+                ppu_split_line_emphasis(ppu, value >> 5);
+            }
             ppu->mask = value;
             break;
 
@@ -569,7 +494,31 @@ void PPU_SetMirroring(PPU *ppu, MirrorMode mode) {
     ppu->mirror_mode = mode;
 }
 
-void PPU_Step(PPU *ppu) {
+// Mappers with a scanline counter (MMC3) see it clocked once per rendered line, at dot 260
+static inline void ppu_clock_mapper(PPU *ppu) {
+    const MAPPER *mapper = ppu->nes->mapper;
+    if (mapper && mapper->scanline) {
+        mapper->scanline(ppu->nes);
+    }
+}
+
+// Advances to dot 0 of the next scanline, wrapping to the next frame after the pre-render line
+static inline void ppu_next_scanline(PPU *ppu, bool rendering_enabled) {
+    ppu->cycle = 0;
+    ppu->scanline++;
+
+    if (ppu->scanline == 261 && ppu->frame_odd && rendering_enabled && (ppu->mask & PPUMASK_SHOW_BG)) { // Odd frame, BG enabled
+        ppu->cycle = 1; // Skip cycle 0 (dummy NT fetch)
+    }
+    
+    if (ppu->scanline > 261) { 
+        ppu->scanline = 0;     
+        ppu->frame_odd = !ppu->frame_odd; 
+    }
+}
+
+// Runs a single dot, without advancing ppu->clock
+static inline void ppu_dot(PPU *ppu) {
     bool rendering_enabled = (ppu->mask & PPUMASK_SHOW_BG) || (ppu->mask & PPUMASK_SHOW_SPRITES);
 
     if (ppu->scanline == 261) { // Pre-render line
@@ -610,6 +559,10 @@ void PPU_Step(PPU *ppu) {
             increment_fine_y(ppu);
         }
 
+        if (ppu->cycle == 260) {
+            ppu_clock_mapper(ppu);
+        }
+
         if (ppu->cycle == 257) {
             copy_horizontal_bits(ppu);
             if (ppu->scanline <= 239) { // Evaluate sprites for the *next* scanline, but data is for current render pass
@@ -628,6 +581,9 @@ void PPU_Step(PPU *ppu) {
     if (ppu->scanline <= 239 && ppu->cycle >= 1 && ppu->cycle <= 256) {
         int x = ppu->cycle - 1; 
         int y = ppu->scanline;  
+        if (x == 0) {
+            ppu_begin_line_emphasis(ppu);
+        }
 
         uint8_t bg_pixel_pattern_val = 0;
         uint8_t bg_palette_idx = 0;
@@ -710,10 +666,9 @@ void PPU_Step(PPU *ppu) {
             combined_color_idx = final_bg_color_idx;
         }
         
-        uint32_t final_pixel_color = nes_palette[combined_color_idx];
-        final_pixel_color = apply_color_emphasis(final_pixel_color, ppu->mask);
-        
-        ppu->framebuffer[y * PPU_FRAMEBUFFER_WIDTH + x] = final_pixel_color;
+        if (!ppu->suppress_output) {
+            ppu->framebuffer[y * PPU_FRAMEBUFFER_WIDTH + x] = combined_color_idx | ppu->pixel_tag;
+        }
     }
 
 
@@ -729,17 +684,187 @@ void PPU_Step(PPU *ppu) {
 
     ppu->cycle++;
     if (ppu->cycle > 340) { 
-        ppu->cycle = 0;
-        ppu->scanline++;
+        ppu_next_scanline(ppu, rendering_enabled);
+    }
+}
+
+// Number of dots from the current one to the end of the scanline during which
+// nothing observable happens, 0 if the current dot does work. Covers the post-render
+// and vblank lines (apart from setting vblank at 241,1) and, with rendering off,
+// everything after the visible pixels.
+static inline int ppu_idle_dots(const PPU *ppu, bool rendering_enabled) {
+    if (ppu->scanline >= 240 && ppu->scanline <= 260) {
+        if (ppu->scanline == 241 && ppu->cycle <= 1) return 0;
+        return 341 - ppu->cycle;
+    }
+    if (!rendering_enabled) {
+        if (ppu->scanline <= 239 && ppu->cycle > 256) return 341 - ppu->cycle;
+        if (ppu->scanline == 261 && ppu->cycle > 1) return 341 - ppu->cycle;
+    }
+    return 0;
+}
 
-        if (ppu->scanline == 261 && ppu->frame_odd && rendering_enabled && (ppu->mask & PPUMASK_SHOW_BG)) { // Odd frame, BG enabled
-            ppu->cycle = 1; // Skip cycle 0 (dummy NT fetch)
+// --- Scanline Renderer ---
+// When nothing can touch the PPU before a visible line ends, the whole line is
+// rendered in one go. It produces the same pixels and leaves the same state as
+// running dots 0-340 one at a time. A CPU access always catches the PPU up first,
+// so sprite-0 hit and overflow set anywhere in the line can't be observed early.
+
+// Fetches one background tile and runs the 8 dots it takes to shift it in (x%8 == 1 .. 0)
+static inline void ppu_fetch_tile(PPU *ppu) {
+    load_background_tile_data(ppu);
+    ppu->bg_pattern_shift_low = (uint16_t)(ppu->bg_pattern_shift_low << 8);
+    ppu->bg_pattern_shift_high = (uint16_t)(ppu->bg_pattern_shift_high << 8);
+    ppu->bg_attrib_shift_low = (uint16_t)(ppu->bg_attrib_shift_low << 8);
+    ppu->bg_attrib_shift_high = (uint16_t)(ppu->bg_attrib_shift_high << 8);
+    feed_background_shifters(ppu);
+    increment_coarse_x(ppu);
+}
+
+// Sprite line entries hold the palette index in the low byte and these flags above it
+#define PPU_SPRITE_PIXEL_OPAQUE 0x100 // Sprite covers this pixel
+#define PPU_SPRITE_PIXEL_BEHIND 0x200 // Sprite has background priority
+#define PPU_SPRITE_PIXEL_ZERO   0x400 // Pixel comes from sprite 0
+
+// Flattens the line's sprite shifters into one entry per pixel, lowest index wins
+static inline void ppu_build_sprite_line(PPU *ppu, uint16_t *line) {
+    memset(line, 0, PPU_FRAMEBUFFER_WIDTH * sizeof(uint16_t));
+    for (int i = ppu->sprite_count_current_scanline - 1; i >= 0; --i) {
+        SpriteShifter *s = &ppu->sprite_shifters[i];
+        for (int col = 0; col < 8 && s->x_pos + col < PPU_FRAMEBUFFER_WIDTH; ++col) {
+            int bit = (s->attributes & 0x40) ? col : 7 - col; // Horizontal flip
+            uint8_t value = (uint8_t)((((s->pattern_high >> bit) & 1) << 1) | ((s->pattern_low >> bit) & 1));
+            if (value == 0) continue;
+
+            uint8_t color = ppu->palette[0x10 + ((s->attributes & 0x03) << 2) + value] & 0x3F;
+            line[s->x_pos + col] = color | PPU_SPRITE_PIXEL_OPAQUE |
+                                   ((s->attributes & 0x20) ? PPU_SPRITE_PIXEL_BEHIND : 0) |
+                                   (s->original_oam_index == 0 ? PPU_SPRITE_PIXEL_ZERO : 0);
         }
-        
-        if (ppu->scanline > 261) { 
-            ppu->scanline = 0;     
-            ppu->frame_odd = !ppu->frame_odd; 
+    }
+}
+
+// True if sprite 0 is on this line and could still set the hit flag
+static inline bool ppu_sprite_zero_pending(PPU *ppu) {
+    if ((ppu->status & PPUSTATUS_SPRITE_0_HIT) || !(ppu->mask & PPUMASK_SHOW_BG)) return false;
+    for (int i = 0; i < ppu->sprite_count_current_scanline; ++i) {
+        if (ppu->sprite_shifters[i].original_oam_index == 0) return true;
+    }
+    return false;
+}
+
+// Runs dots 0-340 of a visible scanline with rendering enabled
+static void ppu_render_scanline(PPU *ppu) {
+    uint8_t discard[PPU_FRAMEBUFFER_WIDTH];
+    uint8_t *out = ppu->suppress_output ? discard : &ppu->framebuffer[ppu->scanline * PPU_FRAMEBUFFER_WIDTH];
+    uint16_t sprite_line[PPU_FRAMEBUFFER_WIDTH];
+    ppu_begin_line_emphasis(ppu);
+    bool show_bg = ppu->mask & PPUMASK_SHOW_BG;
+    bool show_sprites = (ppu->mask & PPUMASK_SHOW_SPRITES) && ppu->sprite_count_current_scanline > 0;
+
+    // Without output the pixels only matter for sprite 0 hit, the fetches still have to happen
+    if (ppu->suppress_output && !(show_sprites && ppu_sprite_zero_pending(ppu))) {
+        for (int tile = 0; tile < 32; ++tile) {
+            ppu_fetch_tile(ppu);
+        }
+        goto line_end;
+    }
+
+    if (show_sprites) {
+        ppu_build_sprite_line(ppu, sprite_line);
+    }
+
+    // Dots 1-256: a tile's pixels come out of the shifters while the next tile is fetched
+    for (int tile = 0; tile < 32; ++tile) {
+        uint16_t pattern_low = ppu->bg_pattern_shift_low, pattern_high = ppu->bg_pattern_shift_high;
+        uint16_t attrib_low = ppu->bg_attrib_shift_low, attrib_high = ppu->bg_attrib_shift_high;
+
+        for (int i = 0; i < 8; ++i) {
+            int x = tile * 8 + i;
+            int bit = 14 - ppu->fine_x - i; // Shifted once more on the pixel's own dot
+
+            uint8_t bg_value = 0, bg_palette = 0;
+            bool bg_visible = show_bg && (x >= 8 || !(ppu->mask & PPUMASK_CLIP_BG));
+            if (bg_visible) {
+                bg_value = (uint8_t)((((pattern_high >> bit) & 1) << 1) | ((pattern_low >> bit) & 1));
+                bg_palette = (uint8_t)((((attrib_high >> bit) & 1) << 1) | ((attrib_low >> bit) & 1));
+            }
+            uint8_t color = (bg_value == 0 ? ppu->palette[0] : ppu->palette[(bg_palette << 2) + bg_value]) & 0x3F;
+
+            if (show_sprites && (sprite_line[x] & PPU_SPRITE_PIXEL_OPAQUE) &&
+                (x >= 8 || !(ppu->mask & PPUMASK_CLIP_SPRITES))) {
+                uint16_t sprite = sprite_line[x];
+                if ((sprite & PPU_SPRITE_PIXEL_ZERO) && bg_value != 0 && x < 255) {
+                    ppu->status |= PPUSTATUS_SPRITE_0_HIT;
+                }
+                if (bg_value == 0 || !(sprite & PPU_SPRITE_PIXEL_BEHIND)) {
+                    color = (uint8_t)(sprite & 0x3F);
+                }
+            }
+
+            out[x] = color;
+        }
+
+        ppu_fetch_tile(ppu);
+    }
+
+line_end:
+    increment_fine_y(ppu); // Dot 256
+
+    // Dot 257: sprites for the next line, dot 321: their patterns and the first two tiles
+    copy_horizontal_bits(ppu);
+    evaluate_sprites(ppu);
+    fetch_sprite_patterns(ppu);
+    ppu_fetch_tile(ppu);
+    ppu_fetch_tile(ppu);
+}
+
+// Runs dots 1-256 of a visible scanline with rendering disabled, every pixel is the backdrop
+static void ppu_render_blank_scanline(PPU *ppu) {
+    ppu_begin_line_emphasis(ppu);
+    if (!ppu->suppress_output) {
+        memset(&ppu->framebuffer[ppu->scanline * PPU_FRAMEBUFFER_WIDTH], ppu->palette[0] & 0x3F, PPU_FRAMEBUFFER_WIDTH);
+    }
+}
+
+void PPU_Step(PPU *ppu) {
+    ppu_dot(ppu);
+    ppu->clock++;
+}
+
+void PPU_CatchUp(PPU *ppu, uint64_t clock) {
+    while (ppu->clock < clock) {
+        bool rendering_enabled = (ppu->mask & PPUMASK_SHOW_BG) || (ppu->mask & PPUMASK_SHOW_SPRITES);
+
+        // Whole visible lines that end before the target are rendered at once,
+        // lines a register access lands in run dot by dot
+        if (ppu->scanline <= 239 && ppu->cycle == 0 && clock - ppu->clock >= 341) {
+            if (rendering_enabled) {
+                ppu_render_scanline(ppu);
+                ppu_clock_mapper(ppu); // Its dot 260 went by in the line
+                ppu_next_scanline(ppu, rendering_enabled);
+                ppu->clock += 341;
+            } else {
+                ppu_render_blank_scanline(ppu);
+                ppu->cycle = 257; // The rest of the line is idle
+                ppu->clock += 257;
+            }
+            continue;
         }
+
+        int idle = ppu_idle_dots(ppu, rendering_enabled);
+        if (idle) {
+            // Jump over the idle stretch instead of running it dot by dot
+            if ((uint64_t)idle > clock - ppu->clock) idle = (int)(clock - ppu->clock);
+            ppu->cycle += idle;
+            ppu->clock += (uint64_t)idle;
+            if (ppu->cycle > 340) {
+                ppu_next_scanline(ppu, rendering_enabled);
+            }
+            continue;
+        }
+        ppu_dot(ppu);
+        ppu->clock++;
     }
 }
 
@@ -758,6 +883,122 @@ const uint32_t* PPU_GetPalette(void) {
     return nes_palette;
 }
 
+void PPU_SetPalette(PPU *ppu, const uint32_t *palette) {
+    memcpy(ppu->master_palette, palette ? palette : nes_palette, sizeof(ppu->master_palette));
+    ppu_build_emphasis_palettes(ppu);
+}
+
+const uint8_t* PPU_GetFramebuffer(PPU *ppu) {
+    return ppu->framebuffer;
+}
+
+// --- Framebuffer conversion ---
+static inline uint32_t ppu_convert_color(uint32_t rgba, PPU_PixelFormat format) {
+    switch (format) {
+        case PPU_PIXEL_FORMAT_AABBGGRR:
+            return ((rgba & 0xFF) << 24) | ((rgba & 0xFF00) << 8) | ((rgba >> 8) & 0xFF00) | (rgba >> 24);
+        case PPU_PIXEL_FORMAT_AARRGGBB:
+            return (rgba >> 8) | (rgba << 24);
+        case PPU_PIXEL_FORMAT_RGB565:
+            return ((rgba >> 16) & 0xF800) | ((rgba >> 13) & 0x07E0) | ((rgba >> 11) & 0x001F);
+        case PPU_PIXEL_FORMAT_RRGGBBAA:
+        default:
+            return rgba;
+    }
+}
+
+// Looks up one line of indices
+static void ppu_convert_line32_scalar(const uint8_t *src, uint32_t *dst, const uint32_t *lut) {
+    for (int x = 0; x < PPU_FRAMEBUFFER_WIDTH; ++x) {
+        dst[x] = lut[src[x]];
+    }
+}
+
+#if defined(PPU_CONVERT_AVX2)
+// 8 pixels per gather. GCC and Clang compile just this function for AVX2, MSVC always can
+#if !defined(_MSC_VER)
+__attribute__((target("avx2")))
+#endif
+static void ppu_convert_line32_avx2(const uint8_t *src, uint32_t *dst, const uint32_t *lut) {
+    for (int x = 0; x < PPU_FRAMEBUFFER_WIDTH; x += 8) {
+        __m256i idx = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)(src + x)));
+        _mm256_storeu_si256((__m256i *)(dst + x), _mm256_i32gather_epi32((const int *)lut, idx, 4));
+    }
+}
+
+static bool ppu_cpu_has_avx2(void) {
+#if defined(_MSC_VER)
+    // AVX2 needs the CPU to have it and the OS to save the YMM registers
+    int regs[4];
+    __cpuid(regs, 0);
+    if (regs[0] < 7)
+        return false;
+    __cpuid(regs, 1);
+    if (!(regs[2] & (1 << 27)) || !(regs[2] & (1 << 28)) || (_xgetbv(0) & 6) != 6)
+        return false;
+    __cpuidex(regs, 7, 0);
+    return (regs[1] & (1 << 5)) != 0;
+#else
+    return __builtin_cpu_supports("avx2");
+#endif
+}
+#endif
+
+typedef void (*ppu_convert_line32_fn)(const uint8_t *src, uint32_t *dst, const uint32_t *lut);
+
+// Chosen on the first conversion, every thread picks the same one
+static ppu_convert_line32_fn ppu_select_convert_line32(void) {
+    static _Atomic(ppu_convert_line32_fn) selected;
+    ppu_convert_line32_fn convert = atomic_load(&selected);
+    if (!convert) {
+        convert = ppu_convert_line32_scalar;
+#if defined(PPU_CONVERT_AVX2)
+        if (ppu_cpu_has_avx2())
+            convert = ppu_convert_line32_avx2;
+#endif
+        atomic_store(&selected, convert);
+    }
+    return convert;
+}
+
+void PPU_ConvertFramebuffer(const PPU *ppu, void *pixels, size_t pitch, PPU_PixelFormat format) {
+    uint32_t palettes[8][64];
+    uint32_t line_lut[PPU_EMPHASIS_SLOTS * 64];
+    uint8_t lut_emphasis[PPU_EMPHASIS_SLOTS];
+    ppu_convert_line32_fn convert_line32 = ppu_select_convert_line32();
+
+    for (int e = 0; e < 8; ++e) {
+        for (int i = 0; i < 64; ++i) {
+            palettes[e][i] = ppu_convert_color(ppu->emphasis_palettes[e][i], format);
+        }
+    }
+
+    for (int y = 0; y < PPU_FRAMEBUFFER_HEIGHT; ++y) {
+        const uint8_t *src = &ppu->framebuffer[y * PPU_FRAMEBUFFER_WIDTH];
+        uint8_t *dst = (uint8_t *)pixels + (size_t)y * pitch;
+
+        // Every pixel indexes the whole LUT with its slot bits, so all slots are filled.
+        // Slots the line doesn't use (no tag should name them) get slot 0's palette.
+        // Neighbouring lines almost always match, only slots that changed are copied
+        for (int slot = 0; slot < PPU_EMPHASIS_SLOTS; ++slot) {
+            uint8_t emphasis = ppu->line_emphasis[y][slot < ppu->line_emphasis_count[y] ? slot : 0] & 7;
+            if (y == 0 || lut_emphasis[slot] != emphasis) {
+                memcpy(&line_lut[slot * 64], palettes[emphasis], sizeof(palettes[0]));
+                lut_emphasis[slot] = emphasis;
+            }
+        }
+
+        if (format == PPU_PIXEL_FORMAT_RGB565) {
+            uint16_t *out = (uint16_t *)dst;
+            for (int x = 0; x < PPU_FRAMEBUFFER_WIDTH; ++x) {
+                out[x] = (uint16_t)line_lut[src[x]];
+            }
+        } else {
+            convert_line32(src, (uint32_t *)dst, line_lut);
+        }
+    }
+}
+
 // --- Expose pattern table data ---
 void PPU_GetPatternTableData(PPU* ppu, int table_idx, uint8_t* buffer_128x128_indexed_pixels) {
     uint16_t base_addr = (table_idx == 0) ? 0x0000 : 0x1000;
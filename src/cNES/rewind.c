@@ -0,0 +1,466 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "debug.h"
+#include "cNES/nes.h"
+
+#include "cNES/rewind.h"
+
+// A snapshot in the ring. Its bytes are the inputs of the frames that follow it
+// (2 per frame, interval frames) and then the encoded state.
+typedef struct REWIND_Entry {
+    size_t offset;        // Start of the entry in data
+    size_t size;          // Inputs plus encoded state
+    size_t encoded_size;  // Encoded state only
+    uint64_t frame;       // Frame the snapshot was taken after
+    uint32_t input_count; // Frames recorded after the snapshot so far
+    uint8_t keyframe;     // Encoded against nothing rather than the previous keyframe
+} REWIND_Entry;
+
+struct REWIND {
+    NES *nes;
+    int interval;
+    int keyframe_interval;
+
+    // Ring of entry bytes
+    uint8_t *data;
+    size_t data_size;
+    size_t memory_used;
+
+    // Entries oldest first, circular
+    REWIND_Entry *entries;
+    size_t entry_capacity;
+    size_t entry_first;
+    size_t entry_count;
+
+    // Scratch sized for one save state
+    size_t state_size;
+    uint8_t *state;
+    uint8_t *encoded;  // Worst case encoding of a state
+
+    // Newest keyframe, deltas are encoded against it
+    uint8_t *keyframe;
+    int keyframe_valid;
+    uint64_t keyframe_frame;
+    int since_keyframe; // Snapshots taken since (and including) the keyframe
+
+    uint64_t frame; // Frames since the history started
+};
+
+// --- Delta encoding ---
+// The XOR of a state against its reference is mostly zeros. It is stored as
+// pairs of (zero run, literal run) lengths as LEB128, each literal run followed
+// by its bytes. Literal runs only end at 4 or more zeros, so the worst case
+// output stays within 2x the input.
+
+static inline uint8_t *REWIND_PutLength(uint8_t *out, size_t value)
+{
+    while (value >= 0x80)
+    {
+        *out++ = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+    *out++ = (uint8_t)value;
+    return out;
+}
+
+static inline const uint8_t *REWIND_GetLength(const uint8_t *in, size_t *value)
+{
+    size_t result = 0;
+    int shift = 0;
+    uint8_t byte;
+    do
+    {
+        byte = *in++;
+        result |= (size_t)(byte & 0x7F) << shift;
+        shift += 7;
+    } while (byte & 0x80);
+    *value = result;
+    return in;
+}
+
+// Encodes state XOR reference (NULL meaning all zeros), returns the encoded size
+static size_t REWIND_Encode(const uint8_t *state, const uint8_t *reference, size_t size, uint8_t *out)
+{
+    uint8_t *start = out;
+    size_t i = 0;
+    while (i < size)
+    {
+        size_t zeros = i;
+        while (i < size && (state[i] ^ (reference ? reference[i] : 0)) == 0)
+            i++;
+        if (i == size)
+            break;
+        zeros = i - zeros;
+
+        // Literal run, ends at the first 4 zero bytes in a row
+        size_t literal = i;
+        size_t zero_run = 0;
+        while (i < size && zero_run < 4)
+        {
+            zero_run = (state[i] ^ (reference ? reference[i] : 0)) ? 0 : zero_run + 1;
+            i++;
+        }
+        i -= zero_run;
+        size_t length = i - literal;
+
+        out = REWIND_PutLength(out, zeros);
+        out = REWIND_PutLength(out, length);
+        for (size_t j = 0; j < length; j++)
+            *out++ = state[literal + j] ^ (reference ? reference[literal + j] : 0);
+    }
+    return (size_t)(out - start);
+}
+
+// XORs an encoded delta into state
+static void REWIND_Apply(uint8_t *state, const uint8_t *in, size_t encoded_size)
+{
+    const uint8_t *end = in + encoded_size;
+    size_t position = 0;
+    while (in < end)
+    {
+        size_t zeros, length;
+        in = REWIND_GetLength(in, &zeros);
+        in = REWIND_GetLength(in, &length);
+        position += zeros;
+        for (size_t j = 0; j < length; j++)
+            state[position + j] ^= in[j];
+        in += length;
+        position += length;
+    }
+}
+
+// --- Entry ring ---
+
+static inline REWIND_Entry *REWIND_GetEntry(REWIND *rewind, size_t index)
+{
+    return &rewind->entries[(rewind->entry_first + index) % rewind->entry_capacity];
+}
+
+static inline uint8_t *REWIND_GetInputs(REWIND *rewind, const REWIND_Entry *entry)
+{
+    return rewind->data + entry->offset;
+}
+
+static inline uint8_t *REWIND_GetEncoded(REWIND *rewind, const REWIND_Entry *entry)
+{
+    return rewind->data + entry->offset + (size_t)rewind->interval * 2;
+}
+
+static void REWIND_DropOldest(REWIND *rewind)
+{
+    REWIND_Entry *entry = REWIND_GetEntry(rewind, 0);
+    if (entry->keyframe && entry->frame == rewind->keyframe_frame)
+        rewind->keyframe_valid = 0;
+    rewind->memory_used -= entry->size;
+    rewind->entry_first = (rewind->entry_first + 1) % rewind->entry_capacity;
+    rewind->entry_count--;
+}
+
+static void REWIND_DropNewest(REWIND *rewind)
+{
+    REWIND_Entry *entry = REWIND_GetEntry(rewind, rewind->entry_count - 1);
+    rewind->memory_used -= entry->size;
+    rewind->entry_count--;
+}
+
+// Drops the oldest entry, and the deltas after it that needed it as their keyframe
+static void REWIND_DropOldestGroup(REWIND *rewind)
+{
+    REWIND_DropOldest(rewind);
+    while (rewind->entry_count && !REWIND_GetEntry(rewind, 0)->keyframe)
+        REWIND_DropOldest(rewind);
+}
+
+// True if any entry holds bytes in [start, end)
+static int REWIND_Overlaps(REWIND *rewind, size_t start, size_t end)
+{
+    for (size_t i = 0; i < rewind->entry_count; i++)
+    {
+        const REWIND_Entry *entry = REWIND_GetEntry(rewind, i);
+        if (entry->offset < end && entry->offset + entry->size > start)
+            return 1;
+    }
+    return 0;
+}
+
+// Finds room for size bytes after the newest entry, dropping the oldest entries
+// until nothing overlaps it. Deltas whose keyframe got dropped go with it.
+static int REWIND_Allocate(REWIND *rewind, size_t size, size_t *offset)
+{
+    if (size > rewind->data_size)
+        return -1;
+
+    size_t start = 0;
+    if (rewind->entry_count)
+    {
+        REWIND_Entry *newest = REWIND_GetEntry(rewind, rewind->entry_count - 1);
+        start = newest->offset + newest->size;
+        if (start + size > rewind->data_size)
+        {
+            // Wrapping to the front: everything from the newest entry to the end of
+            // the ring is older than the entries at the front, so it goes first
+            while (rewind->entry_count && REWIND_GetEntry(rewind, 0)->offset >= start)
+                REWIND_DropOldestGroup(rewind);
+            start = 0;
+        }
+    }
+
+    while (REWIND_Overlaps(rewind, start, start + size))
+        REWIND_DropOldestGroup(rewind);
+
+    if (rewind->entry_count == rewind->entry_capacity)
+    {
+        size_t capacity = rewind->entry_capacity ? rewind->entry_capacity * 2 : 64;
+        REWIND_Entry *entries = malloc(capacity * sizeof(REWIND_Entry));
+        if (!entries)
+            return -1;
+        for (size_t i = 0; i < rewind->entry_count; i++)
+            entries[i] = *REWIND_GetEntry(rewind, i);
+        free(rewind->entries);
+        rewind->entries = entries;
+        rewind->entry_capacity = capacity;
+        rewind->entry_first = 0;
+    }
+
+    *offset = start;
+    return 0;
+}
+
+// Rebuilds the state of an entry from its keyframe
+static void REWIND_Decode(REWIND *rewind, size_t index, uint8_t *state)
+{
+    size_t key = index;
+    while (!REWIND_GetEntry(rewind, key)->keyframe)
+        key--;
+
+    REWIND_Entry *keyframe = REWIND_GetEntry(rewind, key);
+    memset(state, 0, rewind->state_size);
+    REWIND_Apply(state, REWIND_GetEncoded(rewind, keyframe), keyframe->encoded_size);
+    if (key != index)
+    {
+        REWIND_Entry *entry = REWIND_GetEntry(rewind, index);
+        REWIND_Apply(state, REWIND_GetEncoded(rewind, entry), entry->encoded_size);
+    }
+}
+
+// (Re)sizes the scratch buffers for the loaded ROM's save states
+static int REWIND_PrepareState(REWIND *rewind)
+{
+    size_t size = NES_GetStateSize(rewind->nes);
+    if (size == rewind->state_size)
+        return 0;
+
+    REWIND_Clear(rewind);
+    free(rewind->state);
+    free(rewind->encoded);
+    free(rewind->keyframe);
+    rewind->state_size = size;
+    rewind->state = malloc(size);
+    rewind->encoded = malloc(size * 2 + 16);
+    rewind->keyframe = malloc(size);
+    if (!rewind->state || !rewind->encoded || !rewind->keyframe)
+    {
+        DEBUG_ERROR("REWIND: Failed to allocate state buffers");
+        rewind->state_size = 0;
+        return -1;
+    }
+    return 0;
+}
+
+// --- Rewind API ---
+
+REWIND *REWIND_Create(NES *nes, size_t budget, int interval, int keyframe_interval)
+{
+    REWIND *rewind = calloc(1, sizeof(REWIND));
+    if (!rewind) {goto error;}
+
+    rewind->nes = nes;
+    rewind->interval = interval > 0 ? interval : REWIND_DEFAULT_INTERVAL;
+    rewind->keyframe_interval = keyframe_interval > 0 ? keyframe_interval : REWIND_DEFAULT_KEYFRAME;
+    rewind->data_size = budget ? budget : REWIND_DEFAULT_BUDGET;
+    rewind->data = malloc(rewind->data_size);
+    if (!rewind->data) {goto error;}
+
+    return rewind;
+
+error:
+    REWIND_Destroy(rewind);
+    DEBUG_ERROR("Failed to create rewind buffer");
+
+    return NULL;
+}
+
+void REWIND_Destroy(REWIND *rewind)
+{
+    if (!rewind)
+        return;
+
+    free(rewind->data);
+    free(rewind->entries);
+    free(rewind->state);
+    free(rewind->encoded);
+    free(rewind->keyframe);
+    free(rewind);
+}
+
+void REWIND_Clear(REWIND *rewind)
+{
+    rewind->entry_first = 0;
+    rewind->entry_count = 0;
+    rewind->memory_used = 0;
+    rewind->keyframe_valid = 0;
+    rewind->frame = 0;
+}
+
+int REWIND_Capture(REWIND *rewind)
+{
+    if (REWIND_PrepareState(rewind))
+        return -1;
+
+    NES *nes = rewind->nes;
+    rewind->frame++;
+
+    // Inputs of the frame just run belong to the snapshot before it
+    if (rewind->entry_count)
+    {
+        REWIND_Entry *newest = REWIND_GetEntry(rewind, rewind->entry_count - 1);
+        uint64_t index = rewind->frame - newest->frame - 1;
+        if (index < (uint64_t)rewind->interval)
+        {
+            uint8_t *inputs = REWIND_GetInputs(rewind, newest);
+            inputs[index * 2] = nes->controllers[0];
+            inputs[index * 2 + 1] = nes->controllers[1];
+            newest->input_count = (uint32_t)index + 1;
+        }
+        if (index + 1 < (uint64_t)rewind->interval)
+            return 0;
+    }
+
+    NES_SaveState(nes, rewind->state, rewind->state_size);
+
+    int keyframe;
+    size_t encoded_size;
+    size_t inputs_size = (size_t)rewind->interval * 2;
+    size_t offset;
+    for (;;)
+    {
+        keyframe = !rewind->keyframe_valid || rewind->since_keyframe >= rewind->keyframe_interval;
+        encoded_size = REWIND_Encode(rewind->state, keyframe ? NULL : rewind->keyframe, rewind->state_size, rewind->encoded);
+        if (REWIND_Allocate(rewind, inputs_size + encoded_size, &offset))
+        {
+            DEBUG_WARN("REWIND: Snapshot of %zu bytes doesn't fit the %zu byte budget", inputs_size + encoded_size, rewind->data_size);
+            REWIND_Clear(rewind);
+            return -1;
+        }
+        // Making room can drop the keyframe this delta was encoded against
+        if (keyframe || rewind->keyframe_valid)
+            break;
+    }
+
+    memset(rewind->data + offset, 0, inputs_size);
+    memcpy(rewind->data + offset + inputs_size, rewind->encoded, encoded_size);
+
+    rewind->entry_count++;
+    *REWIND_GetEntry(rewind, rewind->entry_count - 1) = (REWIND_Entry){
+        .offset = offset,
+        .size = inputs_size + encoded_size,
+        .encoded_size = encoded_size,
+        .frame = rewind->frame,
+        .keyframe = (uint8_t)keyframe,
+    };
+    rewind->memory_used += inputs_size + encoded_size;
+
+    if (keyframe)
+    {
+        memcpy(rewind->keyframe, rewind->state, rewind->state_size);
+        rewind->keyframe_valid = 1;
+        rewind->keyframe_frame = rewind->frame;
+        rewind->since_keyframe = 0;
+    }
+    rewind->since_keyframe++;
+
+    return 0;
+}
+
+int REWIND_StepBack(REWIND *rewind)
+{
+    if (!rewind->entry_count || rewind->frame == 0)
+        return -1;
+
+    uint64_t target = rewind->frame - 1;
+
+    // Newest snapshot before the target, so at least one frame is replayed and drawn.
+    // Only the oldest snapshot itself can be returned to without a replay.
+    size_t index = rewind->entry_count;
+    while (index > 0 && REWIND_GetEntry(rewind, index - 1)->frame >= target)
+        index--;
+    if (index == 0)
+    {
+        if (REWIND_GetEntry(rewind, 0)->frame != target)
+            return -1;
+        index = 1;
+    }
+    index--;
+
+    // The replay can only use inputs that were recorded after the snapshot
+    REWIND_Entry *entry = REWIND_GetEntry(rewind, index);
+    if (target - entry->frame > entry->input_count)
+    {
+        DEBUG_ERROR("REWIND: Snapshot of frame %llu has %u inputs, frame %llu needs more",
+                    (unsigned long long)entry->frame, entry->input_count, (unsigned long long)target);
+        return -1;
+    }
+    REWIND_Decode(rewind, index, rewind->state);
+    if (NES_LoadState(rewind->nes, rewind->state, rewind->state_size))
+        return -1;
+
+    // Replayed frames already happened, keep them out of an attached movie
+    MOVIE *movie = rewind->nes->movie;
+    rewind->nes->movie = NULL;
+
+    const uint8_t *inputs = REWIND_GetInputs(rewind, entry);
+    for (uint64_t frame = entry->frame + 1; frame <= target; frame++)
+    {
+        size_t input = (size_t)(frame - entry->frame - 1);
+        NES_SetController(rewind->nes, 0, inputs[input * 2]);
+        NES_SetController(rewind->nes, 1, inputs[input * 2 + 1]);
+        NES_StepFrame(rewind->nes);
+    }
+    rewind->nes->movie = movie;
+
+    // Forget the future, the newest remaining snapshot continues recording from the target
+    while (REWIND_GetEntry(rewind, rewind->entry_count - 1)->frame > target)
+        REWIND_DropNewest(rewind);
+    REWIND_Entry *newest = REWIND_GetEntry(rewind, rewind->entry_count - 1);
+    newest->input_count = (uint32_t)(target - newest->frame);
+    rewind->frame = target;
+
+    // New deltas are encoded against the newest keyframe left
+    size_t key = rewind->entry_count - 1;
+    while (!REWIND_GetEntry(rewind, key)->keyframe)
+        key--;
+    REWIND_Entry *keyframe = REWIND_GetEntry(rewind, key);
+    if (!rewind->keyframe_valid || rewind->keyframe_frame != keyframe->frame)
+    {
+        REWIND_Decode(rewind, key, rewind->keyframe);
+        rewind->keyframe_valid = 1;
+        rewind->keyframe_frame = keyframe->frame;
+    }
+    rewind->since_keyframe = (int)(rewind->entry_count - key);
+
+    return 0;
+}
+
+size_t REWIND_GetFrameCount(const REWIND *rewind)
+{
+    if (!rewind->entry_count)
+        return 0;
+    const REWIND_Entry *oldest = &rewind->entries[rewind->entry_first];
+    return (size_t)(rewind->frame - oldest->frame);
+}
+
+size_t REWIND_GetMemoryUsed(const REWIND *rewind)
+{
+    return rewind->memory_used;
+}
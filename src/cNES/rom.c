@@ -0,0 +1,206 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "debug.h"
+
+#include "cNES/rom.h"
+#include "cNES/mapper.h"
+#include "cNES/filemap.h"
+
+// Fallback for files the OS refuses to map, reads them into a heap image
+static uint8_t *ROM_ReadFile(const char *path, size_t *size)
+{
+    FILE *file = fopen(path, "rb");
+    if (!file) 
+    {
+        DEBUG_ERROR("Unable to open ROM file %s", path);
+        return NULL;
+    }
+
+    uint8_t *data = NULL;
+    long length = -1;
+    if (fseek(file, 0, SEEK_END) == 0)
+        length = ftell(file);
+    if (length < 0 || fseek(file, 0, SEEK_SET) != 0)
+    {
+        DEBUG_ERROR("Could not get the size of %s", path);
+        goto error;
+    }
+
+    data = malloc(length ? (size_t)length : 1);
+    if (!data) 
+    {
+        DEBUG_ERROR("Could not allocate memory for %s", path);
+        goto error;
+    }
+
+    if (fread(data, 1, (size_t)length, file) != (size_t)length) 
+    {
+        DEBUG_ERROR("Could not read %s", path);
+        goto error;
+    }
+
+    fclose(file);
+    *size = (size_t)length;
+    return data;
+
+error:
+    free(data);
+    fclose(file);
+    return NULL;
+}
+
+// Validates an iNES image and wraps it in a ROM. Owns the image on success,
+// on failure the caller still does.
+static ROM *ROM_Create(uint8_t *image, size_t size, bool mapped)
+{
+    // Read the NES header (first 16 bytes)
+    if (size < 16) 
+    {
+        DEBUG_ERROR("ROM image is too small for an NES header");
+        return NULL;
+    }
+    const uint8_t *header = image;
+
+    // Check for valid NES header
+    if (header[0] != 'N' || header[1] != 'E' || header[2] != 'S' || header[3] != 0x1A) 
+    {
+        DEBUG_ERROR("Invalid NES ROM file format");
+        return NULL;
+    }
+
+    uint8_t prg_rom_banks = header[4]; // PRG ROM size in 16KB units
+    uint8_t chr_rom_banks = header[5]; // CHR ROM size in 8KB units, 0 means the cart has CHR RAM
+    uint8_t mirroring = header[6] & 0x01; // Mirroring info (0: horizontal, 1: vertical)
+    uint8_t has_battery = (header[6] & 0x02) >> 1; // Battery backed PRG RAM
+    uint8_t has_trainer = (header[6] & 0x04) >> 2; // Trainer presence (0: no trainer, 1: trainer present)
+    uint8_t mapper_number = (uint8_t)((header[6] >> 4) | (header[7] & 0xF0)); // Low nibble in byte 6, high nibble in byte 7
+
+    size_t prg_rom_size = (size_t)prg_rom_banks * 0x4000; // Total PRG ROM size in bytes
+    size_t chr_rom_size = (size_t)chr_rom_banks * 0x2000; // Total CHR ROM size in bytes
+    size_t trainer_size = has_trainer ? 512 : 0; // Trainer size in bytes
+
+    if (size < 16 + trainer_size + prg_rom_size + chr_rom_size) 
+    {
+        DEBUG_ERROR("ROM image is truncated");
+        return NULL;
+    }
+
+    const MAPPER *mapper = MAPPER_Get(mapper_number);
+    if (!mapper)
+    {
+        DEBUG_ERROR("Mapper %d is not supported", mapper_number);
+        return NULL;
+    }
+    if (prg_rom_size == 0)
+    {
+        DEBUG_ERROR("ROM image has no PRG ROM");
+        return NULL;
+    }
+    if (header[6] & 0x08)
+        DEBUG_WARN("Four screen nametables aren't supported, using the mirroring bit instead");
+
+    ROM *rom = calloc(1, sizeof(ROM));
+    size_t decode_bank_count = (prg_rom_size + ROM_DECODE_BANK_SIZE - 1) / ROM_DECODE_BANK_SIZE;
+    if (rom)
+        rom->decode_banks = calloc(decode_bank_count, sizeof(*rom->decode_banks));
+    if (!rom || !rom->decode_banks)
+    {
+        DEBUG_ERROR("Could not allocate ROM");
+        free(rom);
+        return NULL;
+    }
+    rom->decode_bank_count = decode_bank_count;
+    atomic_init(&rom->references, 1);
+
+    // The trainer is skipped, nothing maps it to $7000 yet
+    rom->image = image;
+    rom->image_size = size;
+    rom->image_mapped = mapped;
+    rom->prg = image + 16 + trainer_size;
+    rom->prg_size = prg_rom_size;
+    rom->chr = chr_rom_size ? rom->prg + prg_rom_size : NULL;
+    rom->chr_size = chr_rom_size;
+
+    rom->mapper = mapper;
+    rom->mapper_number = mapper_number;
+    rom->mirroring = mirroring;
+    rom->prg_banks = prg_rom_banks;
+    rom->chr_banks = chr_rom_banks;
+    rom->has_battery = has_battery;
+
+    // 64-bit FNV-1a of the whole image
+    rom->hash = 0xCBF29CE484222325ULL;
+    for (size_t i = 0; i < size; i++) {
+        rom->hash ^= image[i];
+        rom->hash *= 0x100000001B3ULL;
+    }
+
+    return rom;
+}
+
+ROM *ROM_Load(const char *path)
+{
+    // Mapped read only, banks point straight into the file cache and every
+    // process running the same file shares its pages
+    size_t size = 0;
+    uint8_t *image = FILEMAP_OpenReadOnly(path, &size);
+    if (image)
+    {
+        ROM *rom = ROM_Create(image, size, true);
+        if (!rom)
+            FILEMAP_Close(image, size);
+        return rom;
+    }
+
+    image = ROM_ReadFile(path, &size);
+    if (!image)
+        return NULL;
+    ROM *rom = ROM_Create(image, size, false);
+    if (!rom)
+        free(image);
+    return rom;
+}
+
+ROM *ROM_LoadMemory(const uint8_t *data, size_t size)
+{
+    uint8_t *image = malloc(size ? size : 1);
+    if (!image)
+    {
+        DEBUG_ERROR("Could not allocate %zu bytes for the ROM image", size);
+        return NULL;
+    }
+    memcpy(image, data, size);
+
+    ROM *rom = ROM_Create(image, size, false);
+    if (!rom)
+        free(image);
+    return rom;
+}
+
+ROM *ROM_Retain(ROM *rom)
+{
+    atomic_fetch_add_explicit(&rom->references, 1, memory_order_relaxed);
+    return rom;
+}
+
+void ROM_Release(ROM *rom)
+{
+    if (!rom)
+        return;
+
+    // The last owner must see every other owner's accesses finished before freeing
+    if (atomic_fetch_sub_explicit(&rom->references, 1, memory_order_acq_rel) != 1)
+        return;
+
+    for (size_t bank = 0; bank < rom->decode_bank_count; bank++)
+        free(atomic_load_explicit(&rom->decode_banks[bank], memory_order_relaxed));
+    free(rom->decode_banks);
+
+    if (rom->image_mapped)
+        FILEMAP_Close(rom->image, rom->image_size);
+    else
+        free(rom->image);
+    free(rom);
+}
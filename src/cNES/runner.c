@@ -0,0 +1,281 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+
+#include "debug.h"
+#include "cNES/nes.h"
+#include "cNES/bus.h"
+#include "cNES/cpu.h"
+#include "cNES/ppu.h"
+#include "cNES/hash.h"
+
+#include "cNES/runner.h"
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+#define RUNNER_CACHE_LINE 64
+
+// Jobs still queued on a worker, [head, tail) packed as head | tail << 32 so the
+// owner (taking from the head) and thieves (taking from the tail) race on one word
+typedef struct RUNNER_Worker {
+    _Atomic uint64_t range;
+    uint8_t padding[RUNNER_CACHE_LINE - sizeof(uint64_t)]; // Keeps each deque on its own cache line
+
+    RUNNER *runner;
+    int index;
+    uint32_t *pixels; // Conversion buffer for the final frame hash
+} RUNNER_Worker;
+
+struct RUNNER {
+    int thread_count;
+    RUNNER_Worker *workers;
+
+    // Current RUNNER_Run call
+    RUNNER_Job *jobs;
+    atomic_int failed;
+};
+
+// --- Work stealing ---
+
+static inline uint64_t RUNNER_PackRange(uint32_t head, uint32_t tail)
+{
+    return (uint64_t)head | ((uint64_t)tail << 32);
+}
+
+// Takes the next job from the front of the worker's own range, -1 if it is empty
+static int64_t RUNNER_Pop(RUNNER_Worker *worker)
+{
+    uint64_t range = atomic_load(&worker->range);
+    for (;;)
+    {
+        uint32_t head = (uint32_t)range;
+        uint32_t tail = (uint32_t)(range >> 32);
+        if (head >= tail)
+            return -1;
+        if (atomic_compare_exchange_weak(&worker->range, &range, RUNNER_PackRange(head + 1, tail)))
+            return head;
+    }
+}
+
+// Takes a job from the back of another worker's range, -1 once every range is empty.
+// Jobs are never added while running, so one empty pass means there is nothing left.
+static int64_t RUNNER_Steal(RUNNER_Worker *thief)
+{
+    RUNNER *runner = thief->runner;
+    for (int i = 1; i < runner->thread_count; i++)
+    {
+        RUNNER_Worker *victim = &runner->workers[(thief->index + i) % runner->thread_count];
+        uint64_t range = atomic_load(&victim->range);
+        for (;;)
+        {
+            uint32_t head = (uint32_t)range;
+            uint32_t tail = (uint32_t)(range >> 32);
+            if (head >= tail)
+                break;
+            if (atomic_compare_exchange_weak(&victim->range, &range, RUNNER_PackRange(head, tail - 1)))
+                return tail - 1;
+        }
+    }
+    return -1;
+}
+
+// --- Jobs ---
+
+static int RUNNER_RunJob(RUNNER_Worker *worker, RUNNER_Job *job)
+{
+    NES *nes = NES_Create();
+    if (!nes)
+        return -1;
+
+    if (NES_AttachROM(nes, job->rom))
+    {
+        NES_Destroy(nes);
+        return -1;
+    }
+
+    for (int frame = 0; frame < job->frames; frame++)
+    {
+        if (job->input && job->input_frames)
+        {
+            size_t index = (size_t)frame < job->input_frames ? (size_t)frame : job->input_frames - 1;
+            NES_SetController(nes, 0, job->input[index * 2]);
+            NES_SetController(nes, 1, job->input[index * 2 + 1]);
+        }
+        NES_StepFrame(nes);
+    }
+
+    PPU_ConvertFramebuffer(nes->ppu, worker->pixels, PPU_FRAMEBUFFER_WIDTH * sizeof(uint32_t), PPU_PIXEL_FORMAT_RRGGBBAA);
+    job->frame_hash = HASH_Bytes(worker->pixels, PPU_FRAMEBUFFER_WIDTH * PPU_FRAMEBUFFER_HEIGHT * sizeof(uint32_t), 0);
+    job->ram_hash = HASH_Bytes(nes->bus->ram, sizeof(nes->bus->ram), 0);
+    job->cycles = nes->cpu->total_cycles;
+
+    NES_Destroy(nes);
+    return 0;
+}
+
+static void RUNNER_Work(RUNNER_Worker *worker)
+{
+    RUNNER *runner = worker->runner;
+    int64_t index;
+    while ((index = RUNNER_Pop(worker)) >= 0 || (index = RUNNER_Steal(worker)) >= 0)
+    {
+        RUNNER_Job *job = &runner->jobs[index];
+        job->status = RUNNER_RunJob(worker, job);
+        if (job->status)
+            atomic_fetch_add(&runner->failed, 1);
+    }
+}
+
+// --- Threads ---
+
+#if defined(_WIN32)
+typedef HANDLE RUNNER_Thread;
+
+static DWORD WINAPI RUNNER_ThreadMain(LPVOID arg)
+{
+    RUNNER_Work(arg);
+    return 0;
+}
+
+static int RUNNER_StartThread(RUNNER_Thread *thread, RUNNER_Worker *worker)
+{
+    *thread = CreateThread(NULL, 0, RUNNER_ThreadMain, worker, 0, NULL);
+    return *thread ? 0 : -1;
+}
+
+static void RUNNER_JoinThread(RUNNER_Thread thread)
+{
+    WaitForSingleObject(thread, INFINITE);
+    CloseHandle(thread);
+}
+
+static int RUNNER_CountCPUs(void)
+{
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return (int)info.dwNumberOfProcessors;
+}
+#else
+typedef pthread_t RUNNER_Thread;
+
+static void *RUNNER_ThreadMain(void *arg)
+{
+    RUNNER_Work(arg);
+    return NULL;
+}
+
+static int RUNNER_StartThread(RUNNER_Thread *thread, RUNNER_Worker *worker)
+{
+    return pthread_create(thread, NULL, RUNNER_ThreadMain, worker) ? -1 : 0;
+}
+
+static void RUNNER_JoinThread(RUNNER_Thread thread)
+{
+    pthread_join(thread, NULL);
+}
+
+static int RUNNER_CountCPUs(void)
+{
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? (int)count : 1;
+}
+#endif
+
+// --- Runner API ---
+
+RUNNER *RUNNER_Create(int thread_count)
+{
+    RUNNER *runner = calloc(1, sizeof(RUNNER));
+    if (!runner) {goto error;}
+
+    runner->thread_count = thread_count > 0 ? thread_count : RUNNER_CountCPUs();
+    runner->workers = calloc((size_t)runner->thread_count, sizeof(RUNNER_Worker));
+    if (!runner->workers) {goto error;}
+
+    for (int i = 0; i < runner->thread_count; i++)
+    {
+        RUNNER_Worker *worker = &runner->workers[i];
+        worker->runner = runner;
+        worker->index = i;
+        worker->pixels = malloc(PPU_FRAMEBUFFER_WIDTH * PPU_FRAMEBUFFER_HEIGHT * sizeof(uint32_t));
+        if (!worker->pixels) {goto error;}
+    }
+
+    return runner;
+
+error:
+    RUNNER_Destroy(runner);
+    DEBUG_ERROR("Failed to create runner");
+
+    return NULL;
+}
+
+void RUNNER_Destroy(RUNNER *runner)
+{
+    if (!runner)
+        return;
+
+    if (runner->workers)
+    {
+        for (int i = 0; i < runner->thread_count; i++)
+            free(runner->workers[i].pixels);
+        free(runner->workers);
+    }
+    free(runner);
+}
+
+int RUNNER_GetThreadCount(const RUNNER *runner)
+{
+    return runner->thread_count;
+}
+
+int RUNNER_Run(RUNNER *runner, RUNNER_Job *jobs, size_t count)
+{
+    if (count > UINT32_MAX)
+    {
+        DEBUG_ERROR("RUNNER_Run: Too many jobs (%zu)", count);
+        return -1;
+    }
+
+    runner->jobs = jobs;
+    atomic_store(&runner->failed, 0);
+
+    // Even contiguous split, stealing evens out jobs that run longer than others
+    int threads = runner->thread_count;
+    for (int i = 0; i < threads; i++)
+    {
+        uint32_t head = (uint32_t)(count * (size_t)i / (size_t)threads);
+        uint32_t tail = (uint32_t)(count * (size_t)(i + 1) / (size_t)threads);
+        atomic_store(&runner->workers[i].range, RUNNER_PackRange(head, tail));
+    }
+
+    // The calling thread works as worker 0
+    RUNNER_Thread *handles = threads > 1 ? malloc((size_t)(threads - 1) * sizeof(RUNNER_Thread)) : NULL;
+    int started = 0;
+    if (handles)
+    {
+        for (; started < threads - 1; started++)
+        {
+            if (RUNNER_StartThread(&handles[started], &runner->workers[started + 1]))
+            {
+                DEBUG_WARN("RUNNER_Run: Could only start %d of %d threads", started + 1, threads);
+                break;
+            }
+        }
+    }
+
+    // Ranges of threads that failed to start get stolen by the rest
+    RUNNER_Work(&runner->workers[0]);
+
+    for (int i = 0; i < started; i++)
+        RUNNER_JoinThread(handles[i]);
+    free(handles);
+
+    runner->jobs = NULL;
+    return atomic_load(&runner->failed);
+}
@@ -0,0 +1,270 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+
+#include "debug.h"
+#include "cNES/nes.h"
+#include "cNES/bus.h"
+#include "cNES/cpu.h"
+#include "cNES/ppu.h"
+#include "cNES/mapper.h"
+
+// Save states are a header followed by sections of raw state copied straight
+// out of the emulator structs. Nothing is converted, so a state only loads on
+// the same build layout and endianness it was saved with: every section's size
+// must match what this build expects and NES_STATE_VERSION is bumped on changes
+// that keep the sizes.
+
+#define NES_STATE_MAGIC   0x53454E43 // "CNES"
+#define NES_STATE_VERSION 5
+
+#define NES_STATE_ID(a, b, c, d) ((uint32_t)(a) | ((uint32_t)(b) << 8) | ((uint32_t)(c) << 16) | ((uint32_t)(d) << 24))
+
+#define NES_STATE_MAX_REGIONS 12
+
+#define NES_STATE_LINE NES_STATE_ID('L','I','N','E')
+#define NES_STATE_LINE_EMPHASIS NES_STATE_ID('L','E','M','P')
+#define NES_STATE_LINE_SLOTS    NES_STATE_ID('L','E','M','C')
+
+typedef struct NES_StateHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t size;          // Whole state including this header
+    uint32_t section_count;
+    uint8_t mapper;         // Cartridge the state belongs to
+    uint8_t prg_rom_size;
+    uint8_t chr_rom_size;
+    uint8_t reserved;
+    uint64_t rom_hash;      // NES rom_hash, tells apart carts with the same mapper and sizes
+} NES_StateHeader;
+
+typedef struct NES_StateSectionHeader {
+    uint32_t id;
+    uint32_t size; // Payload bytes following this header
+} NES_StateSectionHeader;
+
+// A run of bytes inside the live emulator that a section copies
+typedef struct NES_StateRegion {
+    uint32_t id;
+    void *data;
+    size_t size;
+} NES_StateRegion;
+
+// States land between frames a few dots into line 0, so the line being drawn
+// is the only part of the framebuffer (and its emphasis slots) the next frame
+// doesn't overwrite
+static int NES_GetStateLine(NES *nes)
+{
+    return nes->ppu->scanline >= 0 && nes->ppu->scanline < PPU_FRAMEBUFFER_HEIGHT ? nes->ppu->scanline : 0;
+}
+
+// Fills regions with everything that makes up the machine state, returns the count.
+// Pointers, caches and output (baked palettes, finished framebuffer lines) are left out.
+static int NES_GetStateRegions(NES *nes, NES_StateRegion *regions)
+{
+    int count = 0;
+
+    // Registers and cycle counters, everything before the NES pointer
+    regions[count++] = (NES_StateRegion){ NES_STATE_ID('C','P','U',' '), nes->cpu, offsetof(CPU, nes) };
+
+    // Registers, timing, the rendering pipeline and memories, then the output of the line being drawn
+    int line = NES_GetStateLine(nes);
+    regions[count++] = (NES_StateRegion){ NES_STATE_ID('P','P','U',' '), nes->ppu, offsetof(PPU, line_emphasis) };
+    regions[count++] = (NES_StateRegion){ NES_STATE_LINE, &nes->ppu->framebuffer[line * PPU_FRAMEBUFFER_WIDTH], PPU_FRAMEBUFFER_WIDTH };
+    regions[count++] = (NES_StateRegion){ NES_STATE_LINE_EMPHASIS, nes->ppu->line_emphasis[line], PPU_EMPHASIS_SLOTS };
+    regions[count++] = (NES_StateRegion){ NES_STATE_LINE_SLOTS, &nes->ppu->line_emphasis_count[line], 1 };
+
+    regions[count++] = (NES_StateRegion){ NES_STATE_ID('R','A','M',' '), nes->bus->ram, sizeof(nes->bus->ram) };
+
+    regions[count++] = (NES_StateRegion){ NES_STATE_ID('P','R','G','R'), nes->bus->prg_ram, sizeof(nes->bus->prg_ram) };
+
+    // Carts without CHR ROM have CHR RAM in its place
+    if (nes->bus->chr == nes->bus->chr_ram)
+        regions[count++] = (NES_StateRegion){ NES_STATE_ID('C','H','R','R'), nes->bus->chr_ram, sizeof(nes->bus->chr_ram) };
+
+    // Mapper registers, the banks they select are mapped again after a load
+    regions[count++] = (NES_StateRegion){ NES_STATE_ID('M','A','P','R'), &nes->bus->mapper_state, sizeof(nes->bus->mapper_state) };
+
+    // Controllers and pending events
+    regions[count++] = (NES_StateRegion){ NES_STATE_ID('N','E','S',' '), (uint8_t *)nes + offsetof(NES, controllers),
+                                          offsetof(NES, scheduler) + sizeof(nes->scheduler) - offsetof(NES, controllers) };
+
+    return count;
+}
+
+size_t NES_GetStateSize(NES *nes)
+{
+    NES_StateRegion regions[NES_STATE_MAX_REGIONS];
+    int count = NES_GetStateRegions(nes, regions);
+
+    size_t size = sizeof(NES_StateHeader);
+    for (int i = 0; i < count; i++)
+        size += sizeof(NES_StateSectionHeader) + regions[i].size;
+    return size;
+}
+
+size_t NES_SaveState(NES *nes, void *buffer, size_t size)
+{
+    NES_StateRegion regions[NES_STATE_MAX_REGIONS];
+    int count = NES_GetStateRegions(nes, regions);
+
+    size_t needed = NES_GetStateSize(nes);
+    if (size < needed)
+    {
+        DEBUG_ERROR("NES_SaveState: Buffer too small (%zu bytes, %zu needed)", size, needed);
+        return 0;
+    }
+
+    uint8_t *out = buffer;
+    NES_StateHeader header = {
+        .magic = NES_STATE_MAGIC,
+        .version = NES_STATE_VERSION,
+        .size = (uint32_t)needed,
+        .section_count = (uint32_t)count,
+        .mapper = nes->bus->mapper,
+        .prg_rom_size = nes->bus->prgRomSize,
+        .chr_rom_size = nes->bus->chrRomSize,
+        .rom_hash = nes->rom_hash,
+    };
+    memcpy(out, &header, sizeof(header));
+    out += sizeof(header);
+
+    for (int i = 0; i < count; i++)
+    {
+        NES_StateSectionHeader section = { regions[i].id, (uint32_t)regions[i].size };
+        memcpy(out, &section, sizeof(section));
+        out += sizeof(section);
+        memcpy(out, regions[i].data, regions[i].size);
+        out += regions[i].size;
+    }
+
+    return needed;
+}
+
+int NES_LoadState(NES *nes, const void *buffer, size_t size)
+{
+    NES_StateRegion regions[NES_STATE_MAX_REGIONS];
+    int count = NES_GetStateRegions(nes, regions);
+
+    const uint8_t *in = buffer;
+    NES_StateHeader header;
+    if (size < sizeof(header))
+    {
+        DEBUG_ERROR("NES_LoadState: State is truncated");
+        return -1;
+    }
+    memcpy(&header, in, sizeof(header));
+
+    if (header.magic != NES_STATE_MAGIC || header.version != NES_STATE_VERSION)
+    {
+        DEBUG_ERROR("NES_LoadState: Not a version %d save state", NES_STATE_VERSION);
+        return -1;
+    }
+    if (header.rom_hash != nes->rom_hash || header.mapper != nes->bus->mapper ||
+        header.prg_rom_size != nes->bus->prgRomSize || header.chr_rom_size != nes->bus->chrRomSize)
+    {
+        DEBUG_ERROR("NES_LoadState: State belongs to a different cartridge");
+        return -1;
+    }
+    if (header.size != NES_GetStateSize(nes) || header.size > size || header.section_count != (uint32_t)count)
+    {
+        DEBUG_ERROR("NES_LoadState: State layout doesn't match this build");
+        return -1;
+    }
+
+    // Check every section before touching anything, a bad state leaves the NES as it was
+    const uint8_t *cursor = in + sizeof(header);
+    for (int i = 0; i < count; i++)
+    {
+        NES_StateSectionHeader section;
+        memcpy(&section, cursor, sizeof(section));
+        if (section.id != regions[i].id || section.size != regions[i].size)
+        {
+            DEBUG_ERROR("NES_LoadState: Unexpected section %08X (%u bytes)", section.id, section.size);
+            return -1;
+        }
+        cursor += sizeof(section) + section.size;
+    }
+
+    cursor = in + sizeof(header);
+    for (int i = 0; i < count; i++)
+    {
+        cursor += sizeof(NES_StateSectionHeader);
+        // The line regions follow the scanline just loaded
+        int line = NES_GetStateLine(nes);
+        if (regions[i].id == NES_STATE_LINE)
+            regions[i].data = &nes->ppu->framebuffer[line * PPU_FRAMEBUFFER_WIDTH];
+        else if (regions[i].id == NES_STATE_LINE_EMPHASIS)
+            regions[i].data = nes->ppu->line_emphasis[line];
+        else if (regions[i].id == NES_STATE_LINE_SLOTS)
+            regions[i].data = &nes->ppu->line_emphasis_count[line];
+        memcpy(regions[i].data, cursor, regions[i].size);
+        cursor += regions[i].size;
+    }
+
+    MAPPER_Sync(nes);
+    nes->bus->prg_ram_dirty = 0xFF; // PRG RAM changed behind the battery's back, it compares on the next flush
+    return 0;
+}
+
+int NES_SaveStateFile(NES *nes, const char *path)
+{
+    size_t size = NES_GetStateSize(nes);
+    uint8_t *buffer = malloc(size);
+    if (!buffer)
+    {
+        DEBUG_ERROR("NES_SaveStateFile: Could not allocate %zu bytes", size);
+        return -1;
+    }
+
+    int result = -1;
+    FILE *file = NULL;
+    if (NES_SaveState(nes, buffer, size) != size)
+        goto cleanup;
+
+    file = fopen(path, "wb");
+    if (!file)
+    {
+        DEBUG_ERROR("NES_SaveStateFile: Unable to open %s", path);
+        goto cleanup;
+    }
+
+    if (fwrite(buffer, 1, size, file) == size)
+        result = 0;
+    else
+        DEBUG_ERROR("NES_SaveStateFile: Could not write %s", path);
+
+cleanup:
+    if (file)
+        fclose(file);
+    free(buffer);
+    return result;
+}
+
+int NES_LoadStateFile(NES *nes, const char *path)
+{
+    size_t size = NES_GetStateSize(nes);
+    uint8_t *buffer = malloc(size);
+    if (!buffer)
+    {
+        DEBUG_ERROR("NES_LoadStateFile: Could not allocate %zu bytes", size);
+        return -1;
+    }
+
+    int result = -1;
+    FILE *file = fopen(path, "rb");
+    if (!file)
+    {
+        DEBUG_ERROR("NES_LoadStateFile: Unable to open %s", path);
+        goto cleanup;
+    }
+
+    size_t read = fread(buffer, 1, size, file);
+    fclose(file);
+    result = NES_LoadState(nes, buffer, read);
+
+cleanup:
+    free(buffer);
+    return result;
+}
@@ -0,0 +1,320 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "debug.h"
+
+#include "cNES/cpu.h"
+#include "cNES/ppu.h"
+#include "cNES/bus.h"
+#include "cNES/nes.h"
+#include "cNES/rewind.h"
+#include "cNES/movie.h"
+#include "cNES/hash.h"
+
+// Command line runner without any UI, for build servers and scripted runs.
+//
+// Input movies are raw: one byte per frame for each controller, player 1 then
+// player 2, using the NES_SetController button layout. The last frame's input is
+// held once the movie runs out. --play and --record use CNMV movies instead (see
+// movie.h), playing one runs for its whole length unless --frames is given.
+//
+// --test runs blargg style test ROMs that report through $6000 (see
+// NES_GetTestStatus) until they finish, and exits with 0 only if they passed.
+
+#define HEADLESS_TEST_FRAMES 7200 // Two emulated minutes before --test gives up
+#define HEADLESS_RESET_DELAY 6    // Frames a test ROM asking for reset waits, a bit over 100ms
+
+typedef struct HeadlessOptions {
+    const char *rom_path;
+    const char *movie_path;
+    const char *play_path;
+    const char *record_path;
+    const char *ppm_path;
+    const char *ram_path;
+    int frames;
+    int rewind_frames;
+    int run_ahead;
+    int print_hash;
+    int test;
+    int recompiler;
+} HeadlessOptions;
+
+static void usage(const char *name)
+{
+    fprintf(stderr,
+            "usage: %s <rom.nes> [options]\n"
+            "  -f, --frames <n>   frames to run (default 60)\n"
+            "  -m, --movie <file> raw input movie, 2 bytes per frame\n"
+            "  --play <file>      play a CNMV movie\n"
+            "  --record <file>    record the input into a CNMV movie from power-on\n"
+            "  --hash             print hashes of the final frame and of the machine state,\n"
+            "                     with --run-ahead both are of the shown frame ahead\n"
+            "  --ppm <file>       write the final frame as a PPM image\n"
+            "  --ram <file>       write the 2KB internal RAM\n"
+            "  --test             run a test ROM that reports through $6000 until it finishes\n"
+            "  --run-ahead <n>    show each frame n frames ahead (n + 1 frames of work per frame)\n"
+            "  --rewind <n>       record rewind history, then step back n frames before the outputs\n"
+            "  --recompiler       run the game's code through the x86-64 recompiler, same results\n",
+            name);
+}
+
+static int parse_options(int argc, char **argv, HeadlessOptions *options)
+{
+    memset(options, 0, sizeof(*options));
+    options->frames = -1;
+
+    for (int i = 1; i < argc; i++)
+    {
+        const char *arg = argv[i];
+        const char *value = (i + 1 < argc) ? argv[i + 1] : NULL;
+
+        if (!strcmp(arg, "-f") || !strcmp(arg, "--frames"))
+        {
+            if (!value || (options->frames = atoi(value)) < 0)
+                return -1;
+            i++;
+        }
+        else if (!strcmp(arg, "-m") || !strcmp(arg, "--movie"))
+        {
+            if (!value)
+                return -1;
+            options->movie_path = value;
+            i++;
+        }
+        else if (!strcmp(arg, "--play") || !strcmp(arg, "--record"))
+        {
+            if (!value)
+                return -1;
+            if (arg[2] == 'p')
+                options->play_path = value;
+            else
+                options->record_path = value;
+            i++;
+        }
+        else if (!strcmp(arg, "--ppm"))
+        {
+            if (!value)
+                return -1;
+            options->ppm_path = value;
+            i++;
+        }
+        else if (!strcmp(arg, "--ram"))
+        {
+            if (!value)
+                return -1;
+            options->ram_path = value;
+            i++;
+        }
+        else if (!strcmp(arg, "--run-ahead"))
+        {
+            if (!value || (options->run_ahead = atoi(value)) < 0)
+                return -1;
+            i++;
+        }
+        else if (!strcmp(arg, "--rewind"))
+        {
+            if (!value || (options->rewind_frames = atoi(value)) < 0)
+                return -1;
+            i++;
+        }
+        else if (!strcmp(arg, "--hash"))
+            options->print_hash = 1;
+        else if (!strcmp(arg, "--test"))
+            options->test = 1;
+        else if (!strcmp(arg, "--recompiler"))
+            options->recompiler = 1;
+        else if (arg[0] != '-' && !options->rom_path)
+            options->rom_path = arg;
+        else
+            return -1;
+    }
+
+    if (options->play_path && (options->record_path || options->movie_path))
+        return -1;
+    return options->rom_path ? 0 : -1;
+}
+
+static int write_ppm(const char *path, const uint32_t *pixels)
+{
+    FILE *file = fopen(path, "wb");
+    if (!file)
+    {
+        DEBUG_ERROR("Could not open %s for writing", path);
+        return -1;
+    }
+
+    fprintf(file, "P6\n%d %d\n255\n", PPU_FRAMEBUFFER_WIDTH, PPU_FRAMEBUFFER_HEIGHT);
+    for (int i = 0; i < PPU_FRAMEBUFFER_WIDTH * PPU_FRAMEBUFFER_HEIGHT; i++)
+    {
+        uint8_t rgb[3] = { (uint8_t)(pixels[i] >> 24), (uint8_t)(pixels[i] >> 16), (uint8_t)(pixels[i] >> 8) };
+        fwrite(rgb, 1, sizeof(rgb), file);
+    }
+
+    fclose(file);
+    return 0;
+}
+
+static int write_file(const char *path, const void *data, size_t size)
+{
+    FILE *file = fopen(path, "wb");
+    if (!file)
+    {
+        DEBUG_ERROR("Could not open %s for writing", path);
+        return -1;
+    }
+
+    size_t written = fwrite(data, 1, size, file);
+    fclose(file);
+    return written == size ? 0 : -1;
+}
+
+int main(int argc, char **argv)
+{
+    HeadlessOptions options;
+    if (parse_options(argc, argv, &options))
+    {
+        usage(argv[0]);
+        return 2;
+    }
+
+    int result = 1;
+    FILE *movie = NULL;
+    MOVIE *cnmv = NULL;
+    REWIND *rewind = NULL;
+    NES *nes = NES_Create();
+    if (!nes)
+        return 1;
+
+    if (NES_Load(options.rom_path, nes))
+    {
+        DEBUG_ERROR("Could not load %s", options.rom_path);
+        goto cleanup;
+    }
+
+    if (options.recompiler && CPU_SetRecompiler(nes->cpu, true))
+    {
+        DEBUG_ERROR("The recompiler is not available on this machine");
+        goto cleanup;
+    }
+
+    NES_SetFrameHashing(nes, options.print_hash);
+
+    if (options.movie_path && !(movie = fopen(options.movie_path, "rb")))
+    {
+        DEBUG_ERROR("Could not open movie %s", options.movie_path);
+        goto cleanup;
+    }
+
+    if (options.play_path && !(cnmv = MOVIE_Play(nes, options.play_path)))
+        goto cleanup;
+    if (options.record_path && !(cnmv = MOVIE_Record(nes, options.record_path, MOVIE_ANCHOR_POWER_ON)))
+        goto cleanup;
+    if (options.frames < 0)
+        options.frames = options.play_path ? (int)MOVIE_GetLength(cnmv) : options.test ? HEADLESS_TEST_FRAMES : 60;
+
+    if (options.rewind_frames && !(rewind = REWIND_Create(nes, REWIND_DEFAULT_BUDGET, REWIND_DEFAULT_INTERVAL, REWIND_DEFAULT_KEYFRAME)))
+        goto cleanup;
+
+    uint8_t input[2] = { 0, 0 };
+    int test_status = -1;
+    int reset_frame = -1;
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    int frame = 0;
+    for (; frame < options.frames; frame++)
+    {
+        if (movie)
+        {
+            uint8_t next[2];
+            if (fread(next, 1, sizeof(next), movie) == sizeof(next))
+                memcpy(input, next, sizeof(input));
+            NES_SetController(nes, 0, input[0]);
+            NES_SetController(nes, 1, input[1]);
+        }
+
+        NES_RunAhead(nes, options.run_ahead);
+        if (rewind)
+            REWIND_Capture(rewind);
+
+        if (options.test)
+        {
+            test_status = NES_GetTestStatus(nes, NULL);
+            if (test_status >= 0 && test_status < NES_TEST_RUNNING)
+            {
+                frame++;
+                break;
+            }
+            if (test_status == NES_TEST_NEEDS_RESET && reset_frame < 0)
+                reset_frame = frame + HEADLESS_RESET_DELAY;
+            if (frame == reset_frame)
+            {
+                NES_Reset(nes);
+                reset_frame = -1;
+            }
+        }
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double seconds = (double)(end.tv_sec - start.tv_sec) + (double)(end.tv_nsec - start.tv_nsec) / 1e9;
+
+    printf("frames: %d\n", frame);
+    printf("seconds: %.3f\n", seconds);
+    printf("fps: %.1f\n", seconds > 0 ? frame / seconds : 0.0);
+
+    if (rewind)
+    {
+        printf("rewind_history: %zu frames, %zu bytes\n", REWIND_GetFrameCount(rewind), REWIND_GetMemoryUsed(rewind));
+
+        int stepped = 0;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        while (stepped < options.rewind_frames && REWIND_StepBack(rewind) == 0)
+            stepped++;
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        seconds = (double)(end.tv_sec - start.tv_sec) + (double)(end.tv_nsec - start.tv_nsec) / 1e9;
+
+        printf("rewound: %d frames in %.3f ms\n", stepped, seconds * 1e3);
+    }
+
+    result = 0;
+
+    if (options.test)
+    {
+        const char *message = "";
+        test_status = NES_GetTestStatus(nes, &message);
+        if (test_status < 0)
+            printf("test_status: none\n");
+        else
+            printf("test_status: %d%s\n%s\n", test_status, test_status >= NES_TEST_RUNNING ? " (timed out)" : "", message);
+        if (test_status != 0)
+            result = 1;
+    }
+
+    if (options.print_hash || options.ppm_path)
+    {
+        static uint32_t pixels[PPU_FRAMEBUFFER_WIDTH * PPU_FRAMEBUFFER_HEIGHT];
+        PPU_ConvertFramebuffer(nes->ppu, pixels, PPU_FRAMEBUFFER_WIDTH * sizeof(uint32_t), PPU_PIXEL_FORMAT_RRGGBBAA);
+
+        if (options.print_hash)
+        {
+            printf("frame_hash: %016llx\n", (unsigned long long)HASH_Bytes(pixels, sizeof(pixels), 0));
+            printf("state_hash: %016llx\n", (unsigned long long)NES_GetFrameHash(nes));
+        }
+        if (options.ppm_path && write_ppm(options.ppm_path, pixels))
+            result = 1;
+    }
+
+    if (options.ram_path && write_file(options.ram_path, nes->bus->ram, sizeof(nes->bus->ram)))
+        result = 1;
+
+cleanup:
+    if (movie)
+        fclose(movie);
+    if (MOVIE_Close(cnmv))
+        result = 1;
+    REWIND_Destroy(rewind);
+    NES_Destroy(nes);
+    return result;
+}
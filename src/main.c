@@ -22,7 +22,8 @@ int main(int argc, char **argv)
 
     NES* nes = NES_Create();
 
-    NES_Load("/home/riley/Downloads/Super Mario Bros..nes", nes);
+    if (argc > 1)
+        NES_Load(argv[1], nes);
     //NES_Load("nestest.nes", nes);
     //NES_Reset(nes);
 
@@ -127,9 +127,8 @@ void Profiler_EndFrame(void) {
     }
 }
 
-int Profiler_BeginSection(const char* name) {
-    if (!g_profiler_enabled || !name) return -1;
-
+// Index of the section called name, a new one if there is none yet. -1 when all are taken
+static int Profiler_FindSection(const char* name) {
     int section_id = -1;
     for (int i = 0; i < g_profiler_instance.num_sections; ++i) {
         if (strcmp(g_profiler_instance.sections[i].name, name) == 0) {
@@ -152,6 +151,14 @@ int Profiler_BeginSection(const char* name) {
         new_sec->max_time_ms = 0.0;
         for(int j=0; j<PROFILER_HISTORY_SIZE; ++j) new_sec->times[j] = 0.0;
     }
+    return section_id;
+}
+
+int Profiler_BeginSection(const char* name) {
+    if (!g_profiler_enabled || !name) return -1;
+
+    int section_id = Profiler_FindSection(name);
+    if (section_id == -1) return -1;
 
     ProfilerSection* sec = &g_profiler_instance.sections[section_id];
     sec->start_ticks = SDL_GetPerformanceCounter();
@@ -204,6 +211,34 @@ void Profiler_EndSection(int section_id) {
     }
 }
 
+void Profiler_RecordSection(const char* name, double time_ms) {
+    if (!g_profiler_enabled || !name || g_profiler_instance.perf_freq == 0) return;
+
+    int section_id = Profiler_FindSection(name);
+    if (section_id == -1) return;
+
+    // Placed in the flame graph as if it had just finished inside the open section
+    ProfilerSection* section = &g_profiler_instance.sections[section_id];
+    uint64_t now_offset_ticks = SDL_GetPerformanceCounter() - g_profiler_instance.frame_start_ticks;
+    double now_in_frame_ms = (double)now_offset_ticks * 1000.0 / g_profiler_instance.perf_freq;
+    section->parent_id = (g_profiler_instance.section_stack_top >= 0) ? g_profiler_instance.section_stack[g_profiler_instance.section_stack_top] : -1;
+    section->depth = g_profiler_instance.section_stack_top + 1;
+    section->start_time_in_frame_ms = now_in_frame_ms > time_ms ? now_in_frame_ms - time_ms : 0.0;
+
+    section->current_time_ms = time_ms;
+    section->times[section->history_idx] = time_ms;
+    section->history_idx = (section->history_idx + 1) % PROFILER_HISTORY_SIZE;
+
+    if (g_profiler_instance.last_frame_flame_items_count < PROFILER_MAX_FLAME_GRAPH_ITEMS) {
+        FlameGraphItem* item = &g_profiler_instance.last_frame_flame_items[g_profiler_instance.last_frame_flame_items_count++];
+        strncpy(item->name, section->name, PROFILER_SECTION_NAME_LEN -1);
+        item->name[PROFILER_SECTION_NAME_LEN-1] = '\0';
+        item->start_time_ms = section->start_time_in_frame_ms;
+        item->duration_ms = section->current_time_ms;
+        item->depth = section->depth;
+    }
+}
+
 float Profiler_GetFPS(void) {
     if (!g_profiler_enabled) return 0.0f;
     return g_profiler_instance.current_fps;
@@ -11,6 +11,7 @@
 #include <stdarg.h> // For va_list
 #include <float.h>  // For FLT_MIN
 #include <time.h>   // For logging timestamp
+#include <stdatomic.h>
 
 #include "debug.h"
 #include "profiler.h"
@@ -20,6 +21,9 @@
 #include "cNES/ppu.h"
 #include "cNES/bus.h"
 #include "cNES/debugging.h"
+#include "cNES/rewind.h"
+#include "cNES/movie.h"
+#include "cNES/emuthread.h"
 #include "cNES/version.h"
 
 #include "ui/cimgui_markdown.h"
@@ -36,6 +40,7 @@ ImVec4 clear_color; // Clear color for the swapchain
 static bool ui_paused = false;
 static char ui_romPath[256] = "";
 static char ui_currentRomName[256] = "No ROM Loaded";
+static char ui_currentRomPath[256] = "";
 static char ui_logBuffer[8192] = ""; // REFACTOR-NOTE: Increased buffer size. Consider a circular buffer for very extensive logging.
 static int ui_logLen = 0;
 static float ui_fps = 0.0f;
@@ -54,6 +59,50 @@ static int ui_selectedSaveLoadSlot = 0;
 
 static uint8_t nes_input_state[2] = {0, 0};
 
+// Rewind, history is recorded every frame while enabled and played back while Backspace is held
+static REWIND *ui_rewind = NULL;
+static bool ui_rewindEnabled = true;
+static bool ui_rewinding = false;
+static int ui_rewindBudgetMB = REWIND_DEFAULT_BUDGET / (1024 * 1024);
+static int ui_rewindInterval = REWIND_DEFAULT_INTERVAL;
+static int ui_rewindKeyframeInterval = REWIND_DEFAULT_KEYFRAME;
+static atomic_size_t ui_rewindFrames = 0; // History as of the last frame, for the settings window
+static atomic_size_t ui_rewindBytes = 0;
+
+// Called by whoever holds the emulation lock after ui_rewind changed
+static void UI_PublishRewindStats(void) {
+    atomic_store(&ui_rewindFrames, ui_rewind ? REWIND_GetFrameCount(ui_rewind) : 0);
+    atomic_store(&ui_rewindBytes, ui_rewind ? REWIND_GetMemoryUsed(ui_rewind) : 0);
+}
+
+// Input movie recording or playing back, kept next to the ROM as <rom>.cnmv
+static MOVIE *ui_movie = NULL;
+
+// Frames emulated ahead of the shown one to hide the game's input lag, 0 is off
+static int ui_runAheadFrames = 0;
+
+// Fast-forward while Tab is held or toggled from the menu. Runs this many frames per
+// shown frame, 0 runs as many as fit in one frame's time. Only the last one is drawn.
+#define UI_FAST_FORWARD_BUDGET_NS 14000000ull // Leaves some of the 16.6ms frame for publishing
+static bool ui_fastForward = false;
+static bool ui_fastForwardHeld = false;
+static int ui_fastForwardFrames = 0;
+static int ui_fastForwardAuto = 2; // Frames per shown frame the time budget allows, adjusted as it runs
+
+// Emulation speed for the status bar, from frames emulated over wall time
+static atomic_uint_fast64_t ui_emulatedFrames = 0;
+static uint64_t ui_speedFrames = 0;
+static uint64_t ui_speedTime = 0;
+static float ui_speed = 0.0f;
+
+// The NES runs on its own thread. Anything here that changes it holds the emulation
+// lock. Everything drawn every frame (game screen, CPU, memory and disassembler windows,
+// movie status) reads the last frame the thread published instead, never the lock
+static EMUTHREAD *ui_emuThread = NULL;
+static const EMUTHREAD_Frame *ui_frame = NULL;
+static uint64_t ui_profiledFrame = 0; // Last frame whose emulation thread timings went to the profiler
+static uint8_t ui_pushedInput[2] = {0, 0};
+
 bool ui_showCpuWindow = true;
 bool ui_showToolbar = true;
 bool ui_showDisassembler = true;
@@ -162,15 +211,34 @@ static void UI_AddRecentRom(const char* path) {
     ui_recentRoms[0][255] = '\0';
 }
 
+static void UI_StopMovie(void) {
+    if (!ui_movie) return;
+    bool recording = MOVIE_IsRecording(ui_movie);
+    uint64_t frames = MOVIE_GetFrame(ui_movie);
+    if (MOVIE_Close(ui_movie) == 0) UI_Log("Movie %s after %llu frames", recording ? "recorded" : "stopped", (unsigned long long)frames);
+    else UI_Log("Movie could not be written completely");
+    ui_movie = NULL;
+}
+
 void UI_LoadRom(NES* nes, const char* path) {
-    if (NES_Load(path, nes) == 0) {
+    EMUTHREAD_Lock(ui_emuThread);
+    UI_StopMovie(); // Belongs to the old ROM
+    int loaded = NES_Load(path, nes);
+    if (loaded == 0) {
+        NES_Reset(nes);
+        if (ui_rewind) REWIND_Clear(ui_rewind);
+    }
+    EMUTHREAD_Unlock(ui_emuThread);
+
+    if (loaded == 0) {
         UI_Log("Successfully loaded ROM: %s", path);
         const char* filename = strrchr(path, '/');
         if (!filename) filename = strrchr(path, '\\');
         if (filename) strncpy(ui_currentRomName, filename + 1, sizeof(ui_currentRomName) - 1);
         else strncpy(ui_currentRomName, path, sizeof(ui_currentRomName) - 1);
         ui_currentRomName[sizeof(ui_currentRomName) - 1] = '\0';
-        NES_Reset(nes);
+        strncpy(ui_currentRomPath, path, sizeof(ui_currentRomPath) - 1);
+        ui_currentRomPath[sizeof(ui_currentRomPath) - 1] = '\0';
         UI_AddRecentRom(path);
     } else {
         UI_Log("Failed to load ROM: %s", path);
@@ -182,7 +250,11 @@ void UI_LoadRom(NES* nes, const char* path) {
 
 void UI_Reset(NES* nes) {
     if (nes) { // REFACTOR-NOTE: Added null check for safety
+        EMUTHREAD_Lock(ui_emuThread);
+        UI_StopMovie();
         NES_Reset(nes);
+        if (ui_rewind) REWIND_Clear(ui_rewind);
+        EMUTHREAD_Unlock(ui_emuThread);
         UI_Log("NES Reset");
     } else {
         UI_Log("Cannot reset: No NES context.");
@@ -191,15 +263,23 @@ void UI_Reset(NES* nes) {
 
 void UI_StepFrame(NES* nes) {
     if (nes) { // REFACTOR-NOTE: Added null check
-        NES_StepFrame(nes);
+        if (ui_emuThread) EMUTHREAD_StepFrame(ui_emuThread);
+        else NES_StepFrame(nes);
         UI_Log("Stepped one frame");
     } else {
         UI_Log("Cannot step frame: No NES context.");
     }
 }
 
+static void UI_StepInstruction(NES* nes) {
+    if (!nes || !nes->cpu) return;
+    if (ui_emuThread) EMUTHREAD_StepInstruction(ui_emuThread);
+    else NES_Step(nes);
+}
+
 void UI_TogglePause(NES* nes) { // REFACTOR-NOTE: NES context not strictly needed here, but good for consistency if actions depend on it.
     ui_paused = !ui_paused;
+    if (ui_emuThread) EMUTHREAD_SetPaused(ui_emuThread, ui_paused);
     UI_Log(ui_paused ? "Emulation Paused" : "Emulation Resumed");
 }
 
@@ -278,6 +358,28 @@ void UI_DrawFileMenu(NES* nes) {
             ui_openLoadStateModal = true;
         }
         igSeparator();
+        char movie_path[300];
+        snprintf(movie_path, sizeof(movie_path), "%s.cnmv", ui_currentRomPath);
+        if (igMenuItem_Bool("Record Movie", NULL, false, rom_loaded_for_state && !ui_movie)) {
+            EMUTHREAD_Lock(ui_emuThread);
+            ui_movie = MOVIE_Record(nes, movie_path, MOVIE_ANCHOR_POWER_ON);
+            if (ui_rewind) REWIND_Clear(ui_rewind);
+            EMUTHREAD_Unlock(ui_emuThread);
+            UI_Log(ui_movie ? "Recording movie to %s" : "Failed to record movie to %s", movie_path);
+        }
+        if (igMenuItem_Bool("Play Movie", NULL, false, rom_loaded_for_state && !ui_movie)) {
+            EMUTHREAD_Lock(ui_emuThread);
+            ui_movie = MOVIE_Play(nes, movie_path);
+            if (ui_rewind) REWIND_Clear(ui_rewind);
+            EMUTHREAD_Unlock(ui_emuThread);
+            UI_Log(ui_movie ? "Playing movie %s" : "Failed to play movie %s", movie_path);
+        }
+        if (igMenuItem_Bool("Stop Movie", NULL, false, ui_movie != NULL)) {
+            EMUTHREAD_Lock(ui_emuThread);
+            UI_StopMovie();
+            EMUTHREAD_Unlock(ui_emuThread);
+        }
+        igSeparator();
         if (igMenuItem_Bool("Exit", "Alt+F4", false, true)) {
             SDL_Event quit_event;
             quit_event.type = SDL_EVENT_QUIT;
@@ -286,7 +388,7 @@ void UI_DrawFileMenu(NES* nes) {
         igEndMenu();
     }
 
-    // REFACTOR-NOTE: Save/Load state modals are placeholders. Actual implementation requires NES_SaveState/NES_LoadState.
+    // Save states live next to the ROM as <rom>.state<slot>
     if (ui_openSaveStateModal) {
         igOpenPopup_Str("Save State", 0);
         if (igBeginPopupModal("Save State", &ui_openSaveStateModal, ImGuiWindowFlags_AlwaysAutoResize)) {
@@ -296,8 +398,16 @@ void UI_DrawFileMenu(NES* nes) {
             ui_selectedSaveLoadSlot = ui_selectedSaveLoadSlot < 0 ? 0 : (ui_selectedSaveLoadSlot > 9 ? 9 : ui_selectedSaveLoadSlot);
 
             if (igButton("Save", (ImVec2){80,0})) {
-                UI_Log("Placeholder: Save state to slot %d for ROM: %s", ui_selectedSaveLoadSlot, ui_currentRomName);
-                // if (nes) NES_SaveState(nes, ui_selectedSaveLoadSlot); // Actual call
+                char state_path[300];
+                snprintf(state_path, sizeof(state_path), "%s.state%d", ui_currentRomPath, ui_selectedSaveLoadSlot);
+                EMUTHREAD_Lock(ui_emuThread);
+                int saved = nes ? NES_SaveStateFile(nes, state_path) : -1;
+                EMUTHREAD_Unlock(ui_emuThread);
+                if (saved == 0) {
+                    UI_Log("Saved state to slot %d for ROM: %s", ui_selectedSaveLoadSlot, ui_currentRomName);
+                } else {
+                    UI_Log("Failed to save state to %s", state_path);
+                }
                 ui_openSaveStateModal = false;
                 igCloseCurrentPopup();
             }
@@ -318,8 +428,18 @@ void UI_DrawFileMenu(NES* nes) {
             ui_selectedSaveLoadSlot = ui_selectedSaveLoadSlot < 0 ? 0 : (ui_selectedSaveLoadSlot > 9 ? 9 : ui_selectedSaveLoadSlot);
 
             if (igButton("Load", (ImVec2){80,0})) {
-                UI_Log("Placeholder: Load state from slot %d for ROM: %s", ui_selectedSaveLoadSlot, ui_currentRomName);
-                // if (nes) NES_LoadState(nes, ui_selectedSaveLoadSlot); // Actual call
+                char state_path[300];
+                snprintf(state_path, sizeof(state_path), "%s.state%d", ui_currentRomPath, ui_selectedSaveLoadSlot);
+                EMUTHREAD_Lock(ui_emuThread);
+                UI_StopMovie(); // The movie's input doesn't lead to the loaded state
+                int loaded = nes ? NES_LoadStateFile(nes, state_path) : -1;
+                if (loaded == 0 && ui_rewind) REWIND_Clear(ui_rewind);
+                EMUTHREAD_Unlock(ui_emuThread);
+                if (loaded == 0) {
+                    UI_Log("Loaded state from slot %d for ROM: %s", ui_selectedSaveLoadSlot, ui_currentRomName);
+                } else {
+                    UI_Log("Failed to load state from %s", state_path);
+                }
                 ui_openLoadStateModal = false;
                 igCloseCurrentPopup();
             }
@@ -641,7 +761,7 @@ void UI_MemoryViewer(NES* nes) {
                         igText("--");
                         continue;
                     }
-                    uint8_t value = BUS_Peek(nes, currentAddr); 
+                    uint8_t value = ui_frame ? EMUTHREAD_PeekFrame(ui_frame, currentAddr) : BUS_Peek(nes, currentAddr); // Memory as of the last published frame or step
                     uint8_t prevValue = ui_memorySnapshot[currentAddr];
 
                     if (nes->cpu && !ui_paused) { 
@@ -665,6 +785,10 @@ void UI_MemoryViewer(NES* nes) {
     igEnd();
 }
 
+static uint8_t UI_PeekFrame(const void *frame, uint16_t address) {
+    return EMUTHREAD_PeekFrame(frame, address);
+}
+
 void UI_DrawDisassembler(NES* nes) {
     if (!ui_showDisassembler) return;
     if (!nes || !nes->cpu) {
@@ -673,11 +797,12 @@ void UI_DrawDisassembler(NES* nes) {
     }
     if (igBegin("Disassembler", &ui_showDisassembler, ImGuiWindowFlags_None)) {
         // REFACTOR-NOTE: Add breakpoint setting, step-over/step-out controls, and syntax highlighting for a richer debugger.
-        uint16_t pc_to_disassemble = nes->cpu->pc;
+        const CPU* cpu = ui_frame ? &ui_frame->cpu : nes->cpu; // Code and registers as of the last published frame or step
+        uint16_t pc_to_disassemble = cpu->pc;
         igText("Current PC: 0x%04X", pc_to_disassemble);
         igSameLine(0, 20);
         if(igButton("Step Op (F7)", (ImVec2){0,0})) { // REFACTOR-NOTE: F7 mapping added here for local control
-            if(ui_paused) NES_Step(nes); 
+            if(ui_paused) UI_StepInstruction(nes); 
             else UI_Log("Cannot step instruction while running. Pause first (F6).");
         }
 
@@ -688,16 +813,16 @@ void UI_DrawDisassembler(NES* nes) {
             igTableSetupColumn("Instruction", ImGuiTableColumnFlags_WidthStretch, 0, 0);
             
             char disasm_buf[128];
-            uint16_t addr_iter = nes->cpu->pc; 
+            uint16_t addr_iter = cpu->pc; 
 
             // Attempt to show a few lines before PC (very simplified, true back-disassembly is complex)
             // This naive approach just starts a bit earlier and hopes instructions align.
-            uint16_t start_addr = nes->cpu->pc;
+            uint16_t start_addr = cpu->pc;
             for(int pre_lines = 0; pre_lines < 8; ++pre_lines) {
                 if (start_addr < 5) { start_addr = 0; break; } // Avoid underflow by too much
                 start_addr -= 3; // Guess average instruction length
             }
-            if (start_addr > nes->cpu->pc) start_addr = nes->cpu->pc; // Safety if PC is very low
+            if (start_addr > cpu->pc) start_addr = cpu->pc; // Safety if PC is very low
 
             addr_iter = start_addr;
 
@@ -705,7 +830,7 @@ void UI_DrawDisassembler(NES* nes) {
                 igTableNextRow(0,0);
                 
                 igTableSetColumnIndex(0);
-                if (addr_iter == nes->cpu->pc) {
+                if (addr_iter == cpu->pc) {
                     igText(">"); 
                 } else {
                     igText(" ");
@@ -716,7 +841,7 @@ void UI_DrawDisassembler(NES* nes) {
 
                 igTableSetColumnIndex(2);
                 uint16_t prev_addr_iter = addr_iter;
-                addr_iter = disassemble(nes, addr_iter, disasm_buf, sizeof(disasm_buf)); // disassemble should return next instruction's address
+                addr_iter = ui_frame ? disassemble_memory(UI_PeekFrame, ui_frame, addr_iter, disasm_buf, sizeof(disasm_buf)) : disassemble(nes, addr_iter, disasm_buf, sizeof(disasm_buf)); // disassemble should return next instruction's address
                 igTextUnformatted(disasm_buf, NULL);
 
                 if (addr_iter <= prev_addr_iter && i < 31) { // Prevent infinite loop if disassembly stalls, but allow last line
@@ -968,7 +1093,49 @@ void UI_SettingsWindow(NES* nes) {
                 igEndTabItem();
             }
             // REFACTOR-NOTE: Add "Paths" tab for save states, screenshots, default ROMs directory.
-            // REFACTOR-NOTE: Add "Advanced" tab for emulation tweaks (e.g., CPU/PPU cycle accuracy options if available).
+            if (igBeginTabItem("Advanced", NULL, 0)) {
+                // The emulation thread reads these every frame. They are edited in copies
+                // and the lock is only taken to store a change
+                int run_ahead = ui_runAheadFrames;
+                int fast_forward = ui_fastForwardFrames;
+                bool emulation_changed = false;
+                emulation_changed |= igSliderInt("Run-Ahead Frames", &run_ahead, 0, 4, "%d", 0);
+                igSameLine(0, 10); igTextDisabled("(each frame costs this many extra frames of emulation)");
+                emulation_changed |= igSliderInt("Fast-Forward Frames", &fast_forward, 0, 16, fast_forward ? "%d" : "Unlimited", 0);
+                igSameLine(0, 10); igTextDisabled("(emulated per shown frame while fast-forwarding, hold Tab)");
+                if (emulation_changed) {
+                    EMUTHREAD_Lock(ui_emuThread);
+                    ui_runAheadFrames = run_ahead;
+                    ui_fastForwardFrames = fast_forward;
+                    EMUTHREAD_Unlock(ui_emuThread);
+                }
+                igSeparator();
+                bool rewind_enabled = ui_rewindEnabled;
+                int rewind_budget = ui_rewindBudgetMB;
+                int rewind_interval = ui_rewindInterval;
+                int rewind_keyframe = ui_rewindKeyframeInterval;
+                bool rewind_changed = false;
+                rewind_changed |= igCheckbox("Rewind (hold Backspace)", &rewind_enabled);
+                rewind_changed |= igSliderInt("History Budget (MB)", &rewind_budget, 1, 64, "%d", 0);
+                rewind_changed |= igSliderInt("Frames per Snapshot", &rewind_interval, 1, 30, "%d", 0);
+                rewind_changed |= igSliderInt("Snapshots per Keyframe", &rewind_keyframe, 1, 120, "%d", 0);
+                if (rewind_changed) {
+                    EMUTHREAD_Lock(ui_emuThread);
+                    ui_rewindEnabled = rewind_enabled;
+                    ui_rewindBudgetMB = rewind_budget;
+                    ui_rewindInterval = rewind_interval;
+                    ui_rewindKeyframeInterval = rewind_keyframe;
+                    REWIND_Destroy(ui_rewind); // Recreated with the new settings on the next frame
+                    ui_rewind = NULL;
+                    UI_PublishRewindStats();
+                    EMUTHREAD_Unlock(ui_emuThread);
+                }
+                if (ui_rewindEnabled) {
+                    igText("History: %zu frames, %.2f MB", atomic_load(&ui_rewindFrames), atomic_load(&ui_rewindBytes) / (1024.0 * 1024.0));
+                }
+                // REFACTOR-NOTE: Add CPU/PPU cycle accuracy options here if available.
+                igEndTabItem();
+            }
             igEndTabBar();
         }
         igSeparator();
@@ -1126,7 +1293,7 @@ static void UI_DebugToolbar(NES* nes) {
         const char* pause_label = ui_paused ? "Resume (F6)" : "Pause (F6)";
         if (igButton(pause_label, (ImVec2){0,0})) UI_TogglePause(nes);
         igSameLine(0, 4);
-        if (igButton("Step CPU (F7)", (ImVec2){0,0})) { if (ui_paused && nes && nes->cpu) NES_Step(nes); else UI_Log("Can only step CPU when paused."); }
+        if (igButton("Step CPU (F7)", (ImVec2){0,0})) { if (ui_paused && nes && nes->cpu) UI_StepInstruction(nes); else UI_Log("Can only step CPU when paused."); }
         igSameLine(0, 4);
         if (igButton("Step Frame (F8)", (ImVec2){0,0})) { if (ui_paused && nes) UI_StepFrame(nes); else UI_Log("Can only step frame when paused.");}
         igSameLine(0, 4);
@@ -1167,18 +1334,19 @@ static void UI_CpuWindow(NES* nes) {
          if (ui_showCpuWindow && (!nes || !nes->cpu)) ui_showCpuWindow = false;
         return;
     }
+    const CPU* cpu = ui_frame ? &ui_frame->cpu : nes->cpu; // Registers as of the last published frame or step
     if (igBegin("CPU Registers", &ui_showCpuWindow, ImGuiWindowFlags_None)) { 
-        igText("A:  0x%02X (%3d)", nes->cpu->a, nes->cpu->a); // %3d for consistent spacing
-        igText("X:  0x%02X (%3d)", nes->cpu->x, nes->cpu->x);
-        igText("Y:  0x%02X (%3d)", nes->cpu->y, nes->cpu->y);
-        igText("SP: 0x01%02X", nes->cpu->sp); 
-        igText("PC: 0x%04X", nes->cpu->pc);
+        igText("A:  0x%02X (%3d)", cpu->a, cpu->a); // %3d for consistent spacing
+        igText("X:  0x%02X (%3d)", cpu->x, cpu->x);
+        igText("Y:  0x%02X (%3d)", cpu->y, cpu->y);
+        igText("SP: 0x01%02X", cpu->sp); 
+        igText("PC: 0x%04X", cpu->pc);
         
-        igText("Status: 0x%02X [", nes->cpu->status);
+        igText("Status: 0x%02X [", cpu->status);
         igSameLine(0,0);
         const char* flag_names = "NV-BDIZC"; // Bit 5 is often shown as '-', though it has a value in the register
         for (int i = 7; i >= 0; i--) { 
-            bool is_set = (nes->cpu->status >> i) & 1;
+            bool is_set = (cpu->status >> i) & 1;
             // Bit 5 ('-') is conventionally shown as set if its bit in the status byte is 1.
             // The B flag (bit 4) has two meanings depending on context (interrupt vs PHP/BRK).
             // Here we just show the raw status register bits.
@@ -1192,7 +1360,7 @@ static void UI_CpuWindow(NES* nes) {
         }
         igSameLine(0,0); igText("]");
         igNewLine();
-        igText("Total Cycles: %llu", (unsigned long long)nes->cpu->total_cycles);
+        igText("Total Cycles: %llu", (unsigned long long)cpu->total_cycles);
         // REFACTOR-NOTE: Add display for pending interrupts (NMI, IRQ lines state from bus/CPU).
         // REFACTOR-NOTE: Add instruction timing/cycle count for current/last instruction (requires more detailed CPU state).
     }
@@ -1206,9 +1374,14 @@ void UI_DrawMainMenuBar(NES* nes) {
             bool rom_loaded = (nes != NULL && strlen(ui_currentRomName) > 0 && strcmp(ui_currentRomName, "No ROM Loaded") != 0 && strcmp(ui_currentRomName, "Failed to load ROM") != 0);
             if (igMenuItem_Bool(ui_paused ? "Resume" : "Pause", "F6", false, rom_loaded)) UI_TogglePause(nes);
             if (igMenuItem_Bool("Reset", "F5", false, rom_loaded)) UI_Reset(nes);
-            if (igMenuItem_Bool("Step CPU Instruction", "F7", false, rom_loaded && ui_paused)) { if(nes && nes->cpu) NES_Step(nes); }
+            if (igMenuItem_Bool("Step CPU Instruction", "F7", false, rom_loaded && ui_paused)) UI_StepInstruction(nes);
             if (igMenuItem_Bool("Step Frame", "F8", false, rom_loaded && ui_paused)) UI_StepFrame(nes);
-            // REFACTOR-NOTE: Add speed controls (e.g., 50%, 100%, 200%, turbo mode). Would require timing adjustments in main loop.
+            bool fast_forward = ui_fastForward;
+            if (igMenuItem_Bool("Fast Forward", "Tab", fast_forward, rom_loaded)) {
+                EMUTHREAD_Lock(ui_emuThread);
+                ui_fastForward = !fast_forward;
+                EMUTHREAD_Unlock(ui_emuThread);
+            }
             igEndMenu();
         }
         if (igBeginMenu("View", true)) {
@@ -1312,14 +1485,15 @@ void UI_GameScreenWindow(NES* nes)
             }
 
             // Update texture if we have new frame data
-            if (ppu_game_texture && nes->ppu->framebuffer) {
+            if (ppu_game_texture) {
                 // Map transfer buffer
                 void* mapped_memory = SDL_MapGPUTransferBuffer(gpu_device, ppu_game_transfer_buffer, false);
                 if (!mapped_memory) {
                     UI_Log("GameScreen: Failed to map GPU transfer buffer: %s", SDL_GetError());
                 } else {
-                    // Copy frame data to transfer buffer
-                    memcpy(mapped_memory, nes->ppu->framebuffer, 256 * 240 * sizeof(uint32_t));
+                    // Convert the indexed frame straight into the transfer buffer
+                    // The last published frame, the live one may be half drawn
+                    PPU_ConvertFramebuffer(ui_frame ? &ui_frame->ppu : nes->ppu, mapped_memory, 256 * sizeof(uint32_t), PPU_PIXEL_FORMAT_RRGGBBAA);
                     SDL_UnmapGPUTransferBuffer(gpu_device, ppu_game_transfer_buffer);
 
                     // Create command buffer for the copy operation
@@ -1589,7 +1763,25 @@ void UI_DrawStatusBar(NES* nes)
         // FPS calculation is now handled by the profiler
         ui_fps = Profiler_GetFPS();
         
-        igText("FPS: %.1f | ROM: %s | %s", ui_fps, ui_currentRomName, ui_paused ? "Paused" : "Running");
+        // Emulated frames against real time, averaged over half a second
+        uint64_t now = SDL_GetTicksNS();
+        if (now - ui_speedTime >= 500000000ull) {
+            uint64_t frames = atomic_load(&ui_emulatedFrames);
+            if (ui_speedTime) ui_speed = (float)((frames - ui_speedFrames) / ((now - ui_speedTime) / 1e9) / EMUTHREAD_NTSC_FPS * 100.0);
+            ui_speedFrames = frames;
+            ui_speedTime = now;
+        }
+
+        igText("FPS: %.1f | Speed: %.0f%% | ROM: %s | %s", ui_fps, ui_speed, ui_currentRomName, ui_paused ? "Paused" : (ui_fastForward || ui_fastForwardHeld) ? "Fast Forward" : "Running");
+        // The movie as of the last published frame, the emulation thread is still writing to it
+        if (ui_frame ? ui_frame->movie : ui_movie != NULL) {
+            bool recording = ui_frame ? ui_frame->movie_recording : MOVIE_IsRecording(ui_movie);
+            uint64_t frame = ui_frame ? ui_frame->movie_frame : MOVIE_GetFrame(ui_movie);
+            uint64_t length = ui_frame ? ui_frame->movie_length : MOVIE_GetLength(ui_movie);
+            igSameLine(0, 0);
+            if (recording) igText(" | Recording %llu", (unsigned long long)frame);
+            else igText(" | Movie %llu/%llu", (unsigned long long)frame, (unsigned long long)length);
+        }
         
         const char* version_text = CNES_VERSION_BUILD_STRING; // REFACTOR-NOTE: Consistent versioning
         ImVec2 version_text_size;
@@ -1703,6 +1895,71 @@ void UI_Draw(NES* nes) {
 
 bool ui_quit_requested = false; 
 
+// Profiler section for a part of UI_EmulateFrame. On the emulation thread the profiler
+// can't be used, the timing goes out with the frame instead (see UI_Update)
+static void UI_EmulationSection(const char* name, uint64_t elapsed_ns) {
+    if (EMUTHREAD_AddTiming(name, elapsed_ns)) Profiler_RecordSection(name, elapsed_ns / 1e6);
+}
+
+// One frame of emulation, run on the emulation thread with its lock held
+static void UI_EmulateFrame(NES* nes, void* userdata) {
+    if (ui_rewindEnabled && !ui_rewind) {
+        ui_rewind = REWIND_Create(nes, (size_t)ui_rewindBudgetMB * 1024 * 1024, ui_rewindInterval, ui_rewindKeyframeInterval);
+    }
+
+    // Stepping back would leave a movie's input out of step with the game
+    if (ui_rewinding && ui_rewind && !ui_movie) {
+        uint64_t start = SDL_GetTicksNS();
+        REWIND_StepBack(ui_rewind);
+        UI_EmulationSection("Rewind_StepBack", SDL_GetTicksNS() - start);
+        UI_PublishRewindStats();
+        return;
+    }
+
+    if (ui_fastForward || ui_fastForwardHeld) {
+        // Run-ahead is pointless when most frames aren't shown anyway
+        int frames = ui_fastForwardFrames > 0 ? ui_fastForwardFrames : ui_fastForwardAuto;
+        uint64_t start = SDL_GetTicksNS();
+        // NES_FastForward without the rewind history skipping the batch: every frame is
+        // captured, only the last one is drawn
+        uint64_t capture_ns = 0;
+        for (int frame = 1; frame <= frames; frame++) {
+            nes->ppu->suppress_output = frame < frames;
+            NES_StepFrame(nes);
+            if (ui_rewind) {
+                uint64_t capture_start = SDL_GetTicksNS();
+                REWIND_Capture(ui_rewind);
+                capture_ns += SDL_GetTicksNS() - capture_start;
+            }
+        }
+        if (ui_rewind) UI_EmulationSection("Rewind_Capture", capture_ns);
+        nes->ppu->suppress_output = false;
+        atomic_fetch_add(&ui_emulatedFrames, (uint64_t)frames);
+
+        if (ui_fastForwardFrames == 0) {
+            // Aim the next batch at the time budget from how long this one took
+            uint64_t elapsed = SDL_GetTicksNS() - start;
+            uint64_t fit = elapsed ? (uint64_t)frames * UI_FAST_FORWARD_BUDGET_NS / elapsed : 64;
+            ui_fastForwardAuto = fit < 1 ? 1 : (fit > 64 ? 64 : (int)fit);
+        }
+    } else {
+        if (ui_runAheadFrames > 0) {
+            uint64_t start = SDL_GetTicksNS();
+            NES_RunAhead(nes, ui_runAheadFrames);
+            UI_EmulationSection("NES_RunAhead", SDL_GetTicksNS() - start);
+        } else {
+            NES_StepFrame(nes);
+        }
+        atomic_fetch_add(&ui_emulatedFrames, 1);
+        if (ui_rewind) {
+            uint64_t start = SDL_GetTicksNS();
+            REWIND_Capture(ui_rewind);
+            UI_EmulationSection("Rewind_Capture", SDL_GetTicksNS() - start);
+        }
+    }
+    UI_PublishRewindStats();
+}
+
 void UI_Update(NES* nes) {
     Profiler_BeginFrame(); // Profiler: Begin Frame
 
@@ -1723,7 +1980,7 @@ void UI_Update(NES* nes) {
 
             if (e.key.key == SDLK_F5 && nes) UI_Reset(nes);
             if (e.key.key == SDLK_F6 && nes) UI_TogglePause(nes);
-            if (e.key.key == SDLK_F7 && nes && nes->cpu && ui_paused) NES_Step(nes);
+            if (e.key.key == SDLK_F7 && nes && nes->cpu && ui_paused) UI_StepInstruction(nes);
             if (e.key.key == SDLK_F8 && nes && ui_paused) UI_StepFrame(nes);    
             if (e.key.key == SDLK_F10) ui_showSettingsWindow = !ui_showSettingsWindow;
             if (e.key.key == SDLK_F11) UI_ToggleFullscreen();
@@ -1741,6 +1998,18 @@ void UI_Update(NES* nes) {
         }
         if ((e.type == SDL_EVENT_KEY_DOWN || e.type == SDL_EVENT_KEY_UP) && !ioptr->WantCaptureKeyboard) {
             UI_HandleInputEvent(&e);
+            // Key repeats change nothing, only take the lock when the held state does
+            bool held = (e.type == SDL_EVENT_KEY_DOWN);
+            if (e.key.key == SDLK_BACKSPACE && held != ui_rewinding) {
+                EMUTHREAD_Lock(ui_emuThread);
+                ui_rewinding = held;
+                EMUTHREAD_Unlock(ui_emuThread);
+            }
+            if (e.key.key == SDLK_TAB && held != ui_fastForwardHeld) {
+                EMUTHREAD_Lock(ui_emuThread);
+                ui_fastForwardHeld = held;
+                EMUTHREAD_Unlock(ui_emuThread);
+            }
         }
     }
 
@@ -1755,12 +2024,33 @@ void UI_Update(NES* nes) {
     igNewFrame();
 
     if (nes) { 
-        NES_SetController(nes, 0, nes_input_state[0]);
-        NES_SetController(nes, 1, nes_input_state[1]);
+        if (!ui_emuThread) {
+            ui_emuThread = EMUTHREAD_Create(nes, UI_EmulateFrame, NULL);
+            if (ui_emuThread) EMUTHREAD_SetPaused(ui_emuThread, ui_paused);
+        }
 
-        if(!ui_paused) {
+        if (ui_emuThread) {
+            // Only changes are queued, the thread keeps applying the last input it saw
+            if (memcmp(ui_pushedInput, nes_input_state, sizeof(ui_pushedInput)) != 0 &&
+                EMUTHREAD_PushInput(ui_emuThread, nes_input_state[0], nes_input_state[1]) == 0) {
+                memcpy(ui_pushedInput, nes_input_state, sizeof(ui_pushedInput));
+            }
+            int section_acquire = Profiler_BeginSection("EMUTHREAD_AcquireFrame");
+            ui_frame = EMUTHREAD_AcquireFrame(ui_emuThread);
+            Profiler_EndSection(section_acquire);
+
+            // Sections timed on the emulation thread, once per frame it ran
+            if (ui_frame->frame != ui_profiledFrame) {
+                for (int i = 0; i < ui_frame->timing_count; ++i) {
+                    Profiler_RecordSection(ui_frame->timings[i].name, ui_frame->timings[i].ns / 1e6);
+                }
+                ui_profiledFrame = ui_frame->frame;
+            }
+        } else if (!ui_paused) { // No thread, emulate in step with the UI instead
+            NES_SetController(nes, 0, nes_input_state[0]);
+            NES_SetController(nes, 1, nes_input_state[1]);
             int section_nes_step = Profiler_BeginSection("NES_StepFrame");
-            NES_StepFrame(nes); 
+            UI_EmulateFrame(nes, NULL);
             Profiler_EndSection(section_nes_step);
         }
     }
@@ -1847,6 +2137,12 @@ void UI_Shutdown() {
     // REFACTOR-NOTE: Save recent ROMs list, window positions/docking layout (imgui.ini handles docking if enabled).
     // Consider saving settings (theme, volume) to a config file.
     Profiler_Shutdown(); // Shutdown Profiler
+    EMUTHREAD_Destroy(ui_emuThread); // Nothing else runs on the NES after this
+    ui_emuThread = NULL;
+    ui_frame = NULL;
+    REWIND_Destroy(ui_rewind);
+    ui_rewind = NULL;
+    UI_StopMovie();
 
     DEBUG_INFO("Shutting down UI");
 
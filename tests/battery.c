@@ -0,0 +1,145 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cNES/bus.h"
+#include "cNES/movie.h"
+#include "cNES/nes.h"
+
+#include "rom_fixture.h"
+
+// Checks that battery saves only ever hold what the player did. A small NROM cart
+// with a battery writes $AA to $6000 at power on, the save starts filled with $55.
+// Recording and playing a movie must leave the save as it was, running the cart
+// without one must write the $AA back.
+//
+// usage: cnes_battery [scratch dir]
+
+#define BATTERY_TEST_FRAMES 5
+#define BATTERY_SAVE_SIZE   0x2000
+#define BATTERY_SAVE_FILL   0x55
+
+// NROM cart with a battery: 16KB PRG ROM with the code at $C000 and 8KB CHR ROM
+static uint8_t *build_rom(size_t *size)
+{
+    static const uint8_t code[] = {
+        0xA9, 0xAA,       // lda #$AA
+        0x8D, 0x00, 0x60, // sta $6000
+        0x4C, 0x05, 0xC0, // jmp *
+    };
+
+    uint8_t *image = rom_fixture_build(0, 1, 1, 0x02, size);
+    if (image)
+        rom_fixture_entry(image, code, sizeof(code));
+    return image;
+}
+
+static int write_save(const char *path)
+{
+    uint8_t save[BATTERY_SAVE_SIZE];
+    memset(save, BATTERY_SAVE_FILL, sizeof(save));
+
+    FILE *file = fopen(path, "wb");
+    if (!file)
+        return -1;
+    size_t written = fwrite(save, 1, sizeof(save), file);
+    return (fclose(file) == 0 && written == sizeof(save)) ? 0 : -1;
+}
+
+// 0 if the save holds first and then BATTERY_SAVE_FILL everywhere else
+static int check_save(const char *path, uint8_t first, const char *what)
+{
+    uint8_t save[BATTERY_SAVE_SIZE];
+    FILE *file = fopen(path, "rb");
+    size_t read = file ? fread(save, 1, sizeof(save), file) : 0;
+    if (file)
+        fclose(file);
+
+    size_t offset = 0;
+    if (read == sizeof(save) && save[0] == first)
+        for (offset = 1; offset < sizeof(save) && save[offset] == BATTERY_SAVE_FILL; offset++)
+            ;
+    if (offset == sizeof(save))
+        return 0;
+
+    fprintf(stderr, "%s: save differs at offset %zu\n", what, offset);
+    return -1;
+}
+
+// Runs the cart with the save attached, through a movie when movie_path is set
+static int run(const uint8_t *image, size_t size, const char *save_path, const char *movie_path, int record)
+{
+    NES *nes = NES_Create();
+    if (!nes || NES_LoadMemory(nes, image, size) || NES_SetBatteryFile(nes, save_path))
+    {
+        fprintf(stderr, "could not set up the cart\n");
+        NES_Destroy(nes);
+        return -1;
+    }
+
+    MOVIE *movie = NULL;
+    if (movie_path && !(movie = record ? MOVIE_Record(nes, movie_path, MOVIE_ANCHOR_POWER_ON) : MOVIE_Play(nes, movie_path)))
+    {
+        fprintf(stderr, "could not open the movie\n");
+        NES_Destroy(nes);
+        return -1;
+    }
+
+    int result = 0;
+    for (int frame = 0; frame < BATTERY_TEST_FRAMES; frame++)
+        NES_StepFrame(nes);
+
+    if (movie)
+    {
+        // The movie sees cleared PRG RAM, the game sees its save again once it is closed
+        if (nes->bus->prg_ram[0] != 0xAA || nes->bus->prg_ram[1] != 0x00)
+        {
+            fprintf(stderr, "the movie didn't start from cleared PRG RAM\n");
+            result = -1;
+        }
+        if (MOVIE_Close(movie))
+            result = -1;
+        if (nes->bus->prg_ram[0] != BATTERY_SAVE_FILL)
+        {
+            fprintf(stderr, "PRG RAM wasn't given back to the save after the movie\n");
+            result = -1;
+        }
+        NES_StepFrame(nes);
+    }
+
+    NES_Destroy(nes);
+    return result;
+}
+
+int main(int argc, char **argv)
+{
+    const char *dir = argc > 1 ? argv[1] : ".";
+    char save_path[1024], movie_path[1024];
+    snprintf(save_path, sizeof(save_path), "%s/cnes_battery_test.sav", dir);
+    snprintf(movie_path, sizeof(movie_path), "%s/cnes_battery_test.cnmv", dir);
+
+    size_t size = 0;
+    uint8_t *image = build_rom(&size);
+    if (!image || write_save(save_path))
+    {
+        fprintf(stderr, "could not write %s\n", save_path);
+        free(image);
+        return 1;
+    }
+
+    int result = 0;
+    if (run(image, size, save_path, movie_path, 1) || check_save(save_path, BATTERY_SAVE_FILL, "recording"))
+        result = 1;
+    else if (run(image, size, save_path, movie_path, 0) || check_save(save_path, BATTERY_SAVE_FILL, "playback"))
+        result = 1;
+    else if (run(image, size, save_path, NULL, 0) || check_save(save_path, 0xAA, "no movie"))
+        result = 1;
+
+    if (!result)
+        printf("battery saves match\n");
+
+    remove(save_path);
+    remove(movie_path);
+    free(image);
+    return result;
+}
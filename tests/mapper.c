@@ -0,0 +1,268 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cNES/bus.h"
+#include "cNES/cpu.h"
+#include "cNES/mapper.h"
+#include "cNES/nes.h"
+#include "cNES/ppu.h"
+
+#include "rom_fixture.h"
+
+// Builds small carts for every supported mapper, writes their registers the way a
+// game would and checks where the CPU pages and CHR slots end up, the nametable
+// mirroring, that MMC3 PRG RAM protection swaps the $6000-$7FFF pages and that
+// the MMC3 IRQ fires on the rendered line its latch says.
+//
+// usage: cnes_mapper
+
+#define MAPPER_TEST_IRQ_LATCH 10
+
+static NES *load(uint8_t mapper, int prg16, int chr8, uint8_t flags, uint8_t first_byte)
+{
+    size_t size = 0;
+    uint8_t *image = rom_fixture_build(mapper, prg16, chr8, flags, &size);
+    NES *nes = image ? NES_Create() : NULL;
+    if (image)
+        image[16] = first_byte; // First byte of PRG ROM, what a read-modify-write of $8000 reads
+    if (!nes || NES_LoadMemory(nes, image, size))
+    {
+        fprintf(stderr, "mapper %d: could not load the cart\n", mapper);
+        NES_Destroy(nes);
+        nes = NULL;
+    }
+    free(image);
+    return nes;
+}
+
+// Register write from the CPU, as far apart from the last one as sta abs writes are
+static void write_register(NES *nes, uint16_t address, uint8_t value)
+{
+    BUS_Write(nes, address, value);
+    nes->cpu->total_cycles += 4;
+}
+
+// Loads an MMC1 register through its serial port, 5 bits LSB first
+static void write_mmc1(NES *nes, uint16_t address, uint8_t value)
+{
+    for (int bit = 0; bit < 5; bit++)
+        write_register(nes, address, (uint8_t)((value >> bit) & 0x01));
+}
+
+static int check(int ok, const char *what)
+{
+    if (!ok)
+        fprintf(stderr, "%s\n", what);
+    return ok ? 0 : -1;
+}
+
+// 0 if the 8KB at a CPU address is PRG ROM unit `unit`
+static int check_prg(NES *nes, uint16_t address, int unit, const char *what)
+{
+    const uint8_t *expected = nes->bus->prg_rom + (size_t)unit * 0x2000;
+    int ok = 1;
+    for (int page = 0; page < 0x20; page++)
+        ok &= nes->bus->read_pages[(address >> 8) + page] == expected + page * 0x100;
+    return check(ok, what);
+}
+
+// 0 if `count` CHR slots from `slot` on hold the 1KB units from `unit` on
+static int check_chr(NES *nes, int slot, int count, int unit, const char *what)
+{
+    int ok = 1;
+    for (int i = 0; i < count; i++)
+        ok &= nes->bus->chr_pages[slot + i] == nes->bus->chr + (size_t)(unit + i) * BUS_CHR_SLOT_SIZE;
+    return check(ok, what);
+}
+
+static int test_nrom(void)
+{
+    NES *nes = load(0, 1, 1, 0x01, 0);
+    if (!nes)
+        return -1;
+
+    int result = 0;
+    result |= check_prg(nes, 0x8000, 0, "NROM: 16KB PRG not at $8000");
+    result |= check_prg(nes, 0xC000, 0, "NROM: 16KB PRG not mirrored at $C000");
+    result |= check_chr(nes, 0, 8, 0, "NROM: CHR not mapped");
+    result |= check(nes->ppu->mirror_mode == MIRROR_VERTICAL, "NROM: mirroring doesn't follow the header");
+    NES_Destroy(nes);
+    return result;
+}
+
+static int test_mmc1(void)
+{
+    // $8000 reads $02, a read-modify-write there shifts in 0 and then 1
+    NES *nes = load(1, 8, 16, 0x00, 0x02);
+    if (!nes)
+        return -1;
+
+    MAPPER_State *state = &nes->bus->mapper_state;
+    int result = 0;
+    result |= check_prg(nes, 0xC000, 14, "MMC1: last bank not fixed at $C000 at power on");
+
+    // inc $8000 from RAM: only the dummy write of the value read may reach the serial port
+    static const uint8_t inc[] = { 0xEE, 0x00, 0x80 };
+    memcpy(nes->bus->ram, inc, sizeof(inc));
+    nes->cpu->pc = 0x0000;
+    CPU_Step(nes->cpu);
+    result |= check(state->shift_count == 1 && state->shift == 0, "MMC1: write on the cycle after the last one wasn't ignored");
+    write_register(nes, 0x8000, 0x80);
+    result |= check(state->shift_count == 0, "MMC1: bit 7 didn't clear the serial port");
+
+    write_mmc1(nes, 0xE000, 3);
+    result |= check_prg(nes, 0x8000, 6, "MMC1: PRG bank 3 not at $8000");
+    result |= check_prg(nes, 0xC000, 14, "MMC1: last bank moved off $C000");
+
+    write_mmc1(nes, 0x8000, 0x08); // Control: PRG mode 2, one screen low
+    result |= check_prg(nes, 0x8000, 0, "MMC1: first bank not fixed at $8000 in mode 2");
+    result |= check_prg(nes, 0xC000, 6, "MMC1: PRG bank 3 not at $C000 in mode 2");
+    result |= check(nes->ppu->mirror_mode == MIRROR_SINGLE_SCREEN_LOW, "MMC1: not one screen low");
+
+    write_mmc1(nes, 0x8000, 0x13); // 4KB CHR, PRG mode 0, horizontal
+    write_mmc1(nes, 0xE000, 5);
+    write_mmc1(nes, 0xA000, 5);
+    write_mmc1(nes, 0xC000, 9);
+    result |= check_prg(nes, 0x8000, 8, "MMC1: 32KB bank 2 not at $8000");
+    result |= check_prg(nes, 0xA000, 9, "MMC1: 32KB bank 2 doesn't continue at $A000");
+    result |= check_chr(nes, 0, 4, 5 * 4, "MMC1: 4KB CHR bank 5 not at $0000");
+    result |= check_chr(nes, 4, 4, 9 * 4, "MMC1: 4KB CHR bank 9 not at $1000");
+    result |= check(nes->ppu->mirror_mode == MIRROR_HORIZONTAL, "MMC1: not horizontal");
+
+    write_mmc1(nes, 0x8000, 0x0E); // 8KB CHR, PRG mode 3, vertical
+    result |= check_chr(nes, 0, 8, 2 * 8, "MMC1: 8KB CHR bank 2 not at $0000");
+    result |= check(nes->ppu->mirror_mode == MIRROR_VERTICAL, "MMC1: not vertical");
+
+    NES_Destroy(nes);
+    return result;
+}
+
+static int test_uxrom(void)
+{
+    NES *nes = load(2, 4, 0, 0x00, 0);
+    if (!nes)
+        return -1;
+
+    int result = 0;
+    write_register(nes, 0x8000, 2);
+    result |= check_prg(nes, 0x8000, 4, "UxROM: bank 2 not at $8000");
+    result |= check_prg(nes, 0xC000, 6, "UxROM: last bank not fixed at $C000");
+    result |= check(nes->bus->chr == nes->bus->chr_ram, "UxROM: CHR RAM not mapped");
+    result |= check(nes->ppu->mirror_mode == MIRROR_HORIZONTAL, "UxROM: mirroring doesn't follow the header");
+    NES_Destroy(nes);
+    return result;
+}
+
+static int test_cnrom(void)
+{
+    NES *nes = load(3, 2, 4, 0x00, 0);
+    if (!nes)
+        return -1;
+
+    int result = 0;
+    write_register(nes, 0xFFFF, 3);
+    result |= check_prg(nes, 0x8000, 0, "CNROM: PRG moved");
+    result |= check_chr(nes, 0, 8, 3 * 8, "CNROM: CHR bank 3 not mapped");
+    NES_Destroy(nes);
+    return result;
+}
+
+static int test_axrom(void)
+{
+    NES *nes = load(7, 8, 0, 0x00, 0);
+    if (!nes)
+        return -1;
+
+    int result = 0;
+    result |= check(nes->ppu->mirror_mode == MIRROR_SINGLE_SCREEN_LOW, "AxROM: not one screen low at power on");
+    write_register(nes, 0x8000, 0x10 | 2);
+    result |= check_prg(nes, 0x8000, 8, "AxROM: 32KB bank 2 not at $8000");
+    result |= check_prg(nes, 0xE000, 11, "AxROM: 32KB bank 2 doesn't continue to $E000");
+    result |= check(nes->ppu->mirror_mode == MIRROR_SINGLE_SCREEN_HIGH, "AxROM: not one screen high");
+    NES_Destroy(nes);
+    return result;
+}
+
+static int test_mmc3(void)
+{
+    NES *nes = load(4, 8, 16, 0x00, 0);
+    if (!nes)
+        return -1;
+
+    int result = 0;
+    write_register(nes, 0x8000, 6);
+    write_register(nes, 0x8001, 5);
+    write_register(nes, 0x8000, 7);
+    write_register(nes, 0x8001, 9);
+    result |= check_prg(nes, 0x8000, 5, "MMC3: R6 not at $8000");
+    result |= check_prg(nes, 0xA000, 9, "MMC3: R7 not at $A000");
+    result |= check_prg(nes, 0xC000, 14, "MMC3: second to last bank not at $C000");
+    result |= check_prg(nes, 0xE000, 15, "MMC3: last bank not at $E000");
+
+    write_register(nes, 0x8000, 0x40);
+    result |= check_prg(nes, 0x8000, 14, "MMC3: second to last bank not at $8000 with bit 6");
+    result |= check_prg(nes, 0xC000, 5, "MMC3: R6 not at $C000 with bit 6");
+
+    write_register(nes, 0x8001, 8);    // R0, 2KB
+    write_register(nes, 0x8000, 0x02);
+    write_register(nes, 0x8001, 0x21); // R2, 1KB
+    result |= check_chr(nes, 0, 2, 8, "MMC3: R0 not at $0000");
+    result |= check_chr(nes, 4, 1, 0x21, "MMC3: R2 not at $1000");
+    write_register(nes, 0x8000, 0x80);
+    result |= check_chr(nes, 4, 2, 8, "MMC3: R0 not at $1000 with bit 7");
+    result |= check_chr(nes, 0, 1, 0x21, "MMC3: R2 not at $0000 with bit 7");
+
+    write_register(nes, 0xA000, 1);
+    result |= check(nes->ppu->mirror_mode == MIRROR_HORIZONTAL, "MMC3: not horizontal");
+    write_register(nes, 0xA000, 0);
+    result |= check(nes->ppu->mirror_mode == MIRROR_VERTICAL, "MMC3: not vertical");
+
+    // $A001: bit 7 enables the PRG RAM, bit 6 protects it from writes
+    BUS *bus = nes->bus;
+    result |= check(bus->read_pages[0x60] == bus->prg_ram && bus->write_pages[0x7F] == bus->prg_ram + 0x1F00, "MMC3: PRG RAM not writable at power on");
+    write_register(nes, 0xA001, 0xC0);
+    BUS_Write(nes, 0x6000, 0x5A);
+    result |= check(bus->read_pages[0x60] == bus->prg_ram && bus->write_pages[0x60] == bus->discard, "MMC3: protected PRG RAM not read only");
+    result |= check(bus->prg_ram[0] == 0, "MMC3: write reached protected PRG RAM");
+    write_register(nes, 0xA001, 0x00);
+    result |= check(bus->read_pages[0x7F] == bus->open_bus && bus->write_pages[0x7F] == bus->discard, "MMC3: disabled PRG RAM still mapped");
+    write_register(nes, 0xA001, 0x80);
+    BUS_Write(nes, 0x6000, 0x5A);
+    result |= check(bus->read_pages[0x60] == bus->prg_ram && bus->prg_ram[0] == 0x5A, "MMC3: enabled PRG RAM not writable");
+
+    // A frame with rendering off leaves the PPU at the start of line 0. The counter
+    // reloads with the latch on line 0 and counts down on every line after it, so
+    // the IRQ goes up on line `latch`, the latch + 1st rendered line
+    NES_StepFrame(nes);
+    write_register(nes, 0xC000, MAPPER_TEST_IRQ_LATCH);
+    write_register(nes, 0xC001, 0);
+    write_register(nes, 0xE001, 0);
+    write_register(nes, 0x2001, PPUMASK_SHOW_BG | PPUMASK_SHOW_SPRITES);
+    result |= check(nes->ppu->scanline == 0 && nes->ppu->cycle < 260, "MMC3: frame didn't end at the start of line 0");
+
+    while (!nes->bus->mapper_state.irq_line && nes->ppu->scanline < 240)
+        NES_Step(nes);
+    result |= check(nes->ppu->scanline == MAPPER_TEST_IRQ_LATCH && nes->ppu->cycle >= 260, "MMC3: IRQ not raised after latch + 1 rendered lines");
+
+    write_register(nes, 0xE000, 0);
+    result |= check(!nes->bus->mapper_state.irq_line, "MMC3: $E000 didn't acknowledge the IRQ");
+
+    NES_Destroy(nes);
+    return result;
+}
+
+int main(void)
+{
+    int result = 0;
+    result |= test_nrom();
+    result |= test_mmc1();
+    result |= test_uxrom();
+    result |= test_cnrom();
+    result |= test_axrom();
+    result |= test_mmc3();
+
+    if (!result)
+        printf("mappers match\n");
+    return result ? 1 : 0;
+}
@@ -0,0 +1,239 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cNES/bus.h"
+#include "cNES/cpu.h"
+#include "cNES/nes.h"
+
+#include "rom_fixture.h"
+
+// Runs the same code on two NES, one through the interpreter and one through the
+// recompiler, in bursts of random length. After every burst the registers,
+// total_cycles and internal RAM must be the same on both. The code is nestest's
+// automated mode, which goes through every official and most unofficial opcodes
+// and must end with no failures, then UxROM carts of random bytes, which hit every
+// addressing mode, page end and bank switch the translator can meet.
+//
+// usage: cnes_recompiler <nestest.nes> [seed]
+
+#define RECOMPILER_TEST_CARTS   16
+#define RECOMPILER_TEST_CYCLES  400000 // Per random cart
+#define RECOMPILER_TEST_BURST   64     // Longest burst in cycles
+#define RECOMPILER_TEST_RESTART 64     // Bursts before random code moves somewhere else
+
+static uint32_t rng_state;
+
+// xorshift32, the runs only need to be repeatable
+static uint32_t next_random(void)
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state;
+}
+
+static int check(int ok, const char *what)
+{
+    if (!ok)
+        fprintf(stderr, "%s\n", what);
+    return ok ? 0 : -1;
+}
+
+// 0 if both machines are in the same state, reports the first difference
+static int compare(const NES *interpreter, const NES *recompiler, const char *what, long burst)
+{
+    const CPU *a = interpreter->cpu;
+    const CPU *b = recompiler->cpu;
+    if (a->a == b->a && a->x == b->x && a->y == b->y && a->sp == b->sp && a->pc == b->pc && a->status == b->status
+        && a->total_cycles == b->total_cycles && !memcmp(interpreter->bus->ram, recompiler->bus->ram, sizeof(interpreter->bus->ram)))
+        return 0;
+
+    fprintf(stderr, "%s: burst %ld differs, interpreter A=%02X X=%02X Y=%02X SP=%02X P=%02X PC=%04X cycle %llu, "
+            "recompiler A=%02X X=%02X Y=%02X SP=%02X P=%02X PC=%04X cycle %llu\n", what, burst,
+            a->a, a->x, a->y, a->sp, a->status, a->pc, (unsigned long long)a->total_cycles,
+            b->a, b->x, b->y, b->sp, b->status, b->pc, (unsigned long long)b->total_cycles);
+    return -1;
+}
+
+// Runs both machines until cycles or a halt. With restart set they carry on from a
+// random address in PRG ROM after a halt, once they leave PRG ROM (code outside it
+// runs through the interpreter on both) and every RECOMPILER_TEST_RESTART bursts so
+// random code doesn't spend the run in one loop. 1 if they halted, 0 if they ran out
+// of cycles and -1 if they differ
+static int run(NES *interpreter, NES *recompiler, uint64_t cycles, int restart, const char *what)
+{
+    for (long burst = 0; interpreter->cpu->total_cycles < cycles; burst++)
+    {
+        uint64_t until = interpreter->cpu->total_cycles + 1 + next_random() % RECOMPILER_TEST_BURST;
+        int halted = CPU_Run(interpreter->cpu, until);
+        if (CPU_Run(recompiler->cpu, until) != halted)
+        {
+            fprintf(stderr, "%s: burst %ld halted on one core only\n", what, burst);
+            return -1;
+        }
+        if (compare(interpreter, recompiler, what, burst))
+            return -1;
+        if (halted && !restart)
+            return 1;
+        if (restart && (halted || interpreter->cpu->pc < 0x8000 || burst % RECOMPILER_TEST_RESTART == RECOMPILER_TEST_RESTART - 1))
+        {
+            uint16_t pc = (uint16_t)(0x8000 | next_random());
+            interpreter->cpu->pc = pc;
+            recompiler->cpu->pc = pc;
+        }
+    }
+    return 0;
+}
+
+static NES *load_file(const char *path, int recompiler)
+{
+    NES *nes = NES_Create();
+    if (!nes || NES_Load(path, nes) || (recompiler && CPU_SetRecompiler(nes->cpu, true)))
+    {
+        fprintf(stderr, "could not load %s\n", path);
+        NES_Destroy(nes);
+        return NULL;
+    }
+    return nes;
+}
+
+static NES *load_image(const uint8_t *image, size_t size, int recompiler)
+{
+    NES *nes = NES_Create();
+    if (!nes || NES_LoadMemory(nes, image, size) || (recompiler && CPU_SetRecompiler(nes->cpu, true)))
+    {
+        fprintf(stderr, "could not load the cart\n");
+        NES_Destroy(nes);
+        return NULL;
+    }
+    return nes;
+}
+
+// nestest's automated mode starts at $C000 and leaves its result codes in $02 and $03
+static int test_nestest(const char *path)
+{
+    NES *interpreter = load_file(path, 0);
+    NES *recompiler = load_file(path, 1);
+    int result = -1;
+    if (interpreter && recompiler)
+    {
+        NES *machines[2] = { interpreter, recompiler };
+        for (int i = 0; i < 2; i++)
+        {
+            machines[i]->cpu->pc = 0xC000;
+            machines[i]->cpu->sp = 0xFD;
+            machines[i]->cpu->status = CPU_FLAG_UNUSED | CPU_FLAG_INTERRUPT;
+            machines[i]->cpu->total_cycles = 7;
+        }
+        int outcome = run(interpreter, recompiler, 100000, 0, "nestest");
+        result = outcome < 0 ? -1 : check(outcome == 1, "nestest: did not finish");
+        result |= check(!interpreter->bus->ram[0x02] && !interpreter->bus->ram[0x03], "nestest: reports failures");
+    }
+    NES_Destroy(interpreter);
+    NES_Destroy(recompiler);
+    return result;
+}
+
+// Random byte that isn't an opcode that halts, so runs get somewhere even when
+// they branch into the middle of an instruction
+static uint8_t random_code_byte(void)
+{
+    static const uint8_t halts[] = { 0x02, 0x12, 0x22, 0x32, 0x42, 0x52, 0x62, 0x72, 0x92, 0xB2, 0xD2, 0xF2, 0x8B, 0x93, 0x9F, 0xAB };
+    uint8_t value;
+    do
+        value = (uint8_t)next_random();
+    while (memchr(halts, value, sizeof(halts)));
+    return value;
+}
+
+// A 64KB UxROM cart of random instructions, BRK and the vectors lead back into it
+static int test_random_cart(int cart)
+{
+    size_t size = 0;
+    uint8_t *image = rom_fixture_build(2, 4, 0, 0, &size);
+    if (!image)
+        return -1;
+
+    uint8_t *prg = image + 16;
+    for (size_t i = 0; i < 4 * 0x4000;)
+    {
+        uint8_t opcode = random_code_byte();
+        prg[i++] = opcode;
+
+        switch (cpu_opcodes[opcode].addressing_mode)
+        {
+        case CPU_MODE_IMPLIED:
+        case CPU_MODE_ACCUMULATOR:
+            break;
+        case CPU_MODE_ABSOLUTE:
+        case CPU_MODE_ABSOLUTE_X:
+        case CPU_MODE_ABSOLUTE_Y:
+        case CPU_MODE_INDIRECT:
+            if (i + 2 <= 4 * 0x4000)
+            {
+                prg[i++] = random_code_byte();
+                prg[i++] = random_code_byte();
+            }
+            break;
+        default:
+            if (i < 4 * 0x4000)
+                prg[i++] = random_code_byte();
+            break;
+        }
+    }
+    for (int bank = 0; bank < 4; bank++)
+    {
+        uint8_t *vectors = prg + bank * 0x4000 + 0x3FFA;
+        const uint8_t targets[6] = { 0x00, 0xC0, 0x00, 0xC0, 0x00, 0x80 }; // NMI, RESET, IRQ/BRK
+        memcpy(vectors, targets, sizeof(targets));
+    }
+
+    NES *interpreter = load_image(image, size, 0);
+    NES *recompiler = load_image(image, size, 1);
+    free(image);
+    int result = -1;
+    if (interpreter && recompiler)
+    {
+        // Random code reads the write only PPU registers all the time and each read
+        // logs a warning, the PPU reads a blank page instead. Writes still reach it
+        static uint8_t blank[0x2000];
+        BUS_MapPages(interpreter->bus, 0x20, 0x20, blank, NULL);
+        BUS_MapPages(recompiler->bus, 0x20, 0x20, blank, NULL);
+        char what[32];
+        snprintf(what, sizeof(what), "random cart %d", cart);
+        result = run(interpreter, recompiler, RECOMPILER_TEST_CYCLES, 1, what) < 0 ? -1 : 0;
+    }
+    NES_Destroy(interpreter);
+    NES_Destroy(recompiler);
+    return result;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "usage: %s <nestest.nes> [seed]\n", argv[0]);
+        return 2;
+    }
+    rng_state = argc > 2 ? (uint32_t)strtoul(argv[2], NULL, 0) : 0x6502C0DEu;
+    if (!rng_state)
+        rng_state = 1;
+
+    NES *probe = NES_Create();
+    int available = probe && !CPU_SetRecompiler(probe->cpu, true);
+    NES_Destroy(probe);
+    if (!available)
+    {
+        fprintf(stderr, "the recompiler is not available\n");
+        return 1;
+    }
+
+    int result = test_nestest(argv[1]);
+    for (int cart = 0; cart < RECOMPILER_TEST_CARTS && !result; cart++)
+        result |= test_random_cart(cart);
+
+    if (!result)
+        printf("recompiler matches the interpreter\n");
+    return result ? 1 : 0;
+}
@@ -0,0 +1,231 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cNES/cpu.h"
+#include "cNES/nes.h"
+#include "cNES/rewind.h"
+
+// Runs a ROM with no input and compares the hash of every frame (NES_GetFrameHash)
+// with a golden file. Golden files are text, one hex hash per frame, and cover as
+// many frames as they have lines.
+//
+// usage: cnes_regression <rom.nes> <golden.hash> [--state n] [--rewind k [--rewind-budget bytes] [--rewind-keyframe n]] [--recompiler] [--update [frames]]
+//
+// --state saves the machine every n frames and carries on in a freshly loaded NES
+// restored from that state, the hashes must not notice.
+//
+// --rewind keeps a rewind history of the whole run, then steps back k frames one
+// at a time. Each step must show the frame the golden file has for it.
+// --rewind-budget shrinks the history so it wraps around many times during the run,
+// stepping back then stops early when the history runs out. --rewind-keyframe sets
+// the snapshots per keyframe, a few keep several keyframes of varying size in it.
+//
+// --recompiler runs the CPU through CPU_SetRecompiler's translated blocks, they must
+// give the same frames as the interpreter.
+//
+// --update rewrites the golden file instead, only do that after checking that a
+// change in output is intended.
+
+#define REGRESSION_DEFAULT_FRAMES 600
+
+static bool use_recompiler;
+
+static NES *load_rom(const char *rom_path)
+{
+    NES *nes = NES_Create();
+    if (!nes || NES_Load(rom_path, nes))
+    {
+        fprintf(stderr, "could not load %s\n", rom_path);
+        NES_Destroy(nes);
+        return NULL;
+    }
+    if (use_recompiler && CPU_SetRecompiler(nes->cpu, true))
+    {
+        fprintf(stderr, "the recompiler is not available\n");
+        NES_Destroy(nes);
+        return NULL;
+    }
+    NES_SetFrameHashing(nes, true);
+    return nes;
+}
+
+// Moves the machine into a new NES through a save state, NULL if that fails
+static NES *state_round_trip(NES *nes, const char *rom_path)
+{
+    size_t size = NES_GetStateSize(nes);
+    uint8_t *state = malloc(size);
+    NES *loaded = load_rom(rom_path);
+    if (!state || !loaded || NES_SaveState(nes, state, size) != size || NES_LoadState(loaded, state, size))
+    {
+        fprintf(stderr, "%s: save state round trip failed\n", rom_path);
+        NES_Destroy(loaded);
+        loaded = NULL;
+    }
+
+    free(state);
+    NES_Destroy(nes);
+    return loaded;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 3)
+    {
+        fprintf(stderr, "usage: %s <rom.nes> <golden.hash> [--state n] [--rewind k [--rewind-budget bytes] [--rewind-keyframe n]] [--recompiler] [--update [frames]]\n", argv[0]);
+        return 2;
+    }
+
+    const char *rom_path = argv[1];
+    const char *golden_path = argv[2];
+    int update = 0;
+    int state_interval = 0;
+    int rewind_frames = 0;
+    size_t rewind_budget = 0;
+    int rewind_keyframe = REWIND_DEFAULT_KEYFRAME;
+    int frames = REGRESSION_DEFAULT_FRAMES;
+    for (int i = 3; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "--state") && i + 1 < argc)
+            state_interval = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--rewind") && i + 1 < argc)
+            rewind_frames = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--rewind-budget") && i + 1 < argc)
+            rewind_budget = (size_t)strtoul(argv[++i], NULL, 0);
+        else if (!strcmp(argv[i], "--rewind-keyframe") && i + 1 < argc)
+            rewind_keyframe = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--recompiler"))
+            use_recompiler = true;
+        else if (!strcmp(argv[i], "--update"))
+        {
+            update = 1;
+            if (i + 1 < argc && argv[i + 1][0] != '-')
+                frames = atoi(argv[++i]);
+        }
+        else
+        {
+            fprintf(stderr, "unknown option %s\n", argv[i]);
+            return 2;
+        }
+    }
+
+    uint64_t *golden = NULL;
+    if (!update)
+    {
+        FILE *file = fopen(golden_path, "r");
+        if (!file)
+        {
+            fprintf(stderr, "could not open %s\n", golden_path);
+            return 1;
+        }
+
+        size_t capacity = 0;
+        unsigned long long hash;
+        frames = 0;
+        while (fscanf(file, "%llx", &hash) == 1)
+        {
+            if ((size_t)frames == capacity)
+            {
+                capacity = capacity ? capacity * 2 : 1024;
+                uint64_t *grown = realloc(golden, capacity * sizeof(uint64_t));
+                if (!grown)
+                    return 1;
+                golden = grown;
+            }
+            golden[frames++] = hash;
+        }
+        fclose(file);
+
+        if (frames == 0)
+        {
+            fprintf(stderr, "%s has no hashes\n", golden_path);
+            return 1;
+        }
+    }
+    if ((rewind_frames && (update || state_interval || rewind_frames < 0 || rewind_frames >= frames)) || (rewind_budget && !rewind_frames))
+    {
+        fprintf(stderr, "--rewind needs fewer frames than the golden file and can't be combined with --state or --update,\n"
+                        "--rewind-budget needs --rewind\n");
+        return 2;
+    }
+
+    NES *nes = load_rom(rom_path);
+    if (!nes)
+        return 1;
+
+    REWIND *rewind = NULL;
+    if (rewind_frames && !(rewind = REWIND_Create(nes, rewind_budget ? rewind_budget : REWIND_DEFAULT_BUDGET, REWIND_DEFAULT_INTERVAL, rewind_keyframe)))
+    {
+        fprintf(stderr, "could not create the rewind history\n");
+        return 1;
+    }
+
+    FILE *out = NULL;
+    if (update && !(out = fopen(golden_path, "w")))
+    {
+        fprintf(stderr, "could not write %s\n", golden_path);
+        return 1;
+    }
+
+    int result = 0;
+    for (int frame = 0; frame < frames; frame++)
+    {
+        if (state_interval > 0 && frame > 0 && frame % state_interval == 0 && !(nes = state_round_trip(nes, rom_path)))
+        {
+            result = 1;
+            break;
+        }
+
+        NES_StepFrame(nes);
+        if (rewind && REWIND_Capture(rewind))
+        {
+            fprintf(stderr, "%s: frame %d didn't fit the rewind history\n", rom_path, frame);
+            result = 1;
+            break;
+        }
+        uint64_t hash = NES_GetFrameHash(nes);
+
+        if (out)
+        {
+            fprintf(out, "%016llx\n", (unsigned long long)hash);
+        }
+        else if (hash != golden[frame])
+        {
+            // Everything after the first difference differs too, one report is enough
+            fprintf(stderr, "%s: frame %d hash %016llx, expected %016llx\n", rom_path, frame,
+                    (unsigned long long)hash, (unsigned long long)golden[frame]);
+            result = 1;
+            break;
+        }
+    }
+
+    // A small history only reaches back as far as it goes
+    if (rewind && rewind_budget && (size_t)rewind_frames > REWIND_GetFrameCount(rewind))
+        rewind_frames = (int)REWIND_GetFrameCount(rewind) - 1;
+
+    // Stepping back from the last frame, frame n shows again after frames - 1 - n steps
+    for (int frame = frames - 2; !result && rewind && frame >= frames - 1 - rewind_frames; frame--)
+    {
+        if (REWIND_StepBack(rewind))
+        {
+            fprintf(stderr, "%s: could not rewind to frame %d\n", rom_path, frame);
+            result = 1;
+        }
+        else if (NES_GetFrameHash(nes) != golden[frame])
+        {
+            fprintf(stderr, "%s: rewound to frame %d hash %016llx, expected %016llx\n", rom_path, frame,
+                    (unsigned long long)NES_GetFrameHash(nes), (unsigned long long)golden[frame]);
+            result = 1;
+        }
+    }
+
+    if (out && fclose(out) != 0)
+        result = 1;
+    if (!result)
+        printf("%s: %d frames %s\n", rom_path, frames, update ? "written" : "match");
+
+    REWIND_Destroy(rewind);
+    NES_Destroy(nes);
+    free(golden);
+    return result;
+}
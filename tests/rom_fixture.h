@@ -0,0 +1,48 @@
+#ifndef ROM_FIXTURE_H
+#define ROM_FIXTURE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Small iNES images for the tests that need a cart of a given shape rather than a real game
+
+// iNES image with prg16 16KB PRG banks and chr8 8KB CHR banks. Every 8KB of PRG
+// ends in sei; jmp * with all vectors on it, so whichever bank is at $E000 idles
+static uint8_t *rom_fixture_build(uint8_t mapper, int prg16, int chr8, uint8_t flags, size_t *size)
+{
+    *size = 16 + (size_t)prg16 * 0x4000 + (size_t)chr8 * 0x2000;
+    uint8_t *image = calloc(1, *size);
+    if (!image)
+        return NULL;
+
+    const uint8_t header[16] = { 'N', 'E', 'S', 0x1A, (uint8_t)prg16, (uint8_t)chr8, (uint8_t)((mapper << 4) | flags), (uint8_t)(mapper & 0xF0) };
+    memcpy(image, header, sizeof(header));
+
+    uint8_t *prg = image + sizeof(header);
+    for (int unit = 0; unit < prg16 * 2; unit++)
+    {
+        uint8_t *end = prg + (size_t)unit * 0x2000 + 0x1FF0;
+        static const uint8_t idle[] = { 0x78, 0x4C, 0xF1, 0xFF }; // sei; jmp $FFF1
+        memcpy(end, idle, sizeof(idle));
+        for (int vector = 0x0A; vector < 0x10; vector += 2)
+        {
+            end[vector] = 0xF0;
+            end[vector + 1] = 0xFF;
+        }
+    }
+    return image;
+}
+
+// Puts code at the start of the last 16KB PRG bank and points RESET at it, that
+// bank sits at $C000 on NROM and on the mappers that fix it there at power on
+static void rom_fixture_entry(uint8_t *image, const uint8_t *code, size_t size)
+{
+    uint8_t *bank = image + 16 + (size_t)(image[4] - 1) * 0x4000;
+    memcpy(bank, code, size);
+    bank[0x3FFC] = 0x00;
+    bank[0x3FFD] = 0xC0;
+}
+
+#endif // ROM_FIXTURE_H
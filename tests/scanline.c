@@ -0,0 +1,179 @@
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cNES/nes.h"
+#include "cNES/ppu.h"
+
+#include "rom_fixture.h"
+
+// Checks that a visible line rendered in one go by PPU_CatchUp comes out the same
+// as running its 341 dots one at a time with PPU_Step. Each trial puts random
+// registers, scroll, shifters, sprites, OAM, nametables and palette on one NES,
+// copies them to a second one and runs the line both ways, then compares the
+// pixels, the sprite-0 hit and overflow bits, v, t and fine x, the line's
+// emphasis slot and the rest of the saved PPU state.
+//
+// usage: cnes_scanline [seed]
+
+#define SCANLINE_TEST_TRIALS 4000
+
+static uint32_t rng_state;
+
+// xorshift32, the trials only need to be repeatable
+static uint32_t next_random(void)
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state;
+}
+
+static NES *load(const uint8_t *image, size_t size)
+{
+    NES *nes = NES_Create();
+    if (!nes || NES_LoadMemory(nes, image, size))
+    {
+        fprintf(stderr, "could not load the cart\n");
+        NES_Destroy(nes);
+        return NULL;
+    }
+    return nes;
+}
+
+// Random state for the start of a visible line with rendering enabled
+static void randomize(PPU *ppu)
+{
+    ppu->scanline = (int)(next_random() % 240);
+    ppu->cycle = 0;
+    ppu->frame_odd = next_random() & 1;
+    ppu->clock = next_random();
+
+    ppu->ctrl = (uint8_t)next_random();
+    ppu->mask = (uint8_t)next_random();
+    if (!(ppu->mask & (PPUMASK_SHOW_BG | PPUMASK_SHOW_SPRITES)))
+        ppu->mask |= (next_random() & 1) ? PPUMASK_SHOW_BG : PPUMASK_SHOW_SPRITES;
+    ppu->status = (uint8_t)(next_random() & (PPUSTATUS_SPRITE_0_HIT | PPUSTATUS_SPRITE_OVERFLOW));
+    ppu->mirror_mode = (MirrorMode)(next_random() % 4); // Four screen needs cart VRAM
+
+    ppu->vram_addr = (uint16_t)(next_random() & 0x7FFF);
+    ppu->temp_addr = (uint16_t)(next_random() & 0x7FFF);
+    ppu->fine_x = (uint8_t)(next_random() & 7);
+
+    // The first two tiles, fetched at the end of the previous line
+    ppu->bg_nt_latch = (uint8_t)next_random();
+    ppu->bg_at_latch_low = (next_random() & 1) ? 0xFF : 0x00;
+    ppu->bg_at_latch_high = (next_random() & 1) ? 0xFF : 0x00;
+    ppu->bg_pt_low_latch = (uint8_t)next_random();
+    ppu->bg_pt_high_latch = (uint8_t)next_random();
+    ppu->bg_pattern_shift_low = (uint16_t)next_random();
+    ppu->bg_pattern_shift_high = (uint16_t)next_random();
+    ppu->bg_attrib_shift_low = (uint16_t)((next_random() & 1) ? 0xFF00 : 0) | ((next_random() & 1) ? 0xFF : 0);
+    ppu->bg_attrib_shift_high = (uint16_t)((next_random() & 1) ? 0xFF00 : 0) | ((next_random() & 1) ? 0xFF : 0);
+
+    // Sprites evaluated for this line, sprite 0 among them now and then
+    ppu->sprite_count_current_scanline = (uint8_t)(next_random() % 9);
+    for (int i = 0; i < 8; ++i)
+    {
+        SpriteShifter *s = &ppu->sprite_shifters[i];
+        s->x_pos = (uint8_t)next_random();
+        s->attributes = (uint8_t)next_random();
+        s->pattern_low = (uint8_t)(next_random() & next_random());
+        s->pattern_high = (uint8_t)(next_random() & next_random());
+        s->original_oam_index = (next_random() % 4) ? (uint8_t)(1 + next_random() % 63) : 0;
+    }
+
+    // OAM for the next line: about half the sprites sit near it, the rest below the screen
+    for (int i = 0; i < 64; ++i)
+    {
+        uint8_t *sprite = &ppu->oam[i * 4];
+        sprite[0] = (next_random() & 1) ? (uint8_t)(ppu->scanline + 1 - (int)(next_random() % 16)) : 0xF0;
+        sprite[1] = (uint8_t)next_random();
+        sprite[2] = (uint8_t)next_random();
+        sprite[3] = (uint8_t)next_random();
+    }
+    for (size_t i = 0; i < sizeof(ppu->vram); ++i)
+        ppu->vram[i] = (uint8_t)next_random();
+    for (size_t i = 0; i < sizeof(ppu->palette); ++i)
+        ppu->palette[i] = (uint8_t)next_random();
+    for (size_t i = 0; i < sizeof(ppu->secondary_oam); ++i)
+        ppu->secondary_oam[i] = (uint8_t)next_random();
+}
+
+static int check(int ok, int trial, const char *what)
+{
+    if (!ok)
+        fprintf(stderr, "trial %d: %s differs\n", trial, what);
+    return ok ? 0 : -1;
+}
+
+// 0 if the line run dot by dot on dots matches the one rendered at once on line
+static int compare(const PPU *dots, const PPU *line, int y, int trial)
+{
+    const uint8_t status_bits = PPUSTATUS_SPRITE_0_HIT | PPUSTATUS_SPRITE_OVERFLOW;
+    int result = 0;
+    result |= check(!memcmp(dots->framebuffer, line->framebuffer, PPU_FRAMEBUFFER_WIDTH * PPU_FRAMEBUFFER_HEIGHT), trial, "framebuffer");
+    result |= check((dots->status & status_bits) == (line->status & status_bits), trial, "sprite-0 hit or overflow");
+    result |= check(dots->vram_addr == line->vram_addr && dots->temp_addr == line->temp_addr && dots->fine_x == line->fine_x, trial, "v, t or fine x");
+    result |= check(dots->pixel_tag == line->pixel_tag && dots->line_emphasis_count[y] == line->line_emphasis_count[y] &&
+                    !memcmp(dots->line_emphasis[y], line->line_emphasis[y], sizeof(dots->line_emphasis[y])), trial, "emphasis slot");
+    result |= check(dots->scanline == line->scanline && dots->cycle == line->cycle && dots->clock == line->clock, trial, "timing");
+    if (!result)
+        result |= check(!memcmp(dots, line, offsetof(PPU, nes)), trial, "saved PPU state");
+    return result;
+}
+
+static int run_trial(NES *dots, NES *line, int trial)
+{
+    memset(dots->ppu->framebuffer, 0, PPU_FRAMEBUFFER_WIDTH * PPU_FRAMEBUFFER_HEIGHT);
+    randomize(dots->ppu);
+    dots->ppu->suppress_output = (trial % 8) == 7;
+
+    memcpy(line->ppu, dots->ppu, offsetof(PPU, nes));
+    memcpy(line->ppu->framebuffer, dots->ppu->framebuffer, PPU_FRAMEBUFFER_WIDTH * PPU_FRAMEBUFFER_HEIGHT);
+    line->ppu->suppress_output = dots->ppu->suppress_output;
+
+    int y = dots->ppu->scanline;
+    for (int dot = 0; dot < 341; ++dot)
+        PPU_Step(dots->ppu);
+    PPU_CatchUp(line->ppu, line->ppu->clock + 341);
+    return compare(dots->ppu, line->ppu, y, trial);
+}
+
+int main(int argc, char **argv)
+{
+    rng_state = argc > 1 ? (uint32_t)strtoul(argv[1], NULL, 0) : 0x2C0FFEE5u;
+    if (!rng_state)
+        rng_state = 1;
+
+    size_t size = 0;
+    uint8_t *image = rom_fixture_build(0, 1, 1, 0, &size);
+    if (!image)
+        return 1;
+    // Random CHR ROM with about a quarter of the bits set, so tiles and sprites
+    // have transparent pixels as well as opaque ones
+    uint8_t *chr = image + 16 + 0x4000;
+    for (int i = 0; i < 0x2000; ++i)
+        chr[i] = (uint8_t)(next_random() & next_random());
+
+    NES *dots = load(image, size);
+    NES *line = load(image, size);
+    free(image);
+    if (!dots || !line)
+    {
+        NES_Destroy(dots);
+        NES_Destroy(line);
+        return 1;
+    }
+
+    int failures = 0;
+    for (int trial = 0; trial < SCANLINE_TEST_TRIALS && failures < 10; ++trial)
+        failures += run_trial(dots, line, trial) ? 1 : 0;
+
+    NES_Destroy(dots);
+    NES_Destroy(line);
+    if (!failures)
+        printf("%d scanlines match\n", SCANLINE_TEST_TRIALS);
+    return failures ? 1 : 0;
+}